@@ -77,13 +77,23 @@ enum UsbProtocol : uint8_t {
                                    // would need to properly emulate an FT*I chip for that
 };
 
+// What a receiver does if several transmitters send to the same buffer
+enum RadioMergeMode : uint8_t {
+    mergeLtp                  = 0, // Latest frame wins, no merging
+    mergeHtp                  = 1, // Highest value of all active sources, per channel
+    mergePriority             = 2, // Lowest source wins, the next one takes over when it's gone
+};
+
 // Size: 2 byte
 struct __attribute__((__packed__)) RadioParams {
     uint8_t compression           : 1;
     uint8_t allowSparse           : 1;
     rf24_datarate_e dataRate      : 3;
     rf24_pa_dbm_e txPower         : 3;
-    uint8_t padding               : 8;
+    uint8_t fec                   : 1; // Broadcast: Parity chunk per frame instead of auto-ACK
+    uint8_t hopping               : 1; // Broadcast: Hop between clean channels, radioChannel is the home channel
+    uint8_t mergeMode             : 2; // Broadcast: RadioMergeMode
+    uint8_t padding               : 4;
 };
 
 enum RadioRole : uint8_t {
@@ -130,8 +140,12 @@ struct __attribute__((__packed__)) Patching {
                           // WiFi: See eth
     PatchType dstType;
     uint16_t dstInstance;
-    uint8_t ethDestParams; // Id of the "Ethernet Destination Parameters" structures
-                           // used for patchings with UsbEth, Eth and WiFi as dstType
+    union {
+        uint8_t ethDestParams; // Id of the "Ethernet Destination Parameters" structures
+                               // used for patchings with UsbEth, Eth and WiFi as dstType
+        uint8_t meshNode;      // nrf24 as dstType in the mesh: nodeID the mesh master
+                               // sends this universe to. 0 = every node
+    };
 };
 
 enum ConfigSource : uint8_t {
@@ -185,7 +199,7 @@ struct __attribute__((__packed__)) ConfigData {
     RadioRole              radioRole;
     uint8_t                radioChannel; // 0-127; Higher values maybe FHSS?
     uint16_t               radioAddress; // RF24Mesh: "nodeId"
-    struct RadioParams     radioParams;  // Bit field: 0,1: Compression, 2: Sparse or Full transfers, 3,4: Data rate, 5,6: TX power
+    struct RadioParams     radioParams;  // Bit field: 0,1: Compression, 2: Sparse or Full transfers, 3,4: Data rate, 5,6: TX power, 7: FEC, 8: Hopping, 9,10: Merge mode
     struct Patching        patching[MAX_PATCHINGS];
     struct EthDestParams   ethDestParams[16];
     uint8_t                statusLedBrightness;
@@ -200,6 +214,9 @@ static const RadioParams constDefaultRadioParams = {
     .allowSparse         = 1,
     .dataRate            = RF24_2MBPS,
     .txPower             = RF24_PA_HIGH,
+    .fec                 = 0,
+    .hopping             = 0,
+    .mergeMode           = RadioMergeMode::mergeLtp,
 };
 
 static const ConfigData constDefaultConfig = {
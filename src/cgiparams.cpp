@@ -0,0 +1,80 @@
+#include "cgiparams.h"
+
+#include <cstdlib>
+#include <cstring>
+
+CgiParams::CgiParams(int count, char* names[], char* values[]) {
+    this->count = (count < 0) ? 0 : ((count > CGIPARAMS_MAX) ? CGIPARAMS_MAX : count);
+    this->names = names;
+    this->values = values;
+
+    for (int i = 0; i < this->count; i++) {
+        if ((names[i] == nullptr) || (values[i] == nullptr)) {
+            // Never matches anything, find() checks the name anyway
+            hashes[i] = 0;
+            continue;
+        }
+        hashes[i] = cgiHash(names[i]);
+    }
+}
+
+char* CgiParams::get(CgiKey key) const {
+    int index = find(key);
+    return (index >= 0) ? values[index] : nullptr;
+}
+
+long CgiParams::getInt(CgiKey key, long fallback) const {
+    char* value = get(key);
+    if ((value == nullptr) || (*value == 0)) {
+        return fallback;
+    }
+    return strtol(value, nullptr, 10);
+}
+
+bool CgiParams::equals(CgiKey key, const char* value) const {
+    char* own = get(key);
+    return (own != nullptr) && (strcmp(own, value) == 0);
+}
+
+static int hexValue(char c) {
+    if ((c >= '0') && (c <= '9')) {
+        return c - '0';
+    }
+    if ((c >= 'a') && (c <= 'f')) {
+        return c - 'a' + 10;
+    }
+    if ((c >= 'A') && (c <= 'F')) {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+size_t CgiParams::urlDecode(char* text) {
+    char* in = text;
+    char* out = text;
+    int high;
+    int low;
+
+    while (*in) {
+        if ((in[0] == '%') && ((high = hexValue(in[1])) >= 0) && ((low = hexValue(in[2])) >= 0)) {
+            *out++ = (high << 4) | low;
+            in += 3;
+        } else {
+            *out++ = *in++;
+        }
+    }
+    *out = 0;
+
+    return out - text;
+}
+
+// The hash rules out almost everything, the name comparison the rest
+int CgiParams::find(CgiKey key) const {
+    for (int i = 0; i < count; i++) {
+        if ((hashes[i] == key.hash) && (names[i] != nullptr) && (values[i] != nullptr) &&
+            (strcmp(names[i], key.name) == 0)) {
+            return i;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,62 @@
+#ifndef CGIPARAMS_H
+#define CGIPARAMS_H
+
+#include <cstdint>
+#include <cstddef>
+
+#ifdef __cplusplus
+
+// lwIP never passes more (LWIP_HTTPD_MAX_CGI_PARAMETERS)
+#define CGIPARAMS_MAX 16
+
+// FNV-1a. constexpr, so the keys used in the code are hashed by the compiler
+constexpr uint32_t cgiHash(const char* text) {
+    uint32_t hash = 2166136261u;
+    while (*text) {
+        hash = (hash ^ (uint8_t)*text++) * 16777619u;
+    }
+    return hash;
+}
+
+// A parameter name known at compile time, e.g. params.get("buffer")
+struct CgiKey {
+    consteval CgiKey(const char* name) : name(name), hash(cgiHash(name)) {}
+    const char* name;
+    uint32_t hash;
+};
+
+// Read-only view on the parameters lwIP hands to a CGI handler. Nothing is
+// copied and nothing is allocated, the names and values stay where lwIP put
+// them and are only valid during the handler. If a parameter is given more
+// than once, the first one counts
+class CgiParams {
+  public:
+    CgiParams(int count, char* names[], char* values[]);
+
+    bool has(CgiKey key) const { return find(key) >= 0; }
+
+    // Value as it is in the URL or nullptr if the parameter is missing
+    char* get(CgiKey key) const;
+
+    // Value as a number or fallback if the parameter is missing or empty
+    long getInt(CgiKey key, long fallback = 0) const;
+
+    // True if the parameter is there and its value is exactly value
+    bool equals(CgiKey key, const char* value) const;
+
+    // Decodes %XX escapes right in the string and returns the new length.
+    // Broken escapes are left as they are
+    static size_t urlDecode(char* text);
+
+  private:
+    int count;
+    char** names;
+    char** values;
+    uint32_t hashes[CGIPARAMS_MAX];
+
+    int find(CgiKey key) const;
+};
+
+#endif // __cplusplus
+
+#endif // CGIPARAMS_H
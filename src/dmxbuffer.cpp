@@ -4,6 +4,11 @@
 #include "boardconfig.h"
 #include "localdmx.h"
 #include "wireless.h"
+#include "udp_edp.h"
+#include "usb_EDP.h"
+#include "usb_UsbPro.h"
+#include "usb_vendor.h"
+#include "dmxfade.h"
 
 extern BoardConfig boardConfig;
 extern LocalDmx localDmx;
@@ -13,6 +18,8 @@ extern critical_section_t bufferLock;
 
 uint8_t DmxBuffer::buffer[DMXBUFFER_COUNT][512];
 uint8_t DmxBuffer::allZeroes[512];
+uint32_t DmxBuffer::lastSequence;
+uint32_t DmxBuffer::sequence[DMXBUFFER_COUNT];
 
 void DmxBuffer::init() {
     // Init the complete area to 0
@@ -20,12 +27,16 @@ void DmxBuffer::init() {
 
     // Init the allZeroes array
     memset(this->allZeroes, 0x00, 512);
+
+    lastSequence = 0;
+    memset(this->sequence, 0x00, sizeof(this->sequence));
 }
 
 void DmxBuffer::zero(uint8_t bufferId) {
     LOG("ZERO buffer %u", bufferId);
 
     // Simply zero out the specified buffer
+    DmxFade::release(bufferId, 0, 512);
     critical_section_enter_blocking(&bufferLock);
     memset(this->buffer[bufferId], 0x00, 512);
     critical_section_exit(&bufferLock);
@@ -57,6 +68,8 @@ bool DmxBuffer::setBuffer(uint8_t bufferId, uint8_t* source, uint16_t sourceLeng
 
     LOG("setBuffer Length: %d, Content: %02x %02x %02x %02x %02x %02x", sourceLength, source[0], source[1], source[2], source[3], source[4], source[5]);
 
+    // The rest is zeroed, so all channels have been written
+    DmxFade::release(bufferId, 0, 512);
     critical_section_enter_blocking(&bufferLock);
     memset(this->buffer[bufferId], 0x00, 512);
     memcpy(this->buffer[bufferId], source, length);
@@ -85,6 +98,7 @@ bool DmxBuffer::setChannel(uint8_t bufferId, uint16_t channel, uint8_t value) {
     // Shall we lock the buffer so two sources don't write at the same time?
     // TODO: Merge modes. For HTP and LTP we might need to remember the source that last wrote here?
 
+    DmxFade::release(bufferId, channel, 1);
     this->buffer[bufferId][channel] = value;
 
     this->triggerPatchings(bufferId);
@@ -92,6 +106,23 @@ bool DmxBuffer::setChannel(uint8_t bufferId, uint16_t channel, uint8_t value) {
     return true;
 }
 
+bool DmxBuffer::setChannels(uint8_t bufferId, uint16_t offset, const uint8_t* values, uint16_t count, bool patch) {
+    if ((bufferId >= DMXBUFFER_COUNT) || (values == nullptr) || (offset >= 512) || (count == 0)) {
+        return false;
+    }
+
+    DmxFade::release(bufferId, offset, count);
+    critical_section_enter_blocking(&bufferLock);
+    memcpy(this->buffer[bufferId] + offset, values, MIN(count, 512 - offset));
+    critical_section_exit(&bufferLock);
+
+    if (patch) {
+        this->triggerPatchings(bufferId);
+    }
+
+    return true;
+}
+
 void DmxBuffer::triggerPatchings(uint8_t bufferId, bool allZero) {
     if ((allZero) || (!memcmp(DmxBuffer::buffer[bufferId], allZeroes, 512))) {
         // universe is all zeroes
@@ -102,6 +133,14 @@ void DmxBuffer::triggerPatchings(uint8_t bufferId, bool allZero) {
 
     LOG("DmxBuffer::triggerPatchings. bufferId: %d, allZeroes: %d", bufferId, DmxBuffer::allZeroBuffers[bufferId]);
 
+    // Writes come from both cores
+    critical_section_enter_blocking(&bufferLock);
+    DmxBuffer::sequence[bufferId] = ++DmxBuffer::lastSequence;
+    critical_section_exit(&bufferLock);
+
+    // Hosts monitoring all buffers, independent of any patching
+    Usb_EDP::bufferChanged(bufferId);
+
     for (uint8_t i = 0; i < MAX_PATCHINGS; i++) {
         Patching patching = boardConfig.activeConfig->patching[i];
         if ((!patching.active) ||
@@ -121,6 +160,13 @@ void DmxBuffer::triggerPatchings(uint8_t bufferId, bool allZero) {
             case PatchType::nrf24:
                 wireless.sendData(patching.dstInstance, DmxBuffer::buffer[bufferId], 512);
                 break;
+            case PatchType::usbProto:
+                Usb_UsbPro::queueBuffer(patching.dstInstance, bufferId);
+                Usb_Vendor::queueBuffer(patching.dstInstance, bufferId);
+                break;
+            case PatchType::ip:
+                Udp_EDP::queueUniverse(patching.dstInstance, bufferId, patching.ethDestParams);
+                break;
         }
     }
 }
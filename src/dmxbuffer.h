@@ -15,17 +15,25 @@ class DmxBuffer {
   public:
     static uint8_t buffer[DMXBUFFER_COUNT][512];
     static uint8_t allZeroes[512]; // Array of 512 zero-bytes to be used with memcmp for performance
+    // Incremented on every write to any buffer. sequence[] holds the value
+    // of the last write per buffer, so clients can ask for "changed since"
+    static uint32_t lastSequence;
+    static uint32_t sequence[DMXBUFFER_COUNT];
     void init();
     void zero(uint8_t bufferId);
     bool getBuffer(uint8_t bufferId, uint8_t* dest, uint16_t destLength); // alias "copyTo"
     bool setBuffer(uint8_t bufferId, uint8_t* source, uint16_t sourceLength); // alias "copyFrom"
     bool getChannel(uint8_t bufferId, uint16_t channel, uint8_t* value);
     bool setChannel(uint8_t bufferId, uint16_t channel, uint8_t value);
+    // With patch = false, call triggerPatchings once all writes to that
+    // buffer are done
+    bool setChannels(uint8_t bufferId, uint16_t offset, const uint8_t* values, uint16_t count, bool patch = true);
 
     bool isAllZero(uint8_t bufferId);
 
-  private:
     void triggerPatchings(uint8_t bufferId, bool allZero = false);
+
+  private:
     bool allZeroBuffers[DMXBUFFER_COUNT];
 };
 
@@ -0,0 +1,181 @@
+#include "dmxfade.h"
+
+#include "log.h"
+
+extern "C" {
+#include <bsp/board.h>
+}
+
+extern DmxBuffer dmxBuffer;
+
+extern critical_section_t bufferLock;
+
+DmxFadeSlot DmxFade::slots[DMXFADE_SLOTS];
+uint32_t DmxFade::lastStep;
+
+void DmxFade::init() {
+    memset(slots, 0x00, sizeof(slots));
+    lastStep = board_millis();
+}
+
+void DmxFade::cyclicTask() {
+    uint32_t now = board_millis();
+    uint32_t elapsed;
+    uint8_t* channels;
+    uint8_t value;
+    bool changed;
+    bool done;
+
+    if ((now - lastStep) < DMXFADE_INTERVAL_MS) {
+        return;
+    }
+    lastStep = now;
+
+    for (uint8_t i = 0; i < DMXFADE_SLOTS; i++) {
+        DmxFadeSlot* slot = &slots[i];
+
+        if (slot->state != fadeRunning) {
+            continue;
+        }
+
+        elapsed = now - slot->since;
+        done = (elapsed >= slot->duration);
+        channels = DmxBuffer::buffer[slot->bufferId];
+        changed = false;
+
+        critical_section_enter_blocking(&bufferLock);
+        for (uint16_t channel = 0; channel < 512; channel++) {
+            if (!(slot->mask[channel / 32] & (1UL << (channel % 32)))) {
+                continue;
+            }
+            if (done) {
+                value = slot->to[channel];
+            } else {
+                value = slot->from[channel] + ((int32_t)(slot->to[channel] - slot->from[channel]) * (int32_t)elapsed) / slot->duration;
+            }
+            if (channels[channel] != value) {
+                channels[channel] = value;
+                changed = true;
+            }
+        }
+        critical_section_exit(&bufferLock);
+
+        if (done) {
+            slot->state = fadeFree;
+        }
+
+        // Slow fades don't change every step
+        if (changed) {
+            dmxBuffer.triggerPatchings(slot->bufferId);
+        }
+    }
+}
+
+bool DmxFade::reserve(uint8_t bufferId, const void* owner) {
+    uint32_t now = board_millis();
+    DmxFadeSlot* slot;
+
+    if (bufferId >= DMXBUFFER_COUNT) {
+        return false;
+    }
+
+    slot = find(bufferId);
+    if (slot && (slot->state == fadeReserved)) {
+        // Targets of somebody else would be mixed into ours
+        if ((slot->owner != owner) && ((now - slot->since) <= DMXFADE_RESERVE_TIMEOUT_MS)) {
+            return false;
+        }
+        // Left over from a request that never started it
+        memset(slot->mask, 0x00, sizeof(slot->mask));
+    }
+    // Already fading: stop where it is, start() picks up from there
+    if (slot) {
+        slot->state = fadeReserved;
+        slot->owner = owner;
+        slot->since = now;
+        return true;
+    }
+
+    for (uint8_t i = 0; i < DMXFADE_SLOTS; i++) {
+        if ((slots[i].state == fadeFree) ||
+            ((slots[i].state == fadeReserved) && ((now - slots[i].since) > DMXFADE_RESERVE_TIMEOUT_MS)))
+        {
+            slot = &slots[i];
+            break;
+        }
+    }
+    if (!slot) {
+        return false;
+    }
+
+    slot->state = fadeReserved;
+    slot->bufferId = bufferId;
+    slot->owner = owner;
+    slot->since = now;
+    memset(slot->mask, 0x00, sizeof(slot->mask));
+
+    return true;
+}
+
+bool DmxFade::setTarget(uint8_t bufferId, const void* owner, uint16_t offset, const uint8_t* values, uint16_t count) {
+    DmxFadeSlot* slot = find(bufferId);
+
+    if (!slot || (slot->state != fadeReserved) || (slot->owner != owner)) {
+        return false;
+    }
+    if (offset >= 512) {
+        return true;
+    }
+    count = MIN(count, 512 - offset);
+
+    memcpy(slot->to + offset, values, count);
+    for (uint16_t channel = offset; channel < (offset + count); channel++) {
+        slot->mask[channel / 32] |= (1UL << (channel % 32));
+    }
+    return true;
+}
+
+bool DmxFade::start(uint8_t bufferId, const void* owner, uint16_t duration) {
+    DmxFadeSlot* slot = find(bufferId);
+
+    if (!slot || (slot->state != fadeReserved) || (slot->owner != owner)) {
+        return false;
+    }
+
+    critical_section_enter_blocking(&bufferLock);
+    memcpy(slot->from, DmxBuffer::buffer[bufferId], 512);
+    critical_section_exit(&bufferLock);
+
+    slot->duration = MAX(duration, 1);
+    slot->since = board_millis();
+    slot->state = fadeRunning;
+
+    LOG("DmxFade: buffer %u fades in %u ms", bufferId, slot->duration);
+
+    return true;
+}
+
+void DmxFade::release(uint8_t bufferId, uint16_t offset, uint16_t count) {
+    DmxFadeSlot* slot = find(bufferId);
+
+    if (!slot || (offset >= 512)) {
+        return;
+    }
+    count = MIN(count, 512 - offset);
+
+    // Writes come from both cores, steps are done under the lock as well
+    critical_section_enter_blocking(&bufferLock);
+    for (uint16_t channel = offset; channel < (offset + count); channel++) {
+        slot->mask[channel / 32] &= ~(1UL << (channel % 32));
+    }
+    critical_section_exit(&bufferLock);
+}
+
+DmxFadeSlot* DmxFade::find(uint8_t bufferId) {
+    for (uint8_t i = 0; i < DMXFADE_SLOTS; i++) {
+        if ((slots[i].state != fadeFree) && (slots[i].bufferId == bufferId)) {
+            return &slots[i];
+        }
+    }
+    return nullptr;
+}
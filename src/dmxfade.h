@@ -0,0 +1,72 @@
+#ifndef DMXFADE_H
+#define DMXFADE_H
+
+#include "pico/stdlib.h"
+
+#include "dmxbuffer.h"
+
+// Buffers that can fade at the same time. Each slot costs a bit more than 1kB
+#define DMXFADE_SLOTS 4
+
+// Time between two steps. About one DMX frame
+#define DMXFADE_INTERVAL_MS 20
+
+// A reserved slot that never got started (the request got lost) is free
+// again after that time
+#define DMXFADE_RESERVE_TIMEOUT_MS 5000
+
+#ifdef __cplusplus
+
+enum DmxFadeState : uint8_t {
+    fadeFree = 0,
+    fadeReserved = 1,       // Targets are being collected
+    fadeRunning = 2,
+};
+
+struct DmxFadeSlot {
+    DmxFadeState state;
+    uint8_t bufferId;
+    const void* owner;      // Who is collecting the targets while reserved
+    uint16_t duration;      // ms
+    uint32_t since;         // board_millis() when reserved or started
+    uint32_t mask[16];      // One bit per channel that fades
+    uint8_t from[512];
+    uint8_t to[512];
+};
+
+// Linear fades of single channels in a DmxBuffer, from whatever value they
+// have to a target. Steps are written from cyclicTask, with one patching
+// per step and buffer.
+//
+// reserve() a buffer, setTarget() as often as needed, then start(), all
+// with the same owner (the web server uses its request). Only one owner
+// collects targets for a buffer at a time. If the buffer is fading already,
+// it stops where it is and all its channels continue from there with the
+// new timing
+class DmxFade {
+  public:
+    static void init();
+    static void cyclicTask();
+
+    // False if all slots are busy or someone else is collecting targets for
+    // that buffer, write the values right away then
+    static bool reserve(uint8_t bufferId, const void* owner);
+    // False if the slot isn't the owner's any more (its reservation timed
+    // out and someone else took it)
+    static bool setTarget(uint8_t bufferId, const void* owner, uint16_t offset, const uint8_t* values, uint16_t count);
+    static bool start(uint8_t bufferId, const void* owner, uint16_t duration);
+
+    // Channels written some other way stop fading. DmxBuffer calls this on
+    // every write, the fade steps don't go through it
+    static void release(uint8_t bufferId, uint16_t offset, uint16_t count);
+
+  private:
+    static DmxFadeSlot slots[DMXFADE_SLOTS];
+    static uint32_t lastStep;
+
+    static DmxFadeSlot* find(uint8_t bufferId);
+};
+
+#endif // __cplusplus
+
+#endif // DMXFADE_H
@@ -2,6 +2,8 @@
 
 #include "crc_X25.h"
 
+#include <pico/unique_id.h>
+
 #include "boardconfig.h"
 #include "dmxbuffer.h"
 
@@ -10,9 +12,46 @@ extern DmxBuffer dmxBuffer;
 
 extern critical_section_t bufferLock;
 
+// Provided by pico_lwip_random.c, good enough to pick a discovery slot
+extern "C" unsigned int pico_lwip_rand(void);
+
+// Compares two serials as big-endian numbers, like memcmp
+static inline int compareSerial(const uint8_t* a, const uint8_t* b) {
+    return memcmp(a, b, 8);
+}
+
 void Edp::init(uint8_t* inData, uint8_t* outData, uint16_t maxSendChunkSize, PatchType patchSource) {
+    pico_unique_board_id_t id;
+
     this->initOkay = false;
 
+    pico_get_unique_board_id(&id);
+    memcpy(this->serial, id.id, sizeof(this->serial));
+
+    memset(&this->stats, 0x00, sizeof(struct EdpStats));
+    this->controlQueueCount = 0;
+    this->pingSequence = 0;
+    this->dmxDataRequested = 0;
+    this->incoming_assembling = false;
+    this->incoming_expectedChunk = 0;
+    this->incoming_universeId = 0;
+    this->discoveryMuted = false;
+    this->discoveryResponsePending = false;
+    this->hopSequencePending = false;
+    this->universeStats = nullptr;
+    this->universeStatsCount = 0;
+    this->mergeHandler = nullptr;
+    this->mergeContext = nullptr;
+    this->mergeSourceId = 0;
+    this->allowCompression = true;
+    this->allowSparse = true;
+    this->fragmentSize = 0;
+    this->fecEnabled = false;
+    this->prepareDmxData_parityDue = false;
+    this->incoming_missingChunk = EDP_NO_CHUNK;
+    this->incoming_lastChunk = EDP_NO_CHUNK;
+    this->incoming_frameDone = false;
+
     if (!inData || !outData || (maxSendChunkSize < 20)) {
         return;
     }
@@ -25,14 +64,143 @@ void Edp::init(uint8_t* inData, uint8_t* outData, uint16_t maxSendChunkSize, Pat
     this->initOkay = true;
 }
 
+// The transport's payload size might change at runtime (MTU, radio settings)
+bool Edp::setMaxSendChunkSize(uint16_t maxSendChunkSize) {
+    if ((maxSendChunkSize < 20) || (maxSendChunkSize > 600)) {
+        return false;
+    }
+
+    if (fecEnabled && (maxSendChunkSize > EDP_FEC_MAX_CHUNK_SIZE)) {
+        return false;
+    }
+
+    this->maxSendChunkSize = maxSendChunkSize;
+    return true;
+}
+
+void Edp::setEncoding(bool allowCompression, bool allowSparse, uint16_t fragmentSize) {
+    this->allowCompression = allowCompression;
+    this->allowSparse = allowSparse;
+    this->fragmentSize = fragmentSize;
+}
+
+void Edp::setUniverseStats(struct EdpUniverseStats* stats, uint8_t count) {
+    this->universeStats = stats;
+    this->universeStatsCount = count;
+}
+
+void Edp::setMergeHandler(EdpMergeHandler handler, void* context, uint8_t sourceId) {
+    this->mergeHandler = handler;
+    this->mergeContext = context;
+    this->mergeSourceId = sourceId;
+}
+
+bool Edp::isDmxData(uint8_t command) {
+    return ((command == Edp_Commands::DmxData) ||
+            (command == Edp_Commands::DmxDataParity) ||
+            (command == Edp_Commands::DmxDataBundle) ||
+            (command == Edp_Commands::DmxDataAllZero));
+}
+
+void Edp::writeBuffer(uint8_t bufferId, uint8_t* data, uint16_t length) {
+    if (mergeHandler) {
+        mergeHandler(mergeContext, mergeSourceId, bufferId, data, length);
+        return;
+    }
+    dmxBuffer.setBuffer(bufferId, data, length);
+}
+
+bool Edp::setFec(bool enabled) {
+    if (enabled && (maxSendChunkSize > EDP_FEC_MAX_CHUNK_SIZE)) {
+        return false;
+    }
+
+    this->fecEnabled = enabled;
+    this->prepareDmxData_parityDue = false;
+    return true;
+}
+
+// XOR the body (everything after the chunk header) of the chunk that is
+// in outData into the parity of the current frame
+void Edp::addToParity(uint16_t chunkSize) {
+    uint16_t bodySize = chunkSize - sizeof(Edp_Commands) - sizeof(struct Edp_DmxData_ChunkHeader);
+    const uint8_t* body = outData + sizeof(Edp_Commands) + sizeof(struct Edp_DmxData_ChunkHeader);
+
+    for (uint16_t i = 0; i < bodySize; i++) {
+        parity[i] ^= body[i];
+    }
+    prepareDmxData_paritySize = MAX(prepareDmxData_paritySize, bodySize);
+}
+
+// Packet header + payload fit into the first chunk minus its headers, every
+// following chunk carries maxSendChunkSize minus the headers. If the
+// transport fragments our chunks itself, its fragments are what counts
+uint16_t Edp::chunksNeeded(uint16_t size, uint16_t firstChunkSize) {
+    uint16_t first = firstChunkSize - sizeof(Edp_Commands) - sizeof(struct Edp_DmxData_ChunkHeader);
+    uint16_t next = maxSendChunkSize - sizeof(Edp_Commands) - sizeof(struct Edp_DmxData_ChunkHeader);
+
+    if (fragmentSize) {
+        first = fragmentSize - sizeof(Edp_Commands) - sizeof(struct Edp_DmxData_ChunkHeader);
+        next = fragmentSize;
+    }
+
+    if (size <= first) {
+        return 1;
+    }
+    return 1 + (size - first + next - 1) / next;
+}
+
+uint16_t Edp::maxSizeForChunks(uint16_t chunks, uint16_t firstChunkSize) {
+    uint16_t first = firstChunkSize - sizeof(Edp_Commands) - sizeof(struct Edp_DmxData_ChunkHeader);
+    uint16_t next = maxSendChunkSize - sizeof(Edp_Commands) - sizeof(struct Edp_DmxData_ChunkHeader);
+
+    if (fragmentSize) {
+        first = fragmentSize - sizeof(Edp_Commands) - sizeof(struct Edp_DmxData_ChunkHeader);
+        next = fragmentSize;
+    }
+
+    return first + (chunks - 1) * next;
+}
+
+// Rough guess how many byte snappy saves: It is good at runs and short
+// repeating patterns (like RGB or RGBW fixtures next to each other). Every
+// byte repeating the one 1, 3 or 4 positions before is counted, minus the tags
+// snappy needs for switching between literals and copies
+uint16_t Edp::estimateCompressionSavings(const uint8_t* data, uint16_t size) {
+    uint16_t repeats = 0;
+
+    for (uint16_t i = 4; i < size; i++) {
+        if ((data[i] == data[i - 1]) || (data[i] == data[i - 3]) || (data[i] == data[i - 4])) {
+            repeats++;
+        }
+    }
+
+    // Uncompressed length varint plus about one tag per 16 byte
+    if (repeats <= 2 + size / 16) {
+        return 0;
+    }
+    return repeats - 2 - size / 16;
+}
+
 // Take data from inData, prepare the complete packet in scratch
 // Then, chop it into chunks and store them in outData, one per call
-bool Edp::prepareDmxData(uint8_t universeId, uint16_t inDataSize, uint16_t* thisChunkSize, bool* callAgain) {
+bool Edp::prepareDmxData(uint8_t universeId, uint16_t inDataSize, uint16_t* thisChunkSize, bool* callAgain, uint16_t chunkSizeLimit) {
+    // Every chunk can be limited individually, for example to fill up a
+    // radio payload that already has the end of another frame in it.
+    // Not with FEC, receivers need all but the last chunk to be full size
+    // to know where a lost one goes
+    uint16_t chunkSize = maxSendChunkSize;
+    if (chunkSizeLimit && !fecEnabled && (chunkSizeLimit < chunkSize)) {
+        chunkSize = MAX(chunkSizeLimit, EDP_MIN_CHUNK_SIZE);
+    }
+
     uint16_t limitedInDataSize;
     uint16_t sparseSize;
     uint8_t* destination;
     uint16_t firstUsedChannel;
     uint16_t lastUsedChannel;
+    uint16_t rawChunks;
+    uint16_t requiredSavings;
 
     struct Edp_DmxData_ChunkHeader* chunkHeader = (struct Edp_DmxData_ChunkHeader*)(outData + sizeof(Edp_Commands));
     struct Edp_DmxData_PacketHeader* packetHeader = (struct Edp_DmxData_PacketHeader*)(outData + sizeof(Edp_Commands) + sizeof(Edp_DmxData_ChunkHeader));
@@ -62,6 +230,10 @@ bool Edp::prepareDmxData(uint8_t universeId, uint16_t inDataSize, uint16_t* this
             outData[1] = universeId;
             *thisChunkSize = 2;
             *callAgain = false;
+            stats.framesSent++;
+            stats.chunksSent++;
+            stats.bytesSent += 2;
+            stats.overheadBytesSent += 2;
             return true;
         }
 
@@ -70,31 +242,52 @@ bool Edp::prepareDmxData(uint8_t universeId, uint16_t inDataSize, uint16_t* this
 
         limitedInDataSize = MIN(inDataSize, 512);
 
-        prepareDmxData_chunkOffset = maxSendChunkSize;
-
-        // TODO: Not yet supported
-        // IF NOT SUPPORT SPARSE
-        packetHeader->sparse = 0;
-        packetHeader->sparseOffset = 0;
-        sparseSize = 512;
-        // ELSE
-        packetHeader->sparse = 1;
-        packetHeader->sparseOffset = MIN(firstUsedChannel, 255);
-        sparseSize = MIN(lastUsedChannel, 511) - packetHeader->sparseOffset + 1;
+        prepareDmxData_chunkOffset = chunkSize;
+
+        // Sparse: Only send from the first to the last used channel. Never
+        // larger than a full frame, so there's nothing to choose if allowed
+        if (allowSparse) {
+            packetHeader->sparse = 1;
+            packetHeader->sparseOffset = MIN(firstUsedChannel, 255);
+            sparseSize = MIN(lastUsedChannel, 511) - packetHeader->sparseOffset + 1;
+            stats.framesSparse++;
+        } else {
+            packetHeader->sparse = 0;
+            packetHeader->sparseOffset = 0;
+            sparseSize = 512;
+        }
         LOG("prepareDMX: firstUsedChannel: %u, lastUsedChannel: %u, sparseOffset: %u, sparseSize: %u", firstUsedChannel, lastUsedChannel, packetHeader->sparseOffset, sparseSize);
 
-        // Compress inData to outData. If it's larger than the input, it will be overwritten later
-        prepareDmxData_sizeOfDataToBeSent = 600 - sizeof(Edp_Commands) - sizeof(Edp_DmxData_ChunkHeader) - sizeof(Edp_DmxData_PacketHeader);
         destination = outData + sizeof(Edp_Commands) + sizeof(struct Edp_DmxData_ChunkHeader) + sizeof(Edp_DmxData_PacketHeader);
-        snappy::RawCompress((const char *)inData + packetHeader->sparseOffset, sparseSize, (char*)destination, &prepareDmxData_sizeOfDataToBeSent);
+        packetHeader->compressed = 0;
+        prepareDmxData_sizeOfDataToBeSent = sparseSize;
+
+        // Compression is only worth it if it saves at least one chunk. The
+        // receiver's CPU time is wasted otherwise and so would be ours, so
+        // snappy isn't even tried if the estimate says it can't get there
+        rawChunks = chunksNeeded(sparseSize + sizeof(struct Edp_DmxData_PacketHeader), chunkSize);
+        if (allowCompression && (rawChunks > 1)) {
+            requiredSavings = sparseSize + sizeof(struct Edp_DmxData_PacketHeader) - maxSizeForChunks(rawChunks - 1, chunkSize);
 
-        if (prepareDmxData_sizeOfDataToBeSent >= sparseSize) {
-            LOG("Compressed size: %d (inSize: %d) => SENDING UNCOMPRESSED!", prepareDmxData_sizeOfDataToBeSent, sparseSize);
-            packetHeader->compressed = 0;
+            if (estimateCompressionSavings(inData + packetHeader->sparseOffset, sparseSize) >= requiredSavings) {
+                // Compress inData to outData. If it doesn't save a chunk, it will be overwritten below
+                prepareDmxData_sizeOfDataToBeSent = 600 - sizeof(Edp_Commands) - sizeof(Edp_DmxData_ChunkHeader) - sizeof(Edp_DmxData_PacketHeader);
+                snappy::RawCompress((const char *)inData + packetHeader->sparseOffset, sparseSize, (char*)destination, &prepareDmxData_sizeOfDataToBeSent);
+
+                if (chunksNeeded(prepareDmxData_sizeOfDataToBeSent + sizeof(struct Edp_DmxData_PacketHeader), chunkSize) < rawChunks) {
+                    packetHeader->compressed = 1;
+                    stats.framesCompressed++;
+                } else {
+                    LOG("Compressed size: %d (inSize: %d) => SENDING UNCOMPRESSED!", prepareDmxData_sizeOfDataToBeSent, sparseSize);
+                    prepareDmxData_sizeOfDataToBeSent = sparseSize;
+                }
+            } else {
+                stats.compressionSkipped++;
+            }
+        }
+
+        if (!packetHeader->compressed) {
             memcpy(destination, inData + packetHeader->sparseOffset, sparseSize);
-            prepareDmxData_sizeOfDataToBeSent = sparseSize;
-        } else {
-            packetHeader->compressed = 1;
         }
 
         // Calculate a CRC so the receivers know if they got all the correct chunks
@@ -110,21 +303,36 @@ bool Edp::prepareDmxData(uint8_t universeId, uint16_t inDataSize, uint16_t* this
 
         // Make chunk 0 ready
         chunkHeader->chunkCounter = Edp_DmxData_ChunkCounter::FirstPacket;
-        if ((prepareDmxData_sizeOfDataToBeSent + sizeof(Edp_Commands) + sizeof (struct Edp_DmxData_ChunkHeader)) <= maxSendChunkSize) {
+        chunkHeader->parity = fecEnabled;
+        memset(parity, 0x00, sizeof(parity));
+        prepareDmxData_paritySize = 0;
+        prepareDmxData_parityDue = fecEnabled;
+        stats.framesSent++;
+        stats.chunksSent++;
+        stats.overheadBytesSent += sizeof(Edp_Commands) + sizeof(struct Edp_DmxData_ChunkHeader) + sizeof(struct Edp_DmxData_PacketHeader);
+        if ((prepareDmxData_sizeOfDataToBeSent + sizeof(Edp_Commands) + sizeof (struct Edp_DmxData_ChunkHeader)) <= chunkSize) {
             // Yay, only one chunk needed :D
             chunkHeader->lastChunk = true;
             *thisChunkSize = prepareDmxData_sizeOfDataToBeSent + sizeof(Edp_Commands) + sizeof (struct Edp_DmxData_ChunkHeader);
-            *callAgain = false;
+            *callAgain = fecEnabled;
+            stats.bytesSent += *thisChunkSize;
+            if (fecEnabled) {
+                addToParity(*thisChunkSize);
+            }
             LOG("Only one chunk is needed :D Size: %u", prepareDmxData_sizeOfDataToBeSent + sizeof(Edp_Commands) + sizeof (struct Edp_DmxData_ChunkHeader));
             return true;
         }
 
         chunkHeader->lastChunk = false;
 
-        *thisChunkSize = maxSendChunkSize;
+        *thisChunkSize = chunkSize;
         *callAgain = true;
+        stats.bytesSent += chunkSize;
+        if (fecEnabled) {
+            addToParity(chunkSize);
+        }
 
-        LOG("Chunk 0 is ready! :D Size: %u", maxSendChunkSize);
+        LOG("Chunk 0 is ready! :D Size: %u", chunkSize);
 
         return true;
 
@@ -135,27 +343,55 @@ bool Edp::prepareDmxData(uint8_t universeId, uint16_t inDataSize, uint16_t* this
 
         // ChunkOffset points to the OLD chunk's data
 
+        // All data chunks are out, the parity chunk follows them. It keeps
+        // the chunk counter of the last data chunk
+        if (prepareDmxData_parityDue && (outData[0] == Edp_Commands::DmxData) && chunkHeader->lastChunk) {
+            prepareDmxData_parityDue = false;
+            outData[0] = Edp_Commands::DmxDataParity;
+            memcpy(outData + sizeof(Edp_Commands) + sizeof(struct Edp_DmxData_ChunkHeader), parity, prepareDmxData_paritySize);
+            *thisChunkSize = sizeof(Edp_Commands) + sizeof(struct Edp_DmxData_ChunkHeader) + prepareDmxData_paritySize;
+            *callAgain = false;
+            stats.chunksSent++;
+            stats.parityChunksSent++;
+            stats.bytesSent += *thisChunkSize;
+            stats.overheadBytesSent += *thisChunkSize;
+            return true;
+        }
+
+        // Source and destination overlap if the previous chunk was smaller
+        // than this one, so memmove it
         destination = outData + sizeof(Edp_Commands) + sizeof(struct Edp_DmxData_ChunkHeader);
-        memcpy(destination, outData + prepareDmxData_chunkOffset, maxSendChunkSize - sizeof(Edp_Commands) - sizeof(struct Edp_DmxData_ChunkHeader));
+        memmove(destination, outData + prepareDmxData_chunkOffset, MIN(chunkSize - sizeof(Edp_Commands) - sizeof(struct Edp_DmxData_ChunkHeader), (size_t)(600 - prepareDmxData_chunkOffset)));
 
         chunkHeader->chunkCounter = (Edp_DmxData_ChunkCounter)(chunkHeader->chunkCounter + 1);
+        stats.chunksSent++;
+        stats.overheadBytesSent += sizeof(Edp_Commands) + sizeof(struct Edp_DmxData_ChunkHeader);
 
         LOG("Chunk %u is ready! chunkOffset: %u, maxSendChunkSize: %u, prepareDmxData_sizeOfDataToBeSent: %u",
             chunkHeader->chunkCounter,
             prepareDmxData_chunkOffset,
-            maxSendChunkSize,
+            chunkSize,
             prepareDmxData_sizeOfDataToBeSent);
 
-        if (prepareDmxData_chunkOffset + maxSendChunkSize >= prepareDmxData_sizeOfDataToBeSent + sizeof(struct Edp_DmxData_PacketHeader)) {
+        if (prepareDmxData_chunkOffset + chunkSize >= prepareDmxData_sizeOfDataToBeSent + sizeof(struct Edp_DmxData_PacketHeader)) {
             chunkHeader->lastChunk = true;
             *thisChunkSize = prepareDmxData_sizeOfDataToBeSent - prepareDmxData_chunkOffset + sizeof(struct Edp_DmxData_PacketHeader);
-            *callAgain = false;
+            *callAgain = fecEnabled;
+            stats.bytesSent += *thisChunkSize;
+            if (fecEnabled) {
+                addToParity(*thisChunkSize);
+            }
             LOG("It's the last chunk! Size: %u %04x", *thisChunkSize, *thisChunkSize);
             return true;
         }
 
-        prepareDmxData_chunkOffset = prepareDmxData_chunkOffset + (maxSendChunkSize - sizeof(Edp_Commands) - sizeof(Edp_DmxData_ChunkHeader));
+        prepareDmxData_chunkOffset = prepareDmxData_chunkOffset + (chunkSize - sizeof(Edp_Commands) - sizeof(Edp_DmxData_ChunkHeader));
+        *thisChunkSize = chunkSize;
         *callAgain = true;
+        stats.bytesSent += chunkSize;
+        if (fecEnabled) {
+            addToParity(chunkSize);
+        }
 
         return true;
     }
@@ -164,11 +400,16 @@ bool Edp::prepareDmxData(uint8_t universeId, uint16_t inDataSize, uint16_t* this
 // Since every data source calling this has its own instance of EDP, this
 // should be safe
 bool Edp::processIncomingChunk(uint16_t chunkSize) {
+    return processIncomingChunk(inData, chunkSize);
+}
+
+// Same as above, but the chunk can be anywhere (for example directly in a
+// received pbuf or inside a DmxDataBundle). inData is only touched if the
+// chunk isn't already there
+bool Edp::processIncomingChunk(const uint8_t* chunk, uint16_t chunkSize) {
     Patching patching;
     uint8_t universeId;
     uint16_t copySize;
-    uint16_t crc;
-    size_t uncompressedLength;
 
     if (chunkSize < 1) {
         return false;
@@ -176,131 +417,800 @@ bool Edp::processIncomingChunk(uint16_t chunkSize) {
 
     patching.active = false;
 
-    LOG("EDP INCOMING: %d byte. Command: %d", chunkSize, inData[0]);
+    LOG("EDP INCOMING: %d byte. Command: %d", chunkSize, chunk[0]);
+
+    if (chunk[0] == Edp_Commands::Ping) {
+        // Just send the payload back, the requester knows what to do with it
+        if (chunkSize < (sizeof(Edp_Commands) + sizeof(struct Edp_PingPong))) {
+            return false;
+        }
+        uint8_t pong[sizeof(Edp_Commands) + sizeof(struct Edp_PingPong)];
+        pong[0] = Edp_Commands::Pong;
+        memcpy(pong + sizeof(Edp_Commands), chunk + sizeof(Edp_Commands), sizeof(struct Edp_PingPong));
+        if (queueControlData(pong, sizeof(pong), 0)) {
+            stats.pingsAnswered++;
+        }
+        return true;
+    }
+
+    if (chunk[0] == Edp_Commands::Pong) {
+        struct Edp_PingPong pong;
+        uint32_t rtt;
+
+        if (chunkSize < (sizeof(Edp_Commands) + sizeof(struct Edp_PingPong))) {
+            return false;
+        }
+        memcpy(&pong, chunk + sizeof(Edp_Commands), sizeof(struct Edp_PingPong));
+
+        // On shared media (radio broadcast), we also see the pongs for other
+        // nodes' pings. Those are of no use for us
+        if (compareSerial(pong.serial, serial)) {
+            return false;
+        }
+
+        rtt = time_us_32() - pong.timestamp;
+        if ((stats.pongsReceived == 0) || (rtt < stats.rttMin)) {
+            stats.rttMin = rtt;
+        }
+        if (rtt > stats.rttMax) {
+            stats.rttMax = rtt;
+        }
+        if (stats.pongsReceived == 0) {
+            stats.rttAvg = rtt;
+        } else {
+            // Smooth by 1/8 so single outliers don't dominate
+            stats.rttAvg = stats.rttAvg - (stats.rttAvg >> 3) + (rtt >> 3);
+        }
+        stats.rttLast = rtt;
+        stats.pongsReceived++;
+
+        LOG("EDP Pong. Sequence: %u, RTT: %u us", pong.sequence, rtt);
+        return true;
+    }
+
+    if (chunk[0] == Edp_Commands::DmxDataRequest) {
+        if (chunkSize < (sizeof(Edp_Commands) + 1)) {
+            return false;
+        }
+        universeId = chunk[1];
+        if (universeId >= 64) {
+            return false;
+        }
+        // The transport knows where the data for this universe comes from
+        // and queues it again
+        dmxDataRequested |= (1ULL << universeId);
+        stats.dmxDataRequestsReceived++;
+        LOG("EDP DmxDataRequest for universe %u", universeId);
+        return true;
+    }
+
+    if (chunk[0] == Edp_Commands::DiscoveryRequest) {
+        struct Edp_DiscoveryRequest request;
+        struct Edp_DiscoveryResponse response;
+        uint32_t delay;
+
+        if (chunkSize < (sizeof(Edp_Commands) + sizeof(struct Edp_DiscoveryRequest))) {
+            return false;
+        }
+        memcpy(&request, chunk + sizeof(Edp_Commands), sizeof(struct Edp_DiscoveryRequest));
+
+        if (discoveryMuted ||
+            (compareSerial(serial, request.lowerBound) < 0) ||
+            (compareSerial(serial, request.upperBound) > 0))
+        {
+            return true;
+        }
+
+        // Answer in a random slot so not all nodes talk at the same time.
+        // Slot 0 is sent right away
+        delay = 0;
+        if (request.slotCount > 1) {
+            delay = (pico_lwip_rand() % request.slotCount) * request.slotTime * 100;
+        }
+
+        memcpy(response.serial, serial, sizeof(response.serial));
+        response.round = request.round;
 
-    if (inData[0] == Edp_Commands::DmxDataAllZero) {
+        uint8_t message[sizeof(Edp_Commands) + sizeof(struct Edp_DiscoveryResponse)];
+        message[0] = Edp_Commands::DiscoveryRespone;
+        memcpy(message + sizeof(Edp_Commands), &response, sizeof(struct Edp_DiscoveryResponse));
+        if (queueControlData(message, sizeof(message), delay)) {
+            stats.discoveryAnswered++;
+        }
+
+        LOG("EDP DiscoveryRequest round %u. Answering in %u us", request.round, delay);
+        return true;
+    }
+
+    if (chunk[0] == Edp_Commands::DiscoveryRespone) {
+        if (chunkSize < (sizeof(Edp_Commands) + sizeof(struct Edp_DiscoveryResponse))) {
+            return false;
+        }
+        memcpy(discoveryResponseSerial, chunk + sizeof(Edp_Commands), sizeof(discoveryResponseSerial));
+        discoveryResponsePending = true;
+        return true;
+    }
+
+    if (chunk[0] == Edp_Commands::DiscoveryMute) {
+        if (chunkSize < (sizeof(Edp_Commands) + sizeof(serial))) {
+            return false;
+        }
+        if (compareSerial(chunk + sizeof(Edp_Commands), serial) == 0) {
+            LOG("EDP DiscoveryMute");
+            discoveryMuted = true;
+            // A response that is still waiting for its slot is no longer needed
+            for (uint8_t i = 0; i < controlQueueCount; i++) {
+                if (controlQueue[i].data[0] == Edp_Commands::DiscoveryRespone) {
+                    removeControlData(i);
+                    break;
+                }
+            }
+        }
+        return true;
+    }
+
+    if (chunk[0] == Edp_Commands::DiscoveryUnMuteAll) {
+        discoveryMuted = false;
+        return true;
+    }
+
+    if (chunk[0] == Edp_Commands::HopSequence) {
+        struct Edp_HopSequence sequence;
+
+        if (chunkSize < (sizeof(Edp_Commands) + sizeof(struct Edp_HopSequence))) {
+            return false;
+        }
+        memcpy(&sequence, chunk + sizeof(Edp_Commands), sizeof(struct Edp_HopSequence));
+        if ((sequence.channelCount == 0) || (sequence.channelCount > EDP_HOP_MAX_CHANNELS) ||
+            (sequence.nextIndex >= sequence.channelCount))
+        {
+            return false;
+        }
+        memcpy(&hopSequence, &sequence, sizeof(struct Edp_HopSequence));
+        hopSequencePending = true;
+        return true;
+    }
+
+    if (chunk[0] == Edp_Commands::DmxDataAllZero) {
         // No chunk header, no packetheader, just the universeId
-        patching = findPatching(inData[1]);
+        if (chunkSize < (sizeof(Edp_Commands) + 1)) {
+            return false;
+        }
+        patching = findPatching(chunk[1]);
+        if (chunk[1] < universeStatsCount) {
+            universeStats[chunk[1]].framesReceived++;
+        }
 
-        LOG("allZero packet. universe: %u patching active: %u buffer: %u", inData[1], patching.active, patching.dstInstance);
+        LOG("allZero packet. universe: %u patching active: %u buffer: %u", chunk[1], patching.active, patching.dstInstance);
 
         if (patching.active) {
-            // Easy: Just clear the DmxBuffer
-            dmxBuffer.zero(patching.dstInstance);
+            // Easy: Just clear the DmxBuffer. Unless it's merged with other sources
+            if (mergeHandler) {
+                writeBuffer(patching.dstInstance, DmxBuffer::allZeroes, 512);
+            } else {
+                dmxBuffer.zero(patching.dstInstance);
+            }
             return true;
         }
         return false;
     }
 
-    if (inData[0] == Edp_Commands::DmxData) {
+    if (chunk[0] == Edp_Commands::DmxDataBundle) {
+        // Records of (uint16_t length, chunk) until the end
+        uint8_t bundleCopy[64];
+        uint16_t offset = sizeof(Edp_Commands);
+        uint16_t recordSize;
+        bool allOkay = true;
+
+        // Small transports (radio, HID) receive to inData, which is also the
+        // scratch area when a frame is completed. So work on a copy then
+        if ((chunk >= inData) && (chunk < inData + 600)) {
+            if (chunkSize > sizeof(bundleCopy)) {
+                return false;
+            }
+            memcpy(bundleCopy, chunk, chunkSize);
+            chunk = bundleCopy;
+        }
+
+        while (offset + sizeof(uint16_t) <= chunkSize) {
+            recordSize = chunk[offset] | (chunk[offset + 1] << 8);
+            offset += sizeof(uint16_t);
+            if (recordSize == 0) {
+                // Padding (fixed payload sizes), nothing follows
+                break;
+            }
+            if (offset + recordSize > chunkSize) {
+                LOG("DmxDataBundle: Record of %u byte at %u exceeds the bundle (%u byte)", recordSize, offset, chunkSize);
+                return false;
+            }
+
+            // Bundles are not nested. Chunks of a frame are processed in order
+            // as if they came in one by one
+            if (chunk[offset] == Edp_Commands::DmxDataBundle) {
+                allOkay = false;
+            } else if (!processIncomingChunk(chunk + offset, recordSize)) {
+                allOkay = false;
+            }
+
+            offset += recordSize;
+        }
+
+        return allOkay;
+    }
+
+    if (chunk[0] == Edp_Commands::DmxData) {
         // At least a chunk header + 1 byte payload needs to be there
 
         if (chunkSize < (sizeof(Edp_Commands) + sizeof(struct Edp_DmxData_ChunkHeader) + 1)) {
             return false;
         }
 
-        struct Edp_DmxData_ChunkHeader* chunkHeader = (struct Edp_DmxData_ChunkHeader*)inData + sizeof(Edp_Commands);
+        struct Edp_DmxData_ChunkHeader* chunkHeader = (struct Edp_DmxData_ChunkHeader*)(chunk + sizeof(Edp_Commands));
 
         LOG("DmxData: Chunk: %d, LastChunk: %d", chunkHeader->chunkCounter, chunkHeader->lastChunk);
 
+        // The whole frame is in this chunk, so there is no need to assemble
+        // it in outData first. Just make sure the scratch area used for
+        // decompression doesn't overlap the chunk
+        if ((chunkHeader->chunkCounter == Edp_DmxData_ChunkCounter::FirstPacket) && chunkHeader->lastChunk) {
+            if (chunkSize < (sizeof(Edp_Commands) + sizeof(struct Edp_DmxData_ChunkHeader) + sizeof(struct Edp_DmxData_PacketHeader))) {
+                return false;
+            }
+            if (incoming_assembling) {
+                frameLost();
+            }
+            incoming_frameDone = true;
+            const uint8_t* frame = chunk + sizeof(Edp_Commands) + sizeof(struct Edp_DmxData_ChunkHeader);
+            bool chunkInInData = (chunk >= inData) && (chunk < inData + 600);
+            return applyDmxData(
+                (const struct Edp_DmxData_PacketHeader*)frame,
+                frame + sizeof(struct Edp_DmxData_PacketHeader),
+                chunkSize - sizeof(Edp_Commands) - sizeof(struct Edp_DmxData_ChunkHeader) - sizeof(struct Edp_DmxData_PacketHeader),
+                chunkInInData ? outData : inData);
+        }
+
         // Complete frame (all chunks) is assembled in outData
+        incoming_frameDone = false;
+
+        // With FEC, a lost first chunk can be recovered as well. Leave
+        // room for it and assemble the rest. Without, waiting is pointless
+        if (chunkHeader->parity && (!incoming_assembling) && (chunkHeader->chunkCounter == 1)) {
+            critical_section_enter_blocking(&bufferLock);
+            memset(outData, 0x00, 600);
+            critical_section_exit(&bufferLock);
+            prepareDmxData_chunkOffset = maxSendChunkSize - sizeof(Edp_Commands) - sizeof(struct Edp_DmxData_ChunkHeader);
+            incoming_assembling = true;
+            incoming_expectedChunk = 0;
+            incoming_missingChunk = EDP_NO_CHUNK;
+            incoming_lastChunk = EDP_NO_CHUNK;
+            incoming_universeId = 0xff;
+        }
+
+        // One missing chunk in the middle: Same, the parity chunk may bring it back
+        if (chunkHeader->parity &&
+            incoming_assembling &&
+            (incoming_missingChunk == EDP_NO_CHUNK) &&
+            (chunkHeader->chunkCounter == incoming_expectedChunk + 1) &&
+            (prepareDmxData_chunkOffset + maxSendChunkSize <= 600))
+        {
+            LOG("DmxData: Chunk %u missing, waiting for parity", incoming_expectedChunk);
+            incoming_missingChunk = incoming_expectedChunk;
+            if (incoming_expectedChunk != 0) {
+                prepareDmxData_chunkOffset += maxSendChunkSize - sizeof(Edp_Commands) - sizeof(struct Edp_DmxData_ChunkHeader);
+            }
+            incoming_expectedChunk++;
+        }
 
         if (chunkHeader->chunkCounter == Edp_DmxData_ChunkCounter::FirstPacket) {
+            // A frame still waiting for its parity can't be completed any more
+            if (incoming_assembling) {
+                frameLost();
+            }
+
             // Clear outData so the following chunks comes in clean
             copySize = MIN((chunkSize - sizeof(Edp_Commands) - sizeof(struct Edp_DmxData_ChunkHeader)), 600);
             LOG("DmxData: FIRST chunk. Will copy %u byte", copySize);
             critical_section_enter_blocking(&bufferLock);
             memset(outData, 0x00, 600);
-            memcpy(outData, inData + sizeof(Edp_Commands) + sizeof(struct Edp_DmxData_ChunkHeader), copySize);
+            memcpy(outData, chunk + sizeof(Edp_Commands) + sizeof(struct Edp_DmxData_ChunkHeader), copySize);
             critical_section_exit(&bufferLock);
             prepareDmxData_chunkOffset = copySize;
-        } else if (chunkHeader->chunkCounter < 32) {
-            // Some intermediate packet: Just copy it to outData
-            copySize = MIN((chunkSize - sizeof(Edp_Commands) - sizeof(struct Edp_DmxData_ChunkHeader)), 600);
+            incoming_assembling = true;
+            incoming_expectedChunk = 1;
+            incoming_missingChunk = EDP_NO_CHUNK;
+            incoming_lastChunk = EDP_NO_CHUNK;
+            incoming_universeId = ((struct Edp_DmxData_PacketHeader*)outData)->universeId;
+        } else {
+            // Some intermediate packet: Make sure it's the one we expect. If
+            // one got lost, the frame can't be completed and we ask for a new one
+            if ((!incoming_assembling) || (chunkHeader->chunkCounter != incoming_expectedChunk)) {
+                LOG("DmxData: Chunk %u while expecting %u. Dropping frame", chunkHeader->chunkCounter, incoming_expectedChunk);
+                if (incoming_assembling) {
+                    frameLost();
+                }
+                return false;
+            }
+            incoming_expectedChunk++;
+
+            // Just copy it to outData
+            copySize = MIN((chunkSize - sizeof(Edp_Commands) - sizeof(struct Edp_DmxData_ChunkHeader)), (uint16_t)(600 - prepareDmxData_chunkOffset));
             LOG("DmxData: INTERMEDIATE chunk. Will copy %u at offset %u", copySize, prepareDmxData_chunkOffset);
             critical_section_enter_blocking(&bufferLock);
-            memcpy(outData + prepareDmxData_chunkOffset, inData + sizeof(Edp_Commands) + sizeof(struct Edp_DmxData_ChunkHeader), copySize);
+            memcpy(outData + prepareDmxData_chunkOffset, chunk + sizeof(Edp_Commands) + sizeof(struct Edp_DmxData_ChunkHeader), copySize);
             critical_section_exit(&bufferLock);
             prepareDmxData_chunkOffset += copySize;
         }
 
-        // If the last chunk just came in, we have everything and can act on it
+        // If the last chunk just came in, we have everything and can act on
+        // it. Unless there is a hole, then the parity chunk has to fill it
+        if (chunkHeader->lastChunk && (incoming_missingChunk != EDP_NO_CHUNK)) {
+            incoming_lastChunk = chunkHeader->chunkCounter;
+            return true;
+        }
+
         if (chunkHeader->lastChunk) {
-            struct Edp_DmxData_PacketHeader* packetHeader = (struct Edp_DmxData_PacketHeader*)outData;
-
-            // Check CRC and discard packet if it doesn't match
-            LOG("Checksum first byte: %02x, len: %u", (outData + sizeof(struct Edp_DmxData_PacketHeader))[0], prepareDmxData_chunkOffset - sizeof(struct Edp_DmxData_PacketHeader));
-            crc = crc_init();
-            crc = crc_update(crc, outData + sizeof(struct Edp_DmxData_PacketHeader), prepareDmxData_chunkOffset - sizeof(struct Edp_DmxData_PacketHeader));
-            crc = crc_finalize(crc);
-            if (crc != packetHeader->crc) {
-                LOG("CRC mismatch! Expected: %04x, Calculated: %04x", packetHeader->crc, crc);
-                return false;
-            }
+            incoming_assembling = false;
+            incoming_frameDone = true;
 
             // The complete packet (compressed or not) sits at outData
             // inData contains the last chunk received + possibly garbage
+            // and can be used as scratch
+            return applyDmxData(
+                (const struct Edp_DmxData_PacketHeader*)outData,
+                outData + sizeof(struct Edp_DmxData_PacketHeader),
+                prepareDmxData_chunkOffset - sizeof(struct Edp_DmxData_PacketHeader),
+                inData);
+        }
+
+        return true;
+    }
+
+    if (chunk[0] == Edp_Commands::DmxDataParity) {
+        return processParityChunk(chunk, chunkSize);
+    }
+
+    // Should not reach here!
+    return false;
+}
+
+// The parity chunk follows the last data chunk of a frame. Its body is the
+// XOR of all data chunk bodies, so exactly one missing chunk can be rebuilt
+bool Edp::processParityChunk(const uint8_t* chunk, uint16_t chunkSize) {
+    const struct Edp_DmxData_ChunkHeader* chunkHeader = (const struct Edp_DmxData_ChunkHeader*)(chunk + sizeof(Edp_Commands));
+    const struct Edp_DmxData_PacketHeader* packetHeader = (const struct Edp_DmxData_PacketHeader*)outData;
+    uint8_t recovered[EDP_FEC_MAX_CHUNK_SIZE];
+    uint16_t paritySize;
+    uint16_t bodySize = maxSendChunkSize - sizeof(Edp_Commands) - sizeof(struct Edp_DmxData_ChunkHeader);
+    uint8_t lastChunk = chunkHeader->chunkCounter;
+    uint16_t frameSize;
+    uint16_t start;
+    uint16_t crc;
+
+    if ((chunkSize < (sizeof(Edp_Commands) + sizeof(struct Edp_DmxData_ChunkHeader) + sizeof(struct Edp_DmxData_PacketHeader))) ||
+        (chunkSize > sizeof(Edp_Commands) + sizeof(struct Edp_DmxData_ChunkHeader) + sizeof(recovered)))
+    {
+        return false;
+    }
+    paritySize = chunkSize - sizeof(Edp_Commands) - sizeof(struct Edp_DmxData_ChunkHeader);
+
+    // Got everything, nothing to do
+    if (incoming_frameDone) {
+        incoming_frameDone = false;
+        return true;
+    }
+
+    // The parity of a single chunk frame is a copy of it
+    if ((lastChunk == Edp_DmxData_ChunkCounter::FirstPacket) && !incoming_assembling) {
+        memcpy(outData, chunk + sizeof(Edp_Commands) + sizeof(struct Edp_DmxData_ChunkHeader), paritySize);
+        stats.framesRecovered++;
+        LOG("DmxData: Recovered single chunk frame from parity");
+        return applyDmxData(packetHeader, outData + sizeof(struct Edp_DmxData_PacketHeader), paritySize - sizeof(struct Edp_DmxData_PacketHeader), inData);
+    }
 
-            // For sparse packets to work, we need 512 byte of zeroed space, so we
-            // will reuse inData for that. So zero it here
-            memset(inData, 0x00, 600);
-
-            patching = findPatching(packetHeader->universeId);
-
-            LOG("DmxData packet complete! universe: %u, packetLen: %u, compressed: %u, sparse: %u, sparseOffset: %u, patching active: %u buffer: %u",
-                packetHeader->universeId,
-                prepareDmxData_chunkOffset,
-                packetHeader->compressed,
-                packetHeader->sparse,
-                packetHeader->sparseOffset,
-                patching.active,
-                patching.dstInstance
-            );
-
-            // If this universe is not patched, no need to do anything
-            if (!patching.active) {
-                return true; // TODO: or better false?
+    if (!incoming_assembling) {
+        return false;
+    }
+
+    // Either the last data chunk is there and we know which one is missing,
+    // or the last one is the one missing
+    if (incoming_lastChunk == EDP_NO_CHUNK) {
+        if ((incoming_missingChunk != EDP_NO_CHUNK) || (lastChunk != incoming_expectedChunk)) {
+            frameLost();
+            return false;
+        }
+        incoming_missingChunk = lastChunk;
+        frameSize = (lastChunk + 1) * bodySize;
+    } else {
+        if (lastChunk != incoming_lastChunk) {
+            frameLost();
+            return false;
+        }
+        frameSize = prepareDmxData_chunkOffset;
+    }
+
+    if ((paritySize != bodySize) || (frameSize > 600)) {
+        frameLost();
+        return false;
+    }
+
+    // The missing chunk's place in outData is still zeroed, so XOR-ing all
+    // chunk places into the parity leaves exactly the missing chunk
+    memcpy(recovered, chunk + sizeof(Edp_Commands) + sizeof(struct Edp_DmxData_ChunkHeader), paritySize);
+    for (uint8_t i = 0; i <= lastChunk; i++) {
+        start = i * bodySize;
+        for (uint16_t j = 0; (j < bodySize) && (start + j < frameSize); j++) {
+            recovered[j] ^= outData[start + j];
+        }
+    }
+    start = incoming_missingChunk * bodySize;
+    critical_section_enter_blocking(&bufferLock);
+    memcpy(outData + start, recovered, MIN(bodySize, (uint16_t)(frameSize - start)));
+    critical_section_exit(&bufferLock);
+
+    incoming_assembling = false;
+
+    // If the last chunk got lost, its length did too. Padding is zero, so
+    // try all possible lengths until the CRC matches
+    if (incoming_lastChunk == EDP_NO_CHUNK) {
+        start = lastChunk * bodySize + 1;
+        crc = crc_init();
+        crc = crc_update(crc, outData + sizeof(struct Edp_DmxData_PacketHeader), start - sizeof(struct Edp_DmxData_PacketHeader));
+        while ((crc_finalize(crc) != packetHeader->crc) && (start < frameSize)) {
+            crc = crc_update(crc, outData + start, 1);
+            start++;
+        }
+        frameSize = start;
+    }
+
+    stats.framesRecovered++;
+    LOG("DmxData: Recovered chunk %u of %u from parity", incoming_missingChunk, lastChunk);
+
+    return applyDmxData(packetHeader, outData + sizeof(struct Edp_DmxData_PacketHeader), frameSize - sizeof(struct Edp_DmxData_PacketHeader), inData);
+}
+
+// A frame that was being assembled can't be completed. Ask for it again
+// if we know which universe it was
+void Edp::frameLost() {
+    incoming_assembling = false;
+    stats.framesChunkGap++;
+    if (incoming_universeId < 64) {
+        prepareDmxDataRequest(incoming_universeId);
+    }
+}
+
+// Check the CRC of a complete DmxData frame and write it to the patched
+// DmxBuffer. scratch needs 600 byte and must not overlap the payload
+bool Edp::applyDmxData(const struct Edp_DmxData_PacketHeader* packetHeader, const uint8_t* payload, uint16_t payloadSize, uint8_t* scratch) {
+    Patching patching;
+    uint16_t crc;
+    size_t uncompressedLength;
+
+    // Check CRC and discard packet if it doesn't match
+    LOG("Checksum first byte: %02x, len: %u", payload[0], payloadSize);
+    crc = crc_init();
+    crc = crc_update(crc, payload, payloadSize);
+    crc = crc_finalize(crc);
+    if (crc != packetHeader->crc) {
+        LOG("CRC mismatch! Expected: %04x, Calculated: %04x", packetHeader->crc, crc);
+        stats.framesCrcError++;
+        if (packetHeader->universeId < universeStatsCount) {
+            universeStats[packetHeader->universeId].framesCrcError++;
+        }
+        prepareDmxDataRequest(packetHeader->universeId);
+        return false;
+    }
+
+    stats.framesReceived++;
+    if (packetHeader->universeId < universeStatsCount) {
+        universeStats[packetHeader->universeId].framesReceived++;
+    }
+
+    // For sparse packets to work, we need 512 byte of zeroed space
+    memset(scratch, 0x00, 600);
+
+    patching = findPatching(packetHeader->universeId);
+
+    LOG("DmxData packet complete! universe: %u, payloadLen: %u, compressed: %u, sparse: %u, sparseOffset: %u, patching active: %u buffer: %u",
+        packetHeader->universeId,
+        payloadSize,
+        packetHeader->compressed,
+        packetHeader->sparse,
+        packetHeader->sparseOffset,
+        patching.active,
+        patching.dstInstance
+    );
+
+    // If this universe is not patched, no need to do anything
+    if (!patching.active) {
+        return true; // TODO: or better false?
+    }
+
+    if (packetHeader->compressed) {
+        if (snappy::GetUncompressedLength((const char*)payload, payloadSize, &uncompressedLength) == true) {
+            LOG("snappy::GetUncompressedLength: %d", uncompressedLength);
+
+            // Sanity check: uncompressedLength must be 512 OR the frame is sparse
+            if ((!packetHeader->sparse && uncompressedLength != 512) || (packetHeader->sparse && uncompressedLength > 512)) {
+                return false;
             }
 
-            if (packetHeader->compressed) {
-                if (snappy::GetUncompressedLength((const char*)(outData + sizeof(struct Edp_DmxData_PacketHeader)), prepareDmxData_chunkOffset - sizeof(struct Edp_DmxData_PacketHeader), &uncompressedLength) == true) {
-                    LOG("snappy::GetUncompressedLength: %d", uncompressedLength);
-
-                    // Sanity check: uncompressedLength must be 512 OR the frame is sparse
-                    if ((!packetHeader->sparse && uncompressedLength != 512) || (packetHeader->sparse && uncompressedLength > 512)) {
-                        return false;
-                    }
-
-                    if (snappy::RawUncompress((const char*)(outData + sizeof(struct Edp_DmxData_PacketHeader)), prepareDmxData_chunkOffset - sizeof(struct Edp_DmxData_PacketHeader), (char*)inData + packetHeader->sparseOffset) == true) {
-                        dmxBuffer.setBuffer(patching.dstInstance, inData, uncompressedLength + packetHeader->sparseOffset);
-                        return true;
-                    } else {
-                        LOG("snappy::RawUncompress failed :(");
-                        return false;
-                    }
-                } else {
-                    LOG("snappy::GetUncompressedLength failed :(");
-                    return false;
-                }
+            if (snappy::RawUncompress((const char*)payload, payloadSize, (char*)scratch + packetHeader->sparseOffset) == true) {
+                writeBuffer(patching.dstInstance, scratch, uncompressedLength + packetHeader->sparseOffset);
+                return true;
             } else {
-                // Sanity check: if full frame, packetLen MUST be 512 + sizeof PacketHeader
-                if (prepareDmxData_chunkOffset == (512 + sizeof(Edp_DmxData_PacketHeader))) {
-                    dmxBuffer.setBuffer(patching.dstInstance, outData + sizeof(struct Edp_DmxData_PacketHeader), (prepareDmxData_chunkOffset - sizeof(struct Edp_DmxData_PacketHeader)));
-                    return true;
-                } else if (packetHeader->sparse) {
-                    memcpy(inData + packetHeader->sparseOffset, outData + sizeof(struct Edp_DmxData_PacketHeader), prepareDmxData_chunkOffset - sizeof(struct Edp_DmxData_PacketHeader));
-                    dmxBuffer.setBuffer(patching.dstInstance, inData, prepareDmxData_chunkOffset + packetHeader->sparseOffset);
-                    return true;
-                }
+                LOG("snappy::RawUncompress failed :(");
                 return false;
             }
+        } else {
+            LOG("snappy::GetUncompressedLength failed :(");
+            return false;
+        }
+    } else {
+        // Sanity check: if full frame, payloadSize MUST be 512
+        if (!packetHeader->sparse && (payloadSize == 512)) {
+            writeBuffer(patching.dstInstance, (uint8_t*)payload, payloadSize);
+            return true;
+        } else if (packetHeader->sparse && (packetHeader->sparseOffset + payloadSize <= 512)) {
+            memcpy(scratch + packetHeader->sparseOffset, payload, payloadSize);
+            writeBuffer(patching.dstInstance, scratch, packetHeader->sparseOffset + payloadSize);
+            return true;
+        }
+        return false;
+    }
+}
+
+bool Edp::preparePing() {
+    struct Edp_PingPong ping;
+
+    if (!initOkay) {
+        return false;
+    }
+
+    memcpy(ping.serial, serial, sizeof(ping.serial));
+    ping.timestamp = time_us_32();
+    ping.sequence = pingSequence++;
+
+    uint8_t message[sizeof(Edp_Commands) + sizeof(struct Edp_PingPong)];
+    message[0] = Edp_Commands::Ping;
+    memcpy(message + sizeof(Edp_Commands), &ping, sizeof(struct Edp_PingPong));
+    if (!queueControlData(message, sizeof(message), 0)) {
+        return false;
+    }
+    stats.pingsSent++;
+
+    return true;
+}
+
+uint16_t Edp::prepareDmxDataDelta(uint8_t universeId, const uint8_t* current, uint8_t* shadow, uint8_t* out, uint16_t outSize, bool* callAgain) {
+    uint16_t size;
+    uint16_t start = 0;
+    uint16_t end;
+    uint16_t length;
+
+    *callAgain = false;
+
+    // Command, universe and at least one range with one byte
+    if ((universeId >= 64) || (outSize < 6)) {
+        return 0;
+    }
+
+    out[0] = Edp_Commands::DmxDataDelta;
+    out[1] = universeId;
+    size = 2;
+
+    while (start < 512) {
+        if (current[start] == shadow[start]) {
+            start++;
+            continue;
+        }
+
+        // Extend the range over small gaps of unchanged channels
+        end = start + 1;
+        for (uint16_t i = end; (i < 512) && (i - start < 255) && (i - end <= EDP_DELTA_MERGE_GAP); i++) {
+            if (current[i] != shadow[i]) {
+                end = i + 1;
+            }
+        }
+
+        if (size + 3 >= outSize) {
+            break;
+        }
+        length = MIN(end - start, outSize - size - 3);
+
+        out[size] = start & 0xff;
+        out[size + 1] = start >> 8;
+        out[size + 2] = length;
+        // The buffer might change while we are here, so shadow is set to
+        // exactly what is sent
+        memcpy(out + size + 3, current + start, length);
+        memcpy(shadow + start, out + size + 3, length);
+        size += 3 + length;
+        start += length;
+    }
+
+    if (size == 2) {
+        return 0;
+    }
+
+    if (start < 512) {
+        *callAgain = (memcmp(current + start, shadow + start, 512 - start) != 0);
+    }
+
+    // Terminate the list if there is room, otherwise the size tells the end
+    if (size + 3 <= outSize) {
+        memset(out + size, 0x00, 3);
+    }
+
+    stats.deltasSent++;
+
+    return size;
+}
+
+bool Edp::prepareDmxDataRequest(uint8_t universeId) {
+    if ((!initOkay) || (universeId >= 64)) {
+        return false;
+    }
+
+    uint8_t message[sizeof(Edp_Commands) + 1];
+    message[0] = Edp_Commands::DmxDataRequest;
+    message[1] = universeId;
+    if (!queueControlData(message, sizeof(message), 0)) {
+        return false;
+    }
+    stats.dmxDataRequestsSent++;
+
+    return true;
+}
+
+bool Edp::prepareDiscoveryRequest(const uint8_t* lowerBound, const uint8_t* upperBound, uint8_t slotCount, uint8_t slotTime, uint8_t round) {
+    struct Edp_DiscoveryRequest request;
+
+    if (!initOkay) {
+        return false;
+    }
+
+    memcpy(request.lowerBound, lowerBound, sizeof(request.lowerBound));
+    memcpy(request.upperBound, upperBound, sizeof(request.upperBound));
+    request.slotCount = MAX(slotCount, 1);
+    request.slotTime = slotTime;
+    request.round = round;
+
+    uint8_t message[sizeof(Edp_Commands) + sizeof(struct Edp_DiscoveryRequest)];
+    message[0] = Edp_Commands::DiscoveryRequest;
+    memcpy(message + sizeof(Edp_Commands), &request, sizeof(struct Edp_DiscoveryRequest));
+
+    return queueControlData(message, sizeof(message), 0);
+}
+
+bool Edp::prepareDiscoveryMute(const uint8_t* serial) {
+    if (!initOkay) {
+        return false;
+    }
+
+    uint8_t message[sizeof(Edp_Commands) + sizeof(this->serial)];
+    message[0] = Edp_Commands::DiscoveryMute;
+    memcpy(message + sizeof(Edp_Commands), serial, sizeof(this->serial));
+
+    return queueControlData(message, sizeof(message), 0);
+}
+
+bool Edp::prepareDiscoveryUnMuteAll() {
+    if (!initOkay) {
+        return false;
+    }
+
+    uint8_t message = Edp_Commands::DiscoveryUnMuteAll;
+
+    return queueControlData(&message, sizeof(message), 0);
+}
+
+// Messages of the same kind replace each other instead of queueing up: pongs
+// to the same requester, requests for the same universe, mutes of the same
+// node and every other command on its own. A replaced message keeps its place
+bool Edp::queueControlData(const uint8_t* data, uint8_t size, uint32_t delay) {
+    uint8_t keySize = sizeof(Edp_Commands);
+    uint8_t index;
+
+    if ((size == 0) || (size > EDP_CONTROL_DATA_SIZE)) {
+        return false;
+    }
+
+    if ((data[0] == Edp_Commands::Pong) || (data[0] == Edp_Commands::DiscoveryMute)) {
+        keySize += sizeof(serial);
+    } else if (data[0] == Edp_Commands::DmxDataRequest) {
+        keySize += 1;
+    }
+    keySize = MIN(keySize, size);
+
+    for (index = 0; index < controlQueueCount; index++) {
+        if ((controlQueue[index].size >= keySize) &&
+            (!memcmp(controlQueue[index].data, data, keySize)))
+        {
+            break;
+        }
+    }
+
+    if (index >= EDP_CONTROL_QUEUE) {
+        LOG("EDP control queue full, dropping command %u", data[0]);
+        return false;
+    }
+    if (index == controlQueueCount) {
+        controlQueueCount++;
+    }
+
+    memcpy(controlQueue[index].data, data, size);
+    controlQueue[index].size = size;
+    controlQueue[index].due = time_us_32() + delay;
+
+    return true;
+}
+
+void Edp::removeControlData(uint8_t index) {
+    if (index >= controlQueueCount) {
+        return;
+    }
+
+    controlQueueCount--;
+    for (uint8_t i = index; i < controlQueueCount; i++) {
+        controlQueue[i] = controlQueue[i + 1];
+    }
+}
+
+// The oldest message that is due goes first. Discovery responses wait for
+// their slot without holding up anything queued after them
+bool Edp::takeControlData(uint16_t* thisChunkSize) {
+    for (uint8_t i = 0; i < controlQueueCount; i++) {
+        if ((int32_t)(time_us_32() - controlQueue[i].due) < 0) {
+            continue;
+        }
+
+        memcpy(controlData, controlQueue[i].data, controlQueue[i].size);
+        *thisChunkSize = controlQueue[i].size;
+        removeControlData(i);
+        return true;
+    }
+
+    return false;
+}
+
+bool Edp::takeDmxDataRequest(uint8_t* universeId) {
+    if (dmxDataRequested == 0) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < 64; i++) {
+        if (dmxDataRequested & (1ULL << i)) {
+            dmxDataRequested &= ~(1ULL << i);
+            *universeId = i;
+            return true;
         }
     }
 
-    // Should not reach here!
     return false;
 }
 
+bool Edp::takeDiscoveryResponse(uint8_t* serial) {
+    if (!discoveryResponsePending) {
+        return false;
+    }
+
+    memcpy(serial, discoveryResponseSerial, sizeof(discoveryResponseSerial));
+    discoveryResponsePending = false;
+
+    return true;
+}
+
+bool Edp::takeHopSequence(struct Edp_HopSequence* sequence) {
+    if (!hopSequencePending) {
+        return false;
+    }
+
+    memcpy(sequence, &hopSequence, sizeof(struct Edp_HopSequence));
+    hopSequencePending = false;
+
+    return true;
+}
+
 // Find a patching patching from ETH -> buffer. All other patching destination
 // are NOT supported for now
 Patching Edp::findPatching(uint8_t universeId) {
@@ -13,15 +13,25 @@
 // Efficient Dmx Protocol Commands
 
 enum Edp_Commands : uint8_t {
-    Ping                      = 0x00, // Payload: Serial number of requester
-    Pong                      = 0x01, // Payload: Serial number of responder
+    Ping                      = 0x00, // Payload: Edp_PingPong (serial number + timestamp of requester)
+    Pong                      = 0x01, // Payload: The Edp_PingPong of the Ping, sent back unmodified
     DmxDataAllZero            = 0x10, // Followed by 1 byte (universeId), no chunk header, no packet header
     DmxData                   = 0x11, // One command for compressed and uncompressed data, sent in chunks
-    DmxDataRequest            = 0x12, // Poll the content of a universe
-    DiscoveryRequest          = 0x20,
-    DiscoveryRespone          = 0x21,
-    DiscoveryMute             = 0x22,
-    DiscoveryUnMuteAll        = 0x23,
+    DmxDataRequest            = 0x12, // Poll the content of a universe. Followed by 1 byte (universeId)
+    DmxDataBundle             = 0x13, // Several DmxData chunks or DmxDataAllZero frames, each prefixed
+                                      // by its length (uint16_t, little endian). Not chunked itself
+    DmxDataDelta              = 0x14, // Followed by 1 byte (universeId) and changed ranges, each as
+                                      // offset (uint16_t, little endian), length (uint8_t), data.
+                                      // A range of length 0 ends the list. Not chunked, every
+                                      // message can be applied on its own
+    DmxDataParity             = 0x15, // Sent after the last chunk of a DmxData frame if FEC is enabled.
+                                      // Chunk header (counter of the last data chunk), then the XOR of
+                                      // all chunk bodies (everything after the chunk header)
+    DiscoveryRequest          = 0x20, // Payload: Edp_DiscoveryRequest. Unmuted nodes in range answer in a random slot
+    DiscoveryRespone          = 0x21, // Payload: Edp_DiscoveryResponse
+    DiscoveryMute             = 0x22, // Followed by 8 byte (serial). That node stops answering DiscoveryRequests
+    DiscoveryUnMuteAll        = 0x23, // No payload. All nodes answer DiscoveryRequests again
+    HopSequence               = 0x30, // Payload: Edp_HopSequence. Channels to hop through and when to hop next
 };
 
 // The smallest chunk size this is designed to work on is 32 bytes (RF24 max payload length)
@@ -42,7 +52,8 @@ enum Edp_DmxData_ChunkCounter : uint8_t {
 
 // Should occupy one byte
 struct Edp_DmxData_ChunkHeader {
-    uint8_t                   RESERVED0    : 2; // Reserved for future use ;)
+    uint8_t                   RESERVED0    : 1; // Reserved for future use ;)
+    bool                      parity       : 1; // 1 = a DmxDataParity chunk follows the frame (FEC)
     Edp_DmxData_ChunkCounter  chunkCounter : 5;
     bool                      lastChunk    : 1; // 0 = first or middle chunk, 1 = last chunk
 };
@@ -56,14 +67,189 @@ struct Edp_DmxData_PacketHeader {
     uint8_t               sparseOffset;    // If sparse: Position the frame starts at
 };
 
+// 13 byte
+// The responder doesn't need to understand the content, it just copies it
+// into the Pong. That way, the requester can calculate the round-trip time
+// with its own clock and no clock sync between the two is required
+struct __attribute__((__packed__)) Edp_PingPong {
+    uint8_t               serial[8];       // Unique board id of the requester
+    uint32_t              timestamp;       // time_us_32() of the requester when the ping was sent
+    uint8_t               sequence;        // Incremented for every ping sent
+};
+
+// 19 byte
+// Discovery is slotted ALOHA: every unmuted node whose serial is within the
+// range picks one of slotCount slots at random and answers in it. The
+// requester mutes every node it heard and repeats until nobody answers anymore.
+// Serials are compared as big-endian numbers, so a requester can also split
+// the range if there are too many nodes for the available slots
+struct __attribute__((__packed__)) Edp_DiscoveryRequest {
+    uint8_t               lowerBound[8];   // Lowest serial that should answer
+    uint8_t               upperBound[8];   // Highest serial that should answer
+    uint8_t               slotCount;       // Number of slots to chose from (at least 1)
+    uint8_t               slotTime;        // Length of one slot, in 100us
+    uint8_t               round;           // Copied into the response
+};
+
+// 9 byte
+struct __attribute__((__packed__)) Edp_DiscoveryResponse {
+    uint8_t               serial[8];       // Unique board id of the responder
+    uint8_t               round;           // Round of the request that is answered
+};
+
+// Most channels a hop sequence can have
+#define EDP_HOP_MAX_CHANNELS 8
+
+// 17 byte
+// Sent by the hop master right after every hop and whenever the channels
+// change. Receivers hop to channels[nextIndex] in `remaining` us and go on
+// from there every dwellTime ms
+struct __attribute__((__packed__)) Edp_HopSequence {
+    uint8_t               sequenceId;      // Incremented whenever the channels change
+    uint8_t               channelCount;    // 1 to EDP_HOP_MAX_CHANNELS
+    uint8_t               nextIndex;       // Index into channels of the next hop
+    uint16_t              dwellTime;       // Time on one channel, in ms
+    uint32_t              remaining;       // Time until the next hop, in us
+    uint8_t               channels[EDP_HOP_MAX_CHANNELS];
+};
+
+// Smallest chunk prepareDmxData creates when asked to limit a chunk:
+// command + chunk header + packet header + 2 byte payload
+#define EDP_MIN_CHUNK_SIZE 8
+
+// Two ranges of a DmxDataDelta closer than this are sent as one range, since
+// the range header would be larger than the unchanged data in between
+#define EDP_DELTA_MERGE_GAP 3
+
+// FEC keeps the parity of the frame being sent, so it's limited to small chunks
+#define EDP_FEC_MAX_CHUNK_SIZE 64
+
+// Value for "no chunk" in incoming_missingChunk and incoming_lastChunk
+#define EDP_NO_CHUNK 0xff
+
+// Control messages (Ping, Pong, DmxDataRequest, Discovery*) always fit into one chunk
+// of the smallest transport (RF24: 32 byte)
+#define EDP_CONTROL_DATA_SIZE 32
+
+// Control messages waiting to be sent. A discovery response can wait for its
+// slot for a while, pongs and keyframe requests queue up behind it instead of
+// replacing it
+#define EDP_CONTROL_QUEUE 4
+
+// Statistics for one link (= one instance of Edp)
+struct EdpStats {
+    uint32_t pingsSent;                // Pings we sent
+    uint32_t pingsAnswered;            // Pings we received and answered with a pong
+    uint32_t pongsReceived;            // Pongs we received for our own pings
+    uint32_t rttLast;                  // Round-trip time of the last pong, in us
+    uint32_t rttMin;                   // Smallest round-trip time seen, in us
+    uint32_t rttMax;                   // Largest round-trip time seen, in us
+    uint32_t rttAvg;                   // Exponentially smoothed round-trip time, in us
+    uint32_t framesReceived;           // DmxData frames that were complete and had a valid CRC
+    uint32_t framesCrcError;           // DmxData frames discarded because of a CRC mismatch
+    uint32_t framesChunkGap;           // DmxData frames discarded because chunks were missing
+    uint32_t dmxDataRequestsSent;      // Keyframes we requested from the sender
+    uint32_t dmxDataRequestsReceived;  // Keyframes a receiver requested from us
+    uint32_t discoveryAnswered;        // DiscoveryRequests we answered
+    uint32_t framesSent;               // DmxData and DmxDataAllZero frames prepared for sending
+    uint32_t chunksSent;               // Chunks those frames were split into
+    uint32_t bytesSent;                // Total size of those chunks
+    uint32_t overheadBytesSent;        // Part of bytesSent that is not DMX data (headers)
+    uint32_t deltasSent;               // DmxDataDelta messages prepared for sending
+    uint32_t framesSparse;             // DmxData frames sent sparse
+    uint32_t framesCompressed;         // DmxData frames sent snappy-compressed
+    uint32_t compressionSkipped;       // Frames snappy wasn't tried for since it wouldn't save a chunk
+    uint32_t parityChunksSent;         // DmxDataParity chunks sent (FEC)
+    uint32_t framesRecovered;          // DmxData frames completed with a lost chunk rebuilt from the parity
+};
+
+// Per universe receive counters. The transport provides them (see
+// setUniverseStats) if it wants them, Edp only counts
+struct EdpUniverseStats {
+    uint32_t framesReceived;           // Complete frames with a valid CRC (incl. DmxDataAllZero)
+    uint32_t framesCrcError;           // Frames discarded because of a CRC mismatch
+};
+
+struct EdpControlEntry {
+    uint8_t data[EDP_CONTROL_DATA_SIZE];
+    uint8_t size;
+    uint32_t due;                      // time_us_32() when it may be sent
+};
+
+// Called with every complete frame instead of writing it to the DmxBuffer
+// (see setMergeHandler). data is always the start of the universe, length
+// up to 512 byte, the rest is zero
+typedef void (*EdpMergeHandler)(void* context, uint8_t sourceId, uint8_t bufferId, const uint8_t* data, uint16_t length);
+
 class Edp {
   public:
     void init(uint8_t* inData, uint8_t* outData, uint16_t maxSendChunkSize, PatchType patchSource);
 
-    // TODO: Chunk generation with buffer, universe id and max chunk size given
-    bool prepareDmxData(uint8_t universeId, uint16_t inDataSize, uint16_t* thisChunkSize, bool* callAgain);
+    bool setMaxSendChunkSize(uint16_t maxSendChunkSize);
+    uint16_t getMaxSendChunkSize() { return maxSendChunkSize; }
+
+    // Which encodings prepareDmxData may use. Both are allowed after init.
+    // Sparse is used whenever allowed, compression only if it saves a chunk.
+    // fragmentSize (if not 0) is the packet size of a transport that splits
+    // our chunks further, those packets are counted instead of chunks then
+    void setEncoding(bool allowCompression, bool allowSparse, uint16_t fragmentSize = 0);
+
+    // Send a DmxDataParity chunk after every DmxData frame. Receivers can
+    // rebuild one lost chunk per frame from it. Only possible for chunk
+    // sizes up to EDP_FEC_MAX_CHUNK_SIZE
+    bool setFec(bool enabled);
+
+    // chunkSizeLimit (if not 0) makes only this chunk smaller than maxSendChunkSize
+    bool prepareDmxData(uint8_t universeId, uint16_t inDataSize, uint16_t* thisChunkSize, bool* callAgain, uint16_t chunkSizeLimit = 0);
+
+    // Compare current to shadow (what the other side has seen so far) and
+    // put as many changed ranges as fit into outSize byte of out. shadow is
+    // updated with what has been put into out. Returns the message size,
+    // 0 if nothing changed. callAgain is set if there are more changes
+    uint16_t prepareDmxDataDelta(uint8_t universeId, const uint8_t* current, uint8_t* shadow, uint8_t* out, uint16_t outSize, bool* callAgain);
 
     bool processIncomingChunk(uint16_t chunkSize);
+    bool processIncomingChunk(const uint8_t* chunk, uint16_t chunkSize);
+
+    // Control messages are queued instead of prepared in outData so they
+    // don't interfere with a DmxData frame being sent or assembled. The
+    // transport sends controlData as soon as takeControlData returns true.
+    // A newer message of the same kind (e.g. a pong to the same requester)
+    // replaces the queued one, if the queue is full the new one is dropped
+    bool preparePing();
+    bool prepareDmxDataRequest(uint8_t universeId);
+    bool prepareDiscoveryRequest(const uint8_t* lowerBound, const uint8_t* upperBound, uint8_t slotCount, uint8_t slotTime, uint8_t round);
+    bool prepareDiscoveryMute(const uint8_t* serial);
+    bool prepareDiscoveryUnMuteAll();
+    bool takeControlData(uint16_t* thisChunkSize);
+    bool controlDataPending() { return controlQueueCount != 0; }
+
+    // Returns true (one universe per call) if the other side asked us to
+    // send a universe again (DmxDataRequest)
+    bool takeDmxDataRequest(uint8_t* universeId);
+
+    // Returns true if a DiscoveryRespone came in. Only of interest for the
+    // one running the discovery (see EdpDiscovery)
+    bool takeDiscoveryResponse(uint8_t* serial);
+
+    // Count received frames per universe in stats[0] to stats[count-1]
+    void setUniverseStats(struct EdpUniverseStats* stats, uint8_t count);
+
+    // Returns true if a HopSequence came in since the last call
+    bool takeHopSequence(struct Edp_HopSequence* sequence);
+
+    // A transport that receives from several sources, one Edp each, can
+    // decide what ends up in the DmxBuffer if more than one of them is
+    // patched to the same buffer. handler = nullptr writes directly again
+    void setMergeHandler(EdpMergeHandler handler, void* context, uint8_t sourceId);
+
+    // DmxData* commands (the ones that end up in a DmxBuffer)
+    static bool isDmxData(uint8_t command);
+
+    uint8_t serial[8];                // Our own unique board id
+
+    uint8_t controlData[EDP_CONTROL_DATA_SIZE];
+    struct EdpStats stats;
 
   private:
     bool initOkay;
@@ -71,11 +257,56 @@ class Edp {
     uint8_t* inData;
     uint8_t* outData;
     uint16_t maxSendChunkSize;
+    bool allowCompression;
+    bool allowSparse;
+    uint16_t fragmentSize;
+    bool fecEnabled;
 
     size_t prepareDmxData_sizeOfDataToBeSent;  // Packetheader + payload length
     uint16_t prepareDmxData_chunkOffset;
+    bool prepareDmxData_parityDue;             // The parity chunk is sent on the next call
+    uint16_t prepareDmxData_paritySize;        // Size of the largest chunk body so far
+    uint8_t parity[EDP_FEC_MAX_CHUNK_SIZE];
+
+    struct EdpControlEntry controlQueue[EDP_CONTROL_QUEUE];
+    uint8_t controlQueueCount;
+    uint8_t pingSequence;
+    bool queueControlData(const uint8_t* data, uint8_t size, uint32_t delay);
+    void removeControlData(uint8_t index);
+    uint64_t dmxDataRequested;        // Bit field, one bit per universeId
+
+    bool incoming_assembling;         // True while the chunks of a frame come in
+    uint8_t incoming_expectedChunk;   // Chunk counter of the next chunk we expect
+    uint8_t incoming_universeId;      // Universe of the frame being assembled
+    uint8_t incoming_missingChunk;    // Chunk that got lost, waiting for the parity to rebuild it
+    uint8_t incoming_lastChunk;       // Counter of the last chunk if it came in while waiting for the parity
+    bool incoming_frameDone;          // The last frame is complete, its parity isn't needed
+
+    bool discoveryMuted;              // Don't answer DiscoveryRequests until unmuted
+    bool discoveryResponsePending;
+    uint8_t discoveryResponseSerial[8];
 
+    bool hopSequencePending;
+
+    struct EdpUniverseStats* universeStats;
+    uint8_t universeStatsCount;
+    struct Edp_HopSequence hopSequence;
+
+    EdpMergeHandler mergeHandler;
+    void* mergeContext;
+    uint8_t mergeSourceId;
+    void writeBuffer(uint8_t bufferId, uint8_t* data, uint16_t length);
+
+    bool applyDmxData(const struct Edp_DmxData_PacketHeader* packetHeader, const uint8_t* payload, uint16_t payloadSize, uint8_t* scratch);
     Patching findPatching(uint8_t universeId);
+
+    void addToParity(uint16_t chunkSize);
+    bool processParityChunk(const uint8_t* chunk, uint16_t chunkSize);
+    void frameLost();
+
+    uint16_t chunksNeeded(uint16_t size, uint16_t firstChunkSize);
+    uint16_t maxSizeForChunks(uint16_t chunks, uint16_t firstChunkSize);
+    static uint16_t estimateCompressionSavings(const uint8_t* data, uint16_t size);
 };
 
 #endif // __cplusplus
@@ -0,0 +1,191 @@
+#include "edp_discovery.h"
+
+#include "log.h"
+
+extern "C" {
+#include <bsp/board.h>
+}
+
+static const uint8_t serialLowest[8]  = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+static const uint8_t serialHighest[8] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+void EdpDiscovery::init(Edp* edp) {
+    this->edp = edp;
+    this->state = EdpDiscoveryState::idle;
+    this->startRequested = false;
+    this->nodeCount = 0;
+
+    memset(this->nodes, 0x00, sizeof(this->nodes));
+    memset(&this->stats, 0x00, sizeof(struct EdpDiscoveryStats));
+}
+
+// The actual start happens in cyclicTask, on the core that runs the transport
+void EdpDiscovery::start() {
+    startRequested = true;
+}
+
+bool EdpDiscovery::isRunning() {
+    return startRequested || (state != EdpDiscoveryState::idle);
+}
+
+void EdpDiscovery::cyclicTask() {
+    if (!edp) {
+        return;
+    }
+
+    if (startRequested) {
+        startRequested = false;
+
+        // Known nodes stay in the table so patchings referring to them don't
+        // break. They are simply found (and muted) again
+        for (uint8_t i = 0; i < nodeCount; i++) {
+            nodes[i].needsMute = false;
+        }
+        memset(&stats, 0x00, sizeof(struct EdpDiscoveryStats));
+        stats.startedAt = board_millis();
+
+        round = 0;
+        slotCount = EDP_DISCOVERY_START_SLOTS;
+        quietRounds = 0;
+        unmutesSent = 0;
+        state = EdpDiscoveryState::unmute;
+        LOG("EDP Discovery started");
+    }
+
+    if (state == EdpDiscoveryState::idle) {
+        return;
+    }
+
+    // Wait for the transport to send what we prepared before
+    if (edp->controlDataPending()) {
+        return;
+    }
+
+    switch (state) {
+        case EdpDiscoveryState::unmute:
+            // Sent twice since there is no answer telling us it arrived
+            edp->prepareDiscoveryUnMuteAll();
+            unmutesSent++;
+            if (unmutesSent >= 2) {
+                state = EdpDiscoveryState::request;
+            }
+            break;
+
+        case EdpDiscoveryState::request:
+            if (stats.rounds >= EDP_DISCOVERY_MAX_ROUNDS) {
+                LOG("EDP Discovery: Giving up after %u rounds", stats.rounds);
+                finish();
+                break;
+            }
+            edp->prepareDiscoveryRequest(serialLowest, serialHighest, slotCount, EDP_DISCOVERY_SLOT_TIME, round);
+            stats.rounds++;
+            responsesThisRound = 0;
+            listenUntil = time_us_32() + (uint32_t)slotCount * EDP_DISCOVERY_SLOT_TIME * 100 + EDP_DISCOVERY_LISTEN_MARGIN_US;
+            state = EdpDiscoveryState::listen;
+            break;
+
+        case EdpDiscoveryState::listen:
+            if ((int32_t)(time_us_32() - listenUntil) < 0) {
+                break;
+            }
+
+            LOG("EDP Discovery: Round %u, %u slots, %u responses", round, slotCount, responsesThisRound);
+
+            // A round without any response could also mean that all responses
+            // collided, so the last rounds are done with more slots. Only
+            // quiet rounds with enough of them count
+            if (responsesThisRound == 0) {
+                if (slotCount >= EDP_DISCOVERY_QUIET_SLOTS) {
+                    quietRounds++;
+                }
+                if (quietRounds >= EDP_DISCOVERY_QUIET_ROUNDS) {
+                    finish();
+                    break;
+                }
+                slotCount = MIN(slotCount * 2, EDP_DISCOVERY_MAX_SLOTS);
+            } else {
+                quietRounds = 0;
+                // Only a third of the slots with a readable response means
+                // many collisions. Very few responses means wasted airtime
+                if (responsesThisRound * 3 > slotCount) {
+                    slotCount = MIN(slotCount * 2, EDP_DISCOVERY_MAX_SLOTS);
+                } else if (responsesThisRound * 8 < slotCount) {
+                    slotCount = MAX(slotCount / 2, EDP_DISCOVERY_MIN_SLOTS);
+                }
+            }
+
+            round++;
+            state = EdpDiscoveryState::mute;
+            break;
+
+        case EdpDiscoveryState::mute:
+            // One mute per call, then on to the next round
+            for (uint8_t i = 0; i < nodeCount; i++) {
+                if (nodes[i].needsMute) {
+                    nodes[i].needsMute = false;
+                    edp->prepareDiscoveryMute(nodes[i].serial);
+                    stats.mutesSent++;
+                    return;
+                }
+            }
+            state = EdpDiscoveryState::request;
+            break;
+
+        default:
+            break;
+    }
+}
+
+void EdpDiscovery::handleResponse(const uint8_t* serial) {
+    int index;
+    char serialString[EDP_SERIAL_STRING_SIZE];
+
+    if (state == EdpDiscoveryState::idle) {
+        return;
+    }
+
+    stats.responses++;
+    if (state == EdpDiscoveryState::listen) {
+        responsesThisRound++;
+    }
+
+    index = findNode(serial);
+    if (index < 0) {
+        serialToString(serial, serialString);
+        if (nodeCount >= EDP_DISCOVERY_MAX_NODES) {
+            LOG("EDP Discovery: Node table full, ignoring %s", serialString);
+            return;
+        }
+        index = nodeCount;
+        nodeCount++;
+        memcpy(nodes[index].serial, serial, sizeof(nodes[index].serial));
+        nodes[index].firstSeen = board_millis();
+        LOG("EDP Discovery: New node %s", serialString);
+    }
+
+    // If it answered again, our previous mute got lost
+    nodes[index].lastSeen = board_millis();
+    nodes[index].needsMute = true;
+}
+
+int EdpDiscovery::findNode(const uint8_t* serial) {
+    for (uint8_t i = 0; i < nodeCount; i++) {
+        if (!memcmp(nodes[i].serial, serial, sizeof(nodes[i].serial))) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Same format as BoardConfig::boardSerialString
+void EdpDiscovery::serialToString(const uint8_t* serial, char* out) {
+    snprintf(out, EDP_SERIAL_STRING_SIZE, "dmxsun_%02x%02x%02x%02x%02x%02x%02x%02x",
+        serial[0], serial[1], serial[2], serial[3],
+        serial[4], serial[5], serial[6], serial[7]);
+}
+
+void EdpDiscovery::finish() {
+    stats.duration = board_millis() - stats.startedAt;
+    state = EdpDiscoveryState::idle;
+    LOG("EDP Discovery done. %u nodes known, %u rounds, %u ms", nodeCount, stats.rounds, stats.duration);
+}
@@ -0,0 +1,98 @@
+#ifndef EDP_DISCOVERY_H
+#define EDP_DISCOVERY_H
+
+#ifdef __cplusplus
+
+#include "edp.h"
+
+// How many nodes we can remember
+#define EDP_DISCOVERY_MAX_NODES 64
+
+// The number of slots adapts to how many nodes answer per round
+#define EDP_DISCOVERY_MIN_SLOTS 8
+#define EDP_DISCOVERY_MAX_SLOTS 128
+#define EDP_DISCOVERY_START_SLOTS 16
+
+// Length of one slot in 100us. Has to fit one response incl. ACK on the radio
+#define EDP_DISCOVERY_SLOT_TIME 10
+
+// Extra time to wait after the last slot, in us
+#define EDP_DISCOVERY_LISTEN_MARGIN_US 2000
+
+// Discovery is done after that many rounds in a row without any response,
+// with at least EDP_DISCOVERY_QUIET_SLOTS slots each. With less, 64 nodes
+// starting at 16 slots can collide in every slot for two rounds
+// (see tests/sim_discovery.cpp)
+#define EDP_DISCOVERY_QUIET_ROUNDS 2
+#define EDP_DISCOVERY_QUIET_SLOTS 32
+
+// Upper bound so discovery always ends, even on a very noisy channel
+#define EDP_DISCOVERY_MAX_ROUNDS 64
+
+// "dmxsun_" + 16 hex digits + terminator, see serialToString
+#define EDP_SERIAL_STRING_SIZE 24
+
+struct EdpDiscoveredNode {
+    uint8_t serial[8];
+    uint32_t firstSeen;                // board_millis()
+    uint32_t lastSeen;                 // board_millis()
+    bool needsMute;                    // It answered, we still need to mute it
+};
+
+struct EdpDiscoveryStats {
+    uint32_t startedAt;                // board_millis() when the last discovery started
+    uint32_t duration;                 // How long the last discovery took, in ms
+    uint32_t rounds;                   // DiscoveryRequests sent in the last discovery
+    uint32_t responses;                // Responses received in the last discovery
+    uint32_t mutesSent;                // DiscoveryMutes sent in the last discovery
+};
+
+enum EdpDiscoveryState : uint8_t {
+    idle,
+    unmute,
+    request,
+    listen,
+    mute,
+};
+
+// Runs the controller side of the discovery over one Edp instance. The
+// transport calls cyclicTask, sends whatever ends up in the Edp's controlData
+// and hands in all DiscoveryResponses it got
+class EdpDiscovery {
+  public:
+    void init(Edp* edp);
+    void cyclicTask();
+
+    void start();
+    bool isRunning();
+    void handleResponse(const uint8_t* serial);
+
+    // Returns the index into nodes or -1 if that node is unknown
+    int findNode(const uint8_t* serial);
+
+    // Writes the serial as text to out (EDP_SERIAL_STRING_SIZE byte)
+    static void serialToString(const uint8_t* serial, char* out);
+
+    struct EdpDiscoveredNode nodes[EDP_DISCOVERY_MAX_NODES];
+    uint8_t nodeCount;
+
+    struct EdpDiscoveryStats stats;
+
+  private:
+    Edp* edp;
+    EdpDiscoveryState state;
+    volatile bool startRequested;      // start() may be called from the other core
+
+    uint8_t round;
+    uint8_t slotCount;
+    uint8_t quietRounds;
+    uint8_t unmutesSent;
+    uint8_t responsesThisRound;
+    uint32_t listenUntil;              // time_us_32()
+
+    void finish();
+};
+
+#endif // __cplusplus
+
+#endif // EDP_DISCOVERY_H
@@ -0,0 +1,267 @@
+#include "jsonwriter.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+extern "C" {
+  #include <b64/cencode.h>
+}
+
+JsonWriter::JsonWriter(char* buffer, size_t size, size_t skip) {
+    this->buffer = buffer;
+    this->size = buffer ? size : 0;
+    this->skip = skip;
+    this->position = 0;
+    this->written = 0;
+    this->overflow = false;
+    this->depth = 0;
+    this->first[0] = true;
+    this->afterKey = false;
+}
+
+void JsonWriter::beginObject() {
+    begin('{');
+}
+
+void JsonWriter::beginObject(const char* key) {
+    this->key(key);
+    begin('{');
+}
+
+void JsonWriter::endObject() {
+    end('}');
+}
+
+void JsonWriter::beginArray() {
+    begin('[');
+}
+
+void JsonWriter::beginArray(const char* key) {
+    this->key(key);
+    begin('[');
+}
+
+void JsonWriter::endArray() {
+    end(']');
+}
+
+void JsonWriter::key(const char* key) {
+    separate();
+    string(key, strlen(key));
+    put(':');
+    afterKey = true;
+}
+
+void JsonWriter::value(const char* value) {
+    if (!value) {
+        valueNull();
+        return;
+    }
+    separate();
+    string(value, strlen(value));
+}
+
+void JsonWriter::value(std::string_view value) {
+    separate();
+    string(value.data(), value.size());
+}
+
+void JsonWriter::value(bool value) {
+    separate();
+    if (value) {
+        put("true", 4);
+    } else {
+        put("false", 5);
+    }
+}
+
+void JsonWriter::value(int value) {
+    this->value((long long)value);
+}
+
+void JsonWriter::value(unsigned int value) {
+    this->value((unsigned long long)value);
+}
+
+void JsonWriter::value(long value) {
+    this->value((long long)value);
+}
+
+void JsonWriter::value(unsigned long value) {
+    this->value((unsigned long long)value);
+}
+
+void JsonWriter::value(long long value) {
+    separate();
+    if (value < 0) {
+        // Negate as unsigned, -LLONG_MIN doesn't fit into long long
+        number(0ULL - (unsigned long long)value, true);
+    } else {
+        number(value, false);
+    }
+}
+
+void JsonWriter::value(unsigned long long value) {
+    separate();
+    number(value, false);
+}
+
+void JsonWriter::value(double value) {
+    char text[32];
+    int length;
+
+    if (!std::isfinite(value)) {
+        valueNull();
+        return;
+    }
+
+    separate();
+    length = snprintf(text, sizeof(text), "%.6g", value);
+    if ((length <= 0) || ((size_t)length >= sizeof(text))) {
+        return;
+    }
+    // Keep it a floating point number for whoever reads it, like 0.0
+    // instead of 0. jsoncpp did the same
+    if (!strpbrk(text, ".e")) {
+        text[length++] = '.';
+        text[length++] = '0';
+    }
+    put(text, length);
+}
+
+void JsonWriter::valueNull() {
+    separate();
+    put("null", 4);
+}
+
+void JsonWriter::base64(const uint8_t* data, size_t size) {
+    base64_encodestate state;
+    // 48 byte in give 64 characters out, plus some room for line breaks
+    char encoded[80];
+    size_t chunk;
+
+    separate();
+    put('"');
+    base64_init_encodestate(&state);
+    while (size) {
+        chunk = (size > 48) ? 48 : size;
+        put(encoded, base64_encode_block((const char*)data, chunk, encoded, &state));
+        data += chunk;
+        size -= chunk;
+    }
+    put(encoded, base64_encode_blockend(encoded, &state));
+    put('"');
+}
+
+void JsonWriter::base64(const char* key, const uint8_t* data, size_t size) {
+    this->key(key);
+    base64(data, size);
+}
+
+void JsonWriter::put(const char* data, size_t size) {
+    size_t skipped;
+
+    // That part has been taken by an earlier call already
+    if (position < skip) {
+        skipped = ((skip - position) < size) ? (skip - position) : size;
+        position += skipped;
+        data += skipped;
+        size -= skipped;
+    }
+
+    if (size > (this->size - written)) {
+        overflow = true;
+        size = this->size - written;
+    }
+
+    if (size) {
+        memcpy(buffer + written, data, size);
+    }
+    written += size;
+    position += size;
+}
+
+void JsonWriter::put(char c) {
+    put(&c, 1);
+}
+
+// Comma before everything but the first element of an object or array
+// and the value of a key
+void JsonWriter::separate() {
+    if (afterKey) {
+        afterKey = false;
+        return;
+    }
+    if (!first[depth]) {
+        put(',');
+    }
+    first[depth] = false;
+}
+
+void JsonWriter::begin(char c) {
+    separate();
+    put(c);
+    if (depth >= (JSONWRITER_MAX_DEPTH - 1)) {
+        // Can't keep track anymore, the document would be broken anyway
+        overflow = true;
+        return;
+    }
+    depth++;
+    first[depth] = true;
+}
+
+void JsonWriter::end(char c) {
+    if (depth) {
+        depth--;
+    }
+    put(c);
+}
+
+void JsonWriter::string(const char* data, size_t size) {
+    static const char hex[] = "0123456789abcdef";
+    char escaped[6] = { '\\', 'u', '0', '0', 0, 0 };
+    size_t start = 0;
+    unsigned char c;
+
+    put('"');
+    for (size_t i = 0; i < size; i++) {
+        c = data[i];
+        if ((c >= 0x20) && (c != '"') && (c != '\\')) {
+            continue;
+        }
+
+        // Everything up to here can go out as it is
+        put(data + start, i - start);
+        start = i + 1;
+
+        if ((c == '"') || (c == '\\')) {
+            escaped[1] = c;
+            put(escaped, 2);
+            escaped[1] = 'u';
+        } else {
+            escaped[4] = hex[c >> 4];
+            escaped[5] = hex[c & 0x0f];
+            put(escaped, 6);
+        }
+    }
+    put(data + start, size - start);
+    put('"');
+}
+
+void JsonWriter::number(unsigned long long value, bool negative) {
+    // 20 digits for 2^64 and the sign
+    char text[21];
+    uint8_t start = sizeof(text);
+
+    do {
+        text[--start] = '0' + (value % 10);
+        value /= 10;
+    } while (value);
+
+    if (negative) {
+        text[--start] = '-';
+    }
+
+    put(text + start, sizeof(text) - start);
+}
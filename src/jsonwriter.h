@@ -0,0 +1,84 @@
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <cstdint>
+#include <cstddef>
+
+#ifdef __cplusplus
+
+#include <string_view>
+
+// Deepest nesting of objects and arrays
+#define JSONWRITER_MAX_DEPTH 12
+
+// Writes JSON straight into a buffer given by the caller, no heap involved.
+// Keys and values come out in the order they are written, commas are added
+// as needed.
+//
+// What doesn't fit into the buffer is dropped and overflowed() returns true.
+// To get a document in parts, write it again with skip set to the number of
+// byte already taken. Only what comes after them lands in the buffer
+class JsonWriter {
+  public:
+    JsonWriter(char* buffer, size_t size, size_t skip = 0);
+
+    void beginObject();
+    void beginObject(const char* key);
+    void endObject();
+    void beginArray();
+    void beginArray(const char* key);
+    void endArray();
+
+    // Inside an object: key() followed by exactly one value or begin*().
+    // value(key, value) does both
+    void key(const char* key);
+
+    void value(const char* value);      // nullptr is written as null
+    void value(std::string_view value);
+    void value(bool value);
+    void value(int value);
+    void value(unsigned int value);
+    void value(long value);
+    void value(unsigned long value);
+    void value(long long value);
+    void value(unsigned long long value);
+    void value(double value);           // NaN and infinity are written as null
+    void valueNull();
+
+    template <typename T> void value(const char* key, T value) {
+        this->key(key);
+        this->value(value);
+    }
+
+    // A string with the base64 encoded data
+    void base64(const uint8_t* data, size_t size);
+    void base64(const char* key, const uint8_t* data, size_t size);
+
+    // Byte written to the buffer (never more than its size)
+    size_t length() { return written; }
+    bool overflowed() { return overflow; }
+
+  private:
+    char* buffer;
+    size_t size;
+    size_t skip;
+    size_t position;                    // In the whole document, including what's skipped
+    size_t written;
+    bool overflow;
+
+    uint8_t depth;
+    bool first[JSONWRITER_MAX_DEPTH];   // Nothing written at that level yet
+    bool afterKey;                      // Next value belongs to a key, no comma
+
+    void put(const char* data, size_t size);
+    void put(char c);
+    void separate();
+    void begin(char c);
+    void end(char c);
+    void string(const char* data, size_t size);
+    void number(unsigned long long value, bool negative);
+};
+
+#endif // __cplusplus
+
+#endif // JSONWRITER_H
@@ -5,6 +5,8 @@
 
 #include <tusb.h>
 
+#include "boardconfig.h"
+
 uint32_t Log::logLineCount;
 queue_t Log::logQueue;
 mutex_t Log::logLock;
@@ -29,7 +31,8 @@ void Log::dlog(char* file, uint32_t line, char* text) {
 
     // If ACM console IS connected, just print it
     // If ACM console is not connected, append to log buffer (of course size-limitig it)
-    if (tud_cdc_connected()) {
+    // With USB Pro emulation, the ACM interface is not a console
+    if (tud_cdc_connected() && (getUsbProtocol() != UsbProtocol::UsbPro)) {
         printf("{\"type\": \"log\", \"count\": %ld, \"core\": %u, \"file\": \"%s\", \"line\": %ld, \"text\": \"%s\"}\n", logLineCount, get_core_num(), fname.c_str(), line, text);
     } else {
         mutex_enter_blocking(&logLock);
@@ -72,6 +72,11 @@
 #define LWIP_HTTPD_MAX_TAG_NAME_LEN     64
 #define LWIP_HTTPD_SSI_INCLUDE_TAG      0
 #define LWIP_HTTPD_MAX_TAG_INSERT_LEN   2048
+#define LWIP_HTTPD_SSI_MULTIPART        1
+#define LWIP_HTTPD_FILE_STATE           1
+#define LWIP_HTTPD_CUSTOM_FILES         1
+#define LWIP_HTTPD_DYNAMIC_FILE_READ    1
+#define LWIP_HTTPD_SUPPORT_POST         1
 
 #define LWIP_HTTPD_SUPPORT_11_KEEPALIVE 1
 
@@ -35,11 +35,17 @@ extern "C" {
 #include "dhcpdata.h"
 
 #include "usb_EDP.h"
+#include "usb_JaRule.h"
 #include "usb_NodleU1.h"
+#include "usb_UsbPro.h"
+#include "usb_uDMX.h"
+#include "usb_vendor.h"
 
 #include "udp_artnet.h"
 #include "udp_e1_31.h"
 #include "udp_edp.h"
+#include "websocket.h"
+#include "dmxfade.h"
 
 extern "C" {
 #include <bsp/board.h>          // On-board-LED
@@ -145,6 +151,7 @@ int main() {
     // Phase 2b: Init our DMX buffers
     critical_section_init(&bufferLock);
     dmxBuffer.init();
+    DmxFade::init();
 
     // Phase 3: Make sure we have some configuration ready (includes Phase 3b)
     boardConfig.prepareConfig();
@@ -152,11 +159,18 @@ int main() {
     // Phase 4, USB configuration happens in usb_descriptors (boardConfig is queried)
     //          However, we would need to instantiate the relevant class here
     Usb_EDP::init();
+    Usb_JaRule::init();
     Usb_NodleU1::init();
+    Usb_UsbPro::init();
+    Usb_uDMX::init();
+    Usb_Vendor::init();
 
     // Phase 5: Enable the USB interface, the debugging console, ...
     tusb_init();
-    stdio_usb_init();
+    // USB Pro emulation needs the CDC interface for itself
+    if (getUsbProtocol() != UsbProtocol::UsbPro) {
+        stdio_usb_init();
+    }
     logger.init();
 
     // Phase 6: Fire up the integrated web server
@@ -197,6 +211,7 @@ int main() {
     Udp_ArtNet::init();
     Udp_E1_31::init();
     Udp_EDP::init();
+    WebSocket::init();
 
     // Finally, turn on the green component of the SYSTEM status LED
     statusLeds.setStaticOn(4, 0, 1, 0);
@@ -224,6 +239,9 @@ int main() {
     // Wireless is on core1 so waiting for ACKs won't slow down everything else
     while (true) {
         tud_task();
+        Usb_JaRule::cyclicTask();
+        Usb_UsbPro::cyclicTask();
+        Usb_Vendor::cyclicTask();
 
         if (tud_mounted()) {
             statusLeds.setStaticOn(5, 0, 1, 0);
@@ -234,6 +252,12 @@ int main() {
         webServer.cyclicTask(); // Make sure this is on core0 since it
                                 // WILL halt core1 when writing to the flash!
 
+        Usb_EDP::cyclicTask();
+        Usb_NodleU1::cyclicTask();
+        Udp_EDP::cyclicTask();
+        WebSocket::cyclicTask();
+        DmxFade::cyclicTask();
+
         if (BoardConfig::boardIsPicoW) {
             eth_cyw43.cyclicTask();
         }
@@ -0,0 +1,48 @@
+#include "pbuf_reader.h"
+
+#include <string.h>
+
+uint8_t PbufReader::scratch[PBUF_READER_SCRATCH_SIZE];
+
+PbufReader::PbufReader(const struct pbuf* p) {
+    if (p == NULL) {
+        start = scratch;
+        length = 0;
+        return;
+    }
+
+    if (p->len == p->tot_len) {
+        start = (const uint8_t*)p->payload;
+        length = p->len;
+        return;
+    }
+
+    // Chained: Copy what fits. pbuf_copy_partial walks the chain for us
+    length = pbuf_copy_partial(p, scratch, MIN(p->tot_len, PBUF_READER_SCRATCH_SIZE), 0);
+    start = scratch;
+}
+
+bool PbufReader::readU8(uint16_t offset, uint8_t* value) {
+    if (!has(offset, 1)) {
+        return false;
+    }
+    *value = start[offset];
+    return true;
+}
+
+bool PbufReader::readU16(uint16_t offset, uint16_t* value) {
+    if (!has(offset, 2)) {
+        return false;
+    }
+    *value = ((uint16_t)start[offset] << 8) | start[offset + 1];
+    return true;
+}
+
+bool PbufReader::readU32(uint16_t offset, uint32_t* value) {
+    if (!has(offset, 4)) {
+        return false;
+    }
+    *value = ((uint32_t)start[offset] << 24) | ((uint32_t)start[offset + 1] << 16) |
+             ((uint32_t)start[offset + 2] << 8) | start[offset + 3];
+    return true;
+}
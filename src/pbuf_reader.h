@@ -0,0 +1,52 @@
+#ifndef PBUF_READER_H
+#define PBUF_READER_H
+
+#include "pico/stdlib.h"
+
+#include "lwip/pbuf.h"
+
+#ifdef __cplusplus
+
+// Large enough for one full Ethernet frame
+#define PBUF_READER_SCRATCH_SIZE 1500
+
+// Read-only view on a received packet. If the packet sits in one pbuf (the
+// usual case), it is accessed right there. Only if it's spread over a chain
+// of pbufs, it is copied to a scratch buffer once.
+// All UDP receivers are called from lwIP on core0, one after the other, so
+// they can share that scratch buffer. Don't keep pointers beyond the callback
+class PbufReader {
+  public:
+    PbufReader(const struct pbuf* p);
+
+    // Bytes that can be accessed. Less than the packet length only if a
+    // chained packet is larger than the scratch buffer
+    uint16_t size() { return length; }
+
+    // Pointer to the whole packet or nullptr if it's empty
+    const uint8_t* data() { return length ? start : nullptr; }
+
+    // True if length bytes starting at offset are within the packet
+    bool has(uint16_t offset, uint16_t length) { return ((uint32_t)offset + length) <= this->length; }
+
+    // Pointer to length bytes at offset or nullptr if the packet is too short
+    const uint8_t* at(uint16_t offset, uint16_t length) { return has(offset, length) ? start + offset : nullptr; }
+
+    // Same for a (packed) header struct
+    template<typename T> const T* at(uint16_t offset) { return (const T*)at(offset, sizeof(T)); }
+
+    // Values in network byte order. Return false if out of bounds
+    bool readU8(uint16_t offset, uint8_t* value);
+    bool readU16(uint16_t offset, uint16_t* value);
+    bool readU32(uint16_t offset, uint32_t* value);
+
+  private:
+    const uint8_t* start;
+    uint16_t length;
+
+    static uint8_t scratch[PBUF_READER_SCRATCH_SIZE];
+};
+
+#endif // __cplusplus
+
+#endif // PBUF_READER_H
@@ -0,0 +1,84 @@
+#include "sha1.h"
+
+#include <cstring>
+
+static uint32_t rol(uint32_t value, uint8_t bits) {
+    return (value << bits) | (value >> (32 - bits));
+}
+
+static void sha1Block(uint32_t* state, const uint8_t* block) {
+    uint32_t w[80];
+    uint32_t a = state[0];
+    uint32_t b = state[1];
+    uint32_t c = state[2];
+    uint32_t d = state[3];
+    uint32_t e = state[4];
+    uint32_t f;
+    uint32_t k;
+    uint32_t temp;
+
+    for (uint8_t i = 0; i < 16; i++) {
+        w[i] = (block[i * 4] << 24) | (block[i * 4 + 1] << 16) | (block[i * 4 + 2] << 8) | block[i * 4 + 3];
+    }
+    for (uint8_t i = 16; i < 80; i++) {
+        w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    for (uint8_t i = 0; i < 80; i++) {
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5a827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ed9eba1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8f1bbcdc;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xca62c1d6;
+        }
+        temp = rol(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rol(b, 30);
+        b = a;
+        a = temp;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+void sha1(const uint8_t* data, size_t size, uint8_t* digest) {
+    uint32_t state[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+    uint8_t block[64];
+    uint64_t bits = (uint64_t)size * 8;
+    size_t remaining = size;
+
+    while (remaining >= 64) {
+        sha1Block(state, data);
+        data += 64;
+        remaining -= 64;
+    }
+
+    // Padding: 0x80, zeroes and the length in bits, big endian
+    memset(block, 0x00, sizeof(block));
+    memcpy(block, data, remaining);
+    block[remaining] = 0x80;
+    if (remaining >= 56) {
+        sha1Block(state, block);
+        memset(block, 0x00, sizeof(block));
+    }
+    for (uint8_t i = 0; i < 8; i++) {
+        block[63 - i] = bits >> (i * 8);
+    }
+    sha1Block(state, block);
+
+    for (uint8_t i = 0; i < SHA1_DIGEST_SIZE; i++) {
+        digest[i] = state[i / 4] >> (24 - (i % 4) * 8);
+    }
+}
@@ -0,0 +1,13 @@
+#ifndef SHA1_H
+#define SHA1_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SHA1_DIGEST_SIZE 20
+
+// Only needed once per WebSocket handshake (RFC 6455, section 4.2.2), so
+// this is the short version and not the fast one
+void sha1(const uint8_t* data, size_t size, uint8_t* digest);
+
+#endif // SHA1_H
@@ -86,16 +86,29 @@ extern "C" {
                                     // since it has been replaced by CFG_TUD_NCM
 #define CFG_TUD_NCM             1
 
+// Let the NCM driver pack several datagrams into one transfer block (NTB)
+// and have a second one to fill while the first is on the bus. Only used
+// by TinyUSB versions whose NCM driver supports that, ignored otherwise
+#define CFG_TUD_NCM_IN_NTB_MAX_SIZE  3200
+#define CFG_TUD_NCM_OUT_NTB_MAX_SIZE 3200
+#define CFG_TUD_NCM_IN_NTB_N         2
+#define CFG_TUD_NCM_OUT_NTB_N        1
+#define CFG_TUD_NCM_MAX_DATAGRAMS_PER_NTB 8
+
 // HID buffer size Should be sufficient to hold ID (if any) + Data
 #define CFG_TUD_HID_BUFSIZE     64
 
-#define CFG_TUD_CDC_RX_BUFSIZE 256
-#define CFG_TUD_CDC_TX_BUFSIZE 256
+// USB Pro emulation: RX holds two full DMX frames so the main loop may be
+// a bit late, TX one ReceivedDmx message
+#define CFG_TUD_CDC_RX_BUFSIZE 1024
+#define CFG_TUD_CDC_TX_BUFSIZE 1024
 
 // Vendor FIFO size of TX and RX
 // If not configured vendor endpoints will not be buffered
-#define CFG_TUD_VENDOR_RX_BUFSIZE 64
-#define CFG_TUD_VENDOR_TX_BUFSIZE 64
+// Several packets, so the next transfers are already running while
+// Usb_Vendor copies from/to the FIFO
+#define CFG_TUD_VENDOR_RX_BUFSIZE 512
+#define CFG_TUD_VENDOR_TX_BUFSIZE 512
 
 #ifdef __cplusplus
 }
@@ -42,6 +42,15 @@ static struct netif netif_data;
 /* shared between tud_network_recv_cb() and service_traffic() */
 static struct pbuf *received_frame;
 
+/* frames lwip wants to send while the NCM driver has no room for them */
+/* they are referenced (or cloned if volatile) and handed over from service_traffic() */
+#define NCM_TX_QUEUE_LEN 16
+static struct pbuf *tx_queue[NCM_TX_QUEUE_LEN];
+static uint8_t tx_queue_head;
+static uint8_t tx_queue_count;
+uint32_t ncm_tx_queued;
+uint32_t ncm_tx_dropped;
+
 /* this is used by this code, ./class/net/net_driver.c, and usb_descriptors.c */
 /* ideally speaking, this should be generated from the hardware's unique ID (if available) */
 /* it is suggested that the first byte is 0x02 to indicate a link-local address */
@@ -54,27 +63,83 @@ ip_addr_t gateway;
 ip_addr_t hostIp;
 ip_addr_t ownIp;
 
+/* hand queued frames to the NCM driver as long as it has room for them */
+/* the driver copies each frame into its transfer block in tud_network_xmit_cb(), so it can be released right after */
+static void flush_tx_queue(void)
+{
+    struct pbuf *p;
+
+    while (tx_queue_count && tud_ready())
+    {
+        p = tx_queue[tx_queue_head];
+        if (!tud_network_can_xmit(p->tot_len)) {
+            break;
+        }
+
+        tud_network_xmit(p, 0 /* unused */);
+        pbuf_free(p);
+
+        tx_queue[tx_queue_head] = NULL;
+        tx_queue_head = (tx_queue_head + 1) % NCM_TX_QUEUE_LEN;
+        tx_queue_count--;
+    }
+}
+
+static void clear_tx_queue(void)
+{
+    while (tx_queue_count)
+    {
+        pbuf_free(tx_queue[tx_queue_head]);
+        tx_queue[tx_queue_head] = NULL;
+        tx_queue_head = (tx_queue_head + 1) % NCM_TX_QUEUE_LEN;
+        tx_queue_count--;
+    }
+}
+
 static err_t linkoutput_fn(struct netif *netif, struct pbuf *p)
 {
+    struct pbuf *q;
+
     (void)netif;
 
-    for (;;)
+    /* if TinyUSB isn't ready, we must signal back to lwip that there is nothing we can do */
+    if (!tud_ready()) {
+        return ERR_USE;
+    }
+
+    /* older frames first, so nothing gets reordered */
+    flush_tx_queue();
+
+    /* if the network driver can accept another packet, we make it happen */
+    if (!tx_queue_count && tud_network_can_xmit(p->tot_len))
     {
-        /* if TinyUSB isn't ready, we must signal back to lwip that there is nothing we can do */
-        if (!tud_ready()) {
-            return ERR_USE;
-        }
+        tud_network_xmit(p, 0 /* unused */);
+        return ERR_OK;
+    }
 
-        /* if the network driver can accept another packet, we make it happen */
-        if (tud_network_can_xmit(p->tot_len))
-        {
-          tud_network_xmit(p, 0 /* unused for this example */);
-          return ERR_OK;
+    /* otherwise it waits for service_traffic(), we never spin here */
+    if (tx_queue_count >= NCM_TX_QUEUE_LEN) {
+        ncm_tx_dropped++;
+        return ERR_MEM;
+    }
+
+    /* same as etharp does when queueing: PBUF_REF payloads may change after we return */
+    if (PBUF_NEEDS_COPY(p)) {
+        q = pbuf_clone(PBUF_RAW, PBUF_RAM, p);
+        if (!q) {
+            ncm_tx_dropped++;
+            return ERR_MEM;
         }
-    
-      /* transfer execution to TinyUSB in the hopes that it will finish transmitting the prior packet */
-      tud_task();
-     }
+    } else {
+        q = p;
+        pbuf_ref(q);
+    }
+
+    tx_queue[(tx_queue_head + tx_queue_count) % NCM_TX_QUEUE_LEN] = q;
+    tx_queue_count++;
+    ncm_tx_queued++;
+
+    return ERR_OK;
 }
 
 static err_t output_fn(struct netif *netif, struct pbuf *p, const ip_addr_t *addr)
@@ -151,6 +216,9 @@ void tud_network_init_cb(void)
       pbuf_free(received_frame);
       received_frame = NULL;
     }
+
+    /* frames queued for the previous session are of no use anymore */
+    clear_tx_queue();
 }
 
 bool tud_network_recv_cb(const uint8_t *src, uint16_t size)
@@ -199,7 +267,10 @@ void service_traffic(void)
       received_frame = NULL;
       tud_network_recv_renew();
     }
-    
+
+    /* frames lwip could not hand over directly, e.g. a burst of ArtPollReplies */
+    flush_tx_queue();
+
     sys_check_timeouts();
 }
 
@@ -2,6 +2,7 @@
 
 #include "log.h"
 #include "dmxbuffer.h"
+#include "pbuf_reader.h"
 
 #include <string.h>
 
@@ -81,11 +82,13 @@ static void artnet_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip
 
 void Udp_ArtNet::receive(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port) {
     struct pbuf *p_send;
+    PbufReader reader(p);
 
     //LOG("Received UDP packet. Length: %d, Total: %d", p->len, p->tot_len);
 
-    if ((p->tot_len >= 12) && (!memcmp(p->payload, ArtNetId, 8))) {
-      struct ArtNet_Header* header = (struct ArtNet_Header*)p->payload;
+    const struct ArtNet_Header* header = reader.at<ArtNet_Header>(0);
+
+    if ((header != nullptr) && (!memcmp(header->id, ArtNetId, 8))) {
       //LOG("It's ArtNet :D OpCode: %04x, Version: %04x", header->opCode, header->protoVersion);
 
       if (header->protoVersion != 0x0e00) {
@@ -104,17 +107,23 @@ void Udp_ArtNet::receive(void *arg, struct udp_pcb *pcb, struct pbuf *p, const i
         break;
 
         case 0x5000:
-          struct ArtNet_OpDmx* dmx = (struct ArtNet_OpDmx*)((uint8_t*)p->payload + 12);
+          // Only the fixed part has to be there, data is checked below
+          const struct ArtNet_OpDmx* dmx = (const struct ArtNet_OpDmx*)reader.at(sizeof(struct ArtNet_Header), offsetof(struct ArtNet_OpDmx, data));
+          if (dmx == nullptr) {
+            return;
+          }
 
           // Need to swap bytes due to endianness
           uint16_t length = ntohs(dmx->length);
 
           LOG("ArtNet: OpDmx :D Sequence: %d, Physical: %d, Universe: %d, Length: %d", dmx->sequence, dmx->physical, dmx->universe, length);
 
+          // Never read beyond what was actually received
           length = MIN(length, 512);
+          length = MIN(length, reader.size() - sizeof(struct ArtNet_Header) - offsetof(struct ArtNet_OpDmx, data));
 
-          if (dmx->universe < DMXBUFFER_COUNT) {
-            dmxBuffer.setBuffer(dmx->universe, dmx->data, length);
+          if ((length > 0) && (dmx->universe < DMXBUFFER_COUNT)) {
+            dmxBuffer.setBuffer(dmx->universe, (uint8_t*)dmx->data, length);
           }
 
         break;
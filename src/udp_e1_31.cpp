@@ -3,6 +3,7 @@
 #include "log.h"
 #include "boardconfig.h"
 #include "dmxbuffer.h"
+#include "pbuf_reader.h"
 
 #include <string.h>
 
@@ -53,34 +54,32 @@ static void e1_31_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_
 void Udp_E1_31::receive(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port) {
   uint16_t universe = 0;
   uint16_t size = 0;
+  PbufReader reader(p);
 
   //LOG("Received UDP packet. Length: %d, Total: %d", p->len, p->tot_len);
-  
-  uint16_t* data = (uint16_t*)p->payload;
-  
-  if (p->tot_len < 36) {
+
+  const struct ACN_Header* header = reader.at<ACN_Header>(0);
+
+  if (header == nullptr) {
     return;
   }
-  
-  struct ACN_Header* header = (struct ACN_Header*)p->payload;
-  
+
   if ((header->preamble_size == 0x1000) &&
       (header->postamble_size == 0x0000) &&
       (!memcmp(header->acn_packet_identifier, AcnPacketIdentifier, 12)))
   {
     //LOG("It's E1.31 :D. Vector: %08x", header->vector);
-    
+
     switch (header->vector) {
       case 0x04000000:
-        if (p->tot_len < 114) {
+        const struct e1_31_framing_layer* framing = reader.at<e1_31_framing_layer>(sizeof(struct ACN_Header));
+        if (framing == nullptr) {
           return;
         }
 
-        struct e1_31_framing_layer* framing = (struct e1_31_framing_layer*)((uint8_t*)p->payload + 38);
-
         //LOG("flags: %04x, vector: %08x, source name: %s, sequence: %02x, universe: %04x",
         //  framing->flags_and_length, framing->vector, framing->source_name, framing->sequence_number, framing->universe);
-        
+
         universe = ntohs(framing->universe);
         // E1.31 starts to count at 1 instead of 0, so subtract 1
         if (universe > 0) {
@@ -91,26 +90,30 @@ void Udp_E1_31::receive(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip
           return;
         }
 
-        if (p->tot_len < 128) {
+        // Fixed part of the DMP layer incl. the start code
+        const uint16_t dmpOffset = sizeof(struct ACN_Header) + sizeof(struct e1_31_framing_layer);
+        const struct e1_31_dmp_layer* dmp = (const struct e1_31_dmp_layer*)reader.at(dmpOffset, offsetof(struct e1_31_dmp_layer, start_and_data) + 1);
+        if (dmp == nullptr) {
           return;
         }
-
-        struct e1_31_dmp_layer* dmp = (struct e1_31_dmp_layer*)((uint8_t*)p->payload + 115);
         // TODO: We assume FULL frames here for now
         // TODO: Byteswap all values ;)
 
         //LOG("flags: %04x, vector: %02x", dmp->flags_and_length, dmp->vector);
         //LOG("offset: %u, increments: %u, count: %u", dmp->first_property_address, dmp->address_increment, dmp->property_value_count);
 
+        // property_value_count includes the start code
         size = ntohs(dmp->property_value_count);
+        size = (size > 0) ? (size - 1) : 0;
 
         size = MIN(size, 512);
+        size = MIN(size, reader.size() - dmpOffset - offsetof(struct e1_31_dmp_layer, start_and_data) - 1);
 
         LOG("E1.31 DMX DATA IN. Universe: %u, Sequence: %02x, offset: %u, increments: %u, count: %u", universe, framing->sequence_number,
           ntohs(dmp->first_property_address), ntohs(dmp->address_increment), size);
 
-        if (universe < DMXBUFFER_COUNT) {
-          dmxBuffer.setBuffer(universe, dmp->start_and_data + 1, size);
+        if ((size > 0) && (universe < DMXBUFFER_COUNT)) {
+          dmxBuffer.setBuffer(universe, (uint8_t*)dmp->start_and_data + 1, size);
         }
         break;
     }
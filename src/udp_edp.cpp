@@ -1,23 +1,249 @@
 #include "udp_edp.h"
 
 #include "log.h"
+#include "pbuf_reader.h"
+
+#include "boardconfig.h"
+#include "dmxbuffer.h"
+
+extern BoardConfig boardConfig;
+extern DmxBuffer dmxBuffer;
+
+extern critical_section_t bufferLock;
 
 udp_pcb* Udp_EDP::pcb;
+ip_addr_t Udp_EDP::remoteAddr;
+u16_t Udp_EDP::remotePort;
 
 uint8_t Udp_EDP::tmpBuf[600];
 uint8_t Udp_EDP::tmpBuf2[600];
 Edp Udp_EDP::edp;
 
+uint64_t Udp_EDP::txPending;
+uint8_t Udp_EDP::txBufferId[64];
+uint32_t Udp_EDP::txDstIp[64];
+uint8_t Udp_EDP::txInBuf[600];
+uint8_t Udp_EDP::txOutBuf[600];
+Edp Udp_EDP::edpTX;
+
 // UDP recv callback (for C-based code, not part of the class)
 static void edp_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port) {
   Udp_EDP::receive(arg, pcb, p, addr, port);
+  pbuf_free(p);
 }
 
 void Udp_EDP::receive(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port) {
-    uint16_t size = MIN(p->tot_len, 600);
-    memcpy(tmpBuf, p->payload, size);
+    PbufReader reader(p);
+
+    // Parsed right where it is. That also allows bundles larger than tmpBuf
+    if (reader.size() > 0) {
+        edp.processIncomingChunk(reader.data(), reader.size());
+    }
+
+    // Answer pings and send keyframe requests back to where the data came from
+    ip_addr_copy(remoteAddr, *addr);
+    remotePort = port;
+    sendControlData();
+}
+
+// Discovery responses might have to wait for their slot, so they are sent
+// from here once they are due
+void Udp_EDP::cyclicTask() {
+    if (edp.controlDataPending()) {
+        sendControlData();
+    }
+
+    handleDmxDataRequests();
+    flushQueue();
+}
+
+// A receiver missed some chunks or got a broken frame. Queue the universe
+// again, to every destination it is patched to, so it gets a complete frame
+// without waiting for the next change
+void Udp_EDP::handleDmxDataRequests() {
+    uint8_t universeId;
+
+    while (edp.takeDmxDataRequest(&universeId)) {
+        for (uint8_t i = 0; i < MAX_PATCHINGS; i++) {
+            Patching patching = boardConfig.activeConfig->patching[i];
+            if ((!patching.active) ||
+                (patching.srcType != PatchType::buffer) ||
+                (patching.dstType != PatchType::ip) ||
+                (patching.dstInstance != universeId))
+            {
+                continue;
+            }
+            queueUniverse(universeId, patching.srcInstance, patching.ethDestParams);
+        }
+    }
+}
+
+void Udp_EDP::sendControlData() {
+    uint16_t replySize = 0;
+    if ((pcb != NULL) && edp.takeControlData(&replySize)) {
+        struct pbuf* p_send = pbuf_alloc(PBUF_TRANSPORT, replySize, PBUF_RAM);
+        if (p_send != NULL) {
+            memcpy(p_send->payload, edp.controlData, replySize);
+            udp_sendto(pcb, p_send, &remoteAddr, remotePort);
+            pbuf_free(p_send);
+        }
+    }
+}
+
+void Udp_EDP::queueUniverse(uint8_t universeId, uint8_t bufferId, uint8_t ethDestParams) {
+    uint32_t dstIp = 0;
+
+    if ((universeId >= 64) || (bufferId >= DMXBUFFER_COUNT)) {
+        return;
+    }
+
+    if (ethDestParams < (sizeof(boardConfig.activeConfig->ethDestParams) / sizeof(boardConfig.activeConfig->ethDestParams[0]))) {
+        memcpy(&dstIp, boardConfig.activeConfig->ethDestParams[ethDestParams].dstIp, sizeof(dstIp));
+    }
+    if (!dstIp) {
+        dstIp = boardConfig.activeConfig->hostIp;
+    }
+
+    critical_section_enter_blocking(&bufferLock);
+    txBufferId[universeId] = bufferId;
+    txDstIp[universeId] = dstIp;
+    txPending |= (1ULL << universeId);
+    critical_section_exit(&bufferLock);
+}
 
-    edp.processIncomingChunk(size);
+// Largest datagram that goes out to dstIp without fragmentation
+uint16_t Udp_EDP::maxDatagramSize(uint32_t dstIp) {
+    ip4_addr_t dst;
+    struct netif* netif;
+
+    ip4_addr_set_u32(&dst, dstIp);
+    netif = ip4_route(&dst);
+    if ((netif == NULL) || (netif->mtu <= (20 + 8 + 20))) {
+        return EDP_UDP_MAX_DATAGRAM;
+    }
+
+    return MIN(netif->mtu - 20 - 8, EDP_UDP_MAX_DATAGRAM);
+}
+
+void Udp_EDP::sendBundle(struct pbuf* p, uint16_t used, uint32_t dstIp) {
+    ip_addr_t dst;
+
+    pbuf_realloc(p, used);
+    ip_addr_set_ip4_u32(&dst, dstIp);
+    udp_sendto(pcb, p, &dst, EDP_UDP_PORT);
+    pbuf_free(p);
+}
+
+// Send all queued universes, as many per datagram as fit. lwIP is only
+// used from core0, so this is called from cyclicTask
+void Udp_EDP::flushQueue() {
+    uint64_t pending;
+    uint32_t dstIp;
+    uint8_t bufferId;
+    uint16_t maxDatagram;
+    uint16_t used;
+    uint16_t thisChunkSize;
+    bool callAgain;
+    bool firstChunk;
+    struct pbuf* p;
+    uint8_t* bundle;
+
+    if ((pcb == NULL) || (txPending == 0)) {
+        return;
+    }
+
+    critical_section_enter_blocking(&bufferLock);
+    pending = txPending;
+    txPending = 0;
+    critical_section_exit(&bufferLock);
+
+    while (pending) {
+        // The first pending universe decides where this datagram goes.
+        // Universes for other destinations go into another datagram
+        dstIp = 0;
+        for (uint8_t i = 0; i < 64; i++) {
+            if (pending & (1ULL << i)) {
+                dstIp = txDstIp[i];
+                break;
+            }
+        }
+
+        // Chunks always fit into a datagram, together with the bundle header
+        maxDatagram = maxDatagramSize(dstIp);
+        edpTX.setMaxSendChunkSize(MIN(maxDatagram - sizeof(Edp_Commands) - sizeof(uint16_t), 600));
+
+        p = pbuf_alloc(PBUF_TRANSPORT, maxDatagram, PBUF_RAM);
+        if (p == NULL) {
+            // Try again next time
+            critical_section_enter_blocking(&bufferLock);
+            txPending |= pending;
+            critical_section_exit(&bufferLock);
+            return;
+        }
+        bundle = (uint8_t*)p->payload;
+        bundle[0] = Edp_Commands::DmxDataBundle;
+        used = sizeof(Edp_Commands);
+
+        for (uint8_t i = 0; i < 64; i++) {
+            if (!(pending & (1ULL << i))) {
+                continue;
+            }
+
+            critical_section_enter_blocking(&bufferLock);
+            if (txDstIp[i] != dstIp) {
+                critical_section_exit(&bufferLock);
+                continue;
+            }
+            bufferId = txBufferId[i];
+            memcpy(txInBuf, dmxBuffer.buffer[bufferId], 512);
+            critical_section_exit(&bufferLock);
+
+            pending &= ~(1ULL << i);
+
+            // With a small MTU, the chunks of one frame can span datagrams.
+            // They still arrive in order
+            firstChunk = true;
+            do {
+                edpTX.prepareDmxData(i, firstChunk ? 512 : 0, &thisChunkSize, &callAgain);
+                firstChunk = false;
+
+                if (used + sizeof(uint16_t) + thisChunkSize > maxDatagram) {
+                    sendBundle(p, used, dstIp);
+                    p = pbuf_alloc(PBUF_TRANSPORT, maxDatagram, PBUF_RAM);
+                    if (p == NULL) {
+                        // The receiver will ask for the rest of this frame
+                        critical_section_enter_blocking(&bufferLock);
+                        txPending |= pending;
+                        critical_section_exit(&bufferLock);
+                        return;
+                    }
+                    bundle = (uint8_t*)p->payload;
+                    bundle[0] = Edp_Commands::DmxDataBundle;
+                    used = sizeof(Edp_Commands);
+                }
+
+                bundle[used] = thisChunkSize & 0xff;
+                bundle[used + 1] = thisChunkSize >> 8;
+                memcpy(bundle + used + sizeof(uint16_t), txOutBuf, thisChunkSize);
+                used += sizeof(uint16_t) + thisChunkSize;
+                edpTX.stats.bytesSent += sizeof(uint16_t);
+                edpTX.stats.overheadBytesSent += sizeof(uint16_t);
+            } while (callAgain);
+        }
+
+        // Bundle header, once per datagram
+        edpTX.stats.bytesSent += sizeof(Edp_Commands);
+        edpTX.stats.overheadBytesSent += sizeof(Edp_Commands);
+        sendBundle(p, used, dstIp);
+    }
+}
+
+const EdpStats& Udp_EDP::getStats() {
+    return edp.stats;
+}
+
+const EdpStats& Udp_EDP::getTxStats() {
+    return edpTX.stats;
 }
 
 void Udp_EDP::init(void) {
@@ -26,13 +252,18 @@ void Udp_EDP::init(void) {
 
   edp.init(tmpBuf, tmpBuf2, 600, PatchType::ip);
 
+  memset(txInBuf, 0x00, 600);
+  memset(txOutBuf, 0x00, 600);
+  txPending = 0;
+  edpTX.init(txInBuf, txOutBuf, 600, PatchType::ip);
+
   if (pcb == NULL) {
     pcb = udp_new_ip_type(IPADDR_TYPE_V4);
     LWIP_ASSERT("Failed to allocate udp pcb for edp", pcb != NULL);
     if (pcb != NULL) {
       udp_recv(pcb, edp_recv, NULL);
 
-      udp_bind(pcb, IP4_ADDR_ANY, 2040);
+      udp_bind(pcb, IP4_ADDR_ANY, EDP_UDP_PORT);
     }
   }
 }
@@ -9,9 +9,17 @@
 #include "lwip/dns.h"
 #include "lwip/ip_addr.h"
 #include "lwip/pbuf.h"
+#include "lwip/ip4.h"
 
 #include "edp.h"
 
+// Where EDP is sent to and received on
+#define EDP_UDP_PORT 2040
+
+// Largest datagram we send: MTU - IP header - UDP header. Smaller if the
+// interface the datagram goes out on has a smaller MTU
+#define EDP_UDP_MAX_DATAGRAM (1500 - 20 - 8)
+
 #ifdef __cplusplus
 
 #include <string>
@@ -21,14 +29,38 @@ class Udp_EDP {
     static void init();
     static void stop();
     static void receive(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port);
+    static void cyclicTask();
+    static const EdpStats& getStats();
+    static const EdpStats& getTxStats();
+
+    // Called from DmxBuffer (any core) for patchings buffer -> ip. The data
+    // is sent from cyclicTask, bundled with all other changed universes
+    static void queueUniverse(uint8_t universeId, uint8_t bufferId, uint8_t ethDestParams);
 
   private:
     static struct udp_pcb *pcb;
 
+    // Where control data (pongs, discovery responses, ...) goes to
+    static ip_addr_t remoteAddr;
+    static u16_t remotePort;
+    static void sendControlData();
+
     static uint8_t tmpBuf[600];
     static uint8_t tmpBuf2[600];
 
     static Edp edp;
+
+    // TX path (node -> host)
+    static void flushQueue();
+    static void handleDmxDataRequests();
+    static uint16_t maxDatagramSize(uint32_t dstIp);
+    static void sendBundle(struct pbuf* p, uint16_t used, uint32_t dstIp);
+    static uint64_t txPending;        // Bit field, one bit per universeId
+    static uint8_t txBufferId[64];
+    static uint32_t txDstIp[64];
+    static uint8_t txInBuf[600];
+    static uint8_t txOutBuf[600];
+    static Edp edpTX;
 };
 
 #endif // __cplusplus
@@ -4,16 +4,45 @@
 
 #include "dmxbuffer.h"
 
+#include <new>
+
 extern DmxBuffer dmxBuffer;
 
+extern critical_section_t bufferLock;
+
 uint8_t Usb_EDP::tmpBuf[600];
 uint8_t Usb_EDP::tmpBuf2[600];
+uint8_t Usb_EDP::reportBuf[CFG_TUD_HID_BUFSIZE];
 Edp Usb_EDP::edp;
 
+bool Usb_EDP::notifyHost;
+uint32_t Usb_EDP::deltaPending;
+uint8_t Usb_EDP::deltaNext;
+uint8_t (*Usb_EDP::shadow)[512];
+
 void Usb_EDP::init() {
     memset(tmpBuf, 0x00, 600);
     memset(tmpBuf2, 0x00, 600);
 
+    notifyHost = (getUsbProtocol() == UsbProtocol::EDP) &&
+                 (BoardConfig::activeConfig->usbProtocolDirections & 0x02);
+    deltaPending = 0;
+    deltaNext = 0;
+
+    // Most boards never send anything to the host this way, so the shadows
+    // are taken from the heap only if they are needed. Never freed, the USB
+    // protocol can only change with a reboot
+    if (notifyHost && !shadow) {
+        shadow = new (std::nothrow) uint8_t[DMXBUFFER_COUNT][512];
+        if (!shadow) {
+            LOG("USB EDP: No memory for the host's shadow buffers, not notifying the host");
+            notifyHost = false;
+        }
+    }
+    if (shadow) {
+        memset(shadow, 0x00, DMXBUFFER_COUNT * 512);
+    }
+
     edp.init(tmpBuf, tmpBuf2, 64, PatchType::ip);
 }
 
@@ -27,4 +56,99 @@ void Usb_EDP::hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_
     memcpy(tmpBuf, buffer, size);
 
     edp.processIncomingChunk(size);
+
+    sendControlData();
+}
+
+// Discovery responses might have to wait for their slot, so they are sent
+// from here once they are due
+void Usb_EDP::cyclicTask() {
+    uint8_t bufferId;
+
+    if (edp.controlDataPending()) {
+        sendControlData();
+    }
+
+    if (!notifyHost) {
+        return;
+    }
+
+    // The host asks for a buffer if it lost track, e.g. after it has been
+    // (re)started. Make all of it differ from what it has seen
+    while (edp.takeDmxDataRequest(&bufferId)) {
+        if (bufferId >= DMXBUFFER_COUNT) {
+            continue;
+        }
+        for (uint16_t i = 0; i < 512; i++) {
+            shadow[bufferId][i] = ~dmxBuffer.buffer[bufferId][i];
+        }
+        critical_section_enter_blocking(&bufferLock);
+        deltaPending |= (1UL << bufferId);
+        critical_section_exit(&bufferLock);
+    }
+
+    // Control data goes first, it uses the same endpoint
+    if (!edp.controlDataPending()) {
+        sendDelta();
+    }
+}
+
+void Usb_EDP::bufferChanged(uint8_t bufferId) {
+    if (!notifyHost || (bufferId >= DMXBUFFER_COUNT)) {
+        return;
+    }
+
+    critical_section_enter_blocking(&bufferLock);
+    deltaPending |= (1UL << bufferId);
+    critical_section_exit(&bufferLock);
+}
+
+// One report whenever the endpoint is free. A buffer stays pending until all
+// of its changes are out
+void Usb_EDP::sendDelta() {
+    uint8_t bufferId;
+    uint16_t size;
+    bool callAgain;
+
+    if (!deltaPending || !tud_hid_ready()) {
+        return;
+    }
+
+    bufferId = deltaNext;
+    while (!(deltaPending & (1UL << bufferId))) {
+        bufferId = (bufferId + 1) % DMXBUFFER_COUNT;
+    }
+    deltaNext = (bufferId + 1) % DMXBUFFER_COUNT;
+
+    critical_section_enter_blocking(&bufferLock);
+    deltaPending &= ~(1UL << bufferId);
+    critical_section_exit(&bufferLock);
+
+    memset(reportBuf, 0x00, CFG_TUD_HID_BUFSIZE);
+    size = edp.prepareDmxDataDelta(bufferId, dmxBuffer.buffer[bufferId], shadow[bufferId], reportBuf, CFG_TUD_HID_BUFSIZE, &callAgain);
+
+    if (callAgain) {
+        critical_section_enter_blocking(&bufferLock);
+        deltaPending |= (1UL << bufferId);
+        critical_section_exit(&bufferLock);
+    }
+
+    if (size) {
+        tud_hid_report(0, reportBuf, CFG_TUD_HID_BUFSIZE);
+    }
+}
+
+// Answer pings and send keyframe requests back to the host. The report
+// descriptor only knows full-sized reports, so pad with zeroes
+void Usb_EDP::sendControlData() {
+    uint16_t replySize = 0;
+    if (tud_hid_ready() && edp.takeControlData(&replySize)) {
+        memset(reportBuf, 0x00, CFG_TUD_HID_BUFSIZE);
+        memcpy(reportBuf, edp.controlData, MIN(replySize, CFG_TUD_HID_BUFSIZE));
+        tud_hid_report(0, reportBuf, CFG_TUD_HID_BUFSIZE);
+    }
+}
+
+const EdpStats& Usb_EDP::getStats() {
+    return edp.stats;
 }
@@ -5,6 +5,7 @@
 #include <stdint.h>
 
 #include "edp.h"
+#include "dmxbuffer.h"
 
 #ifdef __cplusplus
 
@@ -12,12 +13,30 @@ class Usb_EDP {
   public:
     static void init();
     static void hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t const *buffer, uint16_t bufsize);
+    static void cyclicTask();
+    static const EdpStats& getStats();
+
+    // Called from DmxBuffer (any core) whenever a buffer has been written
+    static void bufferChanged(uint8_t bufferId);
 
   private:
+    static void sendControlData();
+    static void sendDelta();
+
     static uint8_t tmpBuf[600];
     static uint8_t tmpBuf2[600];
+    static uint8_t reportBuf[CFG_TUD_HID_BUFSIZE];
 
     static Edp edp;
+
+    // Device to host: Changes are sent as DmxDataDelta IN reports if bit 1
+    // of usbProtocolDirections is set. Several changes of a buffer before
+    // the host polls again end up in the same report(s)
+    static bool notifyHost;
+    static uint32_t deltaPending;         // Bit field, one bit per buffer
+    static uint8_t deltaNext;             // Round robin, so one busy buffer can't starve the others
+    static uint8_t (*shadow)[512];        // What the host has seen, one per buffer. Only
+                                          // allocated if notifyHost is set, 12 kByte
 };
 
 #endif // __cplusplus
@@ -0,0 +1,249 @@
+#include "usb_JaRule.h"
+
+#include "log.h"
+
+#include "boardconfig.h"
+#include "dmxbuffer.h"
+
+#include <pico/unique_id.h>
+
+extern DmxBuffer dmxBuffer;
+
+uint32_t Usb_JaRule::framesReceived;
+uint32_t Usb_JaRule::errors;
+
+bool Usb_JaRule::active;
+
+struct JaRule_RequestHeader Usb_JaRule::rxHeader;
+uint8_t Usb_JaRule::rxHeaderReceived;
+uint16_t Usb_JaRule::rxPayloadReceived;
+uint8_t* Usb_JaRule::rxDestination;
+uint8_t Usb_JaRule::rxData[JARULE_MAX_PAYLOAD];
+uint8_t Usb_JaRule::staging[512];
+
+uint16_t Usb_JaRule::breakTime;
+uint16_t Usb_JaRule::markTime;
+
+uint8_t Usb_JaRule::txMessage[9 + JARULE_MAX_PAYLOAD];
+uint16_t Usb_JaRule::txMessageSize;
+uint16_t Usb_JaRule::txMessageSent;
+
+void Usb_JaRule::init() {
+    active = (getUsbProtocol() == UsbProtocol::JaRule);
+
+    framesReceived = 0;
+    errors = 0;
+
+    memset(staging, 0x00, 512);
+    rxHeaderReceived = 0;
+    rxPayloadReceived = 0;
+
+    breakTime = 176;
+    markTime = 12;
+
+    txMessageSize = 0;
+    txMessageSent = 0;
+}
+
+// Called on core0 right after tud_task, same as Usb_Vendor which steps
+// aside while we are active
+void Usb_JaRule::cyclicTask() {
+    if (!active) {
+        return;
+    }
+
+    if (!tud_vendor_mounted()) {
+        rxHeaderReceived = 0;
+        txMessageSize = 0;
+        return;
+    }
+
+    transmit();
+    if (txMessageSize == 0) {
+        receive();
+        transmit();
+    }
+}
+
+void Usb_JaRule::receive() {
+    uint32_t count;
+    uint8_t byte;
+
+    while (tud_vendor_available() && (txMessageSize == 0)) {
+        if (rxHeaderReceived == 0) {
+            // Skip everything until something that looks like a request
+            tud_vendor_read(&byte, 1);
+            if (byte != JARULE_SOF) {
+                errors++;
+                continue;
+            }
+            rxHeader.sof = byte;
+            rxHeaderReceived = 1;
+            continue;
+        }
+
+        if (rxHeaderReceived < sizeof(struct JaRule_RequestHeader)) {
+            count = tud_vendor_read((uint8_t*)&rxHeader + rxHeaderReceived, sizeof(struct JaRule_RequestHeader) - rxHeaderReceived);
+            rxHeaderReceived += count;
+            if (rxHeaderReceived < sizeof(struct JaRule_RequestHeader)) {
+                break;
+            }
+
+            if (rxHeader.length > JARULE_MAX_PAYLOAD) {
+                LOG("JaRule: Request too long. Command: %u, length: %u", rxHeader.command, rxHeader.length);
+                errors++;
+                rxDestination = nullptr;
+            } else if ((rxHeader.command == JaRule_Command::TxDmx) && (rxHeader.length <= 512)) {
+                rxDestination = staging;
+            } else {
+                rxDestination = rxData;
+            }
+            rxPayloadReceived = 0;
+            continue;
+        }
+
+        if (rxPayloadReceived < rxHeader.length) {
+            if (rxDestination) {
+                count = tud_vendor_read(rxDestination + rxPayloadReceived, rxHeader.length - rxPayloadReceived);
+            } else {
+                count = tud_vendor_read(rxData, MIN(rxHeader.length - rxPayloadReceived, JARULE_MAX_PAYLOAD));
+            }
+            rxPayloadReceived += count;
+            continue;
+        }
+
+        // Payload complete, only the EOF is missing
+        tud_vendor_read(&byte, 1);
+        if ((byte == JARULE_EOF) && rxDestination) {
+            handleRequest();
+        } else {
+            errors++;
+        }
+        rxHeaderReceived = 0;
+    }
+}
+
+void Usb_JaRule::handleRequest() {
+    uint8_t payload[14];
+    pico_unique_board_id_t id;
+
+    switch (rxHeader.command) {
+        case JaRule_Command::TxDmx:
+            if (rxHeader.length > 512) {
+                prepareResponse(JaRule_ReturnCode::BadParam, nullptr, 0);
+                break;
+            }
+            // Channels the host didn't send are 0, same as a short DMX frame
+            memset(staging + rxHeader.length, 0x00, 512 - rxHeader.length);
+            dmxBuffer.setBuffer(0, staging, 512);
+            framesReceived++;
+            prepareResponse(JaRule_ReturnCode::Ok, nullptr, 0);
+            break;
+
+        case JaRule_Command::ResetDevice:
+            prepareResponse(JaRule_ReturnCode::Ok, nullptr, 0);
+            break;
+
+        case JaRule_Command::SetMode:
+            // Controller mode only, RDM responder mode is not supported
+            if ((rxHeader.length == 1) && (rxData[0] == 0)) {
+                prepareResponse(JaRule_ReturnCode::Ok, nullptr, 0);
+            } else {
+                prepareResponse(JaRule_ReturnCode::InvalidMode, nullptr, 0);
+            }
+            break;
+
+        case JaRule_Command::GetHardwareInfo:
+            // Model id, 6 byte UID, 6 byte MAC. UID and MAC come from the board id
+            pico_get_unique_board_id(&id);
+            payload[0] = JARULE_MODEL_ID & 0xff;
+            payload[1] = JARULE_MODEL_ID >> 8;
+            payload[2] = 0x7a;
+            payload[3] = 0x70;
+            memcpy(payload + 4, id.id + 4, 4);
+            payload[8] = 0x02;
+            memcpy(payload + 9, id.id + 3, 5);
+            prepareResponse(JaRule_ReturnCode::Ok, payload, 14);
+            break;
+
+        case JaRule_Command::RunSelfTest:
+            prepareResponse(JaRule_ReturnCode::Ok, nullptr, 0);
+            break;
+
+        case JaRule_Command::SetBreakTime:
+        case JaRule_Command::SetMarkTime:
+            if (rxHeader.length != 2) {
+                prepareResponse(JaRule_ReturnCode::BadParam, nullptr, 0);
+                break;
+            }
+            if (rxHeader.command == JaRule_Command::SetBreakTime) {
+                breakTime = rxData[0] | rxData[1] << 8;
+            } else {
+                markTime = rxData[0] | rxData[1] << 8;
+            }
+            prepareResponse(JaRule_ReturnCode::Ok, nullptr, 0);
+            break;
+
+        case JaRule_Command::GetBreakTime:
+            payload[0] = breakTime & 0xff;
+            payload[1] = breakTime >> 8;
+            prepareResponse(JaRule_ReturnCode::Ok, payload, 2);
+            break;
+
+        case JaRule_Command::GetMarkTime:
+            payload[0] = markTime & 0xff;
+            payload[1] = markTime >> 8;
+            prepareResponse(JaRule_ReturnCode::Ok, payload, 2);
+            break;
+
+        case JaRule_Command::Echo:
+            prepareResponse(JaRule_ReturnCode::Ok, rxData, rxHeader.length);
+            break;
+
+        case JaRule_Command::GetFlags:
+            payload[0] = 0;
+            prepareResponse(JaRule_ReturnCode::Ok, payload, 1);
+            break;
+
+        default:
+            // RDM and the remaining timing parameters
+            LOG("JaRule: Unsupported command %u", rxHeader.command);
+            prepareResponse(JaRule_ReturnCode::Unknown, nullptr, 0);
+            break;
+    }
+}
+
+void Usb_JaRule::prepareResponse(JaRule_ReturnCode returnCode, const uint8_t* payload, uint16_t length) {
+    txMessage[0] = JARULE_SOF;
+    txMessage[1] = rxHeader.token;
+    txMessage[2] = rxHeader.command & 0xff;
+    txMessage[3] = rxHeader.command >> 8;
+    txMessage[4] = length & 0xff;
+    txMessage[5] = length >> 8;
+    txMessage[6] = returnCode;
+    txMessage[7] = 0;
+    if (length) {
+        memcpy(txMessage + 8, payload, length);
+    }
+    txMessage[8 + length] = JARULE_EOF;
+    txMessageSize = 9 + length;
+    txMessageSent = 0;
+}
+
+void Usb_JaRule::transmit() {
+    uint32_t count;
+
+    if (txMessageSize == 0) {
+        return;
+    }
+
+    count = tud_vendor_write(txMessage + txMessageSent, txMessageSize - txMessageSent);
+    if (count) {
+        tud_vendor_write_flush();
+    }
+    txMessageSent += count;
+
+    if (txMessageSent >= txMessageSize) {
+        txMessageSize = 0;
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef USB_JARULE_H
+#define USB_JARULE_H
+
+#include "tusb.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+
+// Ja Rule emulation on the vendor interface's bulk endpoints, as spoken by
+// OLA's usbdmx plugin. All values are little endian.
+//
+// Request:  SOF, token, command (2), length (2), payload, EOF
+// Response: SOF, token, command (2), length (2), return code, flags, payload, EOF
+//
+// The host treats every vendor interface as one port. We have a single
+// vendor interface, so there is one port, it is DMX OUT and goes to buffer 0
+
+#define JARULE_SOF 0x5a
+#define JARULE_EOF 0xa5
+
+#define JARULE_MAX_PAYLOAD 513
+
+enum JaRule_Command : uint16_t {
+    ResetDevice               = 0x00,
+    SetMode                   = 0x01,
+    GetHardwareInfo           = 0x02,
+    RunSelfTest               = 0x03,
+    SetBreakTime              = 0x10,
+    GetBreakTime              = 0x11,
+    SetMarkTime               = 0x12,
+    GetMarkTime               = 0x13,
+    TxDmx                     = 0x30,
+    Echo                      = 0xf0,
+    GetFlags                  = 0xf2,
+};
+
+enum JaRule_ReturnCode : uint8_t {
+    Ok                        = 0,
+    Unknown                   = 1,
+    BufferFull                = 2,
+    BadParam                  = 3,
+    TxError                   = 4,
+    InvalidMode               = 8,
+};
+
+// 6 byte
+struct __attribute__((__packed__)) JaRule_RequestHeader {
+    uint8_t               sof;
+    uint8_t               token;          // Echoed in the response
+    uint16_t              command;
+    uint16_t              length;
+};
+
+// Hardware model reported in GetHardwareInfo
+#define JARULE_MODEL_ID 0x0100
+
+class Usb_JaRule {
+  public:
+    static void init();
+    static void cyclicTask();
+
+    static uint32_t framesReceived;
+    static uint32_t errors;
+
+  private:
+    static void receive();
+    static void transmit();
+    static void handleRequest();
+    static void prepareResponse(JaRule_ReturnCode returnCode, const uint8_t* payload, uint16_t length);
+
+    static bool active;
+
+    // RX: Header is collected byte-wise, TxDmx payload goes straight to staging
+    static struct JaRule_RequestHeader rxHeader;
+    static uint8_t rxHeaderReceived;
+    static uint16_t rxPayloadReceived;
+    static uint8_t* rxDestination;        // nullptr: payload is skipped
+    static uint8_t rxData[JARULE_MAX_PAYLOAD];
+    static uint8_t staging[512];
+
+    static uint16_t breakTime;            // In us, only stored and echoed
+    static uint16_t markTime;             // In us, only stored and echoed
+
+    // TX: The response to the last request. The next request is only read
+    // once this is out, which is what the host expects anyway
+    static uint8_t txMessage[9 + JARULE_MAX_PAYLOAD];
+    static uint16_t txMessageSize;
+    static uint16_t txMessageSent;
+};
+
+#endif // __cplusplus
+
+#endif // USB_JARULE_H
@@ -2,15 +2,26 @@
 
 #include "log.h"
 
+#include "jsonwriter.h"
+
 #include "dmxbuffer.h"
 
-extern uint8_t usb_buffer[24][512];
+extern "C" {
+#include <bsp/board.h>
+}
 
 extern DmxBuffer dmxBuffer;
 
+struct NodleU1_Universe Usb_NodleU1::universes[NODLEU1_UNIVERSES];
+
 void Usb_NodleU1::init() {
     // Init the complete area to 0
-    memset(usb_buffer, 0x00, 24 * 512);
+    memset(universes, 0x00, sizeof(universes));
+}
+
+// Partial frames also need to be committed if the host stops sending
+void Usb_NodleU1::cyclicTask() {
+    checkTimeouts();
 }
 
 void Usb_NodleU1::hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t const *buffer, uint16_t bufsize) {
@@ -26,31 +37,95 @@ void Usb_NodleU1::hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_rep
     //     Second byte: 4 bit universe ID (0-15) + 4 bit channel offset)
     //     Followed by 60 data bytes
 
+    if (bufsize < 2) {
+        return;
+    }
+
+    checkTimeouts();
+
     if (buffer[0] < 16) {
         // DMX data, universe 0
-        uint8_t datasize = 32;
-        if ((bufsize - 1) < datasize) {
-            datasize = bufsize - 1;
-        }
-        memcpy(usb_buffer[0] + (32 * buffer[0]), buffer + 1, datasize);
-
-        // Check if this was the last transfer = DMX frame is complete
-        if (buffer[0] == 15) {
-            dmxBuffer.setBuffer(0, usb_buffer[0], 512);
-        }
-    } else if (buffer[0] == 32) {
+        receiveSlice(0, false, buffer[0], buffer + 1, bufsize - 1);
+    } else if ((buffer[0] == 32) && (bufsize > 2)) {
         uint8_t uni = (buffer[1] >> 4) & 0xF;
         uint8_t offset = buffer[1] & 0xF;
 
-        uint8_t datasize = 60;
-        if ((bufsize - 2) < datasize) {
-            datasize = bufsize - 1;
-        }
-        memcpy(usb_buffer[uni] + (60 * offset), buffer + 2, datasize);
+        receiveSlice(uni, true, offset, buffer + 2, bufsize - 2);
+    }
+}
+
+// Slices go directly into the universe's staging frame. The frame goes to
+// DmxBuffer once all slices are there, or with what it has once they can't
+// arrive anymore (see commitPartial)
+void Usb_NodleU1::receiveSlice(uint8_t universe, bool extended, uint8_t slice, uint8_t const *data, uint16_t dataSize) {
+    struct NodleU1_Universe* u = &universes[universe];
+    uint16_t sliceSize = extended ? NODLEU1_EXTENDED_SLICE_SIZE : NODLEU1_STANDARD_SLICE_SIZE;
+    uint8_t slices = extended ? NODLEU1_EXTENDED_SLICES : NODLEU1_STANDARD_SLICES;
+    uint16_t sliceStart = sliceSize * slice;
+    uint16_t allSlices = (1 << slices) - 1;
+    uint16_t copySize;
+
+    if (slice >= slices) {
+        return;
+    }
 
-        // Check if this was the last transfer = DMX frame is complete
-        if (offset == 8) {
-            dmxBuffer.setBuffer(uni, usb_buffer[uni], 512);
+    // Same slice again or the host switched the layout: The previous frame
+    // can't be completed anymore, it goes out with what it has, like after
+    // the timeout
+    if (u->sliceBitmap && ((u->sliceBitmap & (1 << slice)) || (u->extended != extended))) {
+        commitPartial(universe);
+    }
+
+    if (!u->sliceBitmap) {
+        u->frameStart = board_millis();
+        u->extended = extended;
+    }
+
+    // The last extended slice only has 32 valid byte
+    copySize = MIN(sliceSize, 512 - sliceStart);
+    copySize = MIN(copySize, dataSize);
+    memcpy(u->staging + sliceStart, data, copySize);
+    u->sliceBitmap |= (1 << slice);
+
+    if (u->sliceBitmap == allSlices) {
+        u->framesComplete++;
+        commit(universe);
+    }
+}
+
+void Usb_NodleU1::commit(uint8_t universe) {
+    universes[universe].sliceBitmap = 0;
+    dmxBuffer.setBuffer(universe, universes[universe].staging, 512);
+}
+
+// Missing slices keep the values of the previous frame
+void Usb_NodleU1::commitPartial(uint8_t universe) {
+    LOG("NodleU1: Universe %u partial. Slices: %04x", universe, universes[universe].sliceBitmap);
+    universes[universe].framesPartial++;
+    commit(universe);
+}
+
+void Usb_NodleU1::checkTimeouts() {
+    uint32_t now = board_millis();
+
+    for (uint8_t i = 0; i < NODLEU1_UNIVERSES; i++) {
+        if (universes[i].sliceBitmap && ((now - universes[i].frameStart) > NODLEU1_FRAME_TIMEOUT_MS)) {
+            commitPartial(i);
         }
     }
 }
+
+void Usb_NodleU1::getStats(JsonWriter* json) {
+    json->beginObject();
+    json->beginArray("complete");
+    for (uint8_t i = 0; i < NODLEU1_UNIVERSES; i++) {
+        json->value(universes[i].framesComplete);
+    }
+    json->endArray();
+    json->beginArray("partial");
+    for (uint8_t i = 0; i < NODLEU1_UNIVERSES; i++) {
+        json->value(universes[i].framesPartial);
+    }
+    json->endArray();
+    json->endObject();
+}
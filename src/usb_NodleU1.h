@@ -6,13 +6,47 @@
 
 #ifdef __cplusplus
 
+#include "jsonwriter.h"
+
+// Universes reachable with the extended protocol (4 bit universe id)
+#define NODLEU1_UNIVERSES 16
+
+// A frame whose slices didn't all arrive within that time is committed
+// with what we have
+#define NODLEU1_FRAME_TIMEOUT_MS 50
+
+// Standard: universe 0 only, 16 slices of 32 byte
+// Extended: 4 bit slice offset, 60 byte per slice => 9 slices, the last one is 32 byte
+#define NODLEU1_STANDARD_SLICE_SIZE 32
+#define NODLEU1_STANDARD_SLICES 16
+#define NODLEU1_EXTENDED_SLICE_SIZE 60
+#define NODLEU1_EXTENDED_SLICES 9
+
+struct NodleU1_Universe {
+    uint8_t staging[512];       // Slices are written here, DmxBuffer gets it once complete
+    uint16_t sliceBitmap;       // Slices received for the frame being assembled
+    bool extended;              // Slice layout of the frame being assembled
+    uint32_t frameStart;        // board_millis() of the frame's first slice
+    uint32_t framesComplete;    // All slices arrived
+    uint32_t framesPartial;     // Committed with slices missing, after NODLEU1_FRAME_TIMEOUT_MS
+                                // or because the next frame started
+};
+
 class Usb_NodleU1 {
   public:
     static void init();
+    static void cyclicTask();
     static void hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t const *buffer, uint16_t bufsize);
 
+    static void getStats(JsonWriter* json);
+
   private:
-    // buffers :)
+    static struct NodleU1_Universe universes[NODLEU1_UNIVERSES];
+
+    static void receiveSlice(uint8_t universe, bool extended, uint8_t slice, uint8_t const *data, uint16_t dataSize);
+    static void commit(uint8_t universe);
+    static void commitPartial(uint8_t universe);
+    static void checkTimeouts();
 };
 
 #endif // __cplusplus
@@ -0,0 +1,404 @@
+#include "usb_UsbPro.h"
+
+#include "log.h"
+
+#include "boardconfig.h"
+#include "dmxbuffer.h"
+#include "version.h"
+
+#include <pico/unique_id.h>
+
+extern DmxBuffer dmxBuffer;
+
+extern critical_section_t bufferLock;
+
+struct UsbPro_Stats Usb_UsbPro::stats;
+
+bool Usb_UsbPro::active;
+
+UsbPro_RxState Usb_UsbPro::rxState;
+uint8_t Usb_UsbPro::rxLabel;
+uint16_t Usb_UsbPro::rxLength;
+uint16_t Usb_UsbPro::rxReceived;
+uint8_t* Usb_UsbPro::rxDestination;
+uint8_t Usb_UsbPro::rxData[USBPRO_MAX_DATA];
+uint8_t Usb_UsbPro::staging[USBPRO_PORTS][513];
+
+struct UsbPro_Params Usb_UsbPro::params;
+uint8_t Usb_UsbPro::onChangeOnly[USBPRO_PORTS];
+uint8_t Usb_UsbPro::pendingReplies;
+
+uint8_t Usb_UsbPro::txPending;
+uint8_t Usb_UsbPro::txChanges;
+uint8_t Usb_UsbPro::txBufferId[USBPRO_PORTS];
+uint8_t Usb_UsbPro::txFrame[USBPRO_PORTS][513];
+uint8_t Usb_UsbPro::lastSent[USBPRO_PORTS][513];
+uint8_t Usb_UsbPro::txMessage[5 + USBPRO_MAX_DATA];
+uint16_t Usb_UsbPro::txMessageSize;
+uint16_t Usb_UsbPro::txMessageSent;
+
+static const char manufacturerName[] = "OpenLightingProject";
+static const char deviceName[] = "rp2040-dmxsun";
+
+// Queries a host may send in a row without waiting for the replies. They are
+// answered in this order
+static const uint8_t replyLabels[] = {
+    UsbPro_Label::GetParams,
+    UsbPro_Label::GetSerial,
+    UsbPro_Label::GetManufacturer,
+    UsbPro_Label::GetName,
+};
+
+void Usb_UsbPro::init() {
+    active = (getUsbProtocol() == UsbProtocol::UsbPro);
+
+    memset(&stats, 0x00, sizeof(struct UsbPro_Stats));
+
+    rxState = UsbPro_RxState::waitStart;
+    memset(staging, 0x00, sizeof(staging));
+
+    params.firmwareLsb = VERSION_BCD & 0xff;
+    params.firmwareMsb = VERSION_BCD >> 8;
+    params.breakTime = 9;
+    params.mabTime = 1;
+    params.rate = 40;
+    memset(onChangeOnly, 0x00, sizeof(onChangeOnly));
+    pendingReplies = 0;
+
+    txPending = 0;
+    txChanges = 0;
+    memset(txFrame, 0x00, sizeof(txFrame));
+    memset(lastSent, 0x00, sizeof(lastSent));
+    txMessageSize = 0;
+    txMessageSent = 0;
+}
+
+// Called on core0 right after tud_task. Nothing here blocks: we only take
+// what the FIFOs have or have room for. If the main loop is slow, TinyUSB
+// stops accepting OUT packets once the RX FIFO is full, so the host waits
+// instead of us losing bytes
+void Usb_UsbPro::cyclicTask() {
+    if (!active) {
+        return;
+    }
+
+    if (!tud_cdc_connected()) {
+        // Start clean when the host opens the port again
+        rxState = UsbPro_RxState::waitStart;
+        txMessageSize = 0;
+        return;
+    }
+
+    receive();
+    transmit();
+}
+
+void Usb_UsbPro::queueBuffer(uint8_t port, uint8_t bufferId) {
+    if (!active || (port >= USBPRO_PORTS) || (bufferId >= DMXBUFFER_COUNT)) {
+        return;
+    }
+
+    critical_section_enter_blocking(&bufferLock);
+    txBufferId[port] = bufferId;
+    txPending |= (1 << port);
+    critical_section_exit(&bufferLock);
+}
+
+void Usb_UsbPro::receive() {
+    uint32_t count;
+    uint8_t byte;
+
+    while (tud_cdc_available()) {
+        if (rxState == UsbPro_RxState::readData) {
+            // Bulk of the traffic: Read as much as the FIFO has in one go
+            if (rxDestination) {
+                count = tud_cdc_read(rxDestination + rxReceived, rxLength - rxReceived);
+            } else {
+                count = tud_cdc_read(rxData, MIN(rxLength - rxReceived, USBPRO_MAX_DATA));
+            }
+            rxReceived += count;
+            if (rxReceived >= rxLength) {
+                rxState = UsbPro_RxState::waitEnd;
+            }
+            continue;
+        }
+
+        tud_cdc_read(&byte, 1);
+
+        switch (rxState) {
+            case UsbPro_RxState::waitStart:
+                if (byte == USBPRO_START_OF_MSG) {
+                    rxState = UsbPro_RxState::readLabel;
+                } else {
+                    stats.errors++;
+                }
+                break;
+
+            case UsbPro_RxState::readLabel:
+                rxLabel = byte;
+                rxState = UsbPro_RxState::readLengthLsb;
+                break;
+
+            case UsbPro_RxState::readLengthLsb:
+                rxLength = byte;
+                rxState = UsbPro_RxState::readLengthMsb;
+                break;
+
+            case UsbPro_RxState::readLengthMsb:
+                rxLength |= (uint16_t)byte << 8;
+                rxReceived = 0;
+
+                // DMX goes directly to the staging frame of its port, all
+                // the small stuff to rxData. Too long messages are skipped
+                if ((rxLabel == UsbPro_Label::SendDmx) || (rxLabel == UsbPro_Label::SendDmxPort2)) {
+                    rxDestination = (rxLength <= 513) ? staging[(rxLabel == UsbPro_Label::SendDmx) ? 0 : 1] : nullptr;
+                } else {
+                    rxDestination = (rxLength <= USBPRO_MAX_DATA) ? rxData : nullptr;
+                }
+                if (!rxDestination) {
+                    LOG("USB Pro: Message too long. Label: %u, length: %u", rxLabel, rxLength);
+                    stats.errors++;
+                }
+                rxState = rxLength ? UsbPro_RxState::readData : UsbPro_RxState::waitEnd;
+                break;
+
+            case UsbPro_RxState::waitEnd:
+                if (byte == USBPRO_END_OF_MSG) {
+                    if (rxDestination) {
+                        applyMessage();
+                    }
+                    rxState = UsbPro_RxState::waitStart;
+                } else {
+                    // If the end marker got lost, this might already be
+                    // the start of the next message
+                    stats.errors++;
+                    rxState = (byte == USBPRO_START_OF_MSG) ? UsbPro_RxState::readLabel : UsbPro_RxState::waitStart;
+                }
+                break;
+
+            default:
+                rxState = UsbPro_RxState::waitStart;
+                break;
+        }
+    }
+}
+
+void Usb_UsbPro::applyMessage() {
+    uint8_t port;
+
+    switch (rxLabel) {
+        case UsbPro_Label::SendDmx:
+        case UsbPro_Label::SendDmxPort2:
+            port = (rxLabel == UsbPro_Label::SendDmx) ? 0 : 1;
+            // Only the NULL start code is DMX, everything else (RDM,
+            // text, ...) is ignored
+            if ((rxLength >= 2) && (staging[port][0] == 0x00)) {
+                dmxBuffer.setBuffer(port, staging[port] + 1, rxLength - 1);
+                stats.framesReceived++;
+            }
+            break;
+
+        case UsbPro_Label::ReceiveDmxOnChange:
+        case UsbPro_Label::ReceiveDmxOnChangePort2:
+            port = (rxLabel == UsbPro_Label::ReceiveDmxOnChange) ? 0 : 1;
+            if (rxLength >= 1) {
+                onChangeOnly[port] = rxData[0] ? 1 : 0;
+                // The first ChangeOfState after switching contains everything
+                memset(lastSent[port] + 1, 0x00, 512);
+                critical_section_enter_blocking(&bufferLock);
+                txChanges |= (1 << port);
+                critical_section_exit(&bufferLock);
+            }
+            break;
+
+        case UsbPro_Label::SetParams:
+            // 2 byte user config size, break, MAB, rate
+            if (rxLength >= 5) {
+                params.breakTime = rxData[2];
+                params.mabTime = rxData[3];
+                params.rate = rxData[4];
+            }
+            break;
+
+        case UsbPro_Label::GetParams:
+        case UsbPro_Label::GetSerial:
+        case UsbPro_Label::GetManufacturer:
+        case UsbPro_Label::GetName:
+            for (uint8_t i = 0; i < sizeof(replyLabels); i++) {
+                if (replyLabels[i] == rxLabel) {
+                    pendingReplies |= (1 << i);
+                }
+            }
+            break;
+
+        case UsbPro_Label::SetApiKey:
+            // Any key is fine, port 2 is always enabled
+            break;
+
+        default:
+            LOG("USB Pro: Unsupported label %u", rxLabel);
+            break;
+    }
+}
+
+void Usb_UsbPro::transmit() {
+    uint32_t count;
+
+    // Replies first, the host usually waits for them
+    if (txMessageSize == 0) {
+        if (!prepareReply()) {
+            for (uint8_t port = 0; port < USBPRO_PORTS; port++) {
+                if (prepareDmx(port)) {
+                    break;
+                }
+            }
+        }
+    }
+
+    if (txMessageSize == 0) {
+        return;
+    }
+
+    count = tud_cdc_write(txMessage + txMessageSent, txMessageSize - txMessageSent);
+    if (count) {
+        tud_cdc_write_flush();
+    }
+    txMessageSent += count;
+
+    if (txMessageSent >= txMessageSize) {
+        txMessageSize = 0;
+    }
+}
+
+bool Usb_UsbPro::prepareReply() {
+    uint8_t* data = txMessage + 4;
+    pico_unique_board_id_t id;
+    uint32_t serial;
+    uint8_t label = 0;
+
+    for (uint8_t i = 0; i < sizeof(replyLabels); i++) {
+        if (pendingReplies & (1 << i)) {
+            pendingReplies &= ~(1 << i);
+            label = replyLabels[i];
+            break;
+        }
+    }
+
+    switch (label) {
+        case UsbPro_Label::GetParams:
+            memcpy(data, &params, sizeof(struct UsbPro_Params));
+            prepareMessage(UsbPro_Label::GetParams, sizeof(struct UsbPro_Params));
+            break;
+
+        case UsbPro_Label::GetSerial:
+            // 8 BCD digits, little endian, taken from the board id
+            pico_get_unique_board_id(&id);
+            serial = ((uint32_t)id.id[4] << 24 | (uint32_t)id.id[5] << 16 | (uint32_t)id.id[6] << 8 | id.id[7]) % 100000000;
+            for (uint8_t i = 0; i < 4; i++) {
+                data[i] = (serial % 10) | ((serial / 10) % 10) << 4;
+                serial = serial / 100;
+            }
+            prepareMessage(UsbPro_Label::GetSerial, 4);
+            break;
+
+        case UsbPro_Label::GetManufacturer:
+            // ESTA id 0x7ff0 (prototyping) + name
+            data[0] = 0xf0;
+            data[1] = 0x7f;
+            memcpy(data + 2, manufacturerName, sizeof(manufacturerName) - 1);
+            prepareMessage(UsbPro_Label::GetManufacturer, 2 + sizeof(manufacturerName) - 1);
+            break;
+
+        case UsbPro_Label::GetName:
+            // Device id + name
+            data[0] = 0x01;
+            data[1] = 0x00;
+            memcpy(data + 2, deviceName, sizeof(deviceName) - 1);
+            prepareMessage(UsbPro_Label::GetName, 2 + sizeof(deviceName) - 1);
+            break;
+
+        default:
+            return false;
+    }
+
+    return true;
+}
+
+// "Send always" mode: One ReceivedDmx per frame. "On change" mode: One
+// ChangeOfState per call, covering 40 slots starting at the first change.
+// It is called again until lastSent matches the frame
+bool Usb_UsbPro::prepareDmx(uint8_t port) {
+    uint8_t* data = txMessage + 4;
+    uint16_t first;
+    uint16_t start;
+    uint8_t count;
+
+    critical_section_enter_blocking(&bufferLock);
+    if (txPending & (1 << port)) {
+        txPending &= ~(1 << port);
+        txChanges |= (1 << port);
+        txFrame[port][0] = 0x00;
+        memcpy(txFrame[port] + 1, dmxBuffer.buffer[txBufferId[port]], 512);
+    }
+    if (!(txChanges & (1 << port))) {
+        critical_section_exit(&bufferLock);
+        return false;
+    }
+    critical_section_exit(&bufferLock);
+
+    if (!onChangeOnly[port]) {
+        // Status byte, then start code and channels
+        data[0] = 0x00;
+        memcpy(data + 1, txFrame[port], 513);
+        memcpy(lastSent[port], txFrame[port], 513);
+        prepareMessage((port == 0) ? UsbPro_Label::ReceivedDmx : UsbPro_Label::ReceivedDmxPort2, 514);
+        stats.framesSent++;
+
+        critical_section_enter_blocking(&bufferLock);
+        txChanges &= ~(1 << port);
+        critical_section_exit(&bufferLock);
+        return true;
+    }
+
+    for (first = 0; first < 513; first++) {
+        if (txFrame[port][first] != lastSent[port][first]) {
+            break;
+        }
+    }
+    if (first >= 513) {
+        critical_section_enter_blocking(&bufferLock);
+        txChanges &= ~(1 << port);
+        critical_section_exit(&bufferLock);
+        return false;
+    }
+
+    // Start changed byte number (in units of 8 slots), 5 byte bit array of
+    // changed slots, then the values of the changed slots
+    start = first & ~0x07;
+    data[0] = start / 8;
+    memset(data + 1, 0x00, 5);
+    count = 0;
+    for (uint16_t i = 0; (i < 40) && (start + i < 513); i++) {
+        if (txFrame[port][start + i] != lastSent[port][start + i]) {
+            data[1 + i / 8] |= (1 << (i % 8));
+            data[6 + count] = txFrame[port][start + i];
+            lastSent[port][start + i] = txFrame[port][start + i];
+            count++;
+        }
+    }
+    prepareMessage((port == 0) ? UsbPro_Label::ChangeOfState : UsbPro_Label::ChangeOfStatePort2, 6 + count);
+    stats.changesSent++;
+
+    return true;
+}
+
+// Data has to be in place at txMessage + 4 already
+void Usb_UsbPro::prepareMessage(uint8_t label, uint16_t length) {
+    txMessage[0] = USBPRO_START_OF_MSG;
+    txMessage[1] = label;
+    txMessage[2] = length & 0xff;
+    txMessage[3] = length >> 8;
+    txMessage[4 + length] = USBPRO_END_OF_MSG;
+    txMessageSize = 5 + length;
+    txMessageSent = 0;
+}
@@ -0,0 +1,120 @@
+#ifndef USB_USBPRO_H
+#define USB_USBPRO_H
+
+#include "tusb.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+
+// ENTTEC DMX USB Pro (and Pro Mk2) emulation on the CDC ACM interface.
+// Only active if the board is configured for UsbProtocol::UsbPro, since the
+// debugging console uses the same interface otherwise.
+//
+// Every message looks like this:
+//   0x7E, label, length LSB, length MSB, <length> byte of data, 0xE7
+//
+// Port 0 is buffer 0, port 1 (Mk2 only) is buffer 1. DMX towards the host
+// comes from patchings to usbProto, instance 0 or 1
+
+#define USBPRO_START_OF_MSG 0x7e
+#define USBPRO_END_OF_MSG   0xe7
+
+// Longest message the widget accepts
+#define USBPRO_MAX_DATA 600
+
+#define USBPRO_PORTS 2
+
+enum UsbPro_Label : uint8_t {
+    GetParams                 = 3,
+    SetParams                 = 4,
+    ReceivedDmx               = 5,  // Device -> host: status + start code + channels
+    SendDmx                   = 6,  // Host -> device: start code + channels
+    ReceiveDmxOnChange        = 8,  // 0 = send every frame, 1 = only changes via ChangeOfState
+    ChangeOfState             = 9,
+    GetSerial                 = 10,
+    SetApiKey                 = 13, // Mk2: Required before port 2 labels are used
+    GetManufacturer           = 77,
+    GetName                   = 78,
+
+    // Mk2 port 2. ENTTEC only hands those out together with the API key,
+    // they have to match what the host software has been configured with
+    SendDmxPort2              = 130,
+    ReceiveDmxOnChangePort2   = 131,
+    ReceivedDmxPort2          = 132,
+    ChangeOfStatePort2        = 133,
+};
+
+// Widget parameters, only stored and echoed. Our DMX timing is set by the
+// local ports, not by the host
+struct __attribute__((__packed__)) UsbPro_Params {
+    uint8_t               firmwareLsb;
+    uint8_t               firmwareMsb;
+    uint8_t               breakTime;      // In 10.67us units, 9 to 127
+    uint8_t               mabTime;        // In 10.67us units, 1 to 127
+    uint8_t               rate;           // Frames per second, 0 = as fast as possible
+};
+
+struct UsbPro_Stats {
+    uint32_t              framesReceived; // SendDmx messages applied
+    uint32_t              framesSent;     // ReceivedDmx messages sent to the host
+    uint32_t              changesSent;    // ChangeOfState messages sent to the host
+    uint32_t              errors;         // Bytes skipped, missing end markers, too long messages
+};
+
+enum UsbPro_RxState : uint8_t {
+    waitStart,
+    readLabel,
+    readLengthLsb,
+    readLengthMsb,
+    readData,
+    waitEnd,
+};
+
+class Usb_UsbPro {
+  public:
+    static void init();
+    static void cyclicTask();
+
+    // Called from DmxBuffer (any core) for patchings buffer -> usbProto
+    static void queueBuffer(uint8_t port, uint8_t bufferId);
+
+    static struct UsbPro_Stats stats;
+
+  private:
+    static void receive();
+    static void applyMessage();
+    static void transmit();
+    static bool prepareReply();
+    static bool prepareDmx(uint8_t port);
+    static void prepareMessage(uint8_t label, uint16_t length);
+
+    static bool active;
+
+    // RX: Header bytes go through the state machine, data is read from the
+    // CDC FIFO straight to where it is used
+    static UsbPro_RxState rxState;
+    static uint8_t rxLabel;
+    static uint16_t rxLength;
+    static uint16_t rxReceived;
+    static uint8_t* rxDestination;        // nullptr: data is skipped
+    static uint8_t rxData[USBPRO_MAX_DATA];
+    static uint8_t staging[USBPRO_PORTS][513];  // Start code + channels
+
+    static struct UsbPro_Params params;
+    static uint8_t onChangeOnly[USBPRO_PORTS];
+    static uint8_t pendingReplies;        // Bit field, one bit per label in replyLabels
+
+    // TX: One message at a time, written as the FIFO has room
+    static uint8_t txPending;             // Bit field, one bit per port
+    static uint8_t txChanges;             // Bit field, txFrame still differs from lastSent
+    static uint8_t txBufferId[USBPRO_PORTS];
+    static uint8_t txFrame[USBPRO_PORTS][513];
+    static uint8_t lastSent[USBPRO_PORTS][513]; // What the host has seen, for ChangeOfState
+    static uint8_t txMessage[5 + USBPRO_MAX_DATA];
+    static uint16_t txMessageSize;
+    static uint16_t txMessageSent;
+};
+
+#endif // __cplusplus
+
+#endif // USB_USBPRO_H
@@ -30,6 +30,7 @@
 
 #include "version.h"
 #include "boardconfig.h"
+#include "usb_uDMX.h"
 
 // Yeah, we got an official USB id:
 // https://github.com/pidcodes/pidcodes.github.com/blob/master/1209/ACEB/index.md
@@ -175,7 +176,7 @@ uint8_t const ncm_configuration[] =
     // Interface number, string index, protocol, report descriptor len, EP In & Out address, size & polling interval
     TUD_HID_INOUT_DESCRIPTOR(ITF_NUM_HID, 0, HID_ITF_PROTOCOL_NONE,
         sizeof(desc_hid_report), EPNUM_HID_OUT, EPNUM_HID_IN,
-        CFG_TUD_HID_BUFSIZE, 5),
+        CFG_TUD_HID_BUFSIZE, 1),
 
     // Interface number, string index, EP notification address and size, EP data address (out, in) and size.
     TUD_CDC_DESCRIPTOR(ITF_NUM_CDC_ACM_CMD, STRID_CDC_ACM_IFNAME, EPNUM_CDC_ACM_CMD,
@@ -293,6 +294,13 @@ const tusb_desc_webusb_url_t desc_url =
 // return false to stall control endpoint (e.g unsupported request)
 bool tud_vendor_control_xfer_cb(uint8_t rhport, uint8_t stage, tusb_control_request_t const * request)
 {
+  // uDMX sends its data as host to device requests, WebUSB and Microsoft
+  // requests are all device to host, so they can't collide
+  if ((getUsbProtocol() == 2) && (request->bmRequestType_bit.type == TUSB_REQ_TYPE_VENDOR) &&
+      (request->bmRequestType_bit.direction == TUSB_DIR_OUT)) {
+    return uDMX_control_xfer_cb(rhport, stage, request);
+  }
+
   // nothing to with DATA & ACK stage
   if (stage != CONTROL_STAGE_SETUP) {
     return true;
@@ -6,8 +6,6 @@
 #include "usb_EDP.h"
 #include "usb_NodleU1.h"
 
-uint8_t usb_buffer[24][512] = {0};
-
 //--------------------------------------------------------------------+
 // USB HID
 //--------------------------------------------------------------------+
@@ -36,9 +34,6 @@ void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_
 
   if (usbProtocol == 0) {
     Usb_EDP::hid_set_report_cb(instance, report_id, report_type, buffer, bufsize);
-  } else if (usbProtocol == 1) {
-    // JaRule emulation
-    // TODO
   } else if ((usbProtocol == 4) || (usbProtocol == 5)) {
     // Nodle U1 emulation
     Usb_NodleU1::hid_set_report_cb(instance, report_id, report_type, buffer, bufsize);
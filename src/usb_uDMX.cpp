@@ -0,0 +1,61 @@
+#include "usb_uDMX.h"
+
+#include "log.h"
+
+#include "dmxbuffer.h"
+
+extern DmxBuffer dmxBuffer;
+
+uint32_t Usb_uDMX::framesReceived;
+uint32_t Usb_uDMX::errors;
+uint8_t Usb_uDMX::staging[512];
+
+bool uDMX_control_xfer_cb(uint8_t rhport, uint8_t stage, tusb_control_request_t const * request) {
+    return Usb_uDMX::control_xfer_cb(rhport, stage, request);
+}
+
+void Usb_uDMX::init() {
+    memset(staging, 0x00, 512);
+    framesReceived = 0;
+    errors = 0;
+}
+
+// Runs in tud_task on core0. The data stage of SetChannelRange is received
+// by TinyUSB into the staging frame, at the offset it has in the universe.
+// Only the channels of the request are written to the buffer, others may
+// have been written by someone else in the meantime
+bool Usb_uDMX::control_xfer_cb(uint8_t rhport, uint8_t stage, tusb_control_request_t const * request) {
+    switch (request->bRequest) {
+        case UDMX_CMD_SET_SINGLE_CHANNEL:
+            if (stage != CONTROL_STAGE_SETUP) {
+                return true;
+            }
+            if (request->wIndex >= 512) {
+                errors++;
+                return false;
+            }
+            dmxBuffer.setChannel(0, request->wIndex, request->wValue & 0xff);
+            framesReceived++;
+            return tud_control_status(rhport, request);
+
+        case UDMX_CMD_SET_CHANNEL_RANGE:
+            if (stage == CONTROL_STAGE_SETUP) {
+                if (((uint32_t)request->wIndex + request->wLength > 512) || (request->wLength == 0)) {
+                    LOG("uDMX: Invalid range. Start: %u, count: %u", request->wIndex, request->wLength);
+                    errors++;
+                    return false;
+                }
+                return tud_control_xfer(rhport, request, staging + request->wIndex, request->wLength);
+            }
+            if (stage == CONTROL_STAGE_DATA) {
+                dmxBuffer.setChannels(0, request->wIndex, staging + request->wIndex, request->wLength);
+                framesReceived++;
+            }
+            return true;
+
+        default:
+            // Bootloader and other requests of the original are not supported
+            errors++;
+            return false;
+    }
+}
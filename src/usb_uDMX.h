@@ -0,0 +1,42 @@
+#ifndef USB_UDMX_H
+#define USB_UDMX_H
+
+#include "tusb.h"
+#include <stdint.h>
+
+// uDMX emulation. There are no data endpoints, the host sends everything as
+// vendor requests (host to device) on the control endpoint:
+//   SetSingleChannel: wValue = value, wIndex = channel, no data stage
+//   SetChannelRange:  wValue = channel count, wIndex = first channel,
+//                     data stage = the values
+// Everything goes to buffer 0
+
+#define UDMX_CMD_SET_SINGLE_CHANNEL 1
+#define UDMX_CMD_SET_CHANNEL_RANGE  2
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Called from tud_vendor_control_xfer_cb (C code) for all host to device
+// vendor requests while uDMX emulation is active
+bool uDMX_control_xfer_cb(uint8_t rhport, uint8_t stage, tusb_control_request_t const * request);
+
+#ifdef __cplusplus
+}
+
+class Usb_uDMX {
+  public:
+    static void init();
+    static bool control_xfer_cb(uint8_t rhport, uint8_t stage, tusb_control_request_t const * request);
+
+    static uint32_t framesReceived;
+    static uint32_t errors;
+
+  private:
+    static uint8_t staging[512];
+};
+
+#endif // __cplusplus
+
+#endif // USB_UDMX_H
@@ -0,0 +1,226 @@
+#include "usb_vendor.h"
+
+#include "log.h"
+
+#include "boardconfig.h"
+
+extern "C" {
+#include <bsp/board.h>
+}
+
+extern DmxBuffer dmxBuffer;
+
+extern critical_section_t bufferLock;
+
+struct UsbVendor_Status Usb_Vendor::stats;
+
+bool Usb_Vendor::active;
+
+struct UsbVendor_Header Usb_Vendor::rxHeader;
+uint8_t Usb_Vendor::rxHeaderReceived;
+uint16_t Usb_Vendor::rxPayloadReceived;
+uint8_t Usb_Vendor::staging[512];
+
+uint32_t Usb_Vendor::txPending;
+uint8_t Usb_Vendor::txBufferId[DMXBUFFER_COUNT];
+uint8_t Usb_Vendor::txMessage[sizeof(struct UsbVendor_Header) + 512];
+uint16_t Usb_Vendor::txMessageSize;
+uint16_t Usb_Vendor::txMessageSent;
+uint32_t Usb_Vendor::lastStatus;
+bool Usb_Vendor::statusRequested;
+
+void Usb_Vendor::init() {
+    active = (getUsbProtocol() != UsbProtocol::JaRule);
+
+    memset(&stats, 0x00, sizeof(struct UsbVendor_Status));
+    stats.bufferCount = DMXBUFFER_COUNT;
+
+    memset(staging, 0x00, sizeof(staging));
+    rxHeaderReceived = 0;
+    rxPayloadReceived = 0;
+
+    txPending = 0;
+    txMessageSize = 0;
+    txMessageSent = 0;
+    lastStatus = 0;
+    statusRequested = false;
+}
+
+// Called on core0 right after tud_task. Nothing here blocks: we only take
+// what the FIFOs have or have room for
+void Usb_Vendor::cyclicTask() {
+    if (!active) {
+        return;
+    }
+
+    if (!tud_vendor_mounted()) {
+        // Start clean when the host opens the interface again
+        rxHeaderReceived = 0;
+        txMessageSize = 0;
+        return;
+    }
+
+    receive();
+    transmit();
+}
+
+void Usb_Vendor::queueBuffer(uint8_t universe, uint8_t bufferId) {
+    if (!active || (universe >= DMXBUFFER_COUNT) || (bufferId >= DMXBUFFER_COUNT)) {
+        return;
+    }
+
+    critical_section_enter_blocking(&bufferLock);
+    txBufferId[universe] = bufferId;
+    txPending |= (1UL << universe);
+    critical_section_exit(&bufferLock);
+}
+
+// The RX FIFO holds several endpoint packets, so TinyUSB already receives the
+// next ones while we copy from it. Payload is read directly into staging and
+// only applied once complete
+void Usb_Vendor::receive() {
+    uint32_t count;
+    uint8_t byte;
+    uint8_t* destination;
+
+    while (tud_vendor_available()) {
+        if (rxHeaderReceived == 0) {
+            // Skip everything until something that looks like a header
+            tud_vendor_read(&byte, 1);
+            if (byte != USB_VENDOR_MAGIC) {
+                stats.errors++;
+                continue;
+            }
+            rxHeader.magic = byte;
+            rxHeaderReceived = 1;
+            continue;
+        }
+
+        if (rxHeaderReceived < sizeof(struct UsbVendor_Header)) {
+            count = tud_vendor_read((uint8_t*)&rxHeader + rxHeaderReceived, sizeof(struct UsbVendor_Header) - rxHeaderReceived);
+            rxHeaderReceived += count;
+            if (rxHeaderReceived < sizeof(struct UsbVendor_Header)) {
+                break;
+            }
+
+            if (!headerValid()) {
+                LOG("USB Vendor: Invalid header. Type: %u, buffer: %u, offset: %u, length: %u", rxHeader.type, rxHeader.buffer, rxHeader.offset, rxHeader.length);
+                stats.errors++;
+                rxHeaderReceived = 0;
+                continue;
+            }
+
+            rxPayloadReceived = 0;
+            if (rxHeader.length == 0) {
+                applyMessage();
+                rxHeaderReceived = 0;
+            }
+            continue;
+        }
+
+        // Only FullFrame and Delta carry a payload, see headerValid
+        destination = staging + rxHeader.offset + rxPayloadReceived;
+        count = tud_vendor_read(destination, rxHeader.length - rxPayloadReceived);
+        rxPayloadReceived += count;
+
+        if (rxPayloadReceived >= rxHeader.length) {
+            applyMessage();
+            rxHeaderReceived = 0;
+        }
+    }
+}
+
+bool Usb_Vendor::headerValid() {
+    switch (rxHeader.type) {
+        case UsbVendor_MsgType::FullFrame:
+            return (rxHeader.buffer < DMXBUFFER_COUNT) &&
+                   (rxHeader.offset == 0) &&
+                   (rxHeader.length <= 512);
+        case UsbVendor_MsgType::Delta:
+            return (rxHeader.buffer < DMXBUFFER_COUNT) &&
+                   (rxHeader.length > 0) &&
+                   ((uint32_t)rxHeader.offset + rxHeader.length <= 512);
+        case UsbVendor_MsgType::GetStatus:
+            return (rxHeader.length == 0);
+        default:
+            return false;
+    }
+}
+
+void Usb_Vendor::applyMessage() {
+    switch (rxHeader.type) {
+        case UsbVendor_MsgType::FullFrame:
+            memset(staging + rxHeader.length, 0x00, 512 - rxHeader.length);
+            dmxBuffer.setBuffer(rxHeader.buffer, staging, 512);
+            stats.framesReceived++;
+            break;
+        case UsbVendor_MsgType::Delta:
+            // Only what the host sent. Channels outside of it may have been
+            // written by someone else since the last message
+            dmxBuffer.setChannels(rxHeader.buffer, rxHeader.offset, staging + rxHeader.offset, rxHeader.length);
+            stats.deltasReceived++;
+            break;
+        case UsbVendor_MsgType::GetStatus:
+            statusRequested = true;
+            break;
+        default:
+            break;
+    }
+}
+
+void Usb_Vendor::transmit() {
+    struct UsbVendor_Header* header = (struct UsbVendor_Header*)txMessage;
+    uint32_t count;
+    uint32_t pending;
+    uint8_t universe;
+
+    if (txMessageSize == 0) {
+        header->magic = USB_VENDOR_MAGIC;
+        header->flags = 0;
+        header->offset = 0;
+
+        if (statusRequested || ((board_millis() - lastStatus) > USB_VENDOR_STATUS_INTERVAL)) {
+            statusRequested = false;
+            lastStatus = board_millis();
+            stats.uptime = lastStatus;
+
+            header->type = UsbVendor_MsgType::Status;
+            header->buffer = 0;
+            header->length = sizeof(struct UsbVendor_Status);
+            memcpy(txMessage + sizeof(struct UsbVendor_Header), &stats, sizeof(struct UsbVendor_Status));
+            txMessageSize = sizeof(struct UsbVendor_Header) + sizeof(struct UsbVendor_Status);
+            txMessageSent = 0;
+        } else if (txPending) {
+            critical_section_enter_blocking(&bufferLock);
+            pending = txPending;
+            universe = 0;
+            while (!(pending & (1UL << universe))) {
+                universe++;
+            }
+            txPending &= ~(1UL << universe);
+            memcpy(txMessage + sizeof(struct UsbVendor_Header), dmxBuffer.buffer[txBufferId[universe]], 512);
+            critical_section_exit(&bufferLock);
+
+            header->type = UsbVendor_MsgType::FullFrame;
+            header->buffer = universe;
+            header->length = 512;
+            txMessageSize = sizeof(struct UsbVendor_Header) + 512;
+            txMessageSent = 0;
+            stats.framesSent++;
+        }
+    }
+
+    if (txMessageSize == 0) {
+        return;
+    }
+
+    count = tud_vendor_write(txMessage + txMessageSent, txMessageSize - txMessageSent);
+    if (count) {
+        tud_vendor_write_flush();
+    }
+    txMessageSent += count;
+
+    if (txMessageSent >= txMessageSize) {
+        txMessageSize = 0;
+    }
+}
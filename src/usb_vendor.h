@@ -0,0 +1,95 @@
+#ifndef USB_VENDOR_H
+#define USB_VENDOR_H
+
+#include "tusb.h"
+#include <stdint.h>
+
+#include "dmxbuffer.h"
+
+#ifdef __cplusplus
+
+// Framed DMX stream over the vendor interface's bulk endpoints. Works in
+// parallel to whatever protocol is used on the HID interface.
+// All values are little endian. Every message starts with this header,
+// followed by `length` byte of payload
+//
+// Host -> device:
+//   FullFrame: payload = channels 0..length-1 of the buffer, rest is zeroed
+//   Delta:     payload = channels offset..offset+length-1, rest unchanged
+//   GetStatus: no payload, answered with Status
+// Device -> host:
+//   FullFrame: DMX data of a buffer patched to usbProto (DMX input)
+//   Status:    payload = UsbVendor_Status
+
+#define USB_VENDOR_MAGIC 0xd5
+
+enum UsbVendor_MsgType : uint8_t {
+    FullFrame                 = 0x01,
+    Delta                     = 0x02,
+    GetStatus                 = 0x10,
+    Status                    = 0x11,
+};
+
+// 8 byte
+struct __attribute__((__packed__)) UsbVendor_Header {
+    uint8_t               magic;          // USB_VENDOR_MAGIC, used to re-sync after garbage
+    UsbVendor_MsgType     type;
+    uint8_t               buffer;         // 0 to DMXBUFFER_COUNT-1
+    uint8_t               flags;          // Reserved, 0
+    uint16_t              offset;         // First channel (Delta only)
+    uint16_t              length;         // Payload length
+};
+
+struct __attribute__((__packed__)) UsbVendor_Status {
+    uint32_t              uptime;         // board_millis()
+    uint32_t              framesReceived; // FullFrame messages applied
+    uint32_t              deltasReceived; // Delta messages applied
+    uint32_t              framesSent;     // FullFrame messages sent to the host
+    uint32_t              errors;         // Invalid headers, bytes skipped while re-syncing
+    uint8_t               bufferCount;    // DMXBUFFER_COUNT
+};
+
+// How often the device sends its status unasked, in ms
+#define USB_VENDOR_STATUS_INTERVAL 1000
+
+class Usb_Vendor {
+  public:
+    static void init();
+    static void cyclicTask();
+
+    // Called from DmxBuffer (any core) for patchings buffer -> usbProto.
+    // universe is what the host sees in the header's buffer field
+    static void queueBuffer(uint8_t universe, uint8_t bufferId);
+
+    static struct UsbVendor_Status stats;
+
+  private:
+    static void receive();
+    static void transmit();
+    static bool headerValid();
+
+    // The vendor interface belongs to Usb_JaRule if that emulation is active
+    static bool active;
+    static void applyMessage();
+
+    // RX: Header is collected byte-wise, payload goes straight to staging,
+    // at the same offset it has in the DMX buffer. Only one message is
+    // received at a time, so one universe is enough for all buffers
+    static struct UsbVendor_Header rxHeader;
+    static uint8_t rxHeaderReceived;
+    static uint16_t rxPayloadReceived;
+    static uint8_t staging[512];
+
+    // TX: One message at a time, written as the FIFO has room
+    static uint32_t txPending;            // Bit field, one bit per universe
+    static uint8_t txBufferId[DMXBUFFER_COUNT];
+    static uint8_t txMessage[sizeof(struct UsbVendor_Header) + 512];
+    static uint16_t txMessageSize;
+    static uint16_t txMessageSent;
+    static uint32_t lastStatus;
+    static bool statusRequested;
+};
+
+#endif // __cplusplus
+
+#endif // USB_VENDOR_H
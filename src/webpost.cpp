@@ -0,0 +1,218 @@
+#include "webpost.h"
+
+#include "dmxfade.h"
+
+extern "C" {
+#include <bsp/board.h>
+}
+
+extern DmxBuffer dmxBuffer;
+
+struct WebServerPost WebPost::posts[WEBSERVER_POSTS];
+struct WebServerPost* WebPost::finishedPost = nullptr;
+
+// The URI comes with the query, if there is one
+bool WebPost::isUri(const char* uri) {
+    return (strncmp(uri, "/dmxBuffer/write.bin", 20) == 0) && ((uri[20] == 0) || (uri[20] == '?'));
+}
+
+bool WebPost::begin(void* connection) {
+    struct WebServerPost* post = nullptr;
+    uint32_t now = board_millis();
+
+    // A slot stays taken until its result has been sent
+    for (uint8_t i = 0; i < WEBSERVER_POSTS; i++) {
+        if (((posts[i].connection == nullptr) && !posts[i].finished) ||
+            ((now - posts[i].startedAt) > WEBSERVER_POST_TIMEOUT_MS))
+        {
+            post = &posts[i];
+            break;
+        }
+    }
+    if (!post) {
+        return false;
+    }
+    if (finishedPost == post) {
+        finishedPost = nullptr;
+    }
+
+    memset(post, 0x00, sizeof(struct WebServerPost));
+    post->connection = connection;
+    post->startedAt = now;
+
+    return true;
+}
+
+// The body is parsed as it comes in, values go straight into the
+// DmxBuffers (or the fade targets) without being collected first
+void WebPost::receive(void* connection, struct pbuf* p) {
+    struct WebServerPost* post = find(connection);
+
+    if (post) {
+        for (struct pbuf* q = p; q != nullptr; q = q->next) {
+            parse(post, (const uint8_t*)q->payload, q->len);
+        }
+    }
+
+    pbuf_free(p);
+}
+
+void WebPost::parse(struct WebServerPost* post, const uint8_t* data, uint16_t size) {
+    struct DmxWriteHeader header;
+    struct DmxWriteRecord record;
+    uint8_t need;
+    uint16_t take;
+    uint32_t bit;
+
+    while (size && !post->error) {
+        if (post->remaining == 0) {
+            // Collect the header or the next record header
+            need = post->haveHeader ? sizeof(struct DmxWriteRecord) : sizeof(struct DmxWriteHeader);
+            take = MIN(need - post->pendingSize, size);
+            memcpy(post->pending + post->pendingSize, data, take);
+            post->pendingSize += take;
+            data += take;
+            size -= take;
+            if (post->pendingSize < need) {
+                return;
+            }
+            post->pendingSize = 0;
+
+            if (!post->haveHeader) {
+                memcpy(&header, post->pending, sizeof(header));
+                if (header.version != DMXWRITE_VERSION) {
+                    post->error = "version";
+                    return;
+                }
+                post->fadeTime = header.fadeTime;
+                post->haveHeader = true;
+                continue;
+            }
+
+            memcpy(&record, post->pending, sizeof(record));
+            if ((record.bufferId >= DMXBUFFER_COUNT) || (record.offset >= 512) || (record.count > (512 - record.offset))) {
+                post->error = "record";
+                return;
+            }
+            post->bufferId = record.bufferId;
+            post->offset = record.offset;
+            post->remaining = record.count;
+            post->records++;
+
+            bit = (1UL << record.bufferId);
+            if (!(post->touched & bit)) {
+                post->touched |= bit;
+                if (post->fadeTime && DmxFade::reserve(record.bufferId, post)) {
+                    post->fading |= bit;
+                }
+            }
+            continue;
+        }
+
+        take = MIN(post->remaining, size);
+        if (post->fading & (1UL << post->bufferId)) {
+            if (!DmxFade::setTarget(post->bufferId, post, post->offset, data, take)) {
+                post->error = "fadeTaken";
+                return;
+            }
+        } else {
+            dmxBuffer.setChannels(post->bufferId, post->offset, data, take, false);
+        }
+        post->offset += take;
+        post->remaining -= take;
+        post->channels += take;
+        data += take;
+        size -= take;
+    }
+}
+
+// Whatever made it into the buffers is patched, even if the request was
+// broken somewhere in the middle
+void WebPost::finish(void* connection) {
+    struct WebServerPost* post = find(connection);
+
+    finishedPost = nullptr;
+    if (!post) {
+        return;
+    }
+
+    if (!post->error && (!post->haveHeader || post->remaining || post->pendingSize)) {
+        post->error = "truncated";
+    }
+
+    for (uint8_t i = 0; i < DMXBUFFER_COUNT; i++) {
+        if (!(post->touched & (1UL << i))) {
+            continue;
+        }
+        if (post->fading & (1UL << i)) {
+            if (!DmxFade::start(i, post, post->fadeTime) && !post->error) {
+                post->error = "fadeTaken";
+            }
+        } else {
+            dmxBuffer.triggerPatchings(i);
+        }
+    }
+
+    // lwIP opens result.json for this connection right after we return
+    post->connection = nullptr;
+    post->finished = true;
+    post->resultFile = nullptr;
+    post->startedAt = board_millis();
+    finishedPost = post;
+}
+
+void WebPost::openResult(void* connection_state) {
+    if (finishedPost) {
+        finishedPost->resultFile = connection_state;
+        finishedPost = nullptr;
+    }
+}
+
+void WebPost::closeResult(void* connection_state) {
+    struct WebServerPost* post = findResult(connection_state);
+
+    if (post) {
+        post->finished = false;
+        post->resultFile = nullptr;
+    }
+}
+
+// Only the connection that sent the POST gets its result
+void WebPost::writeResult(JsonWriter* json, void* connection_state) {
+    struct WebServerPost* post = findResult(connection_state);
+
+    json->beginObject();
+    if (post) {
+        json->value("ok", post->error == nullptr);
+        json->value("error", post->error);
+        json->value("records", post->records);
+        json->value("channels", post->channels);
+        json->value("buffers", __builtin_popcount(post->touched));
+        json->value("fading", __builtin_popcount(post->fading));
+    } else {
+        json->value("ok", false);
+        json->value("error", "noWrite");
+    }
+    json->endObject();
+}
+
+struct WebServerPost* WebPost::findResult(void* connection_state) {
+    if (!connection_state) {
+        return nullptr;
+    }
+    for (uint8_t i = 0; i < WEBSERVER_POSTS; i++) {
+        if (posts[i].finished && (posts[i].resultFile == connection_state)) {
+            return &posts[i];
+        }
+    }
+    return nullptr;
+}
+
+struct WebServerPost* WebPost::find(void* connection) {
+    for (uint8_t i = 0; i < WEBSERVER_POSTS; i++) {
+        if (posts[i].connection == connection) {
+            return &posts[i];
+        }
+    }
+    return nullptr;
+}
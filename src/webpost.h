@@ -0,0 +1,82 @@
+#ifndef WEBPOST_H
+#define WEBPOST_H
+
+#include "pico/stdlib.h"
+
+#include "lwip/pbuf.h"
+
+#include "jsonwriter.h"
+#include "dmxbuffer.h"
+
+// Bulk write, POST /dmxBuffer/write.bin. Little endian, packed: One
+// DmxWriteHeader, then any number of DmxWriteRecord, each followed by count
+// values. Every touched buffer is patched once, at the end of the request.
+// With fadeTime set, the channels fade from their current values instead.
+// The answer is /dmxBuffer/write/result.json with what this request did, or
+// /dmxBuffer/write/busy.json if all slots are taken
+#define DMXWRITE_VERSION 1
+
+struct __attribute__((__packed__)) DmxWriteHeader {
+    uint8_t version;           // DMXWRITE_VERSION
+    uint8_t reserved;
+    uint16_t fadeTime;         // ms, 0: right away
+};
+
+struct __attribute__((__packed__)) DmxWriteRecord {
+    uint8_t bufferId;
+    uint8_t reserved;
+    uint16_t offset;           // First channel, 0-based
+    uint16_t count;            // offset + count <= 512
+};
+
+// Bulk writes being received at the same time. lwIP doesn't tell us about
+// connections that are gone, so a slot is taken over after the timeout
+#define WEBSERVER_POSTS 2
+#define WEBSERVER_POST_TIMEOUT_MS 5000
+
+struct WebServerPost {
+    void* connection;          // nullptr if free
+    uint32_t startedAt;        // board_millis()
+    uint8_t pending[sizeof(struct DmxWriteRecord)]; // Header split over two pbufs
+    uint8_t pendingSize;
+    bool haveHeader;
+    uint16_t fadeTime;
+    uint8_t bufferId;          // Record the values are for
+    uint16_t offset;
+    uint16_t remaining;
+    uint32_t touched;          // One bit per bufferId
+    uint32_t fading;           // Touched and got a fade slot
+    uint16_t records;
+    uint32_t channels;
+    const char* error;         // nullptr while everything is fine
+    bool finished;             // Body is done, result.json not sent yet
+    void* resultFile;          // connection_state of the result.json showing it
+};
+
+#ifdef __cplusplus
+
+// The bulk writes, from lwIP's POST hooks (see webserver.cpp) down to the
+// DmxBuffers and DmxFade
+class WebPost {
+  public:
+    static bool isUri(const char* uri);
+    static bool begin(void* connection);   // False if all slots are busy
+    static void receive(void* connection, struct pbuf* p);
+    static void finish(void* connection);
+
+    // result.json of a finished one, opened right after finish()
+    static void openResult(void* connection_state);
+    static void closeResult(void* connection_state);
+    static void writeResult(JsonWriter* json, void* connection_state);
+
+  private:
+    static struct WebServerPost posts[WEBSERVER_POSTS];
+    static struct WebServerPost* finishedPost;  // Its result.json is about to be opened
+    static struct WebServerPost* find(void* connection);
+    static struct WebServerPost* findResult(void* connection_state);
+    static void parse(struct WebServerPost* post, const uint8_t* data, uint16_t size);
+};
+
+#endif // __cplusplus
+
+#endif // WEBPOST_H
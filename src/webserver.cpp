@@ -6,17 +6,22 @@
 
 #include "snappy.h"
 
-#include "json/json.h"
+#include "cgiparams.h"
+#include "jsonwriter.h"
+#include "webstatus.h"
+#include "webpost.h"
+#include "websnapshot.h"
 
 #include "log.h"
 #include "statusleds.h"
 #include "boardconfig.h"
 #include "dmxbuffer.h"
 #include "wireless.h"
-#include "dhcpdata.h"
+#include "usb_NodleU1.h"
 
-#define MAGIC_ENUM_RANGE_MAX 255
-#include "../lib/magic_enum/include/magic_enum.hpp"
+extern "C" {
+#include <bsp/board.h>
+}
 
 extern StatusLeds statusLeds;
 extern BoardConfig boardConfig;
@@ -27,8 +32,8 @@ extern char __StackLimit; /* Set by linker.  */
 
 base64_encodestate WebServer::b64Encode;
 base64_decodestate WebServer::b64Decode;
-uint8_t WebServer::tmpBuf[800]; // Used to store compressed data
 uint8_t WebServer::tmpBuf2[800]; // Used to store UNcompressed data
+struct WebServerSpill WebServer::spills[WEBSERVER_SPILLS];
 
 static const tCGI cgi_handlers[] = {
   {
@@ -67,6 +72,10 @@ static const tCGI cgi_handlers[] = {
     "/config/wireless/set.json",
     cgi_config_wireless_set
   },
+  {
+    "/config/wireless/discovery/start.json",
+    cgi_config_wireless_discovery_start
+  },
   {
     "/dmxBuffer/set.json",
     cgi_dmxBuffer_set
@@ -75,6 +84,10 @@ static const tCGI cgi_handlers[] = {
     "/config/partyMode/set.json",
     cgi_config_partyMode_set
   },
+  {
+    "/dmxBuffer/snapshot.bin",
+    cgi_dmxBuffer_snapshot
+  },
 };
 
 // This array doesn't need elements since we are using LWIP_HTTPD_SSI_RAW
@@ -91,10 +104,6 @@ void WebServer::cyclicTask() {
     service_traffic();
 }
 
-void WebServer::ipToString(uint32_t ip, char* ipString) {
-    sprintf(ipString, "%ld.%ld.%ld.%ld", (ip & 0xff), ((ip >> 8) & 0xff), ((ip >> 16) & 0xff), ((ip >> 24) & 0xff));
-}
-
 static const char *cgi_system_reset_boot(int iIndex, int iNumParams, char *pcParam[], char *pcValue[])
 {
     reset_usb_boot(0, 0);
@@ -115,22 +124,21 @@ static const char *cgi_config_ioBoards_config(int iIndex, int iNumParams, char *
     uint8_t slot = 0;
     ConfigData newConf = constDefaultConfig;
 
-    std::map<std::string, std::string> params;
-    WebServer::paramsToMap(iNumParams, pcParam, pcValue, &params);
+    CgiParams params(iNumParams, pcParam, pcValue);
 
     // TODO: Check if all required parameters have been given
 
-    newConf.boardType = (BoardType)atoi(params["boardType"].c_str());
-    newConf.portParams[0].direction = (PortParamsDirection)atoi(params["port0dir"].c_str());
-    newConf.portParams[0].connector = (PortParamsConnector)atoi(params["port0con"].c_str());
-    newConf.portParams[1].direction = (PortParamsDirection)atoi(params["port1dir"].c_str());
-    newConf.portParams[1].connector = (PortParamsConnector)atoi(params["port1con"].c_str());
-    newConf.portParams[2].direction = (PortParamsDirection)atoi(params["port2dir"].c_str());
-    newConf.portParams[2].connector = (PortParamsConnector)atoi(params["port2con"].c_str());
-    newConf.portParams[3].direction = (PortParamsDirection)atoi(params["port3dir"].c_str());
-    newConf.portParams[3].connector = (PortParamsConnector)atoi(params["port3con"].c_str());
+    newConf.boardType = (BoardType)params.getInt("boardType");
+    newConf.portParams[0].direction = (PortParamsDirection)params.getInt("port0dir");
+    newConf.portParams[0].connector = (PortParamsConnector)params.getInt("port0con");
+    newConf.portParams[1].direction = (PortParamsDirection)params.getInt("port1dir");
+    newConf.portParams[1].connector = (PortParamsConnector)params.getInt("port1con");
+    newConf.portParams[2].direction = (PortParamsDirection)params.getInt("port2dir");
+    newConf.portParams[2].connector = (PortParamsConnector)params.getInt("port2con");
+    newConf.portParams[3].direction = (PortParamsDirection)params.getInt("port3dir");
+    newConf.portParams[3].connector = (PortParamsConnector)params.getInt("port3con");
 
-    boardConfig.configureBoard(atoi(params["slot"].c_str()), &newConf);
+    boardConfig.configureBoard(params.getInt("slot"), &newConf);
 
     return "/empty.json";
 }
@@ -139,11 +147,10 @@ static const char *cgi_config_load(int iIndex, int iNumParams, char *pcParam[],
 {
     uint8_t slot = 0;
 
-    std::map<std::string, std::string> params;
-    WebServer::paramsToMap(iNumParams, pcParam, pcValue, &params);
+    CgiParams params(iNumParams, pcParam, pcValue);
 
     // TODO: Check if all required parameters have been given
-    slot = atoi(params["slot"].c_str());
+    slot = params.getInt("slot");
 
     boardConfig.loadConfig(slot);
 
@@ -154,11 +161,10 @@ static const char *cgi_config_save(int iIndex, int iNumParams, char *pcParam[],
 {
     uint8_t slot = 0;
 
-    std::map<std::string, std::string> params;
-    WebServer::paramsToMap(iNumParams, pcParam, pcValue, &params);
+    CgiParams params(iNumParams, pcParam, pcValue);
 
     // TODO: Check if all required parameters have been given
-    slot = atoi(params["slot"].c_str());
+    slot = params.getInt("slot");
 
     boardConfig.saveConfig(slot);
 
@@ -169,11 +175,10 @@ static const char *cgi_config_enable(int iIndex, int iNumParams, char *pcParam[]
 {
     uint8_t slot = 0;
 
-    std::map<std::string, std::string> params;
-    WebServer::paramsToMap(iNumParams, pcParam, pcValue, &params);
+    CgiParams params(iNumParams, pcParam, pcValue);
 
     // TODO: Check if all required parameters have been given
-    slot = atoi(params["slot"].c_str());
+    slot = params.getInt("slot");
 
     boardConfig.enableConfig(slot);
 
@@ -184,11 +189,10 @@ static const char *cgi_config_disable(int iIndex, int iNumParams, char *pcParam[
 {
     uint8_t slot = 0;
 
-    std::map<std::string, std::string> params;
-    WebServer::paramsToMap(iNumParams, pcParam, pcValue, &params);
+    CgiParams params(iNumParams, pcParam, pcValue);
 
     // TODO: Check if all required parameters have been given
-    slot = atoi(params["slot"].c_str());
+    slot = params.getInt("slot");
 
     boardConfig.disableConfig(slot);
 
@@ -197,22 +201,22 @@ static const char *cgi_config_disable(int iIndex, int iNumParams, char *pcParam[
 
 static const char *cgi_config_set(int iIndex, int iNumParams, char *pcParam[], char *pcValue[])
 {
-    std::map<std::string, std::string> params;
-    WebServer::paramsToMap(iNumParams, pcParam, pcValue, &params);
+    CgiParams params(iNumParams, pcParam, pcValue);
 
-    std::string decoded;
+    char* boardName = params.get("BoardName");
 
-    if (params.contains(std::string("BoardName"))) {
-        decoded = WebServer::urlDecode(params["BoardName"]);
-        LOG("INPUT: %s, DECODED: %s", params["BoardName"].c_str(), decoded.c_str());
-        snprintf(boardConfig.activeConfig->boardName, 32, "%s", decoded.c_str());
+    if (boardName != nullptr) {
+        LOG("INPUT: %s", boardName);
+        CgiParams::urlDecode(boardName);
+        LOG("DECODED: %s", boardName);
+        snprintf(boardConfig.activeConfig->boardName, 32, "%s", boardName);
     }
 
-    if (params.contains(std::string("OwnIp"))) {
+    if (params.has("OwnIp")) {
         ip4_addr_t ip;
         int ok = 0;
 
-        ok = ip4addr_aton(params["OwnIp"].c_str(), &ip);
+        ok = ip4addr_aton(params.get("OwnIp"), &ip);
         if (!ok) {
             return "/empty.json";
         }
@@ -225,12 +229,9 @@ static const char *cgi_config_set(int iIndex, int iNumParams, char *pcParam[], c
 
 static const char *cgi_config_wireless_set(int iIndex, int iNumParams, char *pcParam[], char *pcValue[])
 {
-    std::map<std::string, std::string> params;
-    WebServer::paramsToMap(iNumParams, pcParam, pcValue, &params);
-
-    std::string decoded;
+    CgiParams params(iNumParams, pcParam, pcValue);
 
-    // role, channel, address, compress, sparse, rate, power
+    // role, channel, address, compress, sparse, fec, hopping, merge, rate, power
 
     LOG("ConfigWirelessSet CONFIG PRE:");
     LOG("ConfigWirelessSet role is %d", boardConfig.activeConfig->radioRole);
@@ -241,72 +242,99 @@ static const char *cgi_config_wireless_set(int iIndex, int iNumParams, char *pcP
     LOG("ConfigWirelessSet rate is %d", boardConfig.activeConfig->radioParams.dataRate);
     LOG("ConfigWirelessSet txPower is %d", boardConfig.activeConfig->radioParams.txPower);
 
-    if (params.contains(std::string("role"))) {
-        boardConfig.activeConfig->radioRole = (RadioRole)atoi(params["role"].c_str());
+    if (params.has("role")) {
+        boardConfig.activeConfig->radioRole = (RadioRole)params.getInt("role");
         LOG("ConfigWirelessSet role is now %d", boardConfig.activeConfig->radioRole);
     }
 
-    if (params.contains(std::string("channel"))) {
-        boardConfig.activeConfig->radioChannel = atoi(params["channel"].c_str());
+    if (params.has("channel")) {
+        boardConfig.activeConfig->radioChannel = params.getInt("channel");
         LOG("ConfigWirelessSet channel is now %d", boardConfig.activeConfig->radioChannel);
     }
 
-    if (params.contains(std::string("address"))) {
-        boardConfig.activeConfig->radioAddress = atoi(params["address"].c_str());
+    if (params.has("address")) {
+        boardConfig.activeConfig->radioAddress = params.getInt("address");
         LOG("ConfigWirelessSet address is now %d", boardConfig.activeConfig->radioAddress);
     }
 
-    if (params.contains(std::string("compress"))) {
+    if (params.has("compress")) {
         boardConfig.activeConfig->radioParams.compression = false;
-        if (params["compress"] == "true") {
+        if (params.equals("compress", "true")) {
             boardConfig.activeConfig->radioParams.compression = true;
         }
         LOG("ConfigWirelessSet compress is now %d", boardConfig.activeConfig->radioParams.compression);
     }
 
-    if (params.contains(std::string("sparse"))) {
+    if (params.has("sparse")) {
         boardConfig.activeConfig->radioParams.allowSparse = false;
-        if (params["sparse"] == "true") {
+        if (params.equals("sparse", "true")) {
             boardConfig.activeConfig->radioParams.allowSparse = true;
         }
         LOG("ConfigWirelessSet allowSparse is now %d", boardConfig.activeConfig->radioParams.allowSparse);
     }
 
-    if (params.contains(std::string("rate"))) {
-        boardConfig.activeConfig->radioParams.dataRate = (rf24_datarate_e)atoi(params["rate"].c_str());
+    if (params.has("fec")) {
+        boardConfig.activeConfig->radioParams.fec = false;
+        if (params.equals("fec", "true")) {
+            boardConfig.activeConfig->radioParams.fec = true;
+        }
+        LOG("ConfigWirelessSet fec is now %d", boardConfig.activeConfig->radioParams.fec);
+    }
+
+    if (params.has("hopping")) {
+        boardConfig.activeConfig->radioParams.hopping = false;
+        if (params.equals("hopping", "true")) {
+            boardConfig.activeConfig->radioParams.hopping = true;
+        }
+        LOG("ConfigWirelessSet hopping is now %d", boardConfig.activeConfig->radioParams.hopping);
+    }
+
+    if (params.has("merge")) {
+        boardConfig.activeConfig->radioParams.mergeMode = MIN(params.getInt("merge"), RadioMergeMode::mergePriority);
+        LOG("ConfigWirelessSet mergeMode is now %d", boardConfig.activeConfig->radioParams.mergeMode);
+    }
+
+    if (params.has("rate")) {
+        boardConfig.activeConfig->radioParams.dataRate = (rf24_datarate_e)params.getInt("rate");
         LOG("ConfigWirelessSet rate is now %d", boardConfig.activeConfig->radioParams.dataRate);
     }
 
-    if (params.contains(std::string("power"))) {
-        boardConfig.activeConfig->radioParams.txPower = (rf24_pa_dbm_e)atoi(params["power"].c_str());
+    if (params.has("power")) {
+        boardConfig.activeConfig->radioParams.txPower = (rf24_pa_dbm_e)params.getInt("power");
         LOG("ConfigWirelessSet txPower is now %d", boardConfig.activeConfig->radioParams.txPower);
     }
 
     return "/empty.json";
 }
 
+static const char *cgi_config_wireless_discovery_start(int iIndex, int iNumParams, char *pcParam[], char *pcValue[])
+{
+    // Runs in the background, the result can be polled via /config/wireless/discovery/get.json
+    wireless.startDiscovery();
+    return "/empty.json";
+}
+
 static const char *cgi_config_partyMode_set(int iIndex, int iNumParams, char *pcParam[], char *pcValue[])
 {
-    std::map<std::string, std::string> params;
-    WebServer::paramsToMap(iNumParams, pcParam, pcValue, &params);
+    CgiParams params(iNumParams, pcParam, pcValue);
 
     bool enabled = false;
     uint8_t buffer = 0;
     uint16_t offset = 0;
 
-    if (params.contains(std::string("enabled"))) {
-        statusLeds.partyModeEnabled = (bool)atoi(params["enabled"].c_str());
+    if (params.has("enabled")) {
+        statusLeds.partyModeEnabled = (bool)params.getInt("enabled");
     }
 
-    if (params.contains(std::string("buffer"))) {
-        statusLeds.partyModeBuffer = atoi(params["buffer"].c_str());
+    if (params.has("buffer")) {
+        statusLeds.partyModeBuffer = params.getInt("buffer");
         if (statusLeds.partyModeBuffer > DMXBUFFER_COUNT) {
             statusLeds.partyModeBuffer = DMXBUFFER_COUNT;
         }
     }
 
-    if (params.contains(std::string("offset"))) {
-        statusLeds.partyModeOffset = atoi(params["offset"].c_str());
+    if (params.has("offset")) {
+        statusLeds.partyModeOffset = params.getInt("offset");
         if (statusLeds.partyModeOffset > (512 -24)) {
             statusLeds.partyModeOffset = (512 -24);
         }
@@ -315,6 +343,15 @@ static const char *cgi_config_partyMode_set(int iIndex, int iNumParams, char *pc
     return "/empty.json";
 }
 
+// Only takes the parameters, the file itself is opened right afterwards
+// by lwIP (see fs_open_custom)
+static const char *cgi_dmxBuffer_snapshot(int iIndex, int iNumParams, char *pcParam[], char *pcValue[])
+{
+    WebSnapshot::setParams(iNumParams, pcParam, pcValue);
+
+    return "/dmxBuffer/snapshot.bin";
+}
+
 static const char *cgi_dmxBuffer_set(int iIndex, int iNumParams, char *pcParam[], char *pcValue[])
 {
     uint8_t bufferId = 0;
@@ -325,35 +362,31 @@ static const char *cgi_dmxBuffer_set(int iIndex, int iNumParams, char *pcParam[]
     bool compStatus = false;
     char* data = nullptr;    // Sets the complete buffer
 
-    std::map<std::string, std::string> params;
-    WebServer::paramsToMap(iNumParams, pcParam, pcValue, &params);
-
-    // Parse all arguments. // TODO: std::map ?
-    for (int i = 0; i < iNumParams; i++) {
-        if (!strcmp(pcParam[i], "buffer")) {
-            bufferId = atoi(pcValue[i]);
-        } else if (!strcmp(pcParam[i], "channel")) {
-            channel = atoi(pcValue[i]);
-        } else if (!strcmp(pcParam[i], "value")) {
-            value = atoi(pcValue[i]);
-        } else if (!strcmp(pcParam[i], "data")) {
-            data = pcValue[i];
-        }
-    }
+    CgiParams params(iNumParams, pcParam, pcValue);
 
-    if (!params.contains(std::string("data"))) {
+    bufferId = params.getInt("buffer");
+    channel = params.getInt("channel");
+    value = params.getInt("value");
+    data = params.get("data");
+
+    if (data == nullptr) {
         // Set a single channel
         dmxBuffer.setChannel(bufferId, channel, value);
     } else {
         // TODO: Common, global methods for Base64-decode + Snappy decompress!
         LOG("Set complete buffer: %s", data);
+        // Base64 gives 3 byte per 4 characters
+        if ((strlen(data) / 4 * 3) > sizeof(WebStatus::tmpBuf)) {
+            return "/empty.json";
+        }
         base64_init_decodestate(&WebServer::b64Decode);
-        decodedLength = base64_decode_block(data, strlen(data), WebServer::tmpBuf, &WebServer::b64Decode);
+        decodedLength = base64_decode_block(data, strlen(data), WebStatus::tmpBuf, &WebServer::b64Decode);
         LOG("decodedLength: %d", decodedLength);
 
-        if (snappy::GetUncompressedLength((const char*)WebServer::tmpBuf, decodedLength, &uncompressedLength) == true) {
+        if ((snappy::GetUncompressedLength((const char*)WebStatus::tmpBuf, decodedLength, &uncompressedLength) == true) &&
+            (uncompressedLength <= sizeof(WebServer::tmpBuf2))) {
             LOG("uncompressedLength: %d", uncompressedLength);
-            if (snappy::RawUncompress((const char*)WebServer::tmpBuf, decodedLength, (char*)WebServer::tmpBuf2) == true) {
+            if (snappy::RawUncompress((const char*)WebStatus::tmpBuf, decodedLength, (char*)WebServer::tmpBuf2) == true) {
                 dmxBuffer.setBuffer(bufferId, WebServer::tmpBuf2, uncompressedLength);
             }
         }
@@ -363,240 +396,87 @@ static const char *cgi_dmxBuffer_set(int iIndex, int iNumParams, char *pcParam[]
     return "/empty.json";
 }
 
-static u16_t ssi_handler(const char* ssi_tag_name, char *pcInsert, int iInsertLen) {
-    return WebServer::ssi_handler(ssi_tag_name, pcInsert, iInsertLen);
+static u16_t ssi_handler(const char* ssi_tag_name, char *pcInsert, int iInsertLen, u16_t current_tag_part, u16_t *next_tag_part, void *connection_state) {
+    return WebServer::ssi_handler(ssi_tag_name, pcInsert, iInsertLen, current_tag_part, next_tag_part, connection_state);
 }
 
-u16_t WebServer::ssi_handler(const char* ssi_tag_name, char *pcInsert, int iInsertLen) {
-    // Called once per Tag, no matter which file has been requested
-
-    std::string tagName(ssi_tag_name);
-    Json::Value output;
-    Json::StreamWriterBuilder wbuilder;
-    std::string output_string;
-
-    wbuilder["indentation"] = "";
-
-    if (tagName == "OverviewGet") {
-        char ownIp[16];
-        char ownMask[16];
-        char hostIp[16];
-
-        char ifname[3];
-        char ip[16];
-
-        WebServer::ipToString(boardConfig.activeConfig->ownIp, ownIp);
-        WebServer::ipToString(boardConfig.activeConfig->ownMask, ownMask);
-        WebServer::ipToString(boardConfig.activeConfig->hostIp, hostIp);
-
-        output["debug"]["flash"]["totalSize"] = PICO_FLASH_SIZE_BYTES;
-        output["debug"]["flash"]["sectorSize"] = FLASH_SECTOR_SIZE;
-        output["debug"]["flash"]["blockSize"] = FLASH_BLOCK_SIZE;
-
-        output["debug"]["toolchain"]["pico_sdk_version"] = PICO_SDK_VERSION_STRING;
-        output["debug"]["toolchain"]["PICO_BOARD"] = PICO_BOARD;
-#if defined(__GNUC__)
-# if defined(__GNUC_PATCHLEVEL__)
-#  define __GNUC_VERSION__ (__GNUC__ * 10000 \
-                            + __GNUC_MINOR__ * 100 \
-                            + __GNUC_PATCHLEVEL__)
-# else
-#  define __GNUC_VERSION__ (__GNUC__ * 10000 \
-                            + __GNUC_MINOR__ * 100)
-# endif
-        output["debug"]["toolchain"]["compiler_name"] = "GNU gcc";
-        output["debug"]["toolchain"]["compiler_version"] = __GNUC_VERSION__;
-#endif
-#if defined(__clang_version__)
-        output["debug"]["toolchain"]["compiler_name"] = "LLVM clang";
-        output["debug"]["toolchain"]["compiler_version"] = __clang_version__;
-#endif
-#if defined (__cplusplus)
-        output["debug"]["toolchain"]["cplusplus_standard"] = (int64_t)__cplusplus;
-#endif
-        output["debug"]["structSize"]["ConfigData"] = sizeof(ConfigData);
-        output["debug"]["structSize"]["Patching"] = sizeof(Patching);
-        output["debug"]["structSize"]["EthDestParams"] = sizeof(EthDestParams);
-
-        output["boardName"] = boardConfig.activeConfig->boardName;
-        output["boardIsPicoW"] = BoardConfig::boardIsPicoW;
-        output["configSource"] = boardConfig.configSource;
-        output["configSourceString"] = std::string(magic_enum::enum_name<ConfigSource>(boardConfig.configSource));
-        output["version"] = VERSION;
-        output["serial"] = BoardConfig::boardSerialString;
-        output["shortId"] = BoardConfig::shortId;
-
-        struct netif* iface = netif_list;
-        while (iface != nullptr) {
-            sprintf(ifname, "%c%c", iface->name[0], iface->name[1]);
-            WebServer::ipToString(iface->ip_addr.addr, ip);
-            output["net"][ifname]["ip"] = ip;
-            WebServer::ipToString(iface->netmask.addr, ip);
-            output["net"][ifname]["netmask"] = ip;
-            WebServer::ipToString(iface->gw.addr, ip);
-            output["net"][ifname]["gw"] = ip;
-            if (iface->hostname) {
-                output["net"][ifname]["hostname"] = iface->hostname;
-            }
-
-            iface = iface->next;
-        }
-
-        for (int i = 0; i < DHCP_NUM_ENTRIES_USB; i++) {
-            output["net"]["u0"]["dhcp"][i] = DhcpData::dhcpEntryToString(&(dhcp_entries_usb[i]));
-        }
-        for (int i = 0; i < DHCP_NUM_ENTRIES_ETH; i++) {
-            output["net"]["e0"]["dhcp"][i] = DhcpData::dhcpEntryToString(&(dhcp_entries_eth[i]));
-        }
-        for (int i = 0; i < DHCP_NUM_ENTRIES_WIFI; i++) {
-            output["net"]["w1"]["dhcp"][i] = DhcpData::dhcpEntryToString(&(dhcp_entries_wifi[i]));
-        }
-
-        output["wirelessModule"] = wireless.moduleAvailable;
-        output["statusLedBrightness"] = boardConfig.activeConfig->statusLedBrightness;
-
-        output["createdDefaultConfig"] = boardConfig.createdDefaultConfig;
-
-        output_string = Json::writeString(wbuilder, output);
-        return snprintf(pcInsert, iInsertLen, "%s", output_string.c_str());
-
-    } else if (tagName == "OverviewStatusledsGet") {
-        bool red_static, blue_static, green_static;
-        bool red_blink, green_blink, blue_blink;
-        char hexColor[8];
-
-        for (int i = 0; i < 8; i++) {
-            red_static = 0;
-            green_static = 0;
-            blue_static = 0;
-            red_blink = 0;
-            green_blink = 0;
-            blue_blink = 0;
-            Json::Value ledStatus;
-            statusLeds.getLed(i, &red_static, &green_static, &blue_static, &red_blink, &green_blink, &blue_blink);
-            snprintf(hexColor, 8, "#%02x%02x%02x", red_static ? 0xff : 0x00, green_static ? 0xff : 0x00, blue_static ? 0xff : 0x00);
-            ledStatus["static"] = hexColor;
-            snprintf(hexColor, 8, "#%02x%02x%02x", red_blink ? 0xff : 0x00, green_blink ? 0xff : 0x00, blue_blink ? 0xff : 0x00);
-            ledStatus["blink"] = hexColor;
-            output[i] = ledStatus;
-        }
-        output_string = Json::writeString(wbuilder, output);
-        return snprintf(pcInsert, iInsertLen, "%s", output_string.c_str());
-
-    } else if (tagName == "OverviewIoBoardsGet") {
-        char boardName[10];
-
-        // Does printing the base board info make sense?
-        // Basically it's only to know if it has an invalid, valid or disabled config ...
-        output["base"]["exist"] = true;
-        output["base"]["type"] = boardConfig.configData[4]->boardType;
-        output["base"]["typeString"] = std::string(magic_enum::enum_name(boardConfig.configData[4]->boardType));
-
-        // Iterate over the max 4 io boards
-        for (uint8_t i = 0; i < 4; i++) {
-            output["boards"][i]["exist"] = boardConfig.responding[i];
-            output["boards"][i]["type"] = boardConfig.configData[i]->boardType;
-            output["boards"][i]["typeString"] = std::string(magic_enum::enum_name(boardConfig.configData[i]->boardType));
-            for (uint8_t j = 0; j < 4; j++) {
-                output["boards"][i]["ports"][j]["direction"] = (boardConfig.configData[i]->portParams[j].direction);
-                output["boards"][i]["ports"][j]["directionString"] = std::string(magic_enum::enum_name(boardConfig.configData[i]->portParams[j].direction));
-                output["boards"][i]["ports"][j]["connector"] = boardConfig.configData[i]->portParams[j].connector;
-                output["boards"][i]["ports"][j]["connectorString"] = std::string(magic_enum::enum_name(boardConfig.configData[i]->portParams[j].connector));
-            }
-        }
-
-        output_string = Json::writeString(wbuilder, output);
-        return snprintf(pcInsert, iInsertLen, "%s", output_string.c_str());
-
-    } else if (tagName == "ConfigStatusLedsBrightnessGet") {
-        return snprintf(pcInsert, iInsertLen, "{\"value\":%d}", boardConfig.activeConfig->statusLedBrightness);
-
-    } else if (tagName == "ConfigWebSeverIpGet") {
-        char ownIp[16];
-        char ownMask[16];
-        char hostIp[16];
-        WebServer::ipToString(boardConfig.activeConfig->ownIp, ownIp);
-        WebServer::ipToString(boardConfig.activeConfig->ownMask, ownMask);
-        WebServer::ipToString(boardConfig.activeConfig->hostIp, hostIp);
-        output["ownIp"] = ownIp;
-        output["ownMask"] = ownMask;
-        output["hostIp"] = hostIp;
-        output_string = Json::writeString(wbuilder, output);
-        return snprintf(pcInsert, iInsertLen, "%s", output_string.c_str());
-
-    } else if (tagName == "ConfigWirelessGet") {
-        output["role"] = boardConfig.activeConfig->radioRole;
-        output["channel"] = boardConfig.activeConfig->radioChannel;
-        output["address"] = boardConfig.activeConfig->radioAddress;
-        output["compress"] = boardConfig.activeConfig->radioParams.compression;
-        output["sparse"] = boardConfig.activeConfig->radioParams.allowSparse;
-        output["dataRate"] = (int)boardConfig.activeConfig->radioParams.dataRate;
-        output["txPower"] = (int)boardConfig.activeConfig->radioParams.txPower;
-        output_string = Json::writeString(wbuilder, output);
-        return snprintf(pcInsert, iInsertLen, "%s", output_string.c_str());
-
-    } else if (tagName.rfind("DmxBuffer", 0) == 0) {
-        // Don't use jsoncpp here for performance reasons, write directly to pcInsert
-
-        int buffer = 0;
-        uint16_t channel;
-        uint32_t offset = 0;
-
-        sscanf(ssi_tag_name, "DmxBuffer%dGet", &buffer);
-        offset += sprintf(pcInsert + offset, "{\"buffer\":%d,\"value\":\"", buffer);
-
-        // TODO: common function to compress & base64-encode
-
-/*        void* dummy;
-        dummy = malloc(1);
-        free(dummy);
-        LOG("malloc returned %08x PRE snappy. Stacklimit: %08x", dummy, __StackLimit);
-*/
-        size_t actuallyWritten = 800;
-        snappy::RawCompress((const char *)dmxBuffer.buffer[buffer], 512, (char*)WebServer::tmpBuf, &actuallyWritten);
-
-/*        dummy = malloc(1);
-        free(dummy);
-        LOG("malloc returned %08x POST snappy. Stacklimit: %08x", dummy, __StackLimit);
-*/
-        base64_init_encodestate(&WebServer::b64Encode);
-        offset += base64_encode_block(WebServer::tmpBuf, actuallyWritten, pcInsert + offset, &WebServer::b64Encode);
-        offset += base64_encode_blockend(pcInsert + offset, &WebServer::b64Encode);
+// lwIP asks for a state per opened file. We only need something that tells
+// the connections apart, the file itself does that
+extern "C" void *fs_state_init(struct fs_file *file, const char *name) {
+    if (strcmp(name, "/dmxBuffer/write/result.json") == 0) {
+        WebPost::openResult(file);
+    }
+    return file;
+}
 
-        offset += sprintf(pcInsert + offset, "\"}");
+extern "C" void fs_state_free(struct fs_file *file, void *state) {
+    WebServer::releaseSpill(state);
+    WebPost::closeResult(state);
+}
 
-        return offset;
+extern "C" int fs_open_custom(struct fs_file *file, const char *name) {
+    if (strcmp(name, "/dmxBuffer/snapshot.bin") == 0) {
+        return WebSnapshot::open(file);
+    }
+    return 0;
+}
 
-    } else if (tagName == "ConfigWirelessSpectrumGet") {
-        // Don't use jsoncpp here for performance reasons, write directly to pcInsert
+extern "C" int fs_read_custom(struct fs_file *file, char *buffer, int count) {
+    return WebSnapshot::read(file, buffer, count);
+}
 
-        uint8_t channel;
-        uint32_t offset = 0;
-        uint32_t offset2 = 0;
+extern "C" void fs_close_custom(struct fs_file *file) {
+    WebSnapshot::close(file);
+}
 
-        offset += sprintf(pcInsert + offset, "{\"spectrum\":\"");
+// lwIP's POST hooks (LWIP_HTTPD_SUPPORT_POST)
+extern "C" err_t httpd_post_begin(void *connection, const char *uri, const char *http_request, u16_t http_request_len, int content_len, char *response_uri, u16_t response_uri_len, u8_t *post_auto_wnd) {
+    // lwIP answers with a 404 if response_uri is left empty. Never the URI
+    // itself, that would serve the file or run the CGI behind it
+    if (!WebPost::isUri(uri)) {
+        return ERR_ARG;
+    }
+    if (!WebPost::begin(connection)) {
+        snprintf(response_uri, response_uri_len, "/dmxBuffer/write/busy.json");
+        return ERR_ARG;
+    }
+    return ERR_OK;
+}
 
-        // TODO: common function to compress & base64-encode
+extern "C" err_t httpd_post_receive_data(void *connection, struct pbuf *p) {
+    WebPost::receive(connection, p);
+    return ERR_OK;
+}
 
-        // Compress the array using snappy
-        size_t actuallyRead = 0;
-        size_t actuallyWritten = 1000;
-        snappy::RawCompress((const char *)wireless.signalStrength, MAXCHANNEL*sizeof(uint16_t), (char*)WebServer::tmpBuf, &actuallyWritten);
+extern "C" void httpd_post_finished(void *connection, char *response_uri, u16_t response_uri_len) {
+    WebPost::finish(connection);
+    snprintf(response_uri, response_uri_len, "/dmxBuffer/write/result.json");
+}
 
-        base64_init_encodestate(&WebServer::b64Encode);
-        offset += base64_encode_block(WebServer::tmpBuf, actuallyWritten, pcInsert + offset, &WebServer::b64Encode);
-        offset += base64_encode_blockend(pcInsert + offset, &WebServer::b64Encode);
+struct WebServerSpill* WebServer::findSpill(void* connection_state) {
+    for (uint8_t i = 0; i < WEBSERVER_SPILLS; i++) {
+        if (spills[i].owner == connection_state) {
+            return &spills[i];
+        }
+    }
+    return nullptr;
+}
 
-        offset += sprintf(pcInsert + offset, "\"}");
+void WebServer::releaseSpill(void* connection_state) {
+    struct WebServerSpill* spill;
 
-        return offset;
+    if (connection_state && (spill = findSpill(connection_state))) {
+        spill->owner = nullptr;
+    }
+}
 
-    } else if (tagName == "ConfigWirelessStatsGet") {
-        output_string = wireless.getWirelessStats();
-        return snprintf(pcInsert, iInsertLen, "%s", output_string.c_str());
+u16_t WebServer::ssi_handler(const char* ssi_tag_name, char *pcInsert, int iInsertLen, u16_t current_tag_part, u16_t *next_tag_part, void *connection_state) {
+    // Called once per Tag, no matter which file has been requested.
+    // Called again with the next current_tag_part as long as we set next_tag_part
 
-    } else if (tagName == "LogGet") {
-        // Don't use jsoncpp here for performance reasons, write directly to pcInsert
+    if (strcmp(ssi_tag_name, "LogGet") == 0) {
+        // Reading the log removes the entries, so this can't be written twice
+        // like the others. Fills one insert, the rest comes with the next request
 
         uint32_t offset = 0;
 
@@ -607,35 +487,92 @@ u16_t WebServer::ssi_handler(const char* ssi_tag_name, char *pcInsert, int iInse
         offset += sprintf(pcInsert + offset, "], \"remaining\": %d}", remaining);
 
         return offset;
+    }
 
-    } else {
+    // The rest of a document that didn't fit into the first insert. There
+    // are only more parts if it's in a spill buffer
+    if (current_tag_part != 0) {
+        struct WebServerSpill* spill = connection_state ? findSpill(connection_state) : nullptr;
+        return spill ? sendSpill(spill, pcInsert, iInsertLen, current_tag_part, next_tag_part) : 0;
+    }
+
+    JsonWriter json(pcInsert, iInsertLen);
+    if (!writeTag(ssi_tag_name, &json, connection_state)) {
         return HTTPD_SSI_TAG_UNKNOWN;
     }
-}
+    if (!json.overflowed()) {
+        return json.length();
+    }
 
-void WebServer::paramsToMap(int iNumParams, char *pcParam[], char *pcValue[], std::map<std::string, std::string>* params) {
-    for (int i = 0; i < iNumParams; i++) {
-        if ((pcParam[i] == nullptr) || (pcValue[i] == nullptr)) {
-            continue;
+    // Too large for one insert. Write it once more into a spill buffer, so
+    // all parts are from the same rendering even if the values change meanwhile
+    struct WebServerSpill* spill = connection_state ? findSpill(connection_state) : nullptr;
+    if (connection_state && !spill) {
+        spill = findSpill(nullptr);
+    }
+    if (spill) {
+        JsonWriter spillJson(spill->data, WEBSERVER_SPILL_SIZE);
+        writeTag(ssi_tag_name, &spillJson, connection_state);
+        if (!spillJson.overflowed()) {
+            spill->owner = connection_state;
+            spill->size = spillJson.length();
+            return sendSpill(spill, pcInsert, iInsertLen, 0, next_tag_part);
         }
-        (*params)[std::string(pcParam[i])] = std::string(pcValue[i]);
     }
+
+    // Parts of different renderings wouldn't fit together. Better nothing
+    // than broken JSON
+    JsonWriter error(pcInsert, iInsertLen);
+    error.beginObject();
+    error.value("ok", false);
+    error.value("error", spill ? "tooLarge" : "busy");
+    error.endObject();
+    return error.length();
 }
 
-// From: https://stackoverflow.com/a/4823686
-std::string WebServer::urlDecode(std::string &SRC) {
-    std::string ret;
-    char ch;
-    int i, ii;
-    for (i = 0; i < SRC.length(); i++) {
-        if (int(SRC[i]) == '%') {
-            sscanf(SRC.substr(i+1,2).c_str(), "%x", &ii);
-            ch = static_cast<char>(ii);
-            ret += ch;
-            i = i + 2;
-        } else {
-            ret += SRC[i];
-        }
+// Every part but the last one fills the whole insert
+u16_t WebServer::sendSpill(struct WebServerSpill* spill, char *pcInsert, int iInsertLen, u16_t current_tag_part, u16_t *next_tag_part) {
+    size_t offset = (size_t)current_tag_part * iInsertLen;
+    size_t size;
+
+    if (offset >= spill->size) {
+        spill->owner = nullptr;
+        return 0;
+    }
+
+    size = MIN((size_t)iInsertLen, spill->size - offset);
+    memcpy(pcInsert, spill->data + offset, size);
+    if ((offset + size) < spill->size) {
+        *next_tag_part = current_tag_part + 1;
+    } else {
+        spill->owner = nullptr;
     }
-    return (ret);
+    return size;
+}
+
+// Returns false if the tag is unknown. Must write the same document every
+// time as long as nothing changes, see ssi_handler
+bool WebServer::writeTag(const char* tagName, JsonWriter* json, void *connection_state) {
+    // What the board shows about its state, see webstatus.cpp
+    if (WebStatus::writeTag(tagName, json)) {
+        return true;
+    }
+
+    if (strcmp(tagName, "ConfigWirelessStatsGet") == 0) {
+        wireless.getWirelessStats(json);
+
+    } else if (strcmp(tagName, "ConfigWirelessDiscoveryGet") == 0) {
+        wireless.getDiscoveryResult(json);
+
+    } else if (strcmp(tagName, "DmxBufferWriteResultGet") == 0) {
+        WebPost::writeResult(json, connection_state);
+
+    } else if (strcmp(tagName, "UsbNodleU1StatsGet") == 0) {
+        Usb_NodleU1::getStats(json);
+
+    } else {
+        return false;
+    }
+
+    return true;
 }
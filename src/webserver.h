@@ -12,11 +12,29 @@ extern "C" {
 }
 
 #include "tusb_lwip_glue.h"
+#include "lwip/apps/fs.h"
 
 #include "version.h"
 
 #include <string>
-#include <map>
+
+#include "jsonwriter.h"
+#include "dmxbuffer.h"
+#include "webpost.h"
+
+// SSI output larger than LWIP_HTTPD_MAX_TAG_INSERT_LEN is written once into
+// a spill buffer and sent in parts from there, so all parts are from the
+// same rendering. lwIP can't be told to wait for one, so if all of them are
+// taken by other connections, {"ok":false,"error":"busy"} is sent instead
+// and the browser asks again with its next poll
+#define WEBSERVER_SPILLS 2
+#define WEBSERVER_SPILL_SIZE 8192
+
+struct WebServerSpill {
+    void* owner;               // connection_state, nullptr if free
+    size_t size;
+    char data[WEBSERVER_SPILL_SIZE];
+};
 
 #ifdef __cplusplus
 
@@ -24,18 +42,19 @@ class WebServer {
   public:
     void init();
     void cyclicTask();
-    static inline void ipToString(uint32_t ip, char* ipString);
-    static u16_t ssi_handler(const char* ssi_tag_name, char *pcInsert, int iInsertLen);
-
-    static inline void paramsToMap(int iNumParams, char *pcParam[], char *pcValue[], std::map<std::string, std::string>* params);
-    static std::string urlDecode(std::string &input);
+    static u16_t ssi_handler(const char* ssi_tag_name, char *pcInsert, int iInsertLen, u16_t current_tag_part, u16_t *next_tag_part, void *connection_state);
+    static void releaseSpill(void* connection_state);
 
     static base64_encodestate b64Encode;
     static base64_decodestate b64Decode;
-    static uint8_t tmpBuf[800];
     static uint8_t tmpBuf2[800];
 
   private:
+    static bool writeTag(const char* tagName, JsonWriter* json, void *connection_state);
+
+    static struct WebServerSpill spills[WEBSERVER_SPILLS];
+    static struct WebServerSpill* findSpill(void* connection_state);
+    static u16_t sendSpill(struct WebServerSpill* spill, char *pcInsert, int iInsertLen, u16_t current_tag_part, u16_t *next_tag_part);
 };
 
 #endif // __cplusplus
@@ -55,10 +74,12 @@ static const char *cgi_config_enable(int iIndex, int iNumParams, char *pcParam[]
 static const char *cgi_config_disable(int iIndex, int iNumParams, char *pcParam[], char *pcValue[]);
 static const char *cgi_config_set(int iIndex, int iNumParams, char *pcParam[], char *pcValue[]);
 static const char *cgi_config_wireless_set(int iIndex, int iNumParams, char *pcParam[], char *pcValue[]);
+static const char *cgi_config_wireless_discovery_start(int iIndex, int iNumParams, char *pcParam[], char *pcValue[]);
 static const char *cgi_config_partyMode_set(int iIndex, int iNumParams, char *pcParam[], char *pcValue[]);
+static const char *cgi_dmxBuffer_snapshot(int iIndex, int iNumParams, char *pcParam[], char *pcValue[]);
 
 
-static u16_t ssi_handler(const char* ssi_tag_name, char *pcInsert, int iInsertLen);
+static u16_t ssi_handler(const char* ssi_tag_name, char *pcInsert, int iInsertLen, u16_t current_tag_part, u16_t *next_tag_part, void *connection_state);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,153 @@
+#include "websnapshot.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+uint32_t WebSnapshot::mask = 0;
+uint32_t WebSnapshot::since = 0;
+struct WebServerSnapshot WebSnapshot::snapshots[WEBSERVER_SNAPSHOTS];
+
+static_assert(DMXBUFFER_COUNT <= 32, "WebSnapshot::mask has one bit per buffer");
+
+// Only takes the parameters, the file itself is opened right afterwards
+// by lwIP
+void WebSnapshot::setParams(int iNumParams, char *pcParam[], char *pcValue[]) {
+    char* next;
+    unsigned long bufferId;
+
+    mask = (1UL << DMXBUFFER_COUNT) - 1;
+    since = 0;
+
+    for (int i = 0; i < iNumParams; i++) {
+        if ((pcParam[i] == nullptr) || (pcValue[i] == nullptr)) {
+            continue;
+        }
+
+        if (strcmp(pcParam[i], "since") == 0) {
+            since = strtoul(pcValue[i], nullptr, 10);
+        } else if (strcmp(pcParam[i], "buffers") == 0) {
+            // lwIP doesn't decode the URL, so the commas might be %2C
+            mask = 0;
+            next = pcValue[i];
+            while (*next) {
+                bufferId = strtoul(next, &next, 10);
+                if (bufferId < DMXBUFFER_COUNT) {
+                    mask |= (1UL << bufferId);
+                }
+                while (*next && ((*next < '0') || (*next > '9'))) {
+                    next++;
+                }
+            }
+        }
+    }
+}
+
+// Decides which buffers are part of the snapshot. Their content is read
+// from the DmxBuffers while sending, there is no copy of the whole snapshot
+int WebSnapshot::open(struct fs_file *file) {
+    struct WebServerSnapshot* snapshot = nullptr;
+    uint32_t openMask = mask;
+    uint32_t openSince = since;
+    uint32_t size;
+
+    // The next request without parameters gets everything again
+    mask = (1UL << DMXBUFFER_COUNT) - 1;
+    since = 0;
+
+    for (uint8_t i = 0; i < WEBSERVER_SNAPSHOTS; i++) {
+        if (!snapshots[i].used) {
+            snapshot = &snapshots[i];
+            break;
+        }
+    }
+    if (!snapshot) {
+        return 0;
+    }
+
+    snapshot->header.version = DMXSNAPSHOT_VERSION;
+    snapshot->header.recordCount = 0;
+    snapshot->header.recordSize = sizeof(struct DmxSnapshotRecord) + 512;
+    snapshot->header.sequence = DmxBuffer::lastSequence;
+    for (uint8_t i = 0; i < DMXBUFFER_COUNT; i++) {
+        if ((openMask & (1UL << i)) && (DmxBuffer::sequence[i] > openSince)) {
+            snapshot->bufferIds[snapshot->header.recordCount++] = i;
+        }
+    }
+
+    size = sizeof(struct DmxSnapshotHeader) + snapshot->header.recordCount * snapshot->header.recordSize;
+    snapshot->httpLength = snprintf(snapshot->http, WEBSERVER_SNAPSHOT_HTTP_SIZE,
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: application/octet-stream\r\n"
+        "Content-Length: %lu\r\n"
+        "Cache-Control: no-store\r\n"
+        "\r\n", (unsigned long)size);
+    snapshot->used = true;
+
+    file->data = nullptr;
+    file->len = snapshot->httpLength + size;
+    file->index = 0;
+    file->pextension = snapshot;
+    file->flags = FS_FILE_FLAG_HTTP_HEADER_INCLUDED | FS_FILE_FLAG_HTTP_HEADER_PERSISTENT | FS_FILE_FLAG_HTTP_HEADER_11;
+
+    return 1;
+}
+
+int WebSnapshot::read(struct fs_file *file, char *buffer, int count) {
+    struct WebServerSnapshot* snapshot = (struct WebServerSnapshot*)file->pextension;
+    struct DmxSnapshotRecord record;
+    const uint8_t* source;
+    uint32_t position;
+    uint32_t available;
+    uint8_t recordIndex;
+    int read = 0;
+
+    if (!snapshot || (file->index >= file->len)) {
+        return FS_READ_EOF;
+    }
+
+    memset(&record, 0x00, sizeof(record));
+
+    while ((read < count) && (file->index < file->len)) {
+        position = file->index;
+
+        if (position < snapshot->httpLength) {
+            source = (const uint8_t*)snapshot->http + position;
+            available = snapshot->httpLength - position;
+        } else if ((position -= snapshot->httpLength) < sizeof(struct DmxSnapshotHeader)) {
+            source = (const uint8_t*)&snapshot->header + position;
+            available = sizeof(struct DmxSnapshotHeader) - position;
+        } else {
+            position -= sizeof(struct DmxSnapshotHeader);
+            recordIndex = position / snapshot->header.recordSize;
+            position = position % snapshot->header.recordSize;
+            record.bufferId = snapshot->bufferIds[recordIndex];
+
+            if (position < sizeof(struct DmxSnapshotRecord)) {
+                record.sequence = DmxBuffer::sequence[record.bufferId];
+                source = (const uint8_t*)&record + position;
+                available = sizeof(struct DmxSnapshotRecord) - position;
+            } else {
+                position -= sizeof(struct DmxSnapshotRecord);
+                source = DmxBuffer::buffer[record.bufferId] + position;
+                available = 512 - position;
+            }
+        }
+
+        available = MIN(available, (uint32_t)(count - read));
+        memcpy(buffer + read, source, available);
+        read += available;
+        file->index += available;
+    }
+
+    return read;
+}
+
+void WebSnapshot::close(struct fs_file *file) {
+    struct WebServerSnapshot* snapshot = (struct WebServerSnapshot*)file->pextension;
+
+    if (snapshot) {
+        snapshot->used = false;
+        file->pextension = nullptr;
+    }
+}
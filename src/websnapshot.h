@@ -0,0 +1,62 @@
+#ifndef WEBSNAPSHOT_H
+#define WEBSNAPSHOT_H
+
+#include "pico/stdlib.h"
+
+#include "lwip/apps/fs.h"
+
+#include "dmxbuffer.h"
+
+// Binary snapshot of several DMX buffers, /dmxBuffer/snapshot.bin. Parameters:
+// buffers (comma separated buffer ids, default: all) and since (only buffers
+// written after that sequence number, default: 0). Little endian, packed:
+// One DmxSnapshotHeader, then per buffer one DmxSnapshotRecord + 512 byte
+#define DMXSNAPSHOT_VERSION 1
+
+struct __attribute__((__packed__)) DmxSnapshotHeader {
+    uint8_t version;           // DMXSNAPSHOT_VERSION
+    uint8_t recordCount;
+    uint16_t recordSize;       // Record header + data
+    uint32_t sequence;         // DmxBuffer::lastSequence when opened. Pass as since next time
+};
+
+struct __attribute__((__packed__)) DmxSnapshotRecord {
+    uint8_t bufferId;
+    uint8_t reserved[3];
+    uint32_t sequence;         // DmxBuffer::sequence of that buffer. May be newer than the header's
+};
+
+// Snapshots being sent at the same time
+#define WEBSERVER_SNAPSHOTS 4
+#define WEBSERVER_SNAPSHOT_HTTP_SIZE 128
+
+struct WebServerSnapshot {
+    bool used;
+    char http[WEBSERVER_SNAPSHOT_HTTP_SIZE]; // HTTP header, we don't have it from makefsdata
+    uint16_t httpLength;
+    struct DmxSnapshotHeader header;
+    uint8_t bufferIds[DMXBUFFER_COUNT];
+};
+
+#ifdef __cplusplus
+
+// The snapshots, served by lwIP as custom files (see fs_open_custom in
+// webserver.cpp)
+class WebSnapshot {
+  public:
+    // Parameters of the snapshot about to be opened, from its CGI handler
+    static void setParams(int iNumParams, char *pcParam[], char *pcValue[]);
+
+    static int open(struct fs_file *file);
+    static int read(struct fs_file *file, char *buffer, int count);
+    static void close(struct fs_file *file);
+
+  private:
+    static uint32_t mask;      // One bit per bufferId
+    static uint32_t since;
+    static struct WebServerSnapshot snapshots[WEBSERVER_SNAPSHOTS];
+};
+
+#endif // __cplusplus
+
+#endif // WEBSNAPSHOT_H
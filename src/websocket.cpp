@@ -0,0 +1,591 @@
+#include "websocket.h"
+
+#include "log.h"
+#include "sha1.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
+extern "C" {
+#include <bsp/board.h>
+#include <b64/cencode.h>
+}
+
+extern DmxBuffer dmxBuffer;
+
+struct tcp_pcb* WebSocket::listenPcb;
+WebSocketClient WebSocket::clients[WEBSOCKET_MAX_CLIENTS];
+uint8_t WebSocket::message[WEBSOCKET_MESSAGE_SIZE];
+uint32_t WebSocket::pushesDropped;
+Edp WebSocket::edp;
+
+// Appended to the client's key before hashing, see RFC 6455, section 1.3
+static const char websocketGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+// TCP callbacks (for C-based code, not part of the class)
+static err_t websocket_accept(void *arg, struct tcp_pcb *pcb, err_t err) {
+    return WebSocket::accept(arg, pcb, err);
+}
+
+static err_t websocket_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err) {
+    return WebSocket::receive(arg, pcb, p, err);
+}
+
+static err_t websocket_poll(void *arg, struct tcp_pcb *pcb) {
+    return WebSocket::poll(arg, pcb);
+}
+
+static void websocket_err(void *arg, err_t err) {
+    WebSocket::error(arg, err);
+}
+
+void WebSocket::init() {
+    struct tcp_pcb* pcb;
+
+    memset(clients, 0x00, sizeof(clients));
+    pushesDropped = 0;
+
+    pcb = tcp_new_ip_type(IPADDR_TYPE_V4);
+    if (pcb == NULL) {
+        LOG("WebSocket: unable to create pcb");
+        return;
+    }
+
+    if (tcp_bind(pcb, IP4_ADDR_ANY, WEBSOCKET_PORT) != ERR_OK) {
+        LOG("WebSocket: unable to bind to port %d", WEBSOCKET_PORT);
+        tcp_abort(pcb);
+        return;
+    }
+
+    listenPcb = tcp_listen(pcb);
+    if (listenPcb == NULL) {
+        LOG("WebSocket: unable to listen");
+        tcp_abort(pcb);
+        return;
+    }
+    tcp_accept(listenPcb, websocket_accept);
+}
+
+void WebSocket::cyclicTask() {
+    for (uint8_t i = 0; i < WEBSOCKET_MAX_CLIENTS; i++) {
+        if ((clients[i].pcb != NULL) && clients[i].upgraded) {
+            push(&clients[i]);
+        }
+    }
+}
+
+const EdpStats& WebSocket::getStats() {
+    return edp.stats;
+}
+
+uint32_t WebSocket::getPushesDropped() {
+    return pushesDropped;
+}
+
+err_t WebSocket::accept(void *arg, struct tcp_pcb *pcb, err_t err) {
+    WebSocketClient* client = NULL;
+
+    if ((err != ERR_OK) || (pcb == NULL)) {
+        return ERR_VAL;
+    }
+
+    for (uint8_t i = 0; i < WEBSOCKET_MAX_CLIENTS; i++) {
+        if (clients[i].pcb == NULL) {
+            client = &clients[i];
+            break;
+        }
+    }
+    if (client == NULL) {
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+
+    client->pcb = pcb;
+    client->upgraded = false;
+    client->requestSize = 0;
+    client->handshakeSize = 0;
+    client->requestLine = false;
+    client->upgradeHeader = false;
+    client->keyLength = 0;
+    client->query[0] = 0;
+    client->bufferCount = 0;
+    client->interval = 1000 / WEBSOCKET_DEFAULT_RATE;
+    client->framesSent = 0;
+    client->pushesDropped = 0;
+    client->connectedAt = board_millis();
+    client->lastReceived = client->connectedAt;
+    client->lastPing = client->connectedAt;
+
+    // Go first if lwIP runs out of pcbs, the web server is more important.
+    // Small frames at a steady rate, so don't wait for ACKs to fill segments
+    tcp_setprio(pcb, TCP_PRIO_MIN);
+    tcp_nagle_disable(pcb);
+    tcp_arg(pcb, client);
+    tcp_recv(pcb, websocket_recv);
+    tcp_err(pcb, websocket_err);
+    tcp_poll(pcb, websocket_poll, WEBSOCKET_POLL_INTERVAL);
+
+    return ERR_OK;
+}
+
+err_t WebSocket::receive(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err) {
+    WebSocketClient* client = (WebSocketClient*)arg;
+    uint16_t offset = 0;
+    err_t result;
+
+    if (client == NULL) {
+        if (p != NULL) {
+            pbuf_free(p);
+        }
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+
+    // Remote side closed the connection
+    if (p == NULL) {
+        return close(client);
+    }
+
+    if (err != ERR_OK) {
+        pbuf_free(p);
+        return close(client);
+    }
+
+    client->lastReceived = board_millis();
+    tcp_recved(pcb, p->tot_len);
+
+    if (!client->upgraded) {
+        result = handshake(client, p, &offset);
+        if ((result != ERR_OK) || !client->upgraded) {
+            pbuf_free(p);
+            return result;
+        }
+    }
+
+    // Whatever came after the handshake is the start of the first frame
+    if ((p->tot_len - offset) > (WEBSOCKET_REQUEST_SIZE - client->requestSize)) {
+        // Frames from a browser are never that large (see handleFrames)
+        pbuf_free(p);
+        return close(client);
+    }
+    pbuf_copy_partial(p, client->request + client->requestSize, p->tot_len - offset, offset);
+    client->requestSize += p->tot_len - offset;
+    pbuf_free(p);
+
+    return handleFrames(client);
+}
+
+// Close clients that never finished the handshake or don't answer anymore
+err_t WebSocket::poll(void *arg, struct tcp_pcb *pcb) {
+    WebSocketClient* client = (WebSocketClient*)arg;
+    uint32_t now = board_millis();
+
+    if (client == NULL) {
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+
+    if (!client->upgraded) {
+        if ((now - client->connectedAt) > WEBSOCKET_HANDSHAKE_TIMEOUT_MS) {
+            LOG("WebSocket: No handshake after %u ms, closing", now - client->connectedAt);
+            return close(client);
+        }
+        return ERR_OK;
+    }
+
+    // Half-open: The other side is gone, we would never hear about it. If
+    // data is stuck in our send queue, it can't even close nicely
+    if ((now - client->lastReceived) > WEBSOCKET_IDLE_TIMEOUT_MS) {
+        LOG("WebSocket: Nothing received for %u ms, closing", now - client->lastReceived);
+        tcp_arg(pcb, NULL);
+        client->pcb = NULL;
+        client->upgraded = false;
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+
+    if (((now - client->lastReceived) > WEBSOCKET_PING_INTERVAL_MS) &&
+        ((now - client->lastPing) > WEBSOCKET_PING_INTERVAL_MS))
+    {
+        client->lastPing = now;
+        if (sendFrame(client, WS_OPCODE_PING, NULL, 0)) {
+            tcp_output(pcb);
+        }
+    }
+
+    return ERR_OK;
+}
+
+// The pcb is already gone when this is called
+void WebSocket::error(void *arg, err_t err) {
+    WebSocketClient* client = (WebSocketClient*)arg;
+
+    if (client != NULL) {
+        client->pcb = NULL;
+    }
+}
+
+// Feeds the bytes of p, starting at offset, into the handshake. Stops right
+// after the empty line that ends it, offset is where the first frame starts
+err_t WebSocket::handshake(WebSocketClient* client, struct pbuf* p, uint16_t* offset) {
+    uint8_t c;
+    err_t result;
+
+    while (*offset < p->tot_len) {
+        c = pbuf_get_at(p, (*offset)++);
+        if (++client->handshakeSize > WEBSOCKET_HANDSHAKE_MAX_SIZE) {
+            return close(client);
+        }
+
+        if (c != '\n') {
+            // Only the start of a line matters, the rest of long ones
+            // (cookies) is dropped
+            if ((c != '\r') && (client->requestSize < (WEBSOCKET_REQUEST_SIZE - 1))) {
+                client->request[client->requestSize++] = c;
+            }
+            continue;
+        }
+
+        client->request[client->requestSize] = 0;
+        if (client->requestSize == 0) {
+            return upgrade(client);
+        }
+        result = handshakeLine(client);
+        if ((result != ERR_OK) || (client->pcb == NULL)) {
+            return result;
+        }
+        client->requestSize = 0;
+    }
+
+    // Wait for the rest
+    return ERR_OK;
+}
+
+// One line of the handshake (without the line break) in client->request
+err_t WebSocket::handshakeLine(WebSocketClient* client) {
+    char* line = client->request;
+    char* value;
+    char* query;
+    size_t length;
+
+    // GET /?buffers=0,1&rate=25 HTTP/1.1
+    if (!client->requestLine) {
+        if (strncmp(line, "GET ", 4) != 0) {
+            return close(client);
+        }
+        client->requestLine = true;
+
+        query = strchr(line + 4, '?');
+        if (query != NULL) {
+            query++;
+            length = MIN(strcspn(query, " "), sizeof(client->query) - 1);
+            memcpy(client->query, query, length);
+            client->query[length] = 0;
+        }
+        return ERR_OK;
+    }
+
+    if (strncasecmp(line, "Sec-WebSocket-Key:", 18) == 0) {
+        value = line + 18;
+        while (*value == ' ') {
+            value++;
+        }
+        length = strcspn(value, " ");
+        // Too long isn't a key a browser would send
+        client->keyLength = (length <= sizeof(client->key)) ? length : 0;
+        memcpy(client->key, value, client->keyLength);
+    } else if (strncasecmp(line, "Upgrade:", 8) == 0) {
+        value = line + 8;
+        while (*value == ' ') {
+            value++;
+        }
+        client->upgradeHeader = (strncasecmp(value, "websocket", 9) == 0) &&
+            ((value[9] == 0) || (value[9] == ' '));
+    }
+
+    return ERR_OK;
+}
+
+// The empty line after the headers came in, answer the handshake
+err_t WebSocket::upgrade(WebSocketClient* client) {
+    char hashInput[WEBSOCKET_KEY_SIZE + sizeof(websocketGuid)];
+    uint8_t digest[SHA1_DIGEST_SIZE];
+    char accept[40];
+    int acceptLength;
+    base64_encodestate state;
+    char response[160];
+    int responseLength;
+
+    // A plain HTTP request or another protocol, we only speak WebSocket
+    if (!client->requestLine || !client->upgradeHeader || (client->keyLength == 0)) {
+        static const char badRequest[] = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n";
+        tcp_write(client->pcb, badRequest, sizeof(badRequest) - 1, 0);
+        return close(client);
+    }
+
+    memcpy(hashInput, client->key, client->keyLength);
+    memcpy(hashInput + client->keyLength, websocketGuid, sizeof(websocketGuid) - 1);
+    sha1((const uint8_t*)hashInput, client->keyLength + sizeof(websocketGuid) - 1, digest);
+
+    base64_init_encodestate(&state);
+    acceptLength = base64_encode_block((const char*)digest, sizeof(digest), accept, &state);
+    acceptLength += base64_encode_blockend(accept + acceptLength, &state);
+    // Some versions of libb64 end with a line break
+    while ((acceptLength > 0) && ((accept[acceptLength - 1] == '\n') || (accept[acceptLength - 1] == '\r'))) {
+        acceptLength--;
+    }
+    accept[acceptLength] = 0;
+
+    responseLength = snprintf(response, sizeof(response),
+        "HTTP/1.1 101 Switching Protocols\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: %s\r\n\r\n", accept);
+    if ((responseLength <= 0) || ((size_t)responseLength >= sizeof(response)) ||
+        (tcp_write(client->pcb, response, responseLength, TCP_WRITE_FLAG_COPY) != ERR_OK)) {
+        return close(client);
+    }
+    tcp_output(client->pcb);
+
+    // Initial subscription from the URL
+    if (client->query[0]) {
+        subscribe(client, client->query, strlen(client->query));
+    }
+
+    client->upgraded = true;
+    client->requestSize = 0;
+    // Push right away
+    client->lastPush = board_millis() - client->interval;
+
+    return ERR_OK;
+}
+
+// Frames from the browser are short and masked, see RFC 6455, section 5.2
+err_t WebSocket::handleFrames(WebSocketClient* client) {
+    uint8_t* data = (uint8_t*)client->request;
+    uint8_t opcode;
+    uint16_t length;
+    uint16_t header;
+    uint8_t* payload;
+
+    while (client->requestSize >= 2) {
+        opcode = data[0] & 0x0f;
+        length = data[1] & 0x7f;
+        header = 2;
+
+        if (length == 126) {
+            if (client->requestSize < 4) {
+                break;
+            }
+            length = (data[2] << 8) | data[3];
+            header = 4;
+        } else if (length == 127) {
+            return close(client);
+        }
+
+        // Clients have to mask everything they send
+        if (!(data[1] & 0x80)) {
+            return close(client);
+        }
+        header += 4;
+
+        if ((header + length) > (WEBSOCKET_REQUEST_SIZE - 1)) {
+            return close(client);
+        }
+        if (client->requestSize < (header + length)) {
+            break;
+        }
+
+        payload = data + header;
+        for (uint16_t i = 0; i < length; i++) {
+            payload[i] ^= data[header - 4 + (i % 4)];
+        }
+
+        switch (opcode) {
+            case WS_OPCODE_TEXT:
+                subscribe(client, (const char*)payload, length);
+                break;
+
+            case WS_OPCODE_PING:
+                sendFrame(client, WS_OPCODE_PONG, payload, length);
+                tcp_output(client->pcb);
+                break;
+
+            case WS_OPCODE_CLOSE:
+                // Echo the status code, then we are done
+                sendFrame(client, WS_OPCODE_CLOSE, payload, MIN(length, 2));
+                return close(client);
+
+            default:
+                // Binary, pongs and continuations mean nothing to us
+                break;
+        }
+
+        memmove(data, data + header + length, client->requestSize - header - length);
+        client->requestSize -= header + length;
+    }
+
+    return ERR_OK;
+}
+
+// "buffers=0,1&rate=25". Each subscription starts over, the client has to
+// reset its view of the subscribed buffers to all zeroes
+void WebSocket::subscribe(WebSocketClient* client, const char* params, size_t length) {
+    char text[128];
+    char* param;
+    char* next;
+    char* value;
+    unsigned long number;
+    int rate;
+
+    length = MIN(length, sizeof(text) - 1);
+    memcpy(text, params, length);
+    text[length] = 0;
+
+    for (param = text; param != NULL; param = next) {
+        next = strchr(param, '&');
+        if (next != NULL) {
+            *next++ = 0;
+        }
+
+        value = strchr(param, '=');
+        if (value == NULL) {
+            continue;
+        }
+        *value++ = 0;
+
+        if (strcmp(param, "buffers") == 0) {
+            client->bufferCount = 0;
+            while ((*value != 0) && (client->bufferCount < WEBSOCKET_MAX_BUFFERS)) {
+                number = strtoul(value, &value, 10);
+                if (number < DMXBUFFER_COUNT) {
+                    client->bufferIds[client->bufferCount++] = number;
+                }
+                if (*value != ',') {
+                    break;
+                }
+                value++;
+            }
+            for (uint8_t i = 0; i < client->bufferCount; i++) {
+                memset(client->shadow[i], 0x00, 512);
+                // Anything but the current sequence to get the first delta out
+                client->sentSequence[i] = DmxBuffer::sequence[client->bufferIds[i]] - 1;
+            }
+        } else if (strcmp(param, "rate") == 0) {
+            rate = atoi(value);
+            rate = MAX(1, MIN(rate, WEBSOCKET_MAX_RATE));
+            client->interval = 1000 / rate;
+        }
+    }
+}
+
+// One delta per changed buffer, at most once per interval. If the send
+// buffer is full, the push is skipped and the shadow stays as it is, so the
+// next push carries everything that changed in between
+void WebSocket::push(WebSocketClient* client) {
+    uint32_t now = board_millis();
+    uint32_t sequence;
+    uint16_t room;
+    uint16_t size;
+    bool callAgain;
+    bool sent = false;
+
+    if ((now - client->lastPush) < client->interval) {
+        return;
+    }
+    client->lastPush = now;
+
+    for (uint8_t i = 0; i < client->bufferCount; i++) {
+        // Read before the buffer, if it changes while we are at it, the
+        // next push will look again
+        sequence = DmxBuffer::sequence[client->bufferIds[i]];
+        if (sequence == client->sentSequence[i]) {
+            continue;
+        }
+
+        // Frame header is 4 byte for what we send
+        room = tcp_sndbuf(client->pcb);
+        if ((room < (WEBSOCKET_MIN_SEND + 4)) || (tcp_sndqueuelen(client->pcb) >= (TCP_SND_QUEUELEN - 2))) {
+            client->pushesDropped++;
+            pushesDropped++;
+            break;
+        }
+
+        size = edp.prepareDmxDataDelta(client->bufferIds[i], dmxBuffer.buffer[client->bufferIds[i]],
+            client->shadow[i], message, MIN(WEBSOCKET_MESSAGE_SIZE, room - 4), &callAgain);
+
+        if (size) {
+            // The shadow has been updated already, the client is lost if
+            // this doesn't go out
+            if (!sendFrame(client, WS_OPCODE_BINARY, message, size)) {
+                close(client);
+                return;
+            }
+            client->framesSent++;
+            edp.stats.framesSent++;
+            edp.stats.bytesSent += size;
+            sent = true;
+        }
+
+        if (!callAgain) {
+            client->sentSequence[i] = sequence;
+        }
+    }
+
+    if (sent) {
+        tcp_output(client->pcb);
+    }
+}
+
+// Server frames are never masked and never fragmented
+bool WebSocket::sendFrame(WebSocketClient* client, uint8_t opcode, const uint8_t* data, uint16_t size) {
+    uint8_t header[4];
+    uint8_t headerSize;
+
+    header[0] = 0x80 | opcode;  // FIN
+    if (size < 126) {
+        header[1] = size;
+        headerSize = 2;
+    } else {
+        header[1] = 126;
+        header[2] = size >> 8;
+        header[3] = size & 0xff;
+        headerSize = 4;
+    }
+
+    if (tcp_sndbuf(client->pcb) < (headerSize + size)) {
+        return false;
+    }
+
+    if (tcp_write(client->pcb, header, headerSize, TCP_WRITE_FLAG_COPY | (size ? TCP_WRITE_FLAG_MORE : 0)) != ERR_OK) {
+        return false;
+    }
+    if (size && (tcp_write(client->pcb, data, size, TCP_WRITE_FLAG_COPY) != ERR_OK)) {
+        return false;
+    }
+
+    return true;
+}
+
+err_t WebSocket::close(WebSocketClient* client) {
+    struct tcp_pcb* pcb = client->pcb;
+
+    client->pcb = NULL;
+    client->upgraded = false;
+    if (pcb == NULL) {
+        return ERR_OK;
+    }
+
+    tcp_arg(pcb, NULL);
+    tcp_recv(pcb, NULL);
+    tcp_err(pcb, NULL);
+    tcp_poll(pcb, NULL, 0);
+    if (tcp_close(pcb) != ERR_OK) {
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+
+    return ERR_OK;
+}
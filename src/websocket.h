@@ -0,0 +1,131 @@
+#ifndef WEBSOCKET_H
+#define WEBSOCKET_H
+
+#include "pico/stdlib.h"
+
+#include "lwip/opt.h"
+#include "lwip/tcp.h"
+#include "lwip/pbuf.h"
+
+#include "dmxbuffer.h"
+#include "edp.h"
+
+// lwIP's httpd owns port 80 and can't hand over a connection, so the
+// WebSocket lives on a port of its own
+#define WEBSOCKET_PORT 81
+
+#define WEBSOCKET_MAX_CLIENTS 2
+#define WEBSOCKET_MAX_BUFFERS 4         // Subscribed buffers per client
+#define WEBSOCKET_DEFAULT_RATE 25       // Pushes per second
+#define WEBSOCKET_MAX_RATE 44           // About what a DMX line can do
+
+// Incoming frames. What browsers send us (subscriptions, pings, close) is
+// short. During the handshake it holds the start of the current header line
+#define WEBSOCKET_REQUEST_SIZE 512
+
+// The handshake is read line by line and only the few things we need are
+// kept, so cookies and long user agents don't matter. Only the query of the
+// request line (subscribe() takes 128 byte anyway) and the key are stored,
+// everything together may be as large as browsers allow headers to be
+#define WEBSOCKET_QUERY_SIZE 128
+#define WEBSOCKET_KEY_SIZE 64
+#define WEBSOCKET_HANDSHAKE_MAX_SIZE 16384
+
+// One DmxDataDelta of a full universe: command, universeId, three ranges
+// of up to 255 byte and the terminator
+#define WEBSOCKET_MESSAGE_SIZE 530
+
+// WebSocket opcodes we care about
+#define WS_OPCODE_TEXT   0x1
+#define WS_OPCODE_BINARY 0x2
+#define WS_OPCODE_CLOSE  0x8
+#define WS_OPCODE_PING   0x9
+#define WS_OPCODE_PONG   0xa
+
+// Don't bother with less room than that in the send buffer, wait for the
+// next push instead
+#define WEBSOCKET_MIN_SEND 64
+
+// lwIP polls every connection every WEBSOCKET_POLL_INTERVAL * 500ms. Clients
+// that didn't finish the handshake within WEBSOCKET_HANDSHAKE_TIMEOUT_MS are
+// closed, so a port scan or a stuck browser doesn't keep a slot forever
+#define WEBSOCKET_POLL_INTERVAL 2
+#define WEBSOCKET_HANDSHAKE_TIMEOUT_MS 5000
+
+// Nothing changes in the buffers, nothing is sent and a client that went
+// away without closing would never be noticed. So ping it if it's been quiet
+// and close it if not even the pong came back (browsers answer on their own)
+#define WEBSOCKET_PING_INTERVAL_MS 10000
+#define WEBSOCKET_IDLE_TIMEOUT_MS 30000
+
+#ifdef __cplusplus
+
+struct WebSocketClient {
+    struct tcp_pcb* pcb;                // NULL if the slot is free
+    bool upgraded;                      // Handshake is done, we talk frames now
+    uint32_t connectedAt;               // board_millis()
+    uint32_t lastReceived;              // board_millis() of the last data from the client
+    uint32_t lastPing;                  // board_millis() of the last ping we sent
+    uint16_t requestSize;
+    char request[WEBSOCKET_REQUEST_SIZE];
+
+    // What the handshake found so far
+    uint16_t handshakeSize;
+    bool requestLine;                   // The GET line has been seen
+    bool upgradeHeader;                 // "Upgrade: websocket"
+    uint8_t keyLength;
+    char key[WEBSOCKET_KEY_SIZE];
+    char query[WEBSOCKET_QUERY_SIZE];   // Terminated, empty if there was none
+
+    uint8_t bufferCount;
+    uint8_t bufferIds[WEBSOCKET_MAX_BUFFERS];
+    uint32_t sentSequence[WEBSOCKET_MAX_BUFFERS];   // DmxBuffer::sequence shadow is up to
+    uint8_t shadow[WEBSOCKET_MAX_BUFFERS][512];     // What the client has, starts as all zeroes
+    uint32_t interval;                  // ms between two pushes
+    uint32_t lastPush;                  // board_millis()
+
+    uint32_t framesSent;
+    uint32_t pushesDropped;             // Send buffer was full, changes are coalesced into the next one
+};
+
+// Pushes the changes of DMX buffers to browsers as binary WebSocket
+// messages. Each message is an EDP DmxDataDelta (see edp.h) against what the
+// client got before, starting with all zeroes. Only one push per interval,
+// if the connection can't take it the push is skipped and the changes go out
+// with the next one, nothing is queued.
+//
+// Subscribe with ws://<board>:81/?buffers=0,1&rate=25 or by sending a text
+// message with the same parameters later
+class WebSocket {
+  public:
+    static void init();
+    static void cyclicTask();
+
+    static const EdpStats& getStats();
+    static uint32_t getPushesDropped();
+
+    static err_t accept(void *arg, struct tcp_pcb *pcb, err_t err);
+    static err_t receive(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err);
+    static err_t poll(void *arg, struct tcp_pcb *pcb);
+    static void error(void *arg, err_t err);
+
+  private:
+    static struct tcp_pcb* listenPcb;
+    static WebSocketClient clients[WEBSOCKET_MAX_CLIENTS];
+    static uint8_t message[WEBSOCKET_MESSAGE_SIZE];
+    static uint32_t pushesDropped;
+    static Edp edp;
+
+    static err_t handshake(WebSocketClient* client, struct pbuf* p, uint16_t* offset);
+    static err_t handshakeLine(WebSocketClient* client);
+    static err_t upgrade(WebSocketClient* client);
+    static err_t handleFrames(WebSocketClient* client);
+    static void subscribe(WebSocketClient* client, const char* params, size_t length);
+    static void push(WebSocketClient* client);
+    static bool sendFrame(WebSocketClient* client, uint8_t opcode, const uint8_t* data, uint16_t size);
+    static err_t close(WebSocketClient* client);
+};
+
+#endif // __cplusplus
+
+#endif // WEBSOCKET_H
@@ -0,0 +1,320 @@
+#include "webstatus.h"
+
+#include "hardware/flash.h"
+#include "lwip/netif.h"
+
+#include "snappy.h"
+
+#include "version.h"
+#include "boardconfig.h"
+#include "dmxbuffer.h"
+#include "statusleds.h"
+#include "wireless.h"
+#include "dhcpdata.h"
+#include "usb_EDP.h"
+#include "udp_edp.h"
+#include "websocket.h"
+
+#define MAGIC_ENUM_RANGE_MAX 255
+#include "../lib/magic_enum/include/magic_enum.hpp"
+
+extern StatusLeds statusLeds;
+extern BoardConfig boardConfig;
+extern DmxBuffer dmxBuffer;
+extern Wireless wireless;
+
+uint8_t WebStatus::tmpBuf[800]; // Used to store compressed data
+
+void WebStatus::ipToString(uint32_t ip, char* ipString) {
+    sprintf(ipString, "%ld.%ld.%ld.%ld", (ip & 0xff), ((ip >> 8) & 0xff), ((ip >> 16) & 0xff), ((ip >> 24) & 0xff));
+}
+
+static void edpStatsToJson(JsonWriter* json, const char* key, const EdpStats& stats) {
+    json->beginObject(key);
+    json->value("pingsSent", stats.pingsSent);
+    json->value("pingsAnswered", stats.pingsAnswered);
+    json->value("pongsReceived", stats.pongsReceived);
+    json->value("rttLast", stats.rttLast);
+    json->value("rttMin", stats.rttMin);
+    json->value("rttMax", stats.rttMax);
+    json->value("rttAvg", stats.rttAvg);
+    json->value("framesReceived", stats.framesReceived);
+    json->value("framesCrcError", stats.framesCrcError);
+    json->value("framesChunkGap", stats.framesChunkGap);
+    json->value("dmxDataRequestsSent", stats.dmxDataRequestsSent);
+    json->value("dmxDataRequestsReceived", stats.dmxDataRequestsReceived);
+    json->value("discoveryAnswered", stats.discoveryAnswered);
+    json->value("framesSent", stats.framesSent);
+    json->value("chunksSent", stats.chunksSent);
+    json->value("bytesSent", stats.bytesSent);
+    json->value("overheadBytesSent", stats.overheadBytesSent);
+    json->value("deltasSent", stats.deltasSent);
+    json->value("framesSparse", stats.framesSparse);
+    json->value("framesCompressed", stats.framesCompressed);
+    json->value("compressionSkipped", stats.compressionSkipped);
+    json->value("parityChunksSent", stats.parityChunksSent);
+    json->value("framesRecovered", stats.framesRecovered);
+    json->value("chunksPerFrame", stats.framesSent ? ((double)stats.chunksSent / stats.framesSent) : 0.0);
+    json->endObject();
+}
+
+static void dhcpEntriesToJson(JsonWriter* json, dhcp_entry_t* entries, int count) {
+    json->beginArray("dhcp");
+    for (int i = 0; i < count; i++) {
+        json->value(DhcpData::dhcpEntryToString(&(entries[i])));
+    }
+    json->endArray();
+}
+
+// Returns false if the tag is none of ours. Must write the same document
+// every time as long as nothing changes
+bool WebStatus::writeTag(const char* tagName, JsonWriter* json) {
+    if (strcmp(tagName, "OverviewGet") == 0) {
+        char ifname[3];
+        char ip[16];
+        bool u0Written = false;
+        bool e0Written = false;
+        bool w1Written = false;
+
+        json->beginObject();
+
+        json->beginObject("debug");
+        json->beginObject("flash");
+        json->value("totalSize", PICO_FLASH_SIZE_BYTES);
+        json->value("sectorSize", FLASH_SECTOR_SIZE);
+        json->value("blockSize", FLASH_BLOCK_SIZE);
+        json->endObject();
+
+        json->beginObject("toolchain");
+        json->value("pico_sdk_version", PICO_SDK_VERSION_STRING);
+        json->value("PICO_BOARD", PICO_BOARD);
+#if defined(__clang_version__)
+        json->value("compiler_name", "LLVM clang");
+        json->value("compiler_version", __clang_version__);
+#elif defined(__GNUC__)
+# if defined(__GNUC_PATCHLEVEL__)
+#  define __GNUC_VERSION__ (__GNUC__ * 10000 \
+                            + __GNUC_MINOR__ * 100 \
+                            + __GNUC_PATCHLEVEL__)
+# else
+#  define __GNUC_VERSION__ (__GNUC__ * 10000 \
+                            + __GNUC_MINOR__ * 100)
+# endif
+        json->value("compiler_name", "GNU gcc");
+        json->value("compiler_version", __GNUC_VERSION__);
+#endif
+#if defined (__cplusplus)
+        json->value("cplusplus_standard", (long long)__cplusplus);
+#endif
+        json->endObject();
+
+        json->beginObject("structSize");
+        json->value("ConfigData", sizeof(ConfigData));
+        json->value("Patching", sizeof(Patching));
+        json->value("EthDestParams", sizeof(EthDestParams));
+        json->endObject();
+        json->endObject();
+
+        json->value("boardName", std::string_view(boardConfig.activeConfig->boardName, strnlen(boardConfig.activeConfig->boardName, sizeof(boardConfig.activeConfig->boardName))));
+        json->value("boardIsPicoW", BoardConfig::boardIsPicoW);
+        json->value("configSource", boardConfig.configSource);
+        json->value("configSourceString", magic_enum::enum_name<ConfigSource>(boardConfig.configSource));
+        json->value("version", VERSION);
+        json->value("serial", BoardConfig::boardSerialString);
+        json->value("shortId", BoardConfig::shortId);
+
+        // The DHCP leases go with the interface they belong to
+        json->beginObject("net");
+        struct netif* iface = netif_list;
+        while (iface != nullptr) {
+            sprintf(ifname, "%c%c", iface->name[0], iface->name[1]);
+            json->beginObject(ifname);
+            WebStatus::ipToString(iface->ip_addr.addr, ip);
+            json->value("ip", ip);
+            WebStatus::ipToString(iface->netmask.addr, ip);
+            json->value("netmask", ip);
+            WebStatus::ipToString(iface->gw.addr, ip);
+            json->value("gw", ip);
+            if (iface->hostname) {
+                json->value("hostname", iface->hostname);
+            }
+            if (!u0Written && (strcmp(ifname, "u0") == 0)) {
+                dhcpEntriesToJson(json, dhcp_entries_usb, DHCP_NUM_ENTRIES_USB);
+                u0Written = true;
+            } else if (!e0Written && (strcmp(ifname, "e0") == 0)) {
+                dhcpEntriesToJson(json, dhcp_entries_eth, DHCP_NUM_ENTRIES_ETH);
+                e0Written = true;
+            } else if (!w1Written && (strcmp(ifname, "w1") == 0)) {
+                dhcpEntriesToJson(json, dhcp_entries_wifi, DHCP_NUM_ENTRIES_WIFI);
+                w1Written = true;
+            }
+            json->endObject();
+
+            iface = iface->next;
+        }
+        // Interfaces that are down still have their leases listed
+        if (!u0Written) {
+            json->beginObject("u0");
+            dhcpEntriesToJson(json, dhcp_entries_usb, DHCP_NUM_ENTRIES_USB);
+            json->endObject();
+        }
+        if (!e0Written) {
+            json->beginObject("e0");
+            dhcpEntriesToJson(json, dhcp_entries_eth, DHCP_NUM_ENTRIES_ETH);
+            json->endObject();
+        }
+        if (!w1Written) {
+            json->beginObject("w1");
+            dhcpEntriesToJson(json, dhcp_entries_wifi, DHCP_NUM_ENTRIES_WIFI);
+            json->endObject();
+        }
+        json->endObject();
+
+        json->value("wirelessModule", wireless.moduleAvailable);
+        json->value("statusLedBrightness", boardConfig.activeConfig->statusLedBrightness);
+
+        json->value("createdDefaultConfig", boardConfig.createdDefaultConfig);
+
+        json->endObject();
+
+    } else if (strcmp(tagName, "OverviewStatusledsGet") == 0) {
+        bool red_static, blue_static, green_static;
+        bool red_blink, green_blink, blue_blink;
+        char hexColor[8];
+
+        json->beginArray();
+        for (int i = 0; i < 8; i++) {
+            red_static = 0;
+            green_static = 0;
+            blue_static = 0;
+            red_blink = 0;
+            green_blink = 0;
+            blue_blink = 0;
+            statusLeds.getLed(i, &red_static, &green_static, &blue_static, &red_blink, &green_blink, &blue_blink);
+            json->beginObject();
+            snprintf(hexColor, 8, "#%02x%02x%02x", red_static ? 0xff : 0x00, green_static ? 0xff : 0x00, blue_static ? 0xff : 0x00);
+            json->value("static", hexColor);
+            snprintf(hexColor, 8, "#%02x%02x%02x", red_blink ? 0xff : 0x00, green_blink ? 0xff : 0x00, blue_blink ? 0xff : 0x00);
+            json->value("blink", hexColor);
+            json->endObject();
+        }
+        json->endArray();
+
+    } else if (strcmp(tagName, "OverviewIoBoardsGet") == 0) {
+        json->beginObject();
+
+        // Does printing the base board info make sense?
+        // Basically it's only to know if it has an invalid, valid or disabled config ...
+        json->beginObject("base");
+        json->value("exist", true);
+        json->value("type", boardConfig.configData[4]->boardType);
+        json->value("typeString", magic_enum::enum_name(boardConfig.configData[4]->boardType));
+        json->endObject();
+
+        // Iterate over the max 4 io boards
+        json->beginArray("boards");
+        for (uint8_t i = 0; i < 4; i++) {
+            json->beginObject();
+            json->value("exist", boardConfig.responding[i]);
+            json->value("type", boardConfig.configData[i]->boardType);
+            json->value("typeString", magic_enum::enum_name(boardConfig.configData[i]->boardType));
+            json->beginArray("ports");
+            for (uint8_t j = 0; j < 4; j++) {
+                json->beginObject();
+                json->value("direction", boardConfig.configData[i]->portParams[j].direction);
+                json->value("directionString", magic_enum::enum_name(boardConfig.configData[i]->portParams[j].direction));
+                json->value("connector", boardConfig.configData[i]->portParams[j].connector);
+                json->value("connectorString", magic_enum::enum_name(boardConfig.configData[i]->portParams[j].connector));
+                json->endObject();
+            }
+            json->endArray();
+            json->endObject();
+        }
+        json->endArray();
+
+        json->endObject();
+
+    } else if (strcmp(tagName, "ConfigStatusLedsBrightnessGet") == 0) {
+        json->beginObject();
+        json->value("value", boardConfig.activeConfig->statusLedBrightness);
+        json->endObject();
+
+    } else if (strcmp(tagName, "ConfigWebSeverIpGet") == 0) {
+        char ip[16];
+
+        json->beginObject();
+        WebStatus::ipToString(boardConfig.activeConfig->ownIp, ip);
+        json->value("ownIp", ip);
+        WebStatus::ipToString(boardConfig.activeConfig->ownMask, ip);
+        json->value("ownMask", ip);
+        WebStatus::ipToString(boardConfig.activeConfig->hostIp, ip);
+        json->value("hostIp", ip);
+        json->endObject();
+
+    } else if (strcmp(tagName, "ConfigWirelessGet") == 0) {
+        json->beginObject();
+        json->value("role", boardConfig.activeConfig->radioRole);
+        json->value("channel", boardConfig.activeConfig->radioChannel);
+        json->value("address", boardConfig.activeConfig->radioAddress);
+        json->value("compress", (int)boardConfig.activeConfig->radioParams.compression);
+        json->value("sparse", (int)boardConfig.activeConfig->radioParams.allowSparse);
+        json->value("fec", (int)boardConfig.activeConfig->radioParams.fec);
+        json->value("hopping", (int)boardConfig.activeConfig->radioParams.hopping);
+        json->value("merge", (int)boardConfig.activeConfig->radioParams.mergeMode);
+        json->value("dataRate", (int)boardConfig.activeConfig->radioParams.dataRate);
+        json->value("txPower", (int)boardConfig.activeConfig->radioParams.txPower);
+        json->endObject();
+
+    } else if (strncmp(tagName, "DmxBuffer", 9) == 0) {
+        int buffer = 0;
+        size_t actuallyWritten = sizeof(WebStatus::tmpBuf);
+
+        sscanf(tagName, "DmxBuffer%dGet", &buffer);
+        if ((buffer < 0) || (buffer >= DMXBUFFER_COUNT)) {
+            return false;
+        }
+
+        // TODO: common function to compress & base64-encode
+        snappy::RawCompress((const char *)dmxBuffer.buffer[buffer], 512, (char*)WebStatus::tmpBuf, &actuallyWritten);
+
+        json->beginObject();
+        json->value("buffer", buffer);
+        json->base64("value", WebStatus::tmpBuf, actuallyWritten);
+        json->endObject();
+
+    } else if (strcmp(tagName, "ConfigWirelessSpectrumGet") == 0) {
+        // Compress the array using snappy
+        size_t actuallyWritten = sizeof(WebStatus::tmpBuf);
+        snappy::RawCompress((const char *)wireless.signalStrength, MAXCHANNEL*sizeof(uint16_t), (char*)WebStatus::tmpBuf, &actuallyWritten);
+
+        json->beginObject();
+        json->base64("spectrum", WebStatus::tmpBuf, actuallyWritten);
+        json->endObject();
+
+    } else if (strcmp(tagName, "ConfigWirelessTelemetryGet") == 0) {
+        // Same as the spectrum: Compressed and base64 encoded, see WirelessTelemetry
+        struct WirelessTelemetry telemetry;
+        size_t actuallyWritten = sizeof(WebStatus::tmpBuf);
+
+        wireless.getTelemetry(&telemetry);
+        snappy::RawCompress((const char *)&telemetry, sizeof(struct WirelessTelemetry), (char*)WebStatus::tmpBuf, &actuallyWritten);
+
+        json->beginObject();
+        json->base64("telemetry", WebStatus::tmpBuf, actuallyWritten);
+        json->endObject();
+
+    } else if (strcmp(tagName, "EdpStatsGet") == 0) {
+        // Radio stats are part of ConfigWirelessStatsGet
+        json->beginObject();
+        edpStatsToJson(json, "usb", Usb_EDP::getStats());
+        edpStatsToJson(json, "udp", Udp_EDP::getStats());
+        edpStatsToJson(json, "udpTx", Udp_EDP::getTxStats());
+        edpStatsToJson(json, "webSocket", WebSocket::getStats());
+        json->value("webSocketPushesDropped", WebSocket::getPushesDropped());
+        json->endObject();
+    } else {
+        return false;
+    }
+
+    return true;
+}
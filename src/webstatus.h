@@ -0,0 +1,27 @@
+#ifndef WEBSTATUS_H
+#define WEBSTATUS_H
+
+#include "pico/stdlib.h"
+
+#include "jsonwriter.h"
+
+#ifdef __cplusplus
+
+// The JSON documents of the SSI tags that show the state of the board
+// (overview, IO boards, config, DMX buffers, spectrum, EDP stats). They
+// only read the other modules, the web server decides when they are
+// written and how they are sent (see WebServer::ssi_handler)
+class WebStatus {
+  public:
+    static bool writeTag(const char* tagName, JsonWriter* json);
+
+    static void ipToString(uint32_t ip, char* ipString);
+
+    // Compressed data. Also used by the web server's CGI handlers, they
+    // run on the same core as the SSI handler, one after the other
+    static uint8_t tmpBuf[800];
+};
+
+#endif // __cplusplus
+
+#endif // WEBSTATUS_H
@@ -4,7 +4,7 @@
 #include <RF24Network.h>
 #include <RF24Mesh.h>
 
-#include "json/json.h"
+#include "jsonwriter.h"
 
 #include "log.h"
 
@@ -18,14 +18,20 @@ extern DmxBuffer dmxBuffer;
 
 extern critical_section_t bufferLock;
 
+// Provided by pico_lwip_random.c, good enough to pick a listening time
+extern "C" unsigned int pico_lwip_rand(void);
+
 uint8_t Wireless::tmpBuf_RX0[600]; // Used to store incoming data from radio
 uint8_t Wireless::tmpBuf_RX1[600]; // Used by edpRX to assemble the packets
 uint8_t Wireless::tmpBufQueueCopy[600]; // Used to quickly copy data from the sendQueue. goes to edpTX as inData
 uint8_t Wireless::tmpBuf_TX1[600]; // Used by edpRX to store the chunks ready to be sent
+uint8_t Wireless::packBuf[WIRELESS_PAYLOAD_SIZE]; // Bundle of the end of one frame and the start of the next
+uint8_t Wireless::tmpBuf_Sources[WIRELESS_SOURCES][600]; // Used by edpSources to assemble the packets of one source each
+uint8_t Wireless::mergeBuf[512]; // HTP result of all sources of one buffer
 
-// TODO: Do we need one tmpBuf per incoming universe to assemble them?
-//       Or can we expect them to come in order?
-//       Currently using tmpBuf2 as assemble-buffer for ALL INCOMING packets + outgoing will overwrite them!
+// A transmitter sends its frames in order, so one assemble buffer per
+// source is enough. tmpBuf_RX0 is shared, every chunk is processed before
+// the next one is read
 
 RF24 rf24radio(PIN_RF24_CE, PIN_SPI_CS0);
 RF24Network rf24network(rf24radio);
@@ -37,12 +43,31 @@ void Wireless::init() {
 
     // Stats
     memset(&stats, 0x00, sizeof(struct WirelessStats));
+    memset(&linkStats, 0x00, sizeof(struct WirelessLinkStats));
+    memset(universeRxStats, 0x00, sizeof(universeRxStats));
+    memset(sources, 0x00, sizeof(sources));
+    memset(mergeSlots, 0x00, sizeof(mergeSlots));
+    memset(mergeOwner, 0x00, sizeof(mergeOwner));
+    memset(mergeOwnerSeen, 0x00, sizeof(mergeOwnerSeen));
+
+    memset(sendQueue, 0x00, sizeof(sendQueue));
+    memset(sendQueueData, 0x00, sizeof(sendQueueData));
 
     // RX path goes via RX0 from radio to EDP and RX1 is out buffer
     edpRX.init(tmpBuf_RX0, tmpBuf_RX1, 32, PatchType::nrf24);
+    edpRX.setUniverseStats(universeRxStats, WIRELESS_UNIVERSES);
+
+    for (uint8_t i = 0; i < WIRELESS_SOURCES; i++) {
+        edpSources[i].init(tmpBuf_RX0, tmpBuf_Sources[i], 32, PatchType::nrf24);
+        edpSources[i].setUniverseStats(universeRxStats, WIRELESS_UNIVERSES);
+        edpSources[i].setMergeHandler(&Wireless::mergeFrame, this, i);
+    }
 
     // TX path goes from sendQueueCopy to EDP and TX1 it out buffer
-    edpTX.init(tmpBufQueueCopy, tmpBuf_TX1, 32, PatchType::nrf24);
+    edpTX.init(tmpBufQueueCopy, tmpBuf_TX1, WIRELESS_PAYLOAD_SIZE, PatchType::nrf24);
+
+    // Discovery messages and their responses use the RX path as well
+    discovery.init(&edpRX);
 
     memset(signalStrength, 0x00, MAXCHANNEL * sizeof(uint16_t));
 
@@ -73,41 +98,102 @@ void Wireless::init() {
 
     // Depending on radioRole, more setup is required
     if (boardConfig.activeConfig->radioRole == RadioRole::broadcast) {
+        uint8_t address[5];
+
         rf24radio.setPALevel(boardConfig.activeConfig->radioParams.txPower, true);
         rf24radio.setChannel(boardConfig.activeConfig->radioChannel);
         rf24radio.setDataRate(boardConfig.activeConfig->radioParams.dataRate);
         rf24radio.enableDynamicPayloads();
-        rf24radio.setAutoAck(true);
+        dynamicPayloads = true;
+        // With FEC, receivers rebuild lost chunks themselves. Without ACKs,
+        // every receiver is equal, not only the one that happens to ACK first
+        rf24radio.setAutoAck(!boardConfig.activeConfig->radioParams.fec);
         rf24radio.setCRCLength(RF24_CRC_16);
         rf24radio.disableAckPayload();
-        rf24radio.openWritingPipe((const uint8_t *)"DMXTX");
-        rf24radio.openReadingPipe(1, (const uint8_t *)"DMXTX");
+        // Pipe 0 is reused for the ACKs of what we send, the radio library
+        // restores it when going back to RX
+        ownSource = boardConfig.activeConfig->radioAddress % WIRELESS_SOURCES;
+        sourceAddress(ownSource, address);
+        rf24radio.openWritingPipe(address);
+        for (uint8_t i = 0; i < WIRELESS_SOURCES; i++) {
+            sourceAddress(i, address);
+            rf24radio.openReadingPipe(i, address);
+        }
         rf24radio.setRetries(0, 8);
         rf24radio.startListening();
+
+        hopInit();
+
+        // Chunks always fill complete packets, so follow the payload size
+        edpTX.setMaxSendChunkSize(MIN(rf24radio.getPayloadSize(), WIRELESS_PAYLOAD_SIZE));
+        edpTX.setFec(boardConfig.activeConfig->radioParams.fec);
+
+        // The receiving side needs to know the sender's chunk size to put
+        // chunks back to their place after a lost one
+        edpRX.setMaxSendChunkSize(MIN(rf24radio.getPayloadSize(), WIRELESS_PAYLOAD_SIZE));
+        for (uint8_t i = 0; i < WIRELESS_SOURCES; i++) {
+            edpSources[i].setMaxSendChunkSize(MIN(rf24radio.getPayloadSize(), WIRELESS_PAYLOAD_SIZE));
+        }
     } else if (boardConfig.activeConfig->radioRole == RadioRole::mesh) {
         LOG("RF24: Mesh setNodeID to %d", boardConfig.activeConfig->radioAddress);
         rf24mesh.setNodeID(boardConfig.activeConfig->radioAddress);
         rf24mesh.begin();
+
+        // Multicasts from the master reach the first level, those nodes
+        // pass them on to the next one
+        rf24network.multicastRelay = true;
+
+        edpTX.setMaxSendChunkSize(WIRELESS_MESH_CHUNK_SIZE);
+        memset(meshNodes, 0x00, sizeof(meshNodes));
+        meshNodeCount = 0;
     }
 }
 
 void Wireless::cyclicTask() {
+    uint16_t controlSize = 0;
+    uint32_t startedAt;
+
     if (!moduleAvailable) {
         return;
     }
 
+    startedAt = time_us_32();
+
     switch (boardConfig.activeConfig->radioRole) {
         case RadioRole::sniffer:
-            lastScannedChannel++;
-            if (lastScannedChannel >= MAXCHANNEL) {
-                lastScannedChannel = 0;
+            // Scanning is all we do, so start the next channel right away
+            if (!scanCyclicTask()) {
+                startScan(false);
             }
-            scanChannel(lastScannedChannel);
             break;
         case RadioRole::broadcast:
-            // Nothing to do to keep any network alive
+            // The radio is away on a scan channel, nothing else can happen now
+            if (scanCyclicTask()) {
+                break;
+            }
+            this->hopCyclicTask();
+            // Nothing to do to keep any network alive. Only nodes that send
+            // DMX data (and the hop master if hopping) ping, every node in
+            // range answers. Pure receivers pinging as well would make that
+            // N² pongs
+            // Not while a discovery is running, the pongs would only
+            // collide with the responses
+            if (((board_millis() - lastPing) > WIRELESS_PING_INTERVAL_MS) &&
+                ((boardConfig.activeConfig->radioParams.hopping && hopMaster) || isTransmitter()) &&
+                (!discovery.isRunning()))
+            {
+                lastPing = board_millis();
+                edpRX.preparePing();
+            }
+            discovery.cyclicTask();
+            this->handleDmxDataRequests();
             this->doSendData();
+            this->sendControlData();
+            // Back to RX once everything is out, not per universe or chunk
+            this->endBurst();
             this->handleReceivedData();
+            this->handleDiscoveryResponses();
+            this->backgroundScan();
             break;
         case RadioRole::mesh:
             rf24mesh.update();
@@ -121,25 +207,322 @@ void Wireless::cyclicTask() {
                     statusLeds.setStatic(6, 1, 0, 0);
                 }
             }
+            this->handleDmxDataRequests();
             this->doSendData();
+            this->handleMeshReceivedData();
+            // Pongs and keyframe requests go the same way as DMX data
+            if (edpRX.takeControlData(&controlSize)) {
+                meshWriteChunk(edpRX.controlData, controlSize, 0);
+            }
             break;
     }
+
+    // How much of core1 we use. Averaged per second, so the web interface
+    // doesn't need to poll in time
+    taskBusyUs += time_us_32() - startedAt;
+    stats.taskMaxUs = MAX(stats.taskMaxUs, time_us_32() - startedAt);
+    taskCalls++;
+    if ((time_us_32() - taskWindowStart) >= 1000000) {
+        stats.taskLoad = (uint64_t)taskBusyUs * 100 / (time_us_32() - taskWindowStart);
+        stats.taskAvgUs = taskBusyUs / taskCalls;
+        taskBusyUs = 0;
+        taskCalls = 0;
+        taskWindowStart = time_us_32();
+    }
+}
+
+// Tune to the next channel. The radio needs 130us to settle, then RPD is
+// sampled after a random listening time (150 to 230us) so FHSS devices
+// don't always hide in the same gap. scanCyclicTask does the waiting
+void Wireless::startScan(bool returnAfterwards) {
+    lastScannedChannel++;
+    if (lastScannedChannel >= MAXCHANNEL) {
+        lastScannedChannel = 0;
+        stats.scanSweeps++;
+        stats.scanSweepMs = board_millis() - scanSweepStartedAt;
+        scanSweepStartedAt = board_millis();
+    }
+
+    endBurst();
+    rf24radio.stopListening();
+    rf24radio.setChannel(lastScannedChannel);
+    scanReturn = returnAfterwards;
+    scanStepAt = time_us_32();
+    scanDwellUs = 150 + (pico_lwip_rand() % 81);
+    scanState = WirelessScanState::scanTuning;
+}
+
+// Returns true as long as a scan is running and the radio can't be used
+bool Wireless::scanCyclicTask() {
+    uint32_t now = time_us_32();
+
+    switch (scanState) {
+        case WirelessScanState::scanTuning:
+            if ((now - scanStepAt) < 130) {
+                return true;
+            }
+            rf24radio.startListening();
+            scanStepAt = now;
+            scanState = WirelessScanState::scanListening;
+            return true;
+
+        case WirelessScanState::scanListening:
+            if ((now - scanStepAt) < scanDwellUs) {
+                return true;
+            }
+            if (rf24radio.testRPD()) { // signal detected so increase signalStrength unless already maxed out
+                signalStrength[lastScannedChannel] += (0x7FFF - signalStrength[lastScannedChannel]) >> 5; // increase rapidly when previous value was low, with increase reducing exponentially as value approaches maximum
+            } else { // no signal detected so reduce signalStrength unless already at minimum
+                signalStrength[lastScannedChannel] -= signalStrength[lastScannedChannel] >> 5; // decrease rapidly when previous value was high, with decrease reducing exponentially as value approaches zero
+            }
+            rf24radio.stopListening();
+            stats.scanChannels++;
+            scanState = WirelessScanState::scanIdle;
+
+            if (scanReturn) {
+                tuneTo(hopChannel);
+            }
+            return false;
+
+        default:
+            return false;
+    }
 }
 
-void Wireless::scanChannel(uint8_t channel)
-{
+// Broadcast: Scan one channel now and then, but only if there is nothing
+// to send and nothing came in for a while. Packets sent to us while we
+// are away are lost. Only the hop master picks channels from the scan
+// results and only if hopping is enabled, nobody else goes away for them
+void Wireless::backgroundScan() {
+    bool pending = false;
+
+    if (!boardConfig.activeConfig->radioParams.hopping || !hopMaster) {
+        return;
+    }
+    if ((board_millis() - lastScan) < WIRELESS_SCAN_INTERVAL_MS) {
+        return;
+    }
+    if ((time_us_32() - lastReceivedAt) < WIRELESS_SCAN_QUIET_US) {
+        return;
+    }
+    if (controlDataPending()) {
+        return;
+    }
+
+    critical_section_enter_blocking(&bufferLock);
+    for (uint8_t i = 0; i < WIRELESS_UNIVERSES; i++) {
+        pending = pending || sendQueue[i].pending;
+    }
+    critical_section_exit(&bufferLock);
+    if (pending) {
+        return;
+    }
+
+    lastScan = board_millis();
+    startScan(true);
+}
+
+void Wireless::hopInit() {
+    // Without hopping there is nothing to master, address 0 is just the default
+    hopMaster = boardConfig.activeConfig->radioParams.hopping &&
+                (boardConfig.activeConfig->radioAddress == 0);
+    hopSynced = false;
+    hopAnnounceDue = false;
+
+    // Until the master has scanned all channels once, there is only radioChannel
+    memset(&hopSequence, 0x00, sizeof(struct Edp_HopSequence));
+    hopSequence.channelCount = 1;
+    hopSequence.dwellTime = WIRELESS_HOP_DWELL_MS;
+    hopSequence.channels[0] = boardConfig.activeConfig->radioChannel;
+    hopChannel = boardConfig.activeConfig->radioChannel;
+
+    memset(hopTried, 0x00, sizeof(hopTried));
+    memset(hopLost, 0x00, sizeof(hopLost));
+    memset(hopBlacklistedUntil, 0x00, sizeof(hopBlacklistedUntil));
+    lastHopPick = board_millis();
+    nextHopAt = time_us_32() + WIRELESS_HOP_DWELL_MS * 1000;
+}
+
+void Wireless::hopCyclicTask() {
+    struct Edp_HopSequence received;
+    uint32_t now;
+    uint32_t dwell;
+    bool valid;
+
+    if (!boardConfig.activeConfig->radioParams.hopping) {
+        return;
+    }
+
+    // Others: Take over what the master announced. It was sent right
+    // before, so its time until the next hop is still good
+    if (!hopMaster && edpRX.takeHopSequence(&received)) {
+        valid = (received.dwellTime != 0);
+        for (uint8_t i = 0; i < received.channelCount; i++) {
+            if (received.channels[i] >= MAXCHANNEL) {
+                valid = false;
+            }
+        }
+        if (valid) {
+            if (!hopSynced) {
+                LOG("Wireless: Following hop sequence %u", received.sequenceId);
+            }
+            memcpy(&hopSequence, &received, sizeof(struct Edp_HopSequence));
+            nextHopAt = time_us_32() + received.remaining;
+            lastHopAnnouncement = time_us_32();
+            hopSynced = true;
+            stats.hopAnnouncements++;
+        }
+    }
+
+    now = time_us_32();
+    dwell = (uint32_t)hopSequence.dwellTime * 1000;
+
+    // Lost the master. It comes by radioChannel once per round
+    if (!hopMaster && hopSynced &&
+        ((now - lastHopAnnouncement) > hopSequence.channelCount * dwell * WIRELESS_HOP_SYNC_LOSS_ROUNDS))
+    {
+        LOG("Wireless: Hop master lost, back to channel %u", boardConfig.activeConfig->radioChannel);
+        hopSynced = false;
+        stats.hopSyncLost++;
+        hopSequence.channelCount = 1;
+        hopSequence.channels[0] = boardConfig.activeConfig->radioChannel;
+        tuneTo(hopSequence.channels[0]);
+    }
+
+    if ((hopMaster || hopSynced) && ((int32_t)(now - nextHopAt) >= 0)) {
+        nextHopAt += dwell;
+        // Don't try to catch up after being blocked for a while
+        if ((int32_t)(now - nextHopAt) >= 0) {
+            nextHopAt = now + dwell;
+        }
+        hopTo(hopSequence.nextIndex);
+    }
+
+    if (!hopMaster) {
+        return;
+    }
+
+    // The first complete background scan is there, no need to wait for
+    // WIRELESS_HOP_REPICK_MS
+    if ((hopSequence.channelCount == 1) && (stats.scanSweeps > 0)) {
+        lastHopPick = board_millis();
+        pickHopChannels();
+    }
+
+    if ((board_millis() - lastHopPick) > WIRELESS_HOP_REPICK_MS) {
+        lastHopPick = board_millis();
+        pickHopChannels();
+    }
+
+    if (hopAnnounceDue) {
+        hopAnnounceDue = false;
+        sendHopSequence();
+    }
+}
+
+void Wireless::hopTo(uint8_t index) {
+    uint8_t channel = hopChannel;
+
+    // Master: How did the channel we leave do?
+    if (hopMaster) {
+        hopTried[channel] = MIN(hopTried[channel] + (stats.sentTried - hopTriedAtStart), 0xffff);
+        hopLost[channel] = MIN(hopLost[channel] + (stats.maxRt - hopMaxRtAtStart), 0xffff);
+        if (hopTried[channel] >= WIRELESS_HOP_MIN_PACKETS) {
+            if ((channel != boardConfig.activeConfig->radioChannel) &&
+                ((uint32_t)hopLost[channel] * 100 > (uint32_t)hopTried[channel] * WIRELESS_HOP_BLACKLIST_PERCENT))
+            {
+                LOG("Wireless: Channel %u lost %u of %u packets, blacklisted", channel, hopLost[channel], hopTried[channel]);
+                hopBlacklistedUntil[channel] = board_millis() + WIRELESS_HOP_BLACKLIST_MS;
+                stats.hopBlacklisted++;
+            }
+            hopTried[channel] = 0;
+            hopLost[channel] = 0;
+        }
+    }
+
+    hopSequence.nextIndex = (index + 1) % hopSequence.channelCount;
+    tuneTo(hopSequence.channels[index]);
+    stats.hops++;
+
+    if (hopMaster) {
+        hopTriedAtStart = stats.sentTried;
+        hopMaxRtAtStart = stats.maxRt;
+
+        // A blacklisted channel is left out from now on
+        if (hopBlacklistedUntil[channel] && ((int32_t)(board_millis() - hopBlacklistedUntil[channel]) < 0)) {
+            pickHopChannels();
+        }
+        hopAnnounceDue = true;
+    }
+}
+
+void Wireless::tuneTo(uint8_t channel) {
+    endBurst();
+    rf24radio.stopListening();
     rf24radio.setChannel(channel);
-    sleep_us(130); // Let the radio tune
     rf24radio.startListening();
-    sleep_us(200); // Listen for some time
-    // TODO: Sleep time should ne random between 150 and 230 to
-    //       avoid strobe effects from FHSS devices
-    if (rf24radio.testRPD()) { // signal detected so increase signalStrength unless already maxed out
-        signalStrength[channel] += (0x7FFF - signalStrength[channel]) >> 5; // increase rapidly when previous value was low, with increase reducing exponentially as value approaches maximum
-    } else { // no signal detected so reduce signalStrength unless already at minimum
-        signalStrength[channel] -= signalStrength[channel] >> 5; // decrease rapidly when previous value was high, with decrease reducing exponentially as value approaches zero
+    hopChannel = channel;
+}
+
+// radioChannel first, then the quietest channels that are not blacklisted
+// and not too close to one already picked
+void Wireless::pickHopChannels() {
+    uint8_t channels[EDP_HOP_MAX_CHANNELS];
+    uint8_t count = 1;
+    int best;
+    bool usable;
+
+    channels[0] = boardConfig.activeConfig->radioChannel;
+
+    while (count < MIN(WIRELESS_HOP_CHANNELS, EDP_HOP_MAX_CHANNELS)) {
+        best = -1;
+        for (uint8_t c = WIRELESS_HOP_CHANNEL_MIN; c <= WIRELESS_HOP_CHANNEL_MAX; c++) {
+            usable = !(hopBlacklistedUntil[c] && ((int32_t)(board_millis() - hopBlacklistedUntil[c]) < 0));
+            for (uint8_t i = 0; i < count; i++) {
+                if (abs((int)c - (int)channels[i]) < WIRELESS_HOP_MIN_SPACING) {
+                    usable = false;
+                }
+            }
+            if (usable && ((best < 0) || (signalStrength[c] < signalStrength[best]))) {
+                best = c;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        channels[count] = best;
+        count++;
     }
-    rf24radio.stopListening();
+
+    if ((count == hopSequence.channelCount) && !memcmp(channels, hopSequence.channels, count)) {
+        return;
+    }
+
+    // Where we are now doesn't need to be part of the new sequence. Everyone
+    // learns the new one before the next hop
+    memcpy(hopSequence.channels, channels, count);
+    hopSequence.channelCount = count;
+    hopSequence.sequenceId++;
+    if (hopSequence.nextIndex >= count) {
+        hopSequence.nextIndex = 0;
+    }
+    hopAnnounceDue = true;
+
+    LOG("Wireless: New hop sequence %u with %u channels", hopSequence.sequenceId, count);
+}
+
+// Not via edpRX's controlData, it has to go out right after the hop and
+// must not replace a ping or discovery message waiting there
+void Wireless::sendHopSequence() {
+    uint8_t message[sizeof(Edp_Commands) + sizeof(struct Edp_HopSequence)];
+    int32_t remaining = nextHopAt - time_us_32();
+
+    hopSequence.remaining = MAX(remaining, 0);
+    message[0] = Edp_Commands::HopSequence;
+    memcpy(message + sizeof(Edp_Commands), &hopSequence, sizeof(struct Edp_HopSequence));
+
+    writeChunk(message, sizeof(message));
+    stats.hopAnnouncements++;
 }
 
 void Wireless::sendData(uint8_t universeId, uint8_t *source, uint16_t sourceLength) {
@@ -154,90 +537,448 @@ void Wireless::sendData(uint8_t universeId, uint8_t *source, uint16_t sourceLeng
     // cares about the unsent, old data if we have new values anyway
     LOG("SendData. Universe: %d. RadioRole: %d", universeId, boardConfig.activeConfig->radioRole);
 
+    if (universeId >= WIRELESS_UNIVERSES) {
+        return;
+    }
+
     uint16_t length = MIN(sourceLength, 512);
 
     // TODO: Mutex should be fine here, no reason to disables IRQs
     critical_section_enter_blocking(&bufferLock);
     memset(this->sendQueueData[universeId], 0x00, 512);
     memcpy(this->sendQueueData[universeId], source, length);
+    // Latency counts from the oldest change, not the latest overwrite
+    if (!this->sendQueue[universeId].pending) {
+        this->sendQueue[universeId].queuedAt = time_us_32();
+        this->sendQueue[universeId].pending = true;
+    }
+    this->sendQueue[universeId].hasData = true;
     critical_section_exit(&bufferLock);
+}
+
+// Pending universe waiting longest or -1. Universes not sent for a while
+// are queued again here
+int Wireless::nextUniverseToSend() {
+    int next = -1;
+    uint32_t now = time_us_32();
+    uint32_t longestWait = 0;
+    uint32_t wait;
+
+    critical_section_enter_blocking(&bufferLock);
+    for (uint8_t i = 0; i < WIRELESS_UNIVERSES; i++) {
+        struct WirelessUniverse* u = &this->sendQueue[i];
+
+        if (!u->pending && u->hasData && ((board_millis() - u->lastSent) > WIRELESS_REFRESH_INTERVAL_MS)) {
+            u->pending = true;
+            u->queuedAt = now;
+            u->refreshes++;
+        }
+        if (!u->pending) {
+            continue;
+        }
 
-    this->sendQueueValid[universeId] = true;
+        wait = now - u->queuedAt;
+        if ((next < 0) || (wait > longestWait)) {
+            next = i;
+            longestWait = wait;
+        }
+    }
+    critical_section_exit(&bufferLock);
+
+    return next;
 }
 
 void Wireless::doSendData() {
     bool triedToSend = false;
-    bool success = false;
     bool anyFailed = false;
-    uint8_t automaticRetryCount = 0;
+    int universeId;
+    uint32_t startedAt = time_us_32();
+
+    for (uint8_t sent = 0; sent < WIRELESS_FRAMES_PER_BURST; sent++) {
+        if ((boardConfig.activeConfig->radioRole == RadioRole::mesh) &&
+            ((time_us_32() - startedAt) > WIRELESS_MESH_SEND_BUDGET_US))
+        {
+            break;
+        }
+
+        universeId = nextUniverseToSend();
+        if (universeId < 0) {
+            break;
+        }
+
+        triedToSend = true;
+        sendUniverse(universeId, &anyFailed);
+    }
+
+    // Nothing came to fill up the packet, so send the end of the last frame as it is
+    flushTail(&anyFailed);
 
+    if (triedToSend) {
+        if (anyFailed) {
+            statusLeds.setStaticOn(6, 1, 0, 0);
+        } else {
+            statusLeds.setStaticOff(6, 1, 0, 0);
+        }
+    }
+}
+
+void Wireless::sendUniverse(uint8_t universeId, bool* anyFailed) {
+    struct WirelessUniverse* u = &this->sendQueue[universeId];
     uint16_t thisChunkSize = 0;
+    uint16_t limit = 0;
     bool callAgain = false;
+    uint32_t queuedAt;
+    uint32_t latency;
+    uint8_t bucket;
+    uint8_t destinations[WIRELESS_MESH_UNICAST_MAX];
+    uint8_t destinationCount;
+    bool firstChunk;
 
-    size_t actuallyWritten = 1000;
-    size_t payloadSize = 0;
+    critical_section_enter_blocking(&bufferLock);
+    u->pending = false;
+    queuedAt = u->queuedAt;
 
-    int j = 0;
+    // Copy the data away to somewhere it doesn't change while we read it
+    memcpy(Wireless::tmpBufQueueCopy, this->sendQueueData[universeId], 512);
+    critical_section_exit(&bufferLock);
 
-    for (int i = 0; i < 4; i++) {
-        if (this->sendQueueValid[i]) {
+    statusLeds.setBlinkOnce(6, 0, 1, 0);
 
-            critical_section_enter_blocking(&bufferLock);
-            this->sendQueueValid[i] = false;
+    // Read every time so changes via the web interface apply to the next
+    // frame. RF24Network splits mesh chunks into radio payloads minus its header
+    edpTX.setEncoding(boardConfig.activeConfig->radioParams.compression,
+        boardConfig.activeConfig->radioParams.allowSparse,
+        (boardConfig.activeConfig->radioRole == RadioRole::mesh) ? (MAX_FRAME_SIZE - sizeof(RF24NetworkHeader)) : 0);
 
-            // Copy the data away to somewhere it doesn't change while we read it
-            memcpy(Wireless::tmpBufQueueCopy, this->sendQueueData[i], 512);
-            critical_section_exit(&bufferLock);
+    switch (boardConfig.activeConfig->radioRole) {
+        case RadioRole::broadcast:
+            callAgain = false;
+            limit = 0;
+            if (tailSize && boardConfig.activeConfig->radioParams.fec) {
+                // FEC needs full size first chunks, no room for the tail
+                flushTail(anyFailed);
+            } else if (tailSize) {
+                // Fill up the packet with the end of the previous
+                // frame using the start of this frame
+                limit = WIRELESS_PAYLOAD_SIZE - WIRELESS_PACK_OVERHEAD - tailSize;
+                if (limit < EDP_MIN_CHUNK_SIZE) {
+                    flushTail(anyFailed);
+                    limit = 0;
+                }
+            }
 
-            triedToSend = true;
-            statusLeds.setBlinkOnce(6, 0, 1, 0);
+            edpTX.prepareDmxData(universeId, 512, &thisChunkSize, &callAgain, limit);
 
-            switch (boardConfig.activeConfig->radioRole) {
-                case RadioRole::broadcast:
-                    rf24radio.stopListening();
+            if (tailSize) {
+                packBuf[3 + tailSize] = thisChunkSize & 0xff;
+                packBuf[4 + tailSize] = thisChunkSize >> 8;
+                memcpy(packBuf + WIRELESS_PACK_OVERHEAD + tailSize, Wireless::tmpBuf_TX1, thisChunkSize);
+                if (!writeChunk(packBuf, WIRELESS_PACK_OVERHEAD + tailSize + thisChunkSize)) {
+                    *anyFailed = true;
+                }
+                edpTX.stats.bytesSent += WIRELESS_PACK_OVERHEAD;
+                edpTX.stats.overheadBytesSent += WIRELESS_PACK_OVERHEAD;
+                stats.packed++;
+                tailSize = 0;
+            } else {
+                holdOrWriteChunk(thisChunkSize, anyFailed);
+            }
 
-                    callAgain = false;
-                    edpTX.prepareDmxData(i, 512, &thisChunkSize, &callAgain);
-                    stats.sentTried++;
-                    success = rf24radio.write(Wireless::tmpBuf_TX1, thisChunkSize);
-                    if (!success) {
-                        anyFailed = true;
-                    } else {
-                        stats.sentSuccess++;
-                    }
-                    while(callAgain) {
-                        edpTX.prepareDmxData(i, 0, &thisChunkSize, &callAgain);
-                        success = rf24radio.write(Wireless::tmpBuf_TX1, thisChunkSize);
-                        stats.sentTried++;
-                        if (!success) {
-                            anyFailed = true;
-                        } else {
-                            stats.sentSuccess++;
-                        }
+            while (callAgain) {
+                edpTX.prepareDmxData(universeId, 0, &thisChunkSize, &callAgain);
+                holdOrWriteChunk(thisChunkSize, anyFailed);
+            }
+        break;
+        case RadioRole::mesh:
+            // One chunk is usually a complete frame, RF24Network splits it
+            // into radio packets and puts it together again. Only the nodes
+            // the universe is patched to get it
+            destinationCount = meshDestinations(universeId, destinations);
+            firstChunk = true;
+            do {
+                edpTX.prepareDmxData(universeId, firstChunk ? 512 : 0, &thisChunkSize, &callAgain);
+                firstChunk = false;
+                for (uint8_t i = 0; i < destinationCount; i++) {
+                    if (!meshWriteChunk(Wireless::tmpBuf_TX1, thisChunkSize, destinations[i])) {
+                        *anyFailed = true;
                     }
+                }
+            } while (callAgain);
+        break;
+    }
 
-                    rf24radio.startListening();
-                break;
-                case RadioRole::mesh:
-                    if (boardConfig.activeConfig->radioAddress) {
-                        // We are a node and send to the master?
-                    } else {
-                        // We are the mesh master and iterate through the nodes
-                    }
-                break;
+    latency = time_us_32() - queuedAt;
+    u->lastSent = board_millis();
+    u->framesSent++;
+    u->latencyLast = latency;
+    u->latencyMax = MAX(u->latencyMax, latency);
+    u->latencyAvg = u->latencyAvg ? (u->latencyAvg * 7 + latency) / 8 : latency;
+
+    // Buckets double in size, the last one takes everything above
+    bucket = 0;
+    while ((bucket < WIRELESS_LATENCY_BUCKETS - 1) && (latency >= ((uint32_t)WIRELESS_LATENCY_FIRST_BUCKET_US << bucket))) {
+        bucket++;
+    }
+    u->latencyHistogram[bucket]++;
+
+    LOG("doSendData DONE");
+}
+
+struct WirelessMeshNode* Wireless::findMeshNode(uint8_t nodeID) {
+    for (uint8_t i = 0; i < meshNodeCount; i++) {
+        if (meshNodes[i].nodeID == nodeID) {
+            return &meshNodes[i];
+        }
+    }
+
+    if (meshNodeCount >= WIRELESS_MESH_MAX_NODES) {
+        return nullptr;
+    }
+
+    meshNodes[meshNodeCount].nodeID = nodeID;
+    return &meshNodes[meshNodeCount++];
+}
+
+// Which nodes the master sends a universe to, from the meshNode of its
+// patchings. Returns the number of nodeIDs, one entry 0 means every node
+uint8_t Wireless::meshDestinations(uint8_t universeId, uint8_t* nodeIDs) {
+    uint8_t count = 0;
+    uint8_t i;
+
+    for (uint8_t p = 0; p < MAX_PATCHINGS; p++) {
+        Patching patching = boardConfig.activeConfig->patching[p];
+        if ((!patching.active) ||
+            (patching.srcType != PatchType::buffer) ||
+            (patching.dstType != PatchType::nrf24) ||
+            (patching.dstInstance != universeId))
+        {
+            continue;
+        }
+
+        for (i = 0; (i < count) && (nodeIDs[i] != patching.meshNode); i++);
+        if (i < count) {
+            continue;
+        }
+        // Too many for unicasts, that's what multicasting to all is for
+        if ((patching.meshNode == 0) || (count >= WIRELESS_MESH_UNICAST_MAX)) {
+            nodeIDs[0] = 0;
+            return 1;
+        }
+        nodeIDs[count++] = patching.meshNode;
+    }
+
+    // Queued some other way (keyframe request, refresh) without patching
+    if (count == 0) {
+        nodeIDs[0] = 0;
+        count = 1;
+    }
+
+    return count;
+}
+
+// Nodes send to the master. The master sends to the node given by nodeID,
+// or with nodeID 0 to every node it gave an address to, so we know which
+// ones got it. RF24Network routes over other nodes if required. With many
+// nodes, that takes too long and a multicast (without ACKs) is sent instead
+bool Wireless::meshWriteChunk(const uint8_t* data, uint16_t size, uint8_t nodeID) {
+    struct WirelessMeshNode* node;
+    bool result = true;
+
+    if (boardConfig.activeConfig->radioAddress) {
+        node = findMeshNode(0);
+        stats.sentTried++;
+        if (node) {
+            node->sent++;
+        }
+        if (!rf24mesh.write(data, WIRELESS_MESH_TYPE_EDP, size)) {
+            return false;
+        }
+        stats.sentSuccess++;
+        if (node) {
+            node->acked++;
+            node->lastAck = board_millis();
+        }
+        return true;
+    }
+
+    if (nodeID) {
+        for (uint8_t i = 0; i < rf24mesh.addrListTop; i++) {
+            if (rf24mesh.addrList[i].nodeID != nodeID) {
+                continue;
+            }
+            node = findMeshNode(nodeID);
+            stats.sentTried++;
+            if (node) {
+                node->sent++;
+            }
+            if (!rf24mesh.write(rf24mesh.addrList[i].address, data, WIRELESS_MESH_TYPE_EDP, size)) {
+                return false;
             }
+            stats.sentSuccess++;
+            if (node) {
+                node->acked++;
+                node->lastAck = board_millis();
+            }
+            return true;
+        }
+        // Not (yet) part of the mesh
+        return false;
+    }
 
-            LOG("doSendData DONE");
+    if (rf24mesh.addrListTop > WIRELESS_MESH_UNICAST_MAX) {
+        RF24NetworkHeader header(00, WIRELESS_MESH_TYPE_EDP);
+        stats.sentTried++;
+        if (!rf24network.multicast(header, data, size, 1)) {
+            return false;
         }
+        stats.sentSuccess++;
+        return true;
     }
 
-    if (triedToSend) {
-        if (anyFailed) {
-            statusLeds.setStaticOn(6, 1, 0, 0);
-        } else {
-            statusLeds.setStaticOff(6, 1, 0, 0);
+    for (uint8_t i = 0; i < rf24mesh.addrListTop; i++) {
+        node = findMeshNode(rf24mesh.addrList[i].nodeID);
+        stats.sentTried++;
+        if (node) {
+            node->sent++;
+        }
+        if (!rf24mesh.write(rf24mesh.addrList[i].address, data, WIRELESS_MESH_TYPE_EDP, size)) {
+            result = false;
+            continue;
         }
+        stats.sentSuccess++;
+        if (node) {
+            node->acked++;
+            node->lastAck = board_millis();
+        }
+    }
+
+    return result;
+}
+
+void Wireless::handleMeshReceivedData() {
+    RF24NetworkHeader header;
+    struct WirelessMeshNode* node;
+    uint16_t size;
+
+    while (rf24network.available()) {
+        rf24network.peek(header);
+        if (header.type != WIRELESS_MESH_TYPE_EDP) {
+            // Not for us, just drop it
+            rf24network.read(header, nullptr, 0);
+            continue;
+        }
+
+        size = rf24network.read(header, Wireless::tmpBuf_RX0, sizeof(Wireless::tmpBuf_RX0));
+        if (size < 1) {
+            continue;
+        }
+
+        stats.received++;
+        node = findMeshNode(rf24mesh.getNodeID(header.from_node));
+        if (node) {
+            node->received++;
+        }
+
+        statusLeds.setBlinkOnce(6, 0, 0, 1);
+
+        edpRX.processIncomingChunk(size);
+    }
+}
+
+// writeFast only waits if the TX FIFO is full, which is about one packet's
+// airtime. ACKs are handled by the radio while we prepare the next chunk
+bool Wireless::writeChunk(const uint8_t* data, uint8_t size) {
+    bool result = true;
+
+    if (!txActive) {
+        rf24radio.stopListening();
+        txActive = true;
+        txInFlight = 0;
+        stats.bursts++;
+    }
+
+    stats.sentTried++;
+    if (!rf24radio.writeFast(data, size)) {
+        // The oldest packet in the FIFO ran out of retries and blocks it.
+        // txStandBy clears that and flushes the FIFO, the packets in it
+        // are lost. The receiver asks for the frame again (DmxDataRequest)
+        rf24radio.txStandBy();
+        stats.maxRt++;
+        countArc();
+        // writeFast only fails with a full FIFO, everything before made it
+        if (txInFlight > 3) {
+            stats.sentSuccess += txInFlight - 3;
+        }
+        txInFlight = 0;
+        result = false;
+        rf24radio.writeFast(data, size);
+    }
+    txInFlight++;
+
+    return result;
+}
+
+// Wait until the FIFO is empty and go back to RX
+bool Wireless::endBurst() {
+    bool result;
+
+    if (!txActive) {
+        return true;
+    }
+
+    result = rf24radio.txStandBy();
+    if (result) {
+        stats.sentSuccess += txInFlight;
+    } else {
+        stats.maxRt++;
     }
+    txInFlight = 0;
+    countArc();
+
+    rf24radio.startListening();
+    txActive = false;
+
+    return result;
+}
+
+// ARC only tells about the last packet sent. Without ACKs, it's always 0
+void Wireless::countArc() {
+    uint8_t arc = rf24radio.getARC();
+
+    if (arc < WIRELESS_ARC_BUCKETS) {
+        linkStats.arcHistogram[arc]++;
+    }
+}
+
+// A chunk that leaves enough room for the start of another frame is the
+// last one of its frame. Keep it until we know if another frame follows
+void Wireless::holdOrWriteChunk(uint16_t size, bool* anyFailed) {
+    if (dynamicPayloads && (size + WIRELESS_PACK_OVERHEAD + EDP_MIN_CHUNK_SIZE <= WIRELESS_PAYLOAD_SIZE)) {
+        flushTail(anyFailed);
+        packBuf[0] = Edp_Commands::DmxDataBundle;
+        packBuf[1] = size & 0xff;
+        packBuf[2] = size >> 8;
+        memcpy(packBuf + 3, Wireless::tmpBuf_TX1, size);
+        tailSize = size;
+        return;
+    }
+
+    // Keep the order, a held chunk goes out first
+    flushTail(anyFailed);
+    if (!writeChunk(Wireless::tmpBuf_TX1, size)) {
+        *anyFailed = true;
+    }
+}
+
+void Wireless::flushTail(bool* anyFailed) {
+    if (!tailSize) {
+        return;
+    }
+
+    if (!writeChunk(packBuf + 3, tailSize)) {
+        *anyFailed = true;
+    }
+    tailSize = 0;
 }
 
 void Wireless::handleReceivedData() {
@@ -262,23 +1003,466 @@ void Wireless::handleReceivedData() {
         }
 
         stats.received++;
+        lastReceivedAt = time_us_32();
+        if (rf24radio.testRPD()) {
+            linkStats.rpdHits++;
+        }
 
         statusLeds.setBlinkOnce(6, 0, 0, 1);
 
-        edpRX.processIncomingChunk(bytes);
+        if (pipe >= WIRELESS_SOURCES) {
+            return;
+        }
+        sources[pipe].received++;
+        sources[pipe].lastSeen = board_millis();
+
+        // Chunks of different transmitters may come in interleaved
+        if (Edp::isDmxData(tmpBuf_RX0[0])) {
+            edpSources[pipe].processIncomingChunk(bytes);
+        } else {
+            edpRX.processIncomingChunk(bytes);
+        }
+    }
+}
+
+// Source 0 keeps the address all nodes used before ("DMXTX"). The others
+// only differ in the first (least significant) byte, since pipes 2 to 5
+// share the upper bytes with pipe 1
+void Wireless::sourceAddress(uint8_t sourceId, uint8_t* address) {
+    memcpy(address, "DMXTX", 5);
+    address[0] += sourceId;
+}
+
+void Wireless::mergeFrame(void* context, uint8_t sourceId, uint8_t bufferId, const uint8_t* data, uint16_t length) {
+    ((Wireless*)context)->merge(sourceId, bufferId, data, length);
+}
+
+// Called by edpSources with every complete frame. Sources that weren't
+// heard for WIRELESS_MERGE_TIMEOUT_MS are left out
+void Wireless::merge(uint8_t sourceId, uint8_t bufferId, const uint8_t* data, uint16_t length) {
+    uint32_t now = board_millis();
+    struct WirelessMergeSlot* slot = nullptr;
+    struct WirelessMergeSlot* freeSlot = nullptr;
+    bool others = false;
+
+    if (bufferId >= DMXBUFFER_COUNT) {
+        return;
+    }
+    length = MIN(length, 512);
+
+    switch (boardConfig.activeConfig->radioParams.mergeMode) {
+        case RadioMergeMode::mergePriority:
+            if ((mergeOwnerSeen[bufferId] != 0) &&
+                (mergeOwner[bufferId] < sourceId) &&
+                ((now - mergeOwnerSeen[bufferId]) < WIRELESS_MERGE_TIMEOUT_MS))
+            {
+                stats.mergeDropped++;
+                return;
+            }
+            mergeOwner[bufferId] = sourceId;
+            mergeOwnerSeen[bufferId] = now;
+            break;
+
+        case RadioMergeMode::mergeHtp:
+            for (uint8_t i = 0; i < WIRELESS_MERGE_SLOTS; i++) {
+                if (mergeSlots[i].used && ((now - mergeSlots[i].lastSeen) >= WIRELESS_MERGE_TIMEOUT_MS)) {
+                    mergeSlots[i].used = false;
+                }
+                if (!mergeSlots[i].used) {
+                    freeSlot = freeSlot ? freeSlot : &mergeSlots[i];
+                    continue;
+                }
+                if (mergeSlots[i].bufferId != bufferId) {
+                    continue;
+                }
+                if (mergeSlots[i].sourceId == sourceId) {
+                    slot = &mergeSlots[i];
+                } else {
+                    others = true;
+                }
+            }
+            slot = slot ? slot : freeSlot;
+            if (!slot) {
+                stats.mergeNoSlot++;
+                break;
+            }
+
+            slot->used = true;
+            slot->bufferId = bufferId;
+            slot->sourceId = sourceId;
+            slot->lastSeen = now;
+            memset(slot->data, 0x00, 512);
+            memcpy(slot->data, data, length);
+
+            // Only one source, nothing to merge
+            if (!others) {
+                break;
+            }
+
+            memcpy(mergeBuf, slot->data, 512);
+            for (uint8_t i = 0; i < WIRELESS_MERGE_SLOTS; i++) {
+                if ((!mergeSlots[i].used) || (mergeSlots[i].bufferId != bufferId) || (&mergeSlots[i] == slot)) {
+                    continue;
+                }
+                for (uint16_t j = 0; j < 512; j++) {
+                    mergeBuf[j] = MAX(mergeBuf[j], mergeSlots[i].data[j]);
+                }
+            }
+            stats.mergeHtp++;
+            dmxBuffer.setBuffer(bufferId, mergeBuf, 512);
+            return;
+
+        default:
+            break;
+    }
+
+    dmxBuffer.setBuffer(bufferId, (uint8_t*)data, length);
+}
+
+// Whether any buffer is patched to the radio
+bool Wireless::isTransmitter() {
+    for (uint8_t i = 0; i < MAX_PATCHINGS; i++) {
+        Patching patching = boardConfig.activeConfig->patching[i];
+        if (patching.active &&
+            (patching.srcType == PatchType::buffer) &&
+            (patching.dstType == PatchType::nrf24))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// A receiver missed some chunks or got a broken frame. Queue the universe
+// again so it gets a complete frame without waiting for the next change
+void Wireless::handleDmxDataRequests() {
+    uint8_t universeId;
+
+    while (edpRX.takeDmxDataRequest(&universeId)) {
+        for (uint8_t i = 0; i < MAX_PATCHINGS; i++) {
+            Patching patching = boardConfig.activeConfig->patching[i];
+            if ((!patching.active) ||
+                (patching.srcType != PatchType::buffer) ||
+                (patching.dstType != PatchType::nrf24) ||
+                (patching.dstInstance != universeId))
+            {
+                continue;
+            }
+            this->sendData(universeId, dmxBuffer.buffer[patching.srcInstance], 512);
+            break;
+        }
+    }
+}
+
+void Wireless::handleDiscoveryResponses() {
+    uint8_t serial[8];
+
+    while (edpRX.takeDiscoveryResponse(serial)) {
+        discovery.handleResponse(serial);
+    }
+}
+
+// Pings, pongs and keyframe requests are prepared by edpRX since that's
+// where the answers come in. Only keyframe requests come from edpSources
+void Wireless::sendControlData() {
+    uint16_t thisChunkSize = 0;
+
+    if (edpRX.takeControlData(&thisChunkSize)) {
+        writeChunk(edpRX.controlData, thisChunkSize);
+        return;
+    }
+
+    for (uint8_t i = 0; i < WIRELESS_SOURCES; i++) {
+        if (edpSources[i].takeControlData(&thisChunkSize)) {
+            writeChunk(edpSources[i].controlData, thisChunkSize);
+            return;
+        }
+    }
+}
+
+bool Wireless::controlDataPending() {
+    bool pending = edpRX.controlDataPending();
+
+    for (uint8_t i = 0; i < WIRELESS_SOURCES; i++) {
+        pending = pending || edpSources[i].controlDataPending();
+    }
+
+    return pending;
+}
+
+void Wireless::getWirelessStats(JsonWriter* json) {
+    struct EdpStats rxTotal;
+
+    // DMX data comes in via edpSources in broadcast, via edpRX in the mesh
+    memcpy(&rxTotal, &edpRX.stats, sizeof(struct EdpStats));
+    for (uint8_t i = 0; i < WIRELESS_SOURCES; i++) {
+        rxTotal.framesReceived += edpSources[i].stats.framesReceived;
+        rxTotal.framesCrcError += edpSources[i].stats.framesCrcError;
+        rxTotal.framesChunkGap += edpSources[i].stats.framesChunkGap;
+        rxTotal.framesRecovered += edpSources[i].stats.framesRecovered;
+        rxTotal.dmxDataRequestsSent += edpSources[i].stats.dmxDataRequestsSent;
     }
+
+    json->beginObject();
+
+    json->value("sentTried", stats.sentTried);
+    json->value("sentSuccess", stats.sentSuccess);
+    json->value("received", stats.received);
+    json->value("packed", stats.packed);
+    json->value("bursts", stats.bursts);
+    json->value("maxRt", stats.maxRt);
+    json->value("hops", stats.hops);
+    json->value("hopAnnouncements", stats.hopAnnouncements);
+    json->value("hopSyncLost", stats.hopSyncLost);
+    json->value("hopBlacklisted", stats.hopBlacklisted);
+    json->value("scanChannels", stats.scanChannels);
+    json->value("scanSweeps", stats.scanSweeps);
+    json->value("scanSweepMs", stats.scanSweepMs);
+    json->value("taskLoad", stats.taskLoad);
+    json->value("taskAvgUs", stats.taskAvgUs);
+    json->value("taskMaxUs", stats.taskMaxUs);
+
+    json->beginObject("merge");
+    json->value("mode", (int)boardConfig.activeConfig->radioParams.mergeMode);
+    json->value("htp", stats.mergeHtp);
+    json->value("dropped", stats.mergeDropped);
+    json->value("noSlot", stats.mergeNoSlot);
+    json->endObject();
+
+    // Arrays, one entry per source, to keep it short
+    json->value("ownSource", ownSource);
+    json->beginObject("sources");
+    json->beginArray("received");
+    for (uint8_t i = 0; i < WIRELESS_SOURCES; i++) {
+        json->value(sources[i].received);
+    }
+    json->endArray();
+    json->beginArray("lastSeen");
+    for (uint8_t i = 0; i < WIRELESS_SOURCES; i++) {
+        json->value(sources[i].lastSeen);
+    }
+    json->endArray();
+    json->beginArray("framesReceived");
+    for (uint8_t i = 0; i < WIRELESS_SOURCES; i++) {
+        json->value(edpSources[i].stats.framesReceived);
+    }
+    json->endArray();
+    json->beginArray("framesCrcError");
+    for (uint8_t i = 0; i < WIRELESS_SOURCES; i++) {
+        json->value(edpSources[i].stats.framesCrcError);
+    }
+    json->endArray();
+    json->beginArray("framesChunkGap");
+    for (uint8_t i = 0; i < WIRELESS_SOURCES; i++) {
+        json->value(edpSources[i].stats.framesChunkGap);
+    }
+    json->endArray();
+    json->beginArray("framesRecovered");
+    for (uint8_t i = 0; i < WIRELESS_SOURCES; i++) {
+        json->value(edpSources[i].stats.framesRecovered);
+    }
+    json->endArray();
+    json->endObject();
+
+    json->beginObject("hopping");
+    json->value("enabled", (bool)boardConfig.activeConfig->radioParams.hopping);
+    json->value("master", hopMaster);
+    json->value("synced", hopSynced);
+    json->value("sequenceId", hopSequence.sequenceId);
+    json->value("channel", hopChannel);
+    json->beginArray("channels");
+    for (uint8_t i = 0; i < hopSequence.channelCount; i++) {
+        json->value(hopSequence.channels[i]);
+    }
+    json->endArray();
+    json->endObject();
+
+    json->beginObject("link");
+    json->value("pingsSent", edpRX.stats.pingsSent);
+    json->value("pingsAnswered", edpRX.stats.pingsAnswered);
+    json->value("pongsReceived", edpRX.stats.pongsReceived);
+    json->value("rttLast", edpRX.stats.rttLast);
+    json->value("rttMin", edpRX.stats.rttMin);
+    json->value("rttMax", edpRX.stats.rttMax);
+    json->value("rttAvg", edpRX.stats.rttAvg);
+    json->value("framesReceived", rxTotal.framesReceived);
+    json->value("framesCrcError", rxTotal.framesCrcError);
+    json->value("framesChunkGap", rxTotal.framesChunkGap);
+    json->value("framesRecovered", rxTotal.framesRecovered);
+    json->value("dmxDataRequestsSent", rxTotal.dmxDataRequestsSent);
+    json->value("dmxDataRequestsReceived", edpRX.stats.dmxDataRequestsReceived);
+    json->value("discoveryAnswered", edpRX.stats.discoveryAnswered);
+    json->endObject();
+
+    json->beginObject("tx");
+    json->value("framesSent", edpTX.stats.framesSent);
+    json->value("chunksSent", edpTX.stats.chunksSent);
+    json->value("bytesSent", edpTX.stats.bytesSent);
+    json->value("overheadBytesSent", edpTX.stats.overheadBytesSent);
+    json->value("framesSparse", edpTX.stats.framesSparse);
+    json->value("framesCompressed", edpTX.stats.framesCompressed);
+    json->value("compressionSkipped", edpTX.stats.compressionSkipped);
+    json->value("parityChunksSent", edpTX.stats.parityChunksSent);
+    json->endObject();
+
+    if (meshNodeCount) {
+        json->beginObject("mesh");
+        json->beginArray("nodeID");
+        for (uint8_t i = 0; i < meshNodeCount; i++) {
+            json->value(meshNodes[i].nodeID);
+        }
+        json->endArray();
+        json->beginArray("sent");
+        for (uint8_t i = 0; i < meshNodeCount; i++) {
+            json->value(meshNodes[i].sent);
+        }
+        json->endArray();
+        json->beginArray("acked");
+        for (uint8_t i = 0; i < meshNodeCount; i++) {
+            json->value(meshNodes[i].acked);
+        }
+        json->endArray();
+        json->beginArray("received");
+        for (uint8_t i = 0; i < meshNodeCount; i++) {
+            json->value(meshNodes[i].received);
+        }
+        json->endArray();
+        json->beginArray("lastAck");
+        for (uint8_t i = 0; i < meshNodeCount; i++) {
+            json->value(meshNodes[i].lastAck);
+        }
+        json->endArray();
+        json->endObject();
+    }
+
+    // Arrays, one entry per universe, to keep it short
+    json->beginObject("universes");
+    json->beginArray("framesSent");
+    for (uint8_t i = 0; i < WIRELESS_UNIVERSES; i++) {
+        json->value(sendQueue[i].framesSent);
+    }
+    json->endArray();
+    json->beginArray("refreshes");
+    for (uint8_t i = 0; i < WIRELESS_UNIVERSES; i++) {
+        json->value(sendQueue[i].refreshes);
+    }
+    json->endArray();
+    json->beginArray("latencyLast");
+    for (uint8_t i = 0; i < WIRELESS_UNIVERSES; i++) {
+        json->value(sendQueue[i].latencyLast);
+    }
+    json->endArray();
+    json->beginArray("latencyMax");
+    for (uint8_t i = 0; i < WIRELESS_UNIVERSES; i++) {
+        json->value(sendQueue[i].latencyMax);
+    }
+    json->endArray();
+    json->beginArray("latencyAvg");
+    for (uint8_t i = 0; i < WIRELESS_UNIVERSES; i++) {
+        json->value(sendQueue[i].latencyAvg);
+    }
+    json->endArray();
+    json->beginArray("framesReceived");
+    for (uint8_t i = 0; i < WIRELESS_UNIVERSES; i++) {
+        json->value(universeRxStats[i].framesReceived);
+    }
+    json->endArray();
+    json->beginArray("framesCrcError");
+    for (uint8_t i = 0; i < WIRELESS_UNIVERSES; i++) {
+        json->value(universeRxStats[i].framesCrcError);
+    }
+    json->endArray();
+    // Of the frames that made it to the CRC check. Frames with lost chunks
+    // are not known by universe
+    json->beginArray("deliveryRatio");
+    for (uint8_t i = 0; i < WIRELESS_UNIVERSES; i++) {
+        json->value((universeRxStats[i].framesReceived + universeRxStats[i].framesCrcError) ?
+            ((double)universeRxStats[i].framesReceived / (universeRxStats[i].framesReceived + universeRxStats[i].framesCrcError)) : 0.0);
+    }
+    json->endArray();
+    json->beginArray("latencyHistogram");
+    for (uint8_t i = 0; i < WIRELESS_UNIVERSES; i++) {
+        json->beginArray();
+        for (uint8_t j = 0; j < WIRELESS_LATENCY_BUCKETS; j++) {
+            json->value(sendQueue[i].latencyHistogram[j]);
+        }
+        json->endArray();
+    }
+    json->endArray();
+    json->endObject();
+
+    json->value("rpdHits", linkStats.rpdHits);
+    json->beginArray("arcHistogram");
+    for (uint8_t i = 0; i < WIRELESS_ARC_BUCKETS; i++) {
+        json->value(linkStats.arcHistogram[i]);
+    }
+    json->endArray();
+
+    json->endObject();
 }
 
-std::string Wireless::getWirelessStats() {
-    Json::Value output;
-    Json::StreamWriterBuilder wbuilder;
-    std::string output_string;
+// Everything as one struct, read without locking. A counter may be one
+// update behind another, which doesn't matter for statistics
+void Wireless::getTelemetry(struct WirelessTelemetry* telemetry) {
+    memset(telemetry, 0x00, sizeof(struct WirelessTelemetry));
 
-    wbuilder["indentation"] = "";
+    telemetry->version = WIRELESS_TELEMETRY_VERSION;
+    telemetry->universeCount = WIRELESS_UNIVERSES;
+    telemetry->latencyBuckets = WIRELESS_LATENCY_BUCKETS;
+    telemetry->arcBuckets = WIRELESS_ARC_BUCKETS;
+    telemetry->uptime = board_millis();
+    telemetry->sentTried = stats.sentTried;
+    telemetry->sentSuccess = stats.sentSuccess;
+    telemetry->received = stats.received;
+    telemetry->maxRt = stats.maxRt;
+    telemetry->rpdHits = linkStats.rpdHits;
+    telemetry->framesChunkGap = edpRX.stats.framesChunkGap;
+    telemetry->framesRecovered = edpRX.stats.framesRecovered;
+    for (uint8_t i = 0; i < WIRELESS_SOURCES; i++) {
+        telemetry->framesChunkGap += edpSources[i].stats.framesChunkGap;
+        telemetry->framesRecovered += edpSources[i].stats.framesRecovered;
+    }
+    memcpy(telemetry->arcHistogram, linkStats.arcHistogram, sizeof(telemetry->arcHistogram));
 
-    output["sentTried"] = stats.sentTried;
-    output["sentSuccess"] = stats.sentSuccess;
-    output["received"] = stats.received;
-    output_string = Json::writeString(wbuilder, output);
-    return output_string;
+    for (uint8_t i = 0; i < WIRELESS_UNIVERSES; i++) {
+        telemetry->universes[i].framesSent = sendQueue[i].framesSent;
+        telemetry->universes[i].refreshes = sendQueue[i].refreshes;
+        telemetry->universes[i].latencyMax = sendQueue[i].latencyMax;
+        telemetry->universes[i].latencyAvg = sendQueue[i].latencyAvg;
+        memcpy(telemetry->universes[i].latencyHistogram, sendQueue[i].latencyHistogram, sizeof(telemetry->universes[i].latencyHistogram));
+        telemetry->universes[i].framesReceived = universeRxStats[i].framesReceived;
+        telemetry->universes[i].framesCrcError = universeRxStats[i].framesCrcError;
+    }
+}
+
+void Wireless::startDiscovery() {
+    // Only the broadcast role shares one channel with all other nodes.
+    // The mesh has its own addressing
+    if (!moduleAvailable || (boardConfig.activeConfig->radioRole != RadioRole::broadcast)) {
+        return;
+    }
+
+    discovery.start();
+}
+
+void Wireless::getDiscoveryResult(JsonWriter* json) {
+    char serialString[EDP_SERIAL_STRING_SIZE];
+
+    json->beginObject();
+    json->value("running", discovery.isRunning());
+    json->value("duration", discovery.stats.duration);
+    json->value("rounds", discovery.stats.rounds);
+    json->value("responses", discovery.stats.responses);
+    json->value("mutesSent", discovery.stats.mutesSent);
+
+    // Only the serials, a full table with timestamps wouldn't fit into one
+    // SSI insert
+    json->beginArray("nodes");
+    for (uint8_t i = 0; i < discovery.nodeCount; i++) {
+        EdpDiscovery::serialToString(discovery.nodes[i].serial, serialString);
+        json->value(serialString);
+    }
+    json->endArray();
+    json->endObject();
 }
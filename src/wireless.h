@@ -10,17 +10,200 @@
 #include <RF24Mesh.h>
 
 #include "edp.h"
+#include "edp_discovery.h"
 #include "boardconfig.h"
+#include "dmxbuffer.h"
+#include "jsonwriter.h"
 
 #include "snappy.h"
 
 // nRF24L01+ can tune to 128 channels with 1 MHz spacing from 2400MHz to 2527MHz
 #define MAXCHANNEL 128
 
+// Largest payload of one radio packet
+#define WIRELESS_PAYLOAD_SIZE 32
+
+// DmxDataBundle header (command + length) and the length of the 2nd record
+#define WIRELESS_PACK_OVERHEAD (1 + 2 + 2)
+
+// Universes that can be sent via radio (EDP allows up to 64)
+#ifndef WIRELESS_UNIVERSES
+#define WIRELESS_UNIVERSES 8
+#endif // WIRELESS_UNIVERSES
+
+// Frames sent per burst. Keeps the time without RX short if many universes change at once
+#define WIRELESS_FRAMES_PER_BURST 4
+
+// Universes that didn't change for that long are sent again, for receivers
+// that came up late or missed the last frame
+#define WIRELESS_REFRESH_INTERVAL_MS 1000
+
+// RF24Network message type of EDP chunks in the mesh. Types above 64 are
+// acknowledged by the receiving node
+#define WIRELESS_MESH_TYPE_EDP 70
+
+// EDP chunks in the mesh use RF24Network's fragmentation, not 32 byte packets
+#define WIRELESS_MESH_CHUNK_SIZE MIN(MAX_PAYLOAD_SIZE, 600)
+
+// With more nodes than this, the master multicasts instead of sending to every node
+#define WIRELESS_MESH_UNICAST_MAX 4
+
+// Mesh writes block until the node acknowledged or all retries failed, with
+// routing over other nodes that can take a while. No new universe is started
+// once a cyclicTask has been sending for that long, the rest waits for the
+// next call
+#define WIRELESS_MESH_SEND_BUDGET_US 4000
+
+// Nodes we keep delivery statistics for
+#define WIRELESS_MESH_MAX_NODES 16
+
+// Broadcast: The hop master scans one channel per interval in the background,
+// but only after nothing came in for WIRELESS_SCAN_QUIET_US and nothing is to
+// be sent
+#define WIRELESS_SCAN_INTERVAL_MS 20
+#define WIRELESS_SCAN_QUIET_US 2000
+
+// Frequency hopping (broadcast only). If hopping is enabled, the node with
+// radioAddress 0 is the hop master: It scans in the background, picks the channels and announces them.
+// All others follow. radioChannel is always part of the sequence, that's
+// where nodes that lost the master wait for it
+#define WIRELESS_HOP_CHANNELS 4             // Including radioChannel, up to EDP_HOP_MAX_CHANNELS
+#define WIRELESS_HOP_DWELL_MS 100
+#define WIRELESS_HOP_CHANNEL_MIN 2          // 2402 MHz
+#define WIRELESS_HOP_CHANNEL_MAX 80         // 2480 MHz, stays inside the ISM band
+#define WIRELESS_HOP_MIN_SPACING 3          // In MHz (= channels), 2 Mbit/s use 2 MHz
+#define WIRELESS_HOP_REPICK_MS 10000
+
+// Channels losing more than that many percent of the packets are left out
+// for a while. Only evaluated with ACKs, so not with FEC
+#define WIRELESS_HOP_MIN_PACKETS 32
+#define WIRELESS_HOP_BLACKLIST_PERCENT 10
+#define WIRELESS_HOP_BLACKLIST_MS 60000
+
+// Nodes go back to radioChannel after that many rounds without an announcement
+#define WIRELESS_HOP_SYNC_LOSS_ROUNDS 2
+
+// Broadcast: Every node sends on the address of its source (radioAddress
+// modulo WIRELESS_SOURCES) and listens to all of them, one reading pipe and
+// one EDP receive context per source. So frames of different transmitters
+// don't mix up. The radio has 6 pipes
+#define WIRELESS_SOURCES 6
+
+// A source not heard for that long doesn't take part in merging anymore
+#define WIRELESS_MERGE_TIMEOUT_MS 2500
+
+// HTP keeps the last frame of every source, per buffer. The slots are
+// shared by all buffers, a buffer merged from 2 sources needs 2 of them
+#define WIRELESS_MERGE_SLOTS 8
+
+// How often we measure the round-trip time of the radio link
+#define WIRELESS_PING_INTERVAL_MS 1000
+
+// Latency histogram buckets: < 250us, < 500us, < 1ms, ... < 16ms, >= 16ms
+#define WIRELESS_LATENCY_BUCKETS 8
+#define WIRELESS_LATENCY_FIRST_BUCKET_US 250
+
+// ARC (auto retransmit count) is 4 bit
+#define WIRELESS_ARC_BUCKETS 16
+
+struct WirelessUniverse {
+    bool pending;         // A frame is waiting in sendQueueData
+    bool hasData;         // sendData has been called at least once
+    uint32_t queuedAt;    // time_us_32() of the oldest change not sent yet
+    uint32_t lastSent;    // board_millis()
+    uint32_t framesSent;
+    uint32_t refreshes;   // Frames sent without a change, see WIRELESS_REFRESH_INTERVAL_MS
+    uint32_t latencyLast; // From sendData to the last chunk being in the radio's FIFO, in us
+    uint32_t latencyMax;
+    uint32_t latencyAvg;  // Exponentially smoothed
+    uint32_t latencyHistogram[WIRELESS_LATENCY_BUCKETS];
+};
+
+struct WirelessSource {
+    uint32_t received;    // Packets received on that source's pipe
+    uint32_t lastSeen;    // board_millis(), 0 = never
+};
+
+struct WirelessMergeSlot {
+    bool used;
+    uint8_t bufferId;
+    uint8_t sourceId;
+    uint32_t lastSeen;    // board_millis()
+    uint8_t data[512];
+};
+
+struct WirelessMeshNode {
+    uint8_t nodeID;
+    uint32_t sent;        // Chunks sent to that node
+    uint32_t acked;       // Chunks the node acknowledged
+    uint32_t received;    // Chunks received from that node
+    uint32_t lastAck;     // board_millis()
+};
+
 struct WirelessStats {
     uint64_t sentTried;   // Packets we tried to send in total
     uint64_t sentSuccess; // Packets we got an ACK for
     uint64_t received;    // Packets we received
+    uint64_t packed;      // Packets that carried the end of one frame and the start of the next
+    uint64_t bursts;      // Times we switched to TX and back
+    uint64_t maxRt;       // Times a packet ran out of retries. It and the ones behind it in the FIFO are lost
+    uint64_t hops;        // Channel changes
+    uint64_t hopAnnouncements; // HopSequences sent (master) or received (others)
+    uint64_t hopSyncLost; // Times we went back to radioChannel since the master wasn't heard
+    uint64_t hopBlacklisted; // Channels left out because of too many lost packets
+    uint64_t scanChannels; // Channels scanned
+    uint64_t scanSweeps;  // Times all channels were scanned
+    uint32_t scanSweepMs; // Duration of the last sweep
+    uint32_t taskLoad;    // Part of core1's time spent in cyclicTask during the last second, in %
+    uint32_t taskAvgUs;   // Average time of one cyclicTask call during the last second
+    uint32_t taskMaxUs;   // Longest cyclicTask call so far
+    uint64_t mergeHtp;    // Frames merged (HTP) with the ones of other sources
+    uint64_t mergeDropped; // Frames ignored since a source with higher priority is active
+    uint64_t mergeNoSlot; // HTP frames written as they are since all merge slots were taken
+};
+
+// Radio link counters. Only written on core1 and 32 bit each, so they can
+// be read from core0 without locking
+struct WirelessLinkStats {
+    uint32_t arcHistogram[WIRELESS_ARC_BUCKETS]; // Retransmits needed by the last packet of every burst
+    uint32_t rpdHits;     // Packets received with RPD set (> -64 dBm), a rough RSSI
+};
+
+// Binary export of all counters (base64 via /config/wireless/telemetry/get.json).
+// Little endian, packed. version changes whenever the layout does
+#define WIRELESS_TELEMETRY_VERSION 1
+
+struct __attribute__((__packed__)) WirelessTelemetryUniverse {
+    uint32_t framesSent;
+    uint32_t refreshes;
+    uint32_t latencyMax;
+    uint32_t latencyAvg;
+    uint32_t latencyHistogram[WIRELESS_LATENCY_BUCKETS];
+    uint32_t framesReceived;
+    uint32_t framesCrcError;
+};
+
+struct __attribute__((__packed__)) WirelessTelemetry {
+    uint8_t version;      // WIRELESS_TELEMETRY_VERSION
+    uint8_t universeCount;
+    uint8_t latencyBuckets;
+    uint8_t arcBuckets;
+    uint32_t uptime;      // board_millis()
+    uint32_t sentTried;
+    uint32_t sentSuccess;
+    uint32_t received;
+    uint32_t maxRt;
+    uint32_t rpdHits;
+    uint32_t framesChunkGap;
+    uint32_t framesRecovered;
+    uint32_t arcHistogram[WIRELESS_ARC_BUCKETS];
+    struct WirelessTelemetryUniverse universes[WIRELESS_UNIVERSES];
+};
+
+enum WirelessScanState : uint8_t {
+    scanIdle,
+    scanTuning,           // Waiting for the radio to settle on the channel
+    scanListening,        // Waiting to sample RPD
 };
 
 class Wireless {
@@ -33,7 +216,14 @@ class Wireless {
 
     void sendData(uint8_t universeId, uint8_t* source, uint16_t sourceLength);
 
-    std::string getWirelessStats();
+    void getWirelessStats(JsonWriter* json);
+    void getTelemetry(struct WirelessTelemetry* telemetry);
+
+    // Finds all other dmxsun nodes on our channel. The result is kept in
+    // discovery.nodes
+    void startDiscovery();
+    void getDiscoveryResult(JsonWriter* json);
+    EdpDiscovery discovery;
 
     // TODO: Function to get/set the whole set or single parameters
     //       such as role, channel, txPower
@@ -41,10 +231,29 @@ class Wireless {
     // TODO: Function to get mesh status and nodes
 
   private:
+    // Spectrum scan, one channel at a time without blocking
     uint8_t lastScannedChannel = 0;
-    void scanChannel(uint8_t channel);
-    bool sendQueueValid[4];
-    uint8_t sendQueueData[4][512];
+    WirelessScanState scanState = WirelessScanState::scanIdle;
+    bool scanReturn = false;           // Tune back to hopChannel when done
+    uint32_t scanStepAt = 0;           // time_us_32()
+    uint32_t scanDwellUs = 0;
+    uint32_t scanSweepStartedAt = 0;   // board_millis()
+    uint32_t lastScan = 0;             // board_millis(), background scan
+    uint32_t lastReceivedAt = 0;       // time_us_32()
+    void startScan(bool returnAfterwards);
+    bool scanCyclicTask();
+    void backgroundScan();
+
+    // core1 utilisation, see WirelessStats
+    uint32_t taskWindowStart = 0;      // time_us_32()
+    uint32_t taskBusyUs = 0;
+    uint32_t taskCalls = 0;
+    // Only the latest frame per universe is kept. The one waiting longest
+    // goes first, so a universe that changes all the time can't starve the others
+    struct WirelessUniverse sendQueue[WIRELESS_UNIVERSES];
+    uint8_t sendQueueData[WIRELESS_UNIVERSES][512];
+    int nextUniverseToSend();
+    void sendUniverse(uint8_t universeId, bool* anyFailed);
 
     Edp edpTX;
     Edp edpRX;
@@ -54,11 +263,82 @@ class Wireless {
     static uint8_t tmpBufQueueCopy[600];
     static uint8_t tmpBuf_TX1[600];
 
+    // Broadcast: DMX data is assembled per source, see WIRELESS_SOURCES.
+    // Control messages still go to edpRX
+    Edp edpSources[WIRELESS_SOURCES];
+    static uint8_t tmpBuf_Sources[WIRELESS_SOURCES][600];
+    struct WirelessSource sources[WIRELESS_SOURCES];
+    uint8_t ownSource = 0;
+    static void sourceAddress(uint8_t sourceId, uint8_t* address);
+
+    // Several sources patched to the same buffer, see RadioMergeMode
+    struct WirelessMergeSlot mergeSlots[WIRELESS_MERGE_SLOTS];
+    uint8_t mergeOwner[DMXBUFFER_COUNT];       // mergePriority: Source that writes the buffer
+    uint32_t mergeOwnerSeen[DMXBUFFER_COUNT];  // board_millis(), 0 = nobody
+    static uint8_t mergeBuf[512];
+    static void mergeFrame(void* context, uint8_t sourceId, uint8_t bufferId, const uint8_t* data, uint16_t length);
+    void merge(uint8_t sourceId, uint8_t bufferId, const uint8_t* data, uint16_t length);
+
     void handleReceivedData();
+    void handleDmxDataRequests();
+    bool isTransmitter();
+    void handleDiscoveryResponses();
+    void sendControlData();
+    bool controlDataPending();
     void doSendData();
+    bool writeChunk(const uint8_t* data, uint8_t size);
+    bool endBurst();
+
+    // Packets are put into the radio's 3-deep TX FIFO without waiting for
+    // their ACKs. The radio stays in TX mode until endBurst
+    bool txActive = false;
+    uint16_t txInFlight = 0;           // Written since the FIFO was known to be empty
+
+    // With dynamic payloads, the short last chunk of a frame is held back
+    // and sent together with the first chunk of the next one
+    bool dynamicPayloads = false;
+    static uint8_t packBuf[WIRELESS_PAYLOAD_SIZE];
+    uint8_t tailSize = 0;              // Size of the chunk waiting at packBuf + 3
+    void holdOrWriteChunk(uint16_t size, bool* anyFailed);
+    void flushTail(bool* anyFailed);
+
+    uint32_t lastPing = 0;
+
+    // Frequency hopping, see WIRELESS_HOP_*
+    bool hopMaster = false;
+    bool hopSynced = false;            // Others: Following the master's schedule
+    struct Edp_HopSequence hopSequence;
+    uint8_t hopChannel = 0;            // Channel we are on now
+    uint32_t nextHopAt = 0;            // time_us_32()
+    uint32_t lastHopAnnouncement = 0;  // time_us_32(), others only
+    bool hopAnnounceDue = false;
+    uint32_t lastHopPick = 0;          // board_millis()
+    uint64_t hopTriedAtStart = 0;      // stats.sentTried when we came to this channel
+    uint64_t hopMaxRtAtStart = 0;
+    uint16_t hopTried[MAXCHANNEL];     // Packets sent per channel since the last evaluation
+    uint16_t hopLost[MAXCHANNEL];
+    uint32_t hopBlacklistedUntil[MAXCHANNEL]; // board_millis(), 0 = not blacklisted
+    void hopInit();
+    void hopCyclicTask();
+    void hopTo(uint8_t index);
+    void tuneTo(uint8_t channel);
+    void pickHopChannels();
+    void sendHopSequence();
+
+    // Mesh: The master sends to its nodes, nodes send to the master.
+    // Nodes relay multicasts to the next level
+    struct WirelessMeshNode meshNodes[WIRELESS_MESH_MAX_NODES];
+    uint8_t meshNodeCount = 0;
+    struct WirelessMeshNode* findMeshNode(uint8_t nodeID);
+    bool meshWriteChunk(const uint8_t* data, uint16_t size, uint8_t nodeID);
+    uint8_t meshDestinations(uint8_t universeId, uint8_t* nodeIDs);
+    void handleMeshReceivedData();
 
     // Stats:
     struct WirelessStats stats;
+    struct WirelessLinkStats linkStats;
+    struct EdpUniverseStats universeRxStats[WIRELESS_UNIVERSES];
+    void countArc();
 
 };
 
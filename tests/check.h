@@ -0,0 +1,28 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+// Just enough to write tests without a framework. A failed check is printed
+// and counted, the test goes on. main() returns checkResult()
+extern int checkFailures;
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+            checkFailures++; \
+        } \
+    } while (0)
+
+#define CHECK_EQUAL(expected, actual) do { \
+        long long checkExpected = (long long)(expected); \
+        long long checkActual = (long long)(actual); \
+        if (checkExpected != checkActual) { \
+            printf("%s:%d: CHECK_EQUAL failed: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, checkActual, checkExpected); \
+            checkFailures++; \
+        } \
+    } while (0)
+
+int checkResult();
+
+#endif // CHECK_H
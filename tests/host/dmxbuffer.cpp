@@ -0,0 +1,93 @@
+#include "dmxbuffer.h"
+#include "dmxfade.h"
+
+#include "host/host.h"
+
+#include <string.h>
+
+// Same semantics as src/dmxbuffer.cpp, minus the patchings behind the
+// buffers. triggerPatchings only counts, so tests can look at what the code
+// under test wrote and how often it was patched
+
+DmxBuffer dmxBuffer;
+
+uint8_t DmxBuffer::buffer[DMXBUFFER_COUNT][512];
+uint8_t DmxBuffer::allZeroes[512];
+uint32_t DmxBuffer::lastSequence;
+uint32_t DmxBuffer::sequence[DMXBUFFER_COUNT];
+
+static uint32_t patchCount[DMXBUFFER_COUNT];
+
+uint32_t hostPatchCount(uint8_t bufferId) {
+    return (bufferId < DMXBUFFER_COUNT) ? patchCount[bufferId] : 0;
+}
+
+void DmxBuffer::init() {
+    memset(buffer, 0x00, sizeof(buffer));
+    memset(allZeroes, 0x00, sizeof(allZeroes));
+    lastSequence = 0;
+    memset(sequence, 0x00, sizeof(sequence));
+    memset(patchCount, 0x00, sizeof(patchCount));
+}
+
+void DmxBuffer::zero(uint8_t bufferId) {
+    DmxFade::release(bufferId, 0, 512);
+    memset(buffer[bufferId], 0x00, 512);
+    triggerPatchings(bufferId, true);
+}
+
+bool DmxBuffer::getBuffer(uint8_t bufferId, uint8_t* dest, uint16_t destLength) {
+    if ((bufferId >= DMXBUFFER_COUNT) || (dest == nullptr) || destLength == 0) {
+        return false;
+    }
+    memcpy(dest, buffer[bufferId], destLength);
+    return true;
+}
+
+bool DmxBuffer::setBuffer(uint8_t bufferId, uint8_t* source, uint16_t sourceLength) {
+    if ((bufferId >= DMXBUFFER_COUNT) || (source == nullptr) || sourceLength == 0) {
+        return false;
+    }
+    DmxFade::release(bufferId, 0, 512);
+    memset(buffer[bufferId], 0x00, 512);
+    memcpy(buffer[bufferId], source, (sourceLength < 512) ? sourceLength : 512);
+    triggerPatchings(bufferId);
+    return true;
+}
+
+bool DmxBuffer::getChannel(uint8_t bufferId, uint16_t channel, uint8_t* value) {
+    if ((bufferId >= DMXBUFFER_COUNT) || (channel >= 512) || (value == nullptr)) {
+        return false;
+    }
+    *value = buffer[bufferId][channel];
+    return true;
+}
+
+bool DmxBuffer::setChannel(uint8_t bufferId, uint16_t channel, uint8_t value) {
+    if ((bufferId >= DMXBUFFER_COUNT) || (channel >= 512)) {
+        return false;
+    }
+    DmxFade::release(bufferId, channel, 1);
+    buffer[bufferId][channel] = value;
+    triggerPatchings(bufferId);
+    return true;
+}
+
+bool DmxBuffer::setChannels(uint8_t bufferId, uint16_t offset, const uint8_t* values, uint16_t count, bool patch) {
+    if ((bufferId >= DMXBUFFER_COUNT) || (values == nullptr) || (offset >= 512) || (count == 0)) {
+        return false;
+    }
+    DmxFade::release(bufferId, offset, count);
+    // Clamped to the end of the buffer, like the firmware does
+    memcpy(buffer[bufferId] + offset, values, (count < (512 - offset)) ? count : (512 - offset));
+    if (patch) {
+        triggerPatchings(bufferId);
+    }
+    return true;
+}
+
+void DmxBuffer::triggerPatchings(uint8_t bufferId, bool allZero) {
+    allZeroBuffers[bufferId] = allZero || !memcmp(buffer[bufferId], allZeroes, 512);
+    sequence[bufferId] = ++lastSequence;
+    patchCount[bufferId]++;
+}
@@ -0,0 +1,85 @@
+#include "host.h"
+#include "check.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+
+#include "pico/stdlib.h"
+#include "pico/unique_id.h"
+
+#include "boardconfig.h"
+
+int checkFailures = 0;
+
+int checkResult() {
+    if (checkFailures) {
+        printf("%d check(s) failed\n", checkFailures);
+        return 1;
+    }
+    return 0;
+}
+
+static uint64_t now = 0;
+static std::mt19937 generator(1);
+static uint8_t boardId[8] = { 0xe6, 0x60, 0x58, 0x38, 0x83, 0x2b, 0x4d, 0x2a };
+static int logEnabled = -1;
+
+void hostSetTime(uint64_t us) { now = us; }
+void hostAdvance(uint64_t us) { now += us; }
+void hostSeed(uint32_t seed) { generator.seed(seed); }
+uint32_t hostRand() { return generator(); }
+void hostSetBoardId(const uint8_t* id) { memcpy(boardId, id, sizeof(boardId)); }
+void hostSetLog(bool enabled) { logEnabled = enabled; }
+
+// What main.cpp and boardconfig.cpp provide on the board. The config is the
+// default one, tests change its patchings as they need
+static ConfigData hostConfig = constDefaultConfig;
+ConfigData* BoardConfig::activeConfig = &hostConfig;
+ConfigSource BoardConfig::configSource = ConfigSource::Fallback;
+uint8_t BoardConfig::shortId;
+char BoardConfig::boardSerialString[25];
+char BoardConfig::boardHostnameString[12];
+bool BoardConfig::boardIsPicoW;
+BoardConfig boardConfig;
+critical_section_t bufferLock;
+
+extern "C" {
+
+uint32_t time_us_32() { return (uint32_t)now; }
+uint64_t time_us_64() { return now; }
+uint32_t board_millis() { return (uint32_t)(now / 1000); }
+
+void sleep_us(uint64_t us) { now += us; }
+void sleep_ms(uint32_t ms) { now += (uint64_t)ms * 1000; }
+
+uint32_t get_rand_32() { return generator(); }
+unsigned int pico_lwip_rand() { return generator(); }
+
+void pico_get_unique_board_id(pico_unique_board_id_t* id) {
+    memcpy(id->id, boardId, sizeof(id->id));
+}
+
+void critical_section_init(critical_section_t*) {}
+void critical_section_enter_blocking(critical_section_t*) {}
+void critical_section_exit(critical_section_t*) {}
+
+void dlog(char* file, uint32_t line, char* text, ...) {
+    va_list args;
+
+    if (logEnabled < 0) {
+        logEnabled = (getenv("DMXSUN_TEST_LOG") != NULL);
+    }
+    if (!logEnabled) {
+        return;
+    }
+
+    printf("%s:%u: ", file, line);
+    va_start(args, text);
+    vprintf(text, args);
+    va_end(args);
+    printf("\n");
+}
+
+}
@@ -0,0 +1,65 @@
+#ifndef HOST_H
+#define HOST_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+// Control over the simulated pico-sdk functions
+
+// time_us_32(), time_us_64() and board_millis() only change through these
+void hostSetTime(uint64_t us);
+void hostAdvance(uint64_t us);
+
+// pico_lwip_rand() and get_rand_32() are reproducible for the same seed
+void hostSeed(uint32_t seed);
+uint32_t hostRand();
+
+// What pico_get_unique_board_id() returns. Edp copies it in init()
+void hostSetBoardId(const uint8_t* id);
+
+// How often DmxBuffer::triggerPatchings ran for that buffer since
+// dmxBuffer.init()
+uint32_t hostPatchCount(uint8_t bufferId);
+
+// lwIP connections. hostTcpConnect opens one to the pcb listening on that
+// port, as if a client connected, NULL if it was refused. What is fed in
+// arrives at the recv callback in one chain of pbufs of pieceSize byte each,
+// nothing fed in means the client closed. tcp_write takes from tcp_sndbuf
+// until the client acknowledges
+struct tcp_pcb;
+struct tcp_pcb* hostTcpConnect(uint16_t port);
+int8_t hostTcpFeed(struct tcp_pcb* pcb, const void* data, size_t size, size_t pieceSize = 1460);
+int8_t hostTcpPoll(struct tcp_pcb* pcb);
+void hostTcpAck(struct tcp_pcb* pcb);
+std::vector<uint8_t>& hostTcpSent(struct tcp_pcb* pcb);
+
+// What Usb_EDP and Udp_EDP report in getStats() and getTxStats()
+struct EdpStats;
+enum HostEdpStats {
+    hostEdpUsb,
+    hostEdpUdp,
+    hostEdpUdpTx,
+    hostEdpStatsCount
+};
+EdpStats& hostEdpStats(HostEdpStats which);
+
+// Print LOG() output. Off unless DMXSUN_TEST_LOG is set in the environment
+void hostSetLog(bool enabled);
+
+// The USB interfaces as the device sees them. Data fed in is handed out by
+// the tud_*_read functions in as many pieces as the code under test asks for
+enum HostUsbInterface {
+    hostUsbCdc,
+    hostUsbVendor,
+    hostUsbInterfaces
+};
+void hostUsbSetMounted(bool mounted);
+void hostUsbFeed(HostUsbInterface itf, const uint8_t* data, size_t size);
+// Everything the device wrote so far. Tests clear it when they like
+std::vector<uint8_t>& hostUsbSent(HostUsbInterface itf);
+// How much the tud_*_write functions accept per call, to test partial writes
+void hostUsbSetWriteRoom(uint32_t bytes);
+
+#endif // HOST_H
@@ -0,0 +1,20 @@
+#ifndef __RF24_H__
+#define __RF24_H__
+
+// Only the enums boardconfig.h uses for the radio parameters
+
+typedef enum {
+    RF24_PA_MIN = 0,
+    RF24_PA_LOW,
+    RF24_PA_HIGH,
+    RF24_PA_MAX,
+    RF24_PA_ERROR
+} rf24_pa_dbm_e;
+
+typedef enum {
+    RF24_1MBPS = 0,
+    RF24_2MBPS,
+    RF24_250KBPS
+} rf24_datarate_e;
+
+#endif // __RF24_H__
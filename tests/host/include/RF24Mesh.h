@@ -0,0 +1,8 @@
+#ifndef __RF24MESH_H__
+#define __RF24MESH_H__
+
+// Only included by wireless.h, there is no radio on the host
+
+#include "RF24Network.h"
+
+#endif // __RF24MESH_H__
@@ -0,0 +1,10 @@
+#ifndef __RF24NETWORK_H__
+#define __RF24NETWORK_H__
+
+// Only what wireless.h uses, there is no radio on the host
+
+#include "RF24.h"
+
+#define MAX_PAYLOAD_SIZE 144
+
+#endif // __RF24NETWORK_H__
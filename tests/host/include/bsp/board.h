@@ -0,0 +1,17 @@
+#ifndef _BSP_BOARD_H_
+#define _BSP_BOARD_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Milliseconds of the simulated clock
+uint32_t board_millis(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _BSP_BOARD_H_
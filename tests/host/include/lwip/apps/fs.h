@@ -0,0 +1,29 @@
+#ifndef LWIP_HDR_APPS_FS_H
+#define LWIP_HDR_APPS_FS_H
+
+// Host stand-in for the file struct lwIP's httpd hands to the custom file
+// functions, with the members lwipopts.h enables. Tests open, read and
+// close files the way httpd does
+
+#include "lwip/opt.h"
+#include "lwip/err.h"
+
+#define FS_READ_EOF     -1
+#define FS_READ_DELAYED -2
+
+#define FS_FILE_FLAG_HTTP_HEADER_INCLUDED     0x01
+#define FS_FILE_FLAG_HTTP_HEADER_PERSISTENT   0x02
+#define FS_FILE_FLAG_HTTP_HEADER_11           0x04
+#define FS_FILE_FLAG_SSI                      0x08
+
+struct fs_file {
+    const char* data;
+    int len;
+    int index;
+    void* pextension;
+    u8_t flags;
+    u8_t is_custom_file;
+    void* state;
+};
+
+#endif // LWIP_HDR_APPS_FS_H
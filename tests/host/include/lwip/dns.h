@@ -0,0 +1,8 @@
+#ifndef LWIP_HDR_DNS_H
+#define LWIP_HDR_DNS_H
+
+// Nothing from here is used by the tested code, only included
+
+#include "lwip/ip_addr.h"
+
+#endif // LWIP_HDR_DNS_H
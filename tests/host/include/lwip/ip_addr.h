@@ -0,0 +1,16 @@
+#ifndef LWIP_HDR_IP_ADDR_H
+#define LWIP_HDR_IP_ADDR_H
+
+#include "lwip/opt.h"
+
+// IPv4 only, like the firmware
+typedef struct ip4_addr {
+    u32_t addr;
+} ip4_addr_t;
+
+typedef ip4_addr_t ip_addr_t;
+
+#define IPADDR_TYPE_V4 0
+#define IP4_ADDR_ANY ((const ip_addr_t*)NULL)
+
+#endif // LWIP_HDR_IP_ADDR_H
@@ -0,0 +1,30 @@
+#ifndef LWIP_HDR_NETIF_H
+#define LWIP_HDR_NETIF_H
+
+// Host stand-in for lwIP's interface list. Empty unless a test links its
+// own netif structs into netif_list
+
+#include "lwip/opt.h"
+#include "lwip/ip_addr.h"
+
+struct netif {
+    struct netif* next;
+    ip4_addr_t ip_addr;
+    ip4_addr_t netmask;
+    ip4_addr_t gw;
+    const char* hostname;
+    u16_t mtu;
+    char name[2];
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern struct netif* netif_list;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LWIP_HDR_NETIF_H
@@ -0,0 +1,24 @@
+#ifndef LWIP_HDR_OPT_H
+#define LWIP_HDR_OPT_H
+
+// Host stand-in for lwIP's types and the options the tested code looks at.
+// Same values as src/lwipopts.h where it sets them
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef uint8_t u8_t;
+typedef int8_t s8_t;
+typedef uint16_t u16_t;
+typedef int16_t s16_t;
+typedef uint32_t u32_t;
+typedef int32_t s32_t;
+
+#define TCP_MSS 1460
+#define TCP_SND_BUF (2 * TCP_MSS)
+#define TCP_SND_QUEUELEN ((4 * (TCP_SND_BUF) + (TCP_MSS - 1)) / (TCP_MSS))
+
+#define LWIP_UNUSED_ARG(x) (void)x
+
+#endif // LWIP_HDR_OPT_H
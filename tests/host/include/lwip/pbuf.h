@@ -0,0 +1,45 @@
+#ifndef LWIP_HDR_PBUF_H
+#define LWIP_HDR_PBUF_H
+
+// Host stand-in for lwIP's pbufs, always allocated from the heap. Tests
+// build chains of them with hostTcpFeed (see host/host.h)
+
+#include "lwip/opt.h"
+#include "lwip/err.h"
+
+typedef enum {
+    PBUF_TRANSPORT,
+    PBUF_IP,
+    PBUF_LINK,
+    PBUF_RAW
+} pbuf_layer;
+
+typedef enum {
+    PBUF_RAM,
+    PBUF_ROM,
+    PBUF_REF,
+    PBUF_POOL
+} pbuf_type;
+
+struct pbuf {
+    struct pbuf* next;
+    void* payload;
+    u16_t tot_len;
+    u16_t len;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct pbuf* pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type);
+u8_t pbuf_free(struct pbuf* p);
+void pbuf_cat(struct pbuf* head, struct pbuf* tail);
+u16_t pbuf_copy_partial(const struct pbuf* p, void* dataptr, u16_t len, u16_t offset);
+u8_t pbuf_get_at(const struct pbuf* p, u16_t offset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LWIP_HDR_PBUF_H
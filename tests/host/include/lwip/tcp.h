@@ -0,0 +1,76 @@
+#ifndef LWIP_HDR_TCP_H
+#define LWIP_HDR_TCP_H
+
+// Host stand-in for lwIP's raw TCP API. There is no network, a pcb only
+// remembers its callbacks and what was written to it. Tests feed data into
+// the recv callback and look at what came out (see host/host.h)
+
+#include "lwip/opt.h"
+#include "lwip/err.h"
+#include "lwip/pbuf.h"
+#include "lwip/ip_addr.h"
+
+#define TCP_PRIO_MIN 1
+#define TCP_PRIO_NORMAL 64
+#define TCP_PRIO_MAX 127
+
+#define TCP_WRITE_FLAG_COPY 0x01
+#define TCP_WRITE_FLAG_MORE 0x02
+
+struct tcp_pcb;
+
+typedef err_t (*tcp_accept_fn)(void* arg, struct tcp_pcb* newpcb, err_t err);
+typedef err_t (*tcp_recv_fn)(void* arg, struct tcp_pcb* tpcb, struct pbuf* p, err_t err);
+typedef err_t (*tcp_sent_fn)(void* arg, struct tcp_pcb* tpcb, u16_t len);
+typedef err_t (*tcp_poll_fn)(void* arg, struct tcp_pcb* tpcb);
+typedef void (*tcp_err_fn)(void* arg, err_t err);
+
+struct tcp_pcb {
+    u16_t local_port;
+    void* callback_arg;
+    tcp_accept_fn accept;
+    tcp_recv_fn recv;
+    tcp_sent_fn sent;
+    tcp_poll_fn poll;
+    tcp_err_fn errf;
+    u8_t pollinterval;
+    u8_t prio;
+    bool nagle;
+    bool listening;
+    bool closed;                        // tcp_close or tcp_abort
+    bool aborted;
+    u16_t snd_buf;                      // What tcp_sndbuf returns, tcp_write takes from it
+    u16_t snd_queuelen;
+    u32_t recved;                       // Sum of tcp_recved
+};
+
+#define tcp_sndbuf(pcb) ((pcb)->snd_buf)
+#define tcp_sndqueuelen(pcb) ((pcb)->snd_queuelen)
+#define tcp_nagle_disable(pcb) ((pcb)->nagle = false)
+#define tcp_listen(pcb) tcp_listen_with_backlog(pcb, 255)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct tcp_pcb* tcp_new_ip_type(u8_t type);
+err_t tcp_bind(struct tcp_pcb* pcb, const ip_addr_t* ipaddr, u16_t port);
+struct tcp_pcb* tcp_listen_with_backlog(struct tcp_pcb* pcb, u8_t backlog);
+void tcp_accept(struct tcp_pcb* pcb, tcp_accept_fn accept);
+void tcp_arg(struct tcp_pcb* pcb, void* arg);
+void tcp_recv(struct tcp_pcb* pcb, tcp_recv_fn recv);
+void tcp_sent(struct tcp_pcb* pcb, tcp_sent_fn sent);
+void tcp_poll(struct tcp_pcb* pcb, tcp_poll_fn poll, u8_t interval);
+void tcp_err(struct tcp_pcb* pcb, tcp_err_fn err);
+void tcp_setprio(struct tcp_pcb* pcb, u8_t prio);
+void tcp_recved(struct tcp_pcb* pcb, u16_t len);
+err_t tcp_write(struct tcp_pcb* pcb, const void* dataptr, u16_t len, u8_t apiflags);
+err_t tcp_output(struct tcp_pcb* pcb);
+err_t tcp_close(struct tcp_pcb* pcb);
+void tcp_abort(struct tcp_pcb* pcb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LWIP_HDR_TCP_H
@@ -0,0 +1,15 @@
+#ifndef LWIP_HDR_UDP_H
+#define LWIP_HDR_UDP_H
+
+// Only the types headers of the firmware use, nothing is sent
+
+#include "lwip/opt.h"
+#include "lwip/err.h"
+#include "lwip/ip_addr.h"
+#include "lwip/pbuf.h"
+
+struct udp_pcb;
+
+typedef void (*udp_recv_fn)(void* arg, struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* addr, u16_t port);
+
+#endif // LWIP_HDR_UDP_H
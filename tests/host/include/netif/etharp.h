@@ -0,0 +1,8 @@
+#ifndef LWIP_HDR_NETIF_ETHARP_H
+#define LWIP_HDR_NETIF_ETHARP_H
+
+// Only included, dhcpserver.h needs struct netif
+
+#include "lwip/netif.h"
+
+#endif // LWIP_HDR_NETIF_ETHARP_H
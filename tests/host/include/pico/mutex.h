@@ -0,0 +1,10 @@
+#ifndef _PICO_MUTEX_H
+#define _PICO_MUTEX_H
+
+// Only the type, log.h declares members of it
+
+typedef struct {
+    int unused;
+} mutex_t;
+
+#endif // _PICO_MUTEX_H
@@ -0,0 +1,48 @@
+#ifndef _PICO_STDLIB_H
+#define _PICO_STDLIB_H
+
+// Host stand-in for the parts of the pico-sdk the tested code uses. Times
+// come from the simulated clock in host.cpp
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef unsigned int uint;
+
+// What the web interface shows about the build
+#define PICO_SDK_VERSION_STRING "host"
+#define PICO_BOARD "host"
+
+#ifndef MIN
+#define MIN(a, b) ((b) > (a) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+typedef struct {
+    int unused;
+} critical_section_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t time_us_32(void);
+uint64_t time_us_64(void);
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+uint32_t get_rand_32(void);
+
+void critical_section_init(critical_section_t* crit_sec);
+void critical_section_enter_blocking(critical_section_t* crit_sec);
+void critical_section_exit(critical_section_t* crit_sec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _PICO_STDLIB_H
@@ -0,0 +1,10 @@
+#ifndef _PICO_UTIL_QUEUE_H
+#define _PICO_UTIL_QUEUE_H
+
+// Only the type, log.h declares members of it
+
+typedef struct {
+    int unused;
+} queue_t;
+
+#endif // _PICO_UTIL_QUEUE_H
@@ -0,0 +1,45 @@
+#ifndef _TUSB_H_
+#define _TUSB_H_
+
+// Host stand-in for the TinyUSB device functions of the CDC and vendor
+// interfaces. What the host "sends" comes from hostUsbFeed, what the device
+// writes ends up in hostUsbSent (see host/host.h). HID reports are passed
+// to the set_report callbacks directly
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Same as src/tusb_config.h
+#define CFG_TUD_HID_BUFSIZE 64
+
+typedef enum {
+    HID_REPORT_TYPE_INVALID = 0,
+    HID_REPORT_TYPE_INPUT,
+    HID_REPORT_TYPE_OUTPUT,
+    HID_REPORT_TYPE_FEATURE
+} hid_report_type_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void tud_task(void);
+
+bool tud_cdc_connected(void);
+uint32_t tud_cdc_available(void);
+uint32_t tud_cdc_read(void* buffer, uint32_t bufsize);
+uint32_t tud_cdc_write(void const* buffer, uint32_t bufsize);
+uint32_t tud_cdc_write_flush(void);
+
+bool tud_vendor_mounted(void);
+uint32_t tud_vendor_available(void);
+uint32_t tud_vendor_read(void* buffer, uint32_t bufsize);
+uint32_t tud_vendor_write(void const* buffer, uint32_t bufsize);
+uint32_t tud_vendor_write_flush(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _TUSB_H_
@@ -0,0 +1,201 @@
+#include "host.h"
+
+#include <deque>
+#include <map>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lwip/netif.h"
+#include "lwip/pbuf.h"
+#include "lwip/tcp.h"
+
+// Never freed, tests look at closed pcbs
+static std::deque<struct tcp_pcb> pcbs;
+static std::map<const struct tcp_pcb*, std::vector<uint8_t>> sent;
+
+static struct tcp_pcb* newPcb() {
+    struct tcp_pcb* pcb = &pcbs.emplace_back();
+
+    pcb->prio = TCP_PRIO_NORMAL;
+    pcb->nagle = true;
+    pcb->snd_buf = TCP_SND_BUF;
+    return pcb;
+}
+
+struct tcp_pcb* hostTcpConnect(uint16_t port) {
+    struct tcp_pcb* pcb;
+
+    for (auto& listening : pcbs) {
+        if (listening.listening && !listening.closed && (listening.local_port == port) && listening.accept) {
+            pcb = newPcb();
+            pcb->local_port = port;
+            if ((listening.accept(listening.callback_arg, pcb, ERR_OK) != ERR_OK) || pcb->closed) {
+                return NULL;
+            }
+            return pcb;
+        }
+    }
+    return NULL;
+}
+
+int8_t hostTcpFeed(struct tcp_pcb* pcb, const void* data, size_t size, size_t pieceSize) {
+    struct pbuf* p = NULL;
+    struct pbuf* piece;
+    u16_t length;
+
+    if (pcb->closed || (pcb->recv == NULL)) {
+        return ERR_CLSD;
+    }
+
+    for (size_t offset = 0; offset < size; offset += length) {
+        length = (size - offset < pieceSize) ? (size - offset) : pieceSize;
+        piece = pbuf_alloc(PBUF_RAW, length, PBUF_RAM);
+        memcpy(piece->payload, (const uint8_t*)data + offset, length);
+        if (p == NULL) {
+            p = piece;
+        } else {
+            pbuf_cat(p, piece);
+        }
+    }
+
+    return pcb->recv(pcb->callback_arg, pcb, p, ERR_OK);
+}
+
+int8_t hostTcpPoll(struct tcp_pcb* pcb) {
+    if (pcb->closed || (pcb->poll == NULL)) {
+        return ERR_CLSD;
+    }
+    return pcb->poll(pcb->callback_arg, pcb);
+}
+
+void hostTcpAck(struct tcp_pcb* pcb) {
+    pcb->snd_buf = TCP_SND_BUF;
+    pcb->snd_queuelen = 0;
+}
+
+std::vector<uint8_t>& hostTcpSent(struct tcp_pcb* pcb) {
+    return sent[pcb];
+}
+
+extern "C" {
+
+struct netif* netif_list = NULL;
+
+struct pbuf* pbuf_alloc(pbuf_layer, u16_t length, pbuf_type) {
+    struct pbuf* p = (struct pbuf*)malloc(sizeof(struct pbuf) + length);
+
+    p->next = NULL;
+    p->payload = p + 1;
+    p->tot_len = length;
+    p->len = length;
+    return p;
+}
+
+u8_t pbuf_free(struct pbuf* p) {
+    struct pbuf* next;
+    u8_t count = 0;
+
+    while (p != NULL) {
+        next = p->next;
+        free(p);
+        p = next;
+        count++;
+    }
+    return count;
+}
+
+void pbuf_cat(struct pbuf* head, struct pbuf* tail) {
+    struct pbuf* p = head;
+
+    while (true) {
+        p->tot_len += tail->tot_len;
+        if (p->next == NULL) {
+            break;
+        }
+        p = p->next;
+    }
+    p->next = tail;
+}
+
+u16_t pbuf_copy_partial(const struct pbuf* p, void* dataptr, u16_t len, u16_t offset) {
+    u16_t copied = 0;
+    u16_t length;
+
+    for (; (p != NULL) && (copied < len); p = p->next) {
+        if (offset >= p->len) {
+            offset -= p->len;
+            continue;
+        }
+        length = ((p->len - offset) < (len - copied)) ? (p->len - offset) : (len - copied);
+        memcpy((uint8_t*)dataptr + copied, (const uint8_t*)p->payload + offset, length);
+        copied += length;
+        offset = 0;
+    }
+    return copied;
+}
+
+u8_t pbuf_get_at(const struct pbuf* p, u16_t offset) {
+    for (; p != NULL; p = p->next) {
+        if (offset < p->len) {
+            return ((const uint8_t*)p->payload)[offset];
+        }
+        offset -= p->len;
+    }
+    return 0;
+}
+
+struct tcp_pcb* tcp_new_ip_type(u8_t) {
+    return newPcb();
+}
+
+err_t tcp_bind(struct tcp_pcb* pcb, const ip_addr_t*, u16_t port) {
+    pcb->local_port = port;
+    return ERR_OK;
+}
+
+struct tcp_pcb* tcp_listen_with_backlog(struct tcp_pcb* pcb, u8_t) {
+    pcb->listening = true;
+    return pcb;
+}
+
+void tcp_accept(struct tcp_pcb* pcb, tcp_accept_fn accept) { pcb->accept = accept; }
+void tcp_arg(struct tcp_pcb* pcb, void* arg) { pcb->callback_arg = arg; }
+void tcp_recv(struct tcp_pcb* pcb, tcp_recv_fn recv) { pcb->recv = recv; }
+void tcp_sent(struct tcp_pcb* pcb, tcp_sent_fn sent) { pcb->sent = sent; }
+void tcp_err(struct tcp_pcb* pcb, tcp_err_fn err) { pcb->errf = err; }
+void tcp_setprio(struct tcp_pcb* pcb, u8_t prio) { pcb->prio = prio; }
+void tcp_recved(struct tcp_pcb* pcb, u16_t len) { pcb->recved += len; }
+
+void tcp_poll(struct tcp_pcb* pcb, tcp_poll_fn poll, u8_t interval) {
+    pcb->poll = poll;
+    pcb->pollinterval = interval;
+}
+
+err_t tcp_write(struct tcp_pcb* pcb, const void* dataptr, u16_t len, u8_t) {
+    if (pcb->closed) {
+        return ERR_CONN;
+    }
+    if ((len > pcb->snd_buf) || (pcb->snd_queuelen >= TCP_SND_QUEUELEN)) {
+        return ERR_MEM;
+    }
+    pcb->snd_buf -= len;
+    pcb->snd_queuelen++;
+    sent[pcb].insert(sent[pcb].end(), (const uint8_t*)dataptr, (const uint8_t*)dataptr + len);
+    return ERR_OK;
+}
+
+err_t tcp_output(struct tcp_pcb*) {
+    return ERR_OK;
+}
+
+err_t tcp_close(struct tcp_pcb* pcb) {
+    pcb->closed = true;
+    return ERR_OK;
+}
+
+void tcp_abort(struct tcp_pcb* pcb) {
+    pcb->closed = true;
+    pcb->aborted = true;
+}
+
+}
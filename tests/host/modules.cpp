@@ -0,0 +1,78 @@
+#include "host.h"
+
+#include <string.h>
+
+#include "pico/stdlib.h"
+
+#include "statusleds.h"
+#include "wireless.h"
+#include "usb_EDP.h"
+#include "udp_edp.h"
+
+// The modules the web status reads, as far as it reads them. Their state is
+// whatever the tests put there
+
+StatusLeds statusLeds;
+Wireless wireless;
+
+static EdpStats edpStats[hostEdpStatsCount];
+
+EdpStats& hostEdpStats(HostEdpStats which) {
+    return edpStats[which];
+}
+
+// Same bits as src/statusleds.cpp, nothing is ever written to the LEDs
+void StatusLeds::setStatic(uint8_t ledNum, bool red, bool green, bool blue) {
+    pixels[ledNum] = (green ? 255 : 0) << 16 | (red ? 255 : 0) << 8 | (blue ? 255 : 0);
+}
+
+void StatusLeds::setBlinkOnce(uint8_t ledNum, bool red, bool green, bool blue) {
+    // Never turned off again, there is no cyclicTask
+    toBlinkOn[ledNum][0] = red ? board_millis() : 0;
+    toBlinkOn[ledNum][1] = green ? board_millis() : 0;
+    toBlinkOn[ledNum][2] = blue ? board_millis() : 0;
+}
+
+void StatusLeds::getLed(uint8_t ledNum,
+  bool* red_static, bool* green_static, bool* blue_static,
+  bool* red_blink, bool* green_blink, bool* blue_blink) {
+    if (red_static && (pixels[ledNum] & 0x0000ff00)) {
+        *red_static = true;
+    }
+    if (green_static && (pixels[ledNum] & 0x00ff0000)) {
+        *green_static = true;
+    }
+    if (blue_static && (pixels[ledNum] & 0x000000ff)) {
+        *blue_static = true;
+    }
+    if (red_blink && ((toBlinkOn[ledNum][0]) || (toBlinkOff[ledNum][0]))) {
+        *red_blink = true;
+    }
+    if (green_blink && ((toBlinkOn[ledNum][1]) || (toBlinkOff[ledNum][1]))) {
+        *green_blink = true;
+    }
+    if (blue_blink && ((toBlinkOn[ledNum][2]) || (toBlinkOff[ledNum][2]))) {
+        *blue_blink = true;
+    }
+}
+
+// All zero but the header, like an idle radio
+void Wireless::getTelemetry(struct WirelessTelemetry* telemetry) {
+    memset(telemetry, 0x00, sizeof(struct WirelessTelemetry));
+
+    telemetry->version = WIRELESS_TELEMETRY_VERSION;
+    telemetry->universeCount = WIRELESS_UNIVERSES;
+    telemetry->latencyBuckets = WIRELESS_LATENCY_BUCKETS;
+}
+
+const EdpStats& Usb_EDP::getStats() {
+    return edpStats[hostEdpUsb];
+}
+
+const EdpStats& Udp_EDP::getStats() {
+    return edpStats[hostEdpUdp];
+}
+
+const EdpStats& Udp_EDP::getTxStats() {
+    return edpStats[hostEdpUdpTx];
+}
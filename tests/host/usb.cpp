@@ -0,0 +1,62 @@
+#include "host.h"
+
+#include <deque>
+
+#include "tusb.h"
+
+#include "boardconfig.h"
+
+static bool mounted = true;
+static uint32_t writeRoom = 0xffffffff;
+static std::deque<uint8_t> received[hostUsbInterfaces];
+static std::vector<uint8_t> sent[hostUsbInterfaces];
+
+void hostUsbSetMounted(bool isMounted) { mounted = isMounted; }
+void hostUsbSetWriteRoom(uint32_t bytes) { writeRoom = bytes; }
+
+void hostUsbFeed(HostUsbInterface itf, const uint8_t* data, size_t size) {
+    received[itf].insert(received[itf].end(), data, data + size);
+}
+
+std::vector<uint8_t>& hostUsbSent(HostUsbInterface itf) {
+    return sent[itf];
+}
+
+static uint32_t read(HostUsbInterface itf, void* buffer, uint32_t bufsize) {
+    uint32_t count = 0;
+
+    while ((count < bufsize) && !received[itf].empty()) {
+        ((uint8_t*)buffer)[count++] = received[itf].front();
+        received[itf].pop_front();
+    }
+    return count;
+}
+
+static uint32_t write(HostUsbInterface itf, const void* buffer, uint32_t bufsize) {
+    uint32_t count = (bufsize < writeRoom) ? bufsize : writeRoom;
+
+    sent[itf].insert(sent[itf].end(), (const uint8_t*)buffer, (const uint8_t*)buffer + count);
+    return count;
+}
+
+extern "C" {
+
+void tud_task() {}
+
+bool tud_cdc_connected() { return mounted; }
+uint32_t tud_cdc_available() { return received[hostUsbCdc].size(); }
+uint32_t tud_cdc_read(void* buffer, uint32_t bufsize) { return read(hostUsbCdc, buffer, bufsize); }
+uint32_t tud_cdc_write(void const* buffer, uint32_t bufsize) { return write(hostUsbCdc, buffer, bufsize); }
+uint32_t tud_cdc_write_flush() { return 0; }
+
+bool tud_vendor_mounted() { return mounted; }
+uint32_t tud_vendor_available() { return received[hostUsbVendor].size(); }
+uint32_t tud_vendor_read(void* buffer, uint32_t bufsize) { return read(hostUsbVendor, buffer, bufsize); }
+uint32_t tud_vendor_write(void const* buffer, uint32_t bufsize) { return write(hostUsbVendor, buffer, bufsize); }
+uint32_t tud_vendor_write_flush() { return 0; }
+
+uint8_t getUsbProtocol() {
+    return BoardConfig::activeConfig->usbProtocol;
+}
+
+}
@@ -0,0 +1,183 @@
+// N virtual nodes on one radio channel, discovered by one controller. Prints
+// how long it takes until all of them are found, with and without packet
+// loss. Fails if a discovery ends without having found every node.
+//
+// The channel is simple: every message is on air for AIRTIME_US, two
+// messages overlapping in time are both lost, and every receiver loses a
+// message on its own with the given probability
+
+#include "check.h"
+#include "host/host.h"
+
+#include "edp.h"
+#include "edp_discovery.h"
+#include "dmxbuffer.h"
+
+#include <vector>
+
+extern DmxBuffer dmxBuffer;
+
+#define STEP_US 50
+#define AIRTIME_US 450                 // 32 byte payload at 1 MBit/s incl. preamble and settling
+#define TIMEOUT_US 60000000            // Discovery always ends way earlier, see EDP_DISCOVERY_MAX_ROUNDS
+
+struct Node {
+    Edp edp;
+    uint8_t inData[600];
+    uint8_t outData[600];
+};
+
+struct Transmission {
+    int sender;                        // -1 = controller
+    uint64_t start;
+    uint8_t data[EDP_CONTROL_DATA_SIZE];
+    uint16_t size;
+    bool collided;
+};
+
+struct Result {
+    int found;
+    uint32_t rounds;
+    uint32_t responses;
+    uint32_t collisions;
+    uint32_t durationMs;
+};
+
+static bool lost(double lossRate) {
+    return (hostRand() / 4294967296.0) < lossRate;
+}
+
+static Result simulate(int nodeCount, double lossRate, uint32_t seed) {
+    static uint8_t controllerIn[600], controllerOut[600];
+    std::vector<Node> nodes(nodeCount);
+    std::vector<Transmission> onAir;
+    std::vector<uint64_t> busyUntil(nodeCount + 1, 0);  // A radio sends one message at a time
+    Edp controller;
+    EdpDiscovery discovery;
+    Transmission transmission;
+    Result result = {};
+    uint8_t id[8];
+    uint8_t serial[8];
+    uint64_t now;
+
+    hostSeed(seed);
+    hostSetTime(1000000);
+
+    memset(id, 0x00, sizeof(id));
+    hostSetBoardId(id);
+    controller.init(controllerIn, controllerOut, 32, PatchType::nrf24);
+    discovery.init(&controller);
+
+    for (int i = 0; i < nodeCount; i++) {
+        for (int j = 0; j < 8; j++) {
+            id[j] = hostRand();
+        }
+        hostSetBoardId(id);
+        nodes[i].edp.init(nodes[i].inData, nodes[i].outData, 32, PatchType::nrf24);
+    }
+
+    discovery.start();
+    for (now = 0; now < TIMEOUT_US; now += STEP_US) {
+        hostAdvance(STEP_US);
+
+        // Everything that wants to send starts now
+        discovery.cyclicTask();
+        for (int sender = -1; sender < nodeCount; sender++) {
+            Edp& edp = (sender < 0) ? controller : nodes[sender].edp;
+            if ((busyUntil[sender + 1] > time_us_64()) || !edp.takeControlData(&transmission.size)) {
+                continue;
+            }
+            transmission.sender = sender;
+            transmission.start = time_us_64();
+            memcpy(transmission.data, edp.controlData, transmission.size);
+            transmission.collided = false;
+            busyUntil[sender + 1] = transmission.start + AIRTIME_US;
+            for (Transmission& other : onAir) {
+                if (other.start + AIRTIME_US > transmission.start) {
+                    other.collided = true;
+                    transmission.collided = true;
+                }
+            }
+            onAir.push_back(transmission);
+        }
+
+        // Hand in what is completely received
+        for (size_t i = 0; i < onAir.size(); ) {
+            Transmission& done = onAir[i];
+            if (done.start + AIRTIME_US > time_us_64()) {
+                i++;
+                continue;
+            }
+            if (done.collided) {
+                result.collisions++;
+            } else if (done.sender < 0) {
+                for (Node& node : nodes) {
+                    if (!lost(lossRate)) {
+                        node.edp.processIncomingChunk(done.data, done.size);
+                    }
+                }
+            } else if (!lost(lossRate)) {
+                controller.processIncomingChunk(done.data, done.size);
+                while (controller.takeDiscoveryResponse(serial)) {
+                    discovery.handleResponse(serial);
+                }
+            }
+            onAir.erase(onAir.begin() + i);
+        }
+
+        if (!discovery.isRunning()) {
+            break;
+        }
+    }
+
+    for (Node& node : nodes) {
+        if (discovery.findNode(node.edp.serial) >= 0) {
+            result.found++;
+        }
+    }
+    result.rounds = discovery.stats.rounds;
+    result.responses = discovery.stats.responses;
+    result.durationMs = discovery.stats.duration;
+
+    return result;
+}
+
+#define RUNS 20                        // Per node count and loss rate, each with another seed
+
+int main() {
+    static const int nodeCounts[] = { 1, 4, 16, 32, 64 };
+    static const double lossRates[] = { 0.0, 0.05, 0.2 };
+    Result result;
+    int foundMin;
+    uint32_t rounds, collisions, durationSum, durationMax;
+
+    dmxBuffer.init();
+
+    printf("Averages over %d runs\n", RUNS);
+    printf("nodes  loss  found (min)  rounds  collisions  time avg (ms)  time max (ms)\n");
+    for (double lossRate : lossRates) {
+        for (int nodeCount : nodeCounts) {
+            foundMin = nodeCount;
+            rounds = collisions = durationSum = durationMax = 0;
+            for (int run = 0; run < RUNS; run++) {
+                result = simulate(nodeCount, lossRate, 2040 + run * 100 + nodeCount);
+                foundMin = MIN(foundMin, result.found);
+                rounds += result.rounds;
+                collisions += result.collisions;
+                durationSum += result.durationMs;
+                durationMax = MAX(durationMax, result.durationMs);
+
+                // With a lot of loss, a discovery may end before the last
+                // node made it through. That's what repeating it is for
+                if (lossRate < 0.1) {
+                    CHECK_EQUAL(nodeCount, result.found);
+                }
+            }
+            printf("%5d  %3.0f%%  %11d  %6u  %10u  %13u  %13u\n",
+                nodeCount, lossRate * 100, foundMin, rounds / RUNS,
+                collisions / RUNS, durationSum / RUNS, durationMax);
+        }
+    }
+
+    return checkResult();
+}
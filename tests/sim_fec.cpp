@@ -0,0 +1,124 @@
+// One sender streams DmxData frames over a lossy link to one receiver, with
+// and without FEC (DmxDataParity). Prints how many frames arrive complete
+// depending on how many chunks get lost. Fails if a frame arrives with the
+// wrong content or FEC delivers fewer frames than no FEC.
+//
+// Every chunk is lost on its own with the given probability. A lost frame
+// isn't sent again, the next one replaces it anyway (that's what streaming
+// at 25-44 frames per second does)
+
+#include "check.h"
+#include "host/host.h"
+
+#include "edp.h"
+#include "dmxbuffer.h"
+
+extern DmxBuffer dmxBuffer;
+
+#define FRAMES 2000                    // Per loss rate and setting
+#define CHUNK_SIZE 32                  // RF24 payload
+
+struct Result {
+    uint32_t delivered;
+    uint32_t recovered;
+    uint32_t wrong;                    // Delivered with content that wasn't sent
+    uint32_t chunks;
+};
+
+static bool lost(double lossRate) {
+    return (hostRand() / 4294967296.0) < lossRate;
+}
+
+// usedChannels random values at the start of the universe, the rest is zero
+static Result simulate(bool fec, uint16_t usedChannels, double lossRate, uint32_t seed) {
+    static uint8_t senderIn[600], senderOut[600];
+    static uint8_t receiverIn[600], receiverOut[600];
+    uint8_t received[512];
+    Edp sender;
+    Edp receiver;
+    Result result = {};
+    uint16_t chunkSize;
+    bool callAgain;
+    uint32_t framesBefore;
+
+    hostSeed(seed);
+    dmxBuffer.init();
+
+    sender.init(senderIn, senderOut, CHUNK_SIZE, PatchType::nrf24);
+    sender.setFec(fec);
+    receiver.init(receiverIn, receiverOut, CHUNK_SIZE, PatchType::nrf24);
+
+    for (uint32_t frame = 0; frame < FRAMES; frame++) {
+        memset(senderIn, 0x00, 512);
+        for (uint16_t i = 0; i < usedChannels; i++) {
+            // Never all zero, that would be a DmxDataAllZero
+            senderIn[i] = hostRand() | 1;
+        }
+
+        framesBefore = receiver.stats.framesReceived;
+        sender.prepareDmxData(0, 512, &chunkSize, &callAgain);
+        while (true) {
+            result.chunks++;
+            if (!lost(lossRate)) {
+                receiver.processIncomingChunk(senderOut, chunkSize);
+            }
+            if (!callAgain) {
+                break;
+            }
+            sender.prepareDmxData(0, 0, &chunkSize, &callAgain);
+        }
+
+        if (receiver.stats.framesReceived != framesBefore) {
+            result.delivered++;
+            dmxBuffer.getBuffer(0, received, sizeof(received));
+            if (memcmp(received, senderIn, 512)) {
+                result.wrong++;
+            }
+        }
+    }
+    result.recovered = receiver.stats.framesRecovered;
+
+    return result;
+}
+
+int main() {
+    static const uint16_t channelCounts[] = { 64, 512 };
+    static const double lossRates[] = { 0.0, 0.01, 0.02, 0.05, 0.1, 0.2 };
+    Patching& patching = BoardConfig::activeConfig->patching[0];
+    Result plain;
+    Result fec;
+
+    // Universe 0 from the radio ends up in buffer 0
+    memset(BoardConfig::activeConfig->patching, 0x00, sizeof(BoardConfig::activeConfig->patching));
+    patching.active = true;
+    patching.srcType = PatchType::nrf24;
+    patching.srcInstance = 0;
+    patching.dstType = PatchType::buffer;
+    patching.dstInstance = 0;
+
+    printf("%d frames each, %d byte chunks\n", FRAMES, CHUNK_SIZE);
+    printf("channels  loss  delivered  delivered FEC  recovered  chunks/frame  chunks/frame FEC\n");
+    for (uint16_t channels : channelCounts) {
+        for (double lossRate : lossRates) {
+            plain = simulate(false, channels, lossRate, 2040 + channels);
+            fec = simulate(true, channels, lossRate, 2040 + channels);
+
+            printf("%8u  %3.0f%%  %8.1f%%  %12.1f%%  %9u  %12.1f  %16.1f\n",
+                channels, lossRate * 100,
+                100.0 * plain.delivered / FRAMES, 100.0 * fec.delivered / FRAMES,
+                fec.recovered,
+                (double)plain.chunks / FRAMES, (double)fec.chunks / FRAMES);
+
+            CHECK_EQUAL(0, plain.wrong);
+            CHECK_EQUAL(0, fec.wrong);
+            CHECK(fec.delivered >= plain.delivered);
+            if (lossRate == 0.0) {
+                CHECK_EQUAL(FRAMES, plain.delivered);
+                CHECK_EQUAL(FRAMES, fec.delivered);
+                CHECK_EQUAL(0, fec.recovered);
+            }
+        }
+    }
+
+    return checkResult();
+}
@@ -0,0 +1,107 @@
+// CgiParams with parameter lists as lwIP hands them to the CGI handlers
+
+#include "check.h"
+
+#include "cgiparams.h"
+
+#include <string.h>
+
+// Keys are hashed by the compiler, the names from lwIP at runtime
+static_assert(cgiHash("") == 2166136261u);
+static_assert(cgiHash("buffer") != cgiHash("buffers"));
+
+static void testLookup() {
+    char* names[] = { (char*)"buffer", (char*)"channel", (char*)"value", (char*)"empty", (char*)"buffer" };
+    char* values[] = { (char*)"3", (char*)"-12", (char*)"full", (char*)"", (char*)"7" };
+    CgiParams params(5, names, values);
+
+    CHECK(params.has("buffer"));
+    CHECK(params.has("empty"));
+    CHECK(!params.has("buffers"));
+    CHECK(!params.has("buf"));
+    CHECK(!params.has("Buffer"));
+
+    // The first one counts
+    CHECK_EQUAL(3, params.getInt("buffer"));
+    CHECK(params.get("buffer") == values[0]);
+
+    CHECK_EQUAL(-12, params.getInt("channel"));
+    CHECK_EQUAL(42, params.getInt("missing", 42));
+    CHECK_EQUAL(42, params.getInt("empty", 42));
+    CHECK_EQUAL(0, params.getInt("value"));
+    CHECK(params.get("missing") == nullptr);
+
+    CHECK(params.equals("value", "full"));
+    CHECK(!params.equals("value", "ful"));
+    CHECK(!params.equals("value", "fully"));
+    CHECK(!params.equals("missing", ""));
+    CHECK(params.equals("empty", ""));
+}
+
+static void testBrokenLists() {
+    char* names[CGIPARAMS_MAX + 1];
+    char* values[CGIPARAMS_MAX + 1];
+    char text[CGIPARAMS_MAX + 1][8];
+
+    for (int i = 0; i <= CGIPARAMS_MAX; i++) {
+        snprintf(text[i], sizeof(text[i]), "p%d", i);
+        names[i] = text[i];
+        values[i] = text[i];
+    }
+
+    // Only as many as lwIP can pass
+    CgiParams many(CGIPARAMS_MAX + 1, names, values);
+    CHECK(many.has("p0"));
+    CHECK(many.has("p15"));
+    CHECK(!many.has("p16"));
+
+    CgiParams none(0, nullptr, nullptr);
+    CHECK(!none.has("p0"));
+
+    CgiParams negative(-1, names, values);
+    CHECK(!negative.has("p0"));
+
+    // A name without a value (lwIP does that for "?flag") is never found
+    values[1] = nullptr;
+    names[2] = nullptr;
+    CgiParams holes(4, names, values);
+    CHECK(holes.has("p0"));
+    CHECK(!holes.has("p1"));
+    CHECK(holes.get("p1") == nullptr);
+    CHECK(holes.has("p3"));
+}
+
+static void testUrlDecode() {
+    static const struct {
+        const char* in;
+        const char* out;
+    } cases[] = {
+        { "", "" },
+        { "plain", "plain" },
+        { "a%20b", "a b" },
+        { "%41%62%7e", "Ab~" },
+        { "%c3%bc%C3%BC", "\xc3\xbc\xc3\xbc" },
+        { "100%", "100%" },
+        { "%4", "%4" },
+        { "%zz%4g", "%zz%4g" },
+        { "%%41", "%A" },
+        { "a+b", "a+b" },
+    };
+    char text[32];
+    size_t length;
+
+    for (const auto& c : cases) {
+        strcpy(text, c.in);
+        length = CgiParams::urlDecode(text);
+        CHECK_EQUAL(strlen(c.out), length);
+        CHECK_EQUAL(0, strcmp(c.out, text));
+    }
+}
+
+int main() {
+    testLookup();
+    testBrokenLists();
+    testUrlDecode();
+
+    return checkResult();
+}
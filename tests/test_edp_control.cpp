@@ -0,0 +1,359 @@
+// The control message queue of Edp: discovery responses wait for their slot
+// while pongs and keyframe requests go out, nothing replaces anything else.
+// Also the DmxDataDelta messages a controller sends between keyframes
+
+#include "check.h"
+#include "host/host.h"
+
+#include "edp.h"
+#include "dmxbuffer.h"
+
+#include <vector>
+
+extern DmxBuffer dmxBuffer;
+
+static uint8_t controllerIn[600], controllerOut[600];
+static uint8_t nodeIn[600], nodeOut[600];
+
+static const uint8_t lowest[8]  = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+static const uint8_t highest[8] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+// Send whatever from has queued to to
+static bool deliver(Edp& from, Edp& to) {
+    uint16_t size;
+
+    if (!from.takeControlData(&size)) {
+        return false;
+    }
+    to.processIncomingChunk(from.controlData, size);
+    return true;
+}
+
+// The command that goes out next, 0xff if none is due
+static uint8_t nextCommand(Edp& edp) {
+    uint16_t size;
+
+    if (!edp.takeControlData(&size)) {
+        return 0xff;
+    }
+    return edp.controlData[0];
+}
+
+static void setup(Edp& controller, Edp& node) {
+    static const uint8_t controllerId[8] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08 };
+    static const uint8_t nodeId[8] = { 0x80, 0x70, 0x60, 0x50, 0x40, 0x30, 0x20, 0x10 };
+
+    hostSetTime(1000000);
+    hostSetBoardId(controllerId);
+    controller.init(controllerIn, controllerOut, 32, PatchType::nrf24);
+    hostSetBoardId(nodeId);
+    node.init(nodeIn, nodeOut, 32, PatchType::nrf24);
+}
+
+// Make the node queue a discovery response that is due in the future
+static void queueDelayedResponse(Edp& controller, Edp& node) {
+    uint16_t size;
+
+    // With 128 slots the node answers in slot 0 only once in a while. Try
+    // until it picked a later one
+    for (int i = 0; i < 16; i++) {
+        controller.prepareDiscoveryRequest(lowest, highest, 128, 10, i);
+        CHECK(deliver(controller, node));
+        if (node.controlDataPending() && !node.takeControlData(&size)) {
+            return;
+        }
+    }
+    CHECK(false);
+}
+
+static void testPongDoesNotReplaceResponse() {
+    Edp controller, node;
+
+    setup(controller, node);
+    queueDelayedResponse(controller, node);
+
+    controller.preparePing();
+    CHECK(deliver(controller, node));
+    CHECK_EQUAL(Edp_Commands::Pong, nextCommand(node));
+    CHECK(node.controlDataPending());
+
+    node.prepareDmxDataRequest(3);
+    CHECK_EQUAL(Edp_Commands::DmxDataRequest, nextCommand(node));
+    CHECK_EQUAL(3, node.controlData[1]);
+
+    // Still waiting for its slot
+    CHECK_EQUAL(0xff, nextCommand(node));
+    hostAdvance(128 * 10 * 100);
+    CHECK_EQUAL(Edp_Commands::DiscoveryRespone, nextCommand(node));
+    CHECK(!node.controlDataPending());
+}
+
+static void testMuteDropsResponse() {
+    Edp controller, node;
+
+    setup(controller, node);
+    queueDelayedResponse(controller, node);
+
+    controller.preparePing();
+    CHECK(deliver(controller, node));
+    controller.prepareDiscoveryMute(node.serial);
+    CHECK(deliver(controller, node));
+
+    CHECK_EQUAL(Edp_Commands::Pong, nextCommand(node));
+    hostAdvance(128 * 10 * 100);
+    CHECK_EQUAL(0xff, nextCommand(node));
+    CHECK(!node.controlDataPending());
+}
+
+static void testSameKindReplaces() {
+    Edp controller, node;
+    Edp other;
+    uint8_t otherIn[600], otherOut[600];
+    static const uint8_t otherId[8] = { 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18 };
+    struct Edp_PingPong pong;
+    uint16_t size;
+
+    setup(controller, node);
+    hostSetBoardId(otherId);
+    other.init(otherIn, otherOut, 32, PatchType::nrf24);
+
+    // Two pings of the same requester, only the last one is answered
+    controller.preparePing();
+    CHECK(deliver(controller, node));
+    controller.preparePing();
+    CHECK(deliver(controller, node));
+    // A ping of somebody else gets a pong of its own
+    other.preparePing();
+    CHECK(deliver(other, node));
+
+    CHECK(node.takeControlData(&size));
+    CHECK_EQUAL(Edp_Commands::Pong, node.controlData[0]);
+    memcpy(&pong, node.controlData + 1, sizeof(pong));
+    CHECK_EQUAL(1, pong.sequence);
+    CHECK(!memcmp(pong.serial, controller.serial, 8));
+    CHECK(node.takeControlData(&size));
+    memcpy(&pong, node.controlData + 1, sizeof(pong));
+    CHECK(!memcmp(pong.serial, other.serial, 8));
+    CHECK(!node.controlDataPending());
+
+    // Keyframe requests per universe
+    CHECK(node.prepareDmxDataRequest(5));
+    CHECK(node.prepareDmxDataRequest(5));
+    CHECK(node.prepareDmxDataRequest(6));
+    CHECK(node.takeControlData(&size));
+    CHECK_EQUAL(5, node.controlData[1]);
+    CHECK(node.takeControlData(&size));
+    CHECK_EQUAL(6, node.controlData[1]);
+    CHECK(!node.controlDataPending());
+}
+
+static void testQueueFull() {
+    Edp controller, node;
+    uint16_t size;
+
+    setup(controller, node);
+    for (uint8_t i = 0; i < EDP_CONTROL_QUEUE; i++) {
+        CHECK(node.prepareDmxDataRequest(i));
+    }
+    CHECK(!node.prepareDmxDataRequest(EDP_CONTROL_QUEUE));
+    for (uint8_t i = 0; i < EDP_CONTROL_QUEUE; i++) {
+        CHECK(node.takeControlData(&size));
+        CHECK_EQUAL(i, node.controlData[1]);
+    }
+    CHECK(!node.takeControlData(&size));
+}
+
+// A DmxDataDelta range as it is in the message
+struct DeltaRange {
+    uint16_t start;
+    uint8_t length;
+};
+
+// The ranges in a message of that size, checks the header and that the data
+// of each range is what current has there
+static std::vector<DeltaRange> deltaRanges(const uint8_t* out, uint16_t size, uint8_t universeId, const uint8_t* current) {
+    std::vector<DeltaRange> ranges;
+    uint16_t i = 2;
+
+    CHECK_EQUAL(Edp_Commands::DmxDataDelta, out[0]);
+    CHECK_EQUAL(universeId, out[1]);
+    while (i + 3 <= size) {
+        DeltaRange range = { (uint16_t)(out[i] | (out[i + 1] << 8)), out[i + 2] };
+
+        CHECK(range.length > 0);
+        CHECK(i + 3 + range.length <= size);
+        CHECK(!memcmp(out + i + 3, current + range.start, range.length));
+        ranges.push_back(range);
+        i += 3 + range.length;
+    }
+    CHECK_EQUAL(size, i);
+    return ranges;
+}
+
+static void testDeltaNothingToSend() {
+    Edp controller, node;
+    uint8_t current[512], shadow[512], out[600];
+    bool callAgain = true;
+
+    setup(controller, node);
+    memset(current, 0x42, sizeof(current));
+    memset(shadow, 0x42, sizeof(shadow));
+
+    CHECK_EQUAL(0, controller.prepareDmxDataDelta(1, current, shadow, out, sizeof(out), &callAgain));
+    CHECK(!callAgain);
+
+    // A universe that doesn't exist or no room for a single channel
+    current[0] = 0x43;
+    CHECK_EQUAL(0, controller.prepareDmxDataDelta(64, current, shadow, out, sizeof(out), &callAgain));
+    CHECK_EQUAL(0, controller.prepareDmxDataDelta(1, current, shadow, out, 5, &callAgain));
+    CHECK_EQUAL(0x42, shadow[0]);
+    CHECK_EQUAL(0, controller.stats.deltasSent);
+}
+
+// Changes up to EDP_DELTA_MERGE_GAP channels apart are sent as one range,
+// unchanged channels in between included. One more and it's two ranges
+static void testDeltaGaps() {
+    Edp controller, node;
+    uint8_t current[512], shadow[512], out[600];
+    std::vector<DeltaRange> ranges;
+    uint16_t size;
+    bool callAgain = true;
+
+    setup(controller, node);
+    memset(current, 0x00, sizeof(current));
+    memset(shadow, 0x00, sizeof(shadow));
+    memset(out, 0xee, sizeof(out));
+
+    current[10] = 1;
+    current[10 + EDP_DELTA_MERGE_GAP + 1] = 2;
+    current[100] = 3;
+    current[100 + EDP_DELTA_MERGE_GAP + 2] = 4;
+    current[511] = 5;
+
+    size = controller.prepareDmxDataDelta(7, current, shadow, out, sizeof(out), &callAgain);
+    ranges = deltaRanges(out, size, 7, current);
+    CHECK_EQUAL(4, ranges.size());
+    CHECK_EQUAL(10, ranges[0].start);
+    CHECK_EQUAL(EDP_DELTA_MERGE_GAP + 2, ranges[0].length);
+    CHECK_EQUAL(100, ranges[1].start);
+    CHECK_EQUAL(1, ranges[1].length);
+    CHECK_EQUAL(100 + EDP_DELTA_MERGE_GAP + 2, ranges[2].start);
+    CHECK_EQUAL(1, ranges[2].length);
+    CHECK_EQUAL(511, ranges[3].start);
+    CHECK_EQUAL(1, ranges[3].length);
+    CHECK(!callAgain);
+
+    // Terminated, since there is room
+    CHECK_EQUAL(0, out[size]);
+    CHECK_EQUAL(0, out[size + 1]);
+    CHECK_EQUAL(0, out[size + 2]);
+    CHECK_EQUAL(0xee, out[size + 3]);
+
+    CHECK(!memcmp(current, shadow, 512));
+    CHECK_EQUAL(1, controller.stats.deltasSent);
+
+    // Nothing left to send
+    CHECK_EQUAL(0, controller.prepareDmxDataDelta(7, current, shadow, out, sizeof(out), &callAgain));
+    CHECK_EQUAL(1, controller.stats.deltasSent);
+}
+
+// The length of a range is a single byte
+static void testDeltaLongRange() {
+    Edp controller, node;
+    uint8_t current[512], shadow[512], out[600];
+    std::vector<DeltaRange> ranges;
+    uint16_t size;
+    bool callAgain = true;
+
+    setup(controller, node);
+    memset(shadow, 0x00, sizeof(shadow));
+    for (uint16_t i = 0; i < 512; i++) {
+        current[i] = (i < 300) ? (i % 250) + 1 : 0;
+    }
+
+    size = controller.prepareDmxDataDelta(0, current, shadow, out, sizeof(out), &callAgain);
+    ranges = deltaRanges(out, size, 0, current);
+    CHECK_EQUAL(2, ranges.size());
+    CHECK_EQUAL(0, ranges[0].start);
+    CHECK_EQUAL(255, ranges[0].length);
+    CHECK_EQUAL(255, ranges[1].start);
+    CHECK_EQUAL(45, ranges[1].length);
+    CHECK(!callAgain);
+    CHECK(!memcmp(current, shadow, 512));
+}
+
+// Messages that can't take all changes: shadow only gets what was sent and
+// callAgain asks for the rest
+static void testDeltaOutputFull() {
+    Edp controller, node;
+    uint8_t current[512], shadow[512], out[600];
+    uint8_t before[512];
+    std::vector<DeltaRange> ranges;
+    uint16_t size;
+    uint16_t sent = 0;
+    bool callAgain = false;
+
+    setup(controller, node);
+    memset(current, 0x00, sizeof(current));
+    memset(shadow, 0x00, sizeof(shadow));
+    for (uint16_t i = 0; i < 10; i++) {
+        current[i * 20] = i + 1;
+    }
+
+    // Room for three single channel ranges and no terminator
+    for (int call = 0; call < 4; call++) {
+        memset(out, 0xee, sizeof(out));
+        size = controller.prepareDmxDataDelta(2, current, shadow, out, 14, &callAgain);
+        ranges = deltaRanges(out, size, 2, current);
+        CHECK_EQUAL((call < 3) ? 3 : 1, ranges.size());
+        for (const auto& range : ranges) {
+            CHECK_EQUAL(sent * 20, range.start);
+            CHECK_EQUAL(1, range.length);
+            sent++;
+        }
+        CHECK_EQUAL(call < 3, callAgain);
+        CHECK_EQUAL((call < 3) ? 0xee : 0x00, out[size]);
+        for (uint16_t i = 0; i < 10; i++) {
+            CHECK_EQUAL((i < sent) ? i + 1 : 0, shadow[i * 20]);
+        }
+    }
+    CHECK_EQUAL(10, sent);
+    CHECK_EQUAL(4, controller.stats.deltasSent);
+
+    // A range cut short, the rest of it follows with the next call
+    for (uint16_t i = 50; i < 70; i++) {
+        current[i] = 0x80;
+    }
+    memcpy(before, shadow, sizeof(before));
+    size = controller.prepareDmxDataDelta(2, current, shadow, out, 10, &callAgain);
+    ranges = deltaRanges(out, size, 2, current);
+    CHECK_EQUAL(1, ranges.size());
+    CHECK_EQUAL(50, ranges[0].start);
+    CHECK_EQUAL(5, ranges[0].length);
+    CHECK(callAgain);
+    CHECK(!memcmp(shadow + 50, current + 50, 5));
+    CHECK(!memcmp(shadow + 55, before + 55, 512 - 55));
+
+    size = controller.prepareDmxDataDelta(2, current, shadow, out, sizeof(out), &callAgain);
+    ranges = deltaRanges(out, size, 2, current);
+    CHECK_EQUAL(1, ranges.size());
+    CHECK_EQUAL(55, ranges[0].start);
+    CHECK_EQUAL(15, ranges[0].length);
+    CHECK(!callAgain);
+    CHECK(!memcmp(current, shadow, 512));
+}
+
+int main() {
+    dmxBuffer.init();
+
+    testPongDoesNotReplaceResponse();
+    testMuteDropsResponse();
+    testSameKindReplaces();
+    testQueueFull();
+    testDeltaNothingToSend();
+    testDeltaGaps();
+    testDeltaLongRange();
+    testDeltaOutputFull();
+
+    return checkResult();
+}
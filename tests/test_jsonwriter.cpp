@@ -0,0 +1,686 @@
+// JsonWriter replaced jsoncpp in the web server. The status tags
+// (webstatus.cpp) are written the way they are now and the way they were
+// with jsoncpp, and checked to come out the same. jsoncpp sorts the keys of
+// objects and escapes in its own way, so JsonWriter's output is read back
+// with jsoncpp and both are compared written by jsoncpp, the way the web
+// server did before
+
+#include "check.h"
+#include "host/host.h"
+
+#include "jsonwriter.h"
+#include "webstatus.h"
+
+#include "hardware/flash.h"
+#include "lwip/netif.h"
+
+#include "version.h"
+#include "boardconfig.h"
+#include "dmxbuffer.h"
+#include "statusleds.h"
+#include "wireless.h"
+#include "dhcpdata.h"
+#include "websocket.h"
+
+#define MAGIC_ENUM_RANGE_MAX 255
+#include "../lib/magic_enum/include/magic_enum.hpp"
+
+#include <json/json.h>
+
+#include <climits>
+#include <cmath>
+#include <string>
+
+extern "C" {
+  #include <b64/cencode.h>
+}
+
+extern StatusLeds statusLeds;
+extern BoardConfig boardConfig;
+extern DmxBuffer dmxBuffer;
+extern Wireless wireless;
+
+static std::string writeString(const Json::Value& value) {
+    Json::StreamWriterBuilder wbuilder;
+
+    wbuilder["indentation"] = "";
+    return Json::writeString(wbuilder, value);
+}
+
+// JsonWriter's output as jsoncpp would have written it. "!" if it isn't
+// valid JSON
+static std::string normalize(const char* document, size_t length) {
+    Json::CharReaderBuilder rbuilder;
+    std::unique_ptr<Json::CharReader> reader(rbuilder.newCharReader());
+    Json::Value value;
+    std::string errors;
+
+    if (!reader->parse(document, document + length, &value, &errors)) {
+        printf("Not valid JSON (%s): %.*s\n", errors.c_str(), (int)length, document);
+        return "!";
+    }
+    return writeString(value);
+}
+
+#define CHECK_SAME(expected, json, buffer) do { \
+        CHECK(!(json).overflowed()); \
+        CHECK_EQUAL(true, writeString(expected) == normalize((buffer), (json).length())); \
+        if (writeString(expected) != normalize((buffer), (json).length())) { \
+            printf("  jsoncpp:    %s\n  JsonWriter: %.*s\n", writeString(expected).c_str(), (int)(json).length(), (buffer)); \
+        } \
+    } while (0)
+
+// A status tag as the web server gets it now, compared with what the
+// jsoncpp code wrote
+#define CHECK_TAG(expected, tagName) do { \
+        static char buffer[4096]; \
+        JsonWriter json(buffer, sizeof(buffer)); \
+        CHECK(WebStatus::writeTag((tagName), &json)); \
+        CHECK_SAME(expected, json, buffer); \
+    } while (0)
+
+// What webserver.cpp did before, from a time it still used jsoncpp. Only
+// what it took from the board was put into parameters
+static Json::Value edpStatsToJsonOld(const EdpStats& stats) {
+    Json::Value output;
+
+    output["pingsSent"] = stats.pingsSent;
+    output["pingsAnswered"] = stats.pingsAnswered;
+    output["pongsReceived"] = stats.pongsReceived;
+    output["rttLast"] = stats.rttLast;
+    output["rttMin"] = stats.rttMin;
+    output["rttMax"] = stats.rttMax;
+    output["rttAvg"] = stats.rttAvg;
+    output["framesReceived"] = stats.framesReceived;
+    output["framesCrcError"] = stats.framesCrcError;
+    output["framesChunkGap"] = stats.framesChunkGap;
+    output["dmxDataRequestsSent"] = stats.dmxDataRequestsSent;
+    output["dmxDataRequestsReceived"] = stats.dmxDataRequestsReceived;
+    output["discoveryAnswered"] = stats.discoveryAnswered;
+    output["framesSent"] = stats.framesSent;
+    output["chunksSent"] = stats.chunksSent;
+    output["bytesSent"] = stats.bytesSent;
+    output["overheadBytesSent"] = stats.overheadBytesSent;
+    output["deltasSent"] = stats.deltasSent;
+    output["framesSparse"] = stats.framesSparse;
+    output["framesCompressed"] = stats.framesCompressed;
+    output["compressionSkipped"] = stats.compressionSkipped;
+    output["parityChunksSent"] = stats.parityChunksSent;
+    output["framesRecovered"] = stats.framesRecovered;
+    output["chunksPerFrame"] = stats.framesSent ? ((double)stats.chunksSent / stats.framesSent) : 0.0;
+
+    return output;
+}
+
+static void ipToStringOld(uint32_t ip, char* ipString) {
+    sprintf(ipString, "%ld.%ld.%ld.%ld", (ip & 0xff), ((ip >> 8) & 0xff), ((ip >> 16) & 0xff), ((ip >> 24) & 0xff));
+}
+
+static Json::Value overviewOld() {
+    Json::Value output;
+    char ifname[3];
+    char ip[16];
+
+    output["debug"]["flash"]["totalSize"] = PICO_FLASH_SIZE_BYTES;
+    output["debug"]["flash"]["sectorSize"] = FLASH_SECTOR_SIZE;
+    output["debug"]["flash"]["blockSize"] = FLASH_BLOCK_SIZE;
+
+    output["debug"]["toolchain"]["pico_sdk_version"] = PICO_SDK_VERSION_STRING;
+    output["debug"]["toolchain"]["PICO_BOARD"] = PICO_BOARD;
+#if defined(__GNUC__)
+# if defined(__GNUC_PATCHLEVEL__)
+#  define __GNUC_VERSION__ (__GNUC__ * 10000 \
+                            + __GNUC_MINOR__ * 100 \
+                            + __GNUC_PATCHLEVEL__)
+# else
+#  define __GNUC_VERSION__ (__GNUC__ * 10000 \
+                            + __GNUC_MINOR__ * 100)
+# endif
+    output["debug"]["toolchain"]["compiler_name"] = "GNU gcc";
+    output["debug"]["toolchain"]["compiler_version"] = __GNUC_VERSION__;
+#endif
+#if defined(__clang_version__)
+    output["debug"]["toolchain"]["compiler_name"] = "LLVM clang";
+    output["debug"]["toolchain"]["compiler_version"] = __clang_version__;
+#endif
+#if defined (__cplusplus)
+    output["debug"]["toolchain"]["cplusplus_standard"] = (int64_t)__cplusplus;
+#endif
+    output["debug"]["structSize"]["ConfigData"] = sizeof(ConfigData);
+    output["debug"]["structSize"]["Patching"] = sizeof(Patching);
+    output["debug"]["structSize"]["EthDestParams"] = sizeof(EthDestParams);
+
+    output["boardName"] = boardConfig.activeConfig->boardName;
+    output["boardIsPicoW"] = BoardConfig::boardIsPicoW;
+    output["configSource"] = boardConfig.configSource;
+    output["configSourceString"] = std::string(magic_enum::enum_name<ConfigSource>(boardConfig.configSource));
+    output["version"] = VERSION;
+    output["serial"] = BoardConfig::boardSerialString;
+    output["shortId"] = BoardConfig::shortId;
+
+    struct netif* iface = netif_list;
+    while (iface != nullptr) {
+        sprintf(ifname, "%c%c", iface->name[0], iface->name[1]);
+        ipToStringOld(iface->ip_addr.addr, ip);
+        output["net"][ifname]["ip"] = ip;
+        ipToStringOld(iface->netmask.addr, ip);
+        output["net"][ifname]["netmask"] = ip;
+        ipToStringOld(iface->gw.addr, ip);
+        output["net"][ifname]["gw"] = ip;
+        if (iface->hostname) {
+            output["net"][ifname]["hostname"] = iface->hostname;
+        }
+
+        iface = iface->next;
+    }
+
+    for (int i = 0; i < DHCP_NUM_ENTRIES_USB; i++) {
+        output["net"]["u0"]["dhcp"][i] = DhcpData::dhcpEntryToString(&(dhcp_entries_usb[i]));
+    }
+    for (int i = 0; i < DHCP_NUM_ENTRIES_ETH; i++) {
+        output["net"]["e0"]["dhcp"][i] = DhcpData::dhcpEntryToString(&(dhcp_entries_eth[i]));
+    }
+    for (int i = 0; i < DHCP_NUM_ENTRIES_WIFI; i++) {
+        output["net"]["w1"]["dhcp"][i] = DhcpData::dhcpEntryToString(&(dhcp_entries_wifi[i]));
+    }
+
+    output["wirelessModule"] = wireless.moduleAvailable;
+    output["statusLedBrightness"] = boardConfig.activeConfig->statusLedBrightness;
+
+    output["createdDefaultConfig"] = boardConfig.createdDefaultConfig;
+
+    return output;
+}
+
+static Json::Value statusLedsOld() {
+    Json::Value output;
+    bool red_static, blue_static, green_static;
+    bool red_blink, green_blink, blue_blink;
+    char hexColor[8];
+
+    for (int i = 0; i < 8; i++) {
+        red_static = 0;
+        green_static = 0;
+        blue_static = 0;
+        red_blink = 0;
+        green_blink = 0;
+        blue_blink = 0;
+        Json::Value ledStatus;
+        statusLeds.getLed(i, &red_static, &green_static, &blue_static, &red_blink, &green_blink, &blue_blink);
+        snprintf(hexColor, 8, "#%02x%02x%02x", red_static ? 0xff : 0x00, green_static ? 0xff : 0x00, blue_static ? 0xff : 0x00);
+        ledStatus["static"] = hexColor;
+        snprintf(hexColor, 8, "#%02x%02x%02x", red_blink ? 0xff : 0x00, green_blink ? 0xff : 0x00, blue_blink ? 0xff : 0x00);
+        ledStatus["blink"] = hexColor;
+        output[i] = ledStatus;
+    }
+
+    return output;
+}
+
+static Json::Value ioBoardsOld() {
+    Json::Value output;
+
+    output["base"]["exist"] = true;
+    output["base"]["type"] = boardConfig.configData[4]->boardType;
+    output["base"]["typeString"] = std::string(magic_enum::enum_name(boardConfig.configData[4]->boardType));
+
+    for (uint8_t i = 0; i < 4; i++) {
+        output["boards"][i]["exist"] = boardConfig.responding[i];
+        output["boards"][i]["type"] = boardConfig.configData[i]->boardType;
+        output["boards"][i]["typeString"] = std::string(magic_enum::enum_name(boardConfig.configData[i]->boardType));
+        for (uint8_t j = 0; j < 4; j++) {
+            output["boards"][i]["ports"][j]["direction"] = (boardConfig.configData[i]->portParams[j].direction);
+            output["boards"][i]["ports"][j]["directionString"] = std::string(magic_enum::enum_name(boardConfig.configData[i]->portParams[j].direction));
+            output["boards"][i]["ports"][j]["connector"] = boardConfig.configData[i]->portParams[j].connector;
+            output["boards"][i]["ports"][j]["connectorString"] = std::string(magic_enum::enum_name(boardConfig.configData[i]->portParams[j].connector));
+        }
+    }
+
+    return output;
+}
+
+static Json::Value webServerIpOld() {
+    Json::Value output;
+    char ownIp[16];
+    char ownMask[16];
+    char hostIp[16];
+
+    ipToStringOld(boardConfig.activeConfig->ownIp, ownIp);
+    ipToStringOld(boardConfig.activeConfig->ownMask, ownMask);
+    ipToStringOld(boardConfig.activeConfig->hostIp, hostIp);
+    output["ownIp"] = ownIp;
+    output["ownMask"] = ownMask;
+    output["hostIp"] = hostIp;
+
+    return output;
+}
+
+static Json::Value wirelessOld() {
+    Json::Value output;
+
+    output["role"] = boardConfig.activeConfig->radioRole;
+    output["channel"] = boardConfig.activeConfig->radioChannel;
+    output["address"] = boardConfig.activeConfig->radioAddress;
+    output["compress"] = boardConfig.activeConfig->radioParams.compression;
+    output["sparse"] = boardConfig.activeConfig->radioParams.allowSparse;
+    output["fec"] = boardConfig.activeConfig->radioParams.fec;
+    output["hopping"] = boardConfig.activeConfig->radioParams.hopping;
+    output["merge"] = boardConfig.activeConfig->radioParams.mergeMode;
+    output["dataRate"] = (int)boardConfig.activeConfig->radioParams.dataRate;
+    output["txPower"] = (int)boardConfig.activeConfig->radioParams.txPower;
+
+    return output;
+}
+
+// The tags that were written without jsoncpp: libb64 straight into the insert
+static size_t compressedOld(char* insert, const char* prefix, const void* data, size_t size) {
+    uint8_t compressed[800];
+    size_t actuallyWritten = sizeof(compressed);
+    base64_encodestate state;
+    size_t offset = 0;
+
+    snappy::RawCompress((const char*)data, size, (char*)compressed, &actuallyWritten);
+
+    offset += sprintf(insert + offset, "%s", prefix);
+    base64_init_encodestate(&state);
+    offset += base64_encode_block((const char*)compressed, actuallyWritten, insert + offset, &state);
+    offset += base64_encode_blockend(insert + offset, &state);
+    offset += sprintf(insert + offset, "\"}");
+
+    return offset;
+}
+
+static void checkCompressedTag(const char* tagName, const char* expected, size_t length) {
+    char buffer[2048];
+    JsonWriter json(buffer, sizeof(buffer));
+
+    CHECK(WebStatus::writeTag(tagName, &json));
+    CHECK(!json.overflowed());
+    CHECK_EQUAL(length, json.length());
+    CHECK(!memcmp(expected, buffer, length));
+}
+
+static void testOverview() {
+    static struct netif interfaces[3];
+    static char hostname[] = "dmxsun";
+
+    snprintf(boardConfig.activeConfig->boardName, sizeof(boardConfig.activeConfig->boardName), "Stage \"left\"");
+    BoardConfig::boardIsPicoW = true;
+    BoardConfig::configSource = ConfigSource::BaseBoard;
+    snprintf(BoardConfig::boardSerialString, sizeof(BoardConfig::boardSerialString), "E6605838832B4D2A");
+    BoardConfig::shortId = 0x2a;
+    boardConfig.createdDefaultConfig = true;
+    wireless.moduleAvailable = true;
+    boardConfig.activeConfig->statusLedBrightness = 42;
+
+    // Listed in the order lwIP adds them: Loopback has no DHCP server, e0
+    // is down
+    memset(interfaces, 0x00, sizeof(interfaces));
+    interfaces[0].name[0] = 'w';
+    interfaces[0].name[1] = '1';
+    interfaces[0].ip_addr.addr = 0x0104a8c0;
+    interfaces[0].netmask.addr = 0x00ffffff;
+    interfaces[0].hostname = hostname;
+    interfaces[0].next = &interfaces[1];
+    interfaces[1].name[0] = 'u';
+    interfaces[1].name[1] = '0';
+    interfaces[1].ip_addr.addr = 0x012aa8c0;
+    interfaces[1].netmask.addr = 0x00ffffff;
+    interfaces[1].gw.addr = 0x022aa8c0;
+    interfaces[1].next = &interfaces[2];
+    interfaces[2].name[0] = 'l';
+    interfaces[2].name[1] = 'o';
+    interfaces[2].ip_addr.addr = 0x0100007f;
+    interfaces[2].netmask.addr = 0x000000ff;
+    netif_list = &interfaces[0];
+
+    memset(dhcp_entries_usb, 0x00, sizeof(dhcp_entries_usb));
+    memset(dhcp_entries_eth, 0x00, sizeof(dhcp_entries_eth));
+    memset(dhcp_entries_wifi, 0x00, sizeof(dhcp_entries_wifi));
+    dhcp_entries_usb[0].addr.addr = 0x022aa8c0;
+    dhcp_entries_usb[0].lease = 86400;
+    dhcp_entries_wifi[3].addr.addr = 0x0504a8c0;
+    memcpy(dhcp_entries_wifi[3].mac, "\x02\x00\x5e\x10\x20\x30", 6);
+    dhcp_entries_wifi[3].lease = 3600;
+
+    CHECK_TAG(overviewOld(), "OverviewGet");
+
+    // Nothing up yet, the leases are still listed
+    netif_list = nullptr;
+    boardConfig.activeConfig->boardName[0] = 0;
+    BoardConfig::configSource = ConfigSource::Fallback;
+    CHECK_TAG(overviewOld(), "OverviewGet");
+}
+
+static void testStatusLeds() {
+    hostSetTime(5000000);
+    statusLeds.setStatic(0, true, false, false);
+    statusLeds.setStatic(3, false, true, true);
+    statusLeds.setStatic(7, true, true, true);
+    statusLeds.setBlinkOnce(3, true, false, false);
+    statusLeds.setBlinkOnce(5, false, false, true);
+
+    CHECK_TAG(statusLedsOld(), "OverviewStatusledsGet");
+}
+
+static void testIoBoards() {
+    static ConfigData boards[5];
+
+    memset(boards, 0x00, sizeof(boards));
+    for (uint8_t i = 0; i < 5; i++) {
+        boardConfig.configData[i] = &boards[i];
+    }
+    boards[0].boardType = BoardType::dmx_4ports_isolated;
+    for (uint8_t j = 0; j < 4; j++) {
+        boards[0].portParams[j].direction = (j < 2) ? PortParamsDirection::out : PortParamsDirection::in;
+        boards[0].portParams[j].connector = PortParamsConnector::xlr_5_female;
+    }
+    boards[2].boardType = BoardType::led_4ports;
+    boards[2].portParams[1].direction = PortParamsDirection::switchable;
+    boards[2].portParams[1].connector = PortParamsConnector::screws;
+    boards[3].boardType = BoardType::invalid_ff;
+    boards[4].boardType = BoardType::baseboard_fallback;
+    boardConfig.responding[0] = true;
+    boardConfig.responding[1] = false;
+    boardConfig.responding[2] = true;
+    boardConfig.responding[3] = false;
+
+    CHECK_TAG(ioBoardsOld(), "OverviewIoBoardsGet");
+}
+
+static void testConfig() {
+    Json::Value brightness;
+
+    boardConfig.activeConfig->statusLedBrightness = 255;
+    brightness["value"] = 255;
+    CHECK_TAG(brightness, "ConfigStatusLedsBrightnessGet");
+
+    boardConfig.activeConfig->ownIp = 0x01fea9c0;
+    boardConfig.activeConfig->ownMask = 0x0000ffff;
+    boardConfig.activeConfig->hostIp = 0xfffea9c0;
+    CHECK_TAG(webServerIpOld(), "ConfigWebSeverIpGet");
+
+    boardConfig.activeConfig->radioRole = RadioRole::mesh;
+    boardConfig.activeConfig->radioChannel = 127;
+    boardConfig.activeConfig->radioAddress = 65535;
+    boardConfig.activeConfig->radioParams.compression = 0;
+    boardConfig.activeConfig->radioParams.allowSparse = 1;
+    boardConfig.activeConfig->radioParams.fec = 1;
+    boardConfig.activeConfig->radioParams.hopping = 1;
+    boardConfig.activeConfig->radioParams.mergeMode = RadioMergeMode::mergePriority;
+    boardConfig.activeConfig->radioParams.dataRate = RF24_250KBPS;
+    boardConfig.activeConfig->radioParams.txPower = RF24_PA_MAX;
+    CHECK_TAG(wirelessOld(), "ConfigWirelessGet");
+}
+
+static void testCompressed() {
+    struct WirelessTelemetry telemetry;
+    char expected[2048];
+    size_t length;
+
+    dmxBuffer.init();
+    for (int i = 0; i < 512; i++) {
+        dmxBuffer.buffer[3][i] = (i * 7) ^ (i >> 3);
+    }
+    length = compressedOld(expected, "{\"buffer\":3,\"value\":\"", dmxBuffer.buffer[3], 512);
+    checkCompressedTag("DmxBuffer3Get", expected, length);
+    length = compressedOld(expected, "{\"buffer\":0,\"value\":\"", dmxBuffer.buffer[0], 512);
+    checkCompressedTag("DmxBuffer0Get", expected, length);
+
+    for (int i = 0; i < MAXCHANNEL; i++) {
+        wireless.signalStrength[i] = (i * 37) % 300;
+    }
+    length = compressedOld(expected, "{\"spectrum\":\"", wireless.signalStrength, MAXCHANNEL * sizeof(uint16_t));
+    checkCompressedTag("ConfigWirelessSpectrumGet", expected, length);
+
+    wireless.getTelemetry(&telemetry);
+    length = compressedOld(expected, "{\"telemetry\":\"", &telemetry, sizeof(telemetry));
+    checkCompressedTag("ConfigWirelessTelemetryGet", expected, length);
+}
+
+static void testEdpStats() {
+    Json::Value expected;
+    EdpStats& usb = hostEdpStats(hostEdpUsb);
+    EdpStats& udp = hostEdpStats(hostEdpUdp);
+    EdpStats& udpTx = hostEdpStats(hostEdpUdpTx);
+
+    usb.pingsSent = 4294967295u;
+    usb.rttMin = 1234;
+    usb.framesSent = 4;
+    usb.chunksSent = 73;
+    usb.framesRecovered = 1;
+    udp.framesReceived = 17;
+    udpTx.framesSent = 3;
+    udpTx.chunksSent = 3;
+    udpTx.bytesSent = 1536;
+
+    expected["usb"] = edpStatsToJsonOld(usb);
+    expected["udp"] = edpStatsToJsonOld(udp);
+    expected["udpTx"] = edpStatsToJsonOld(udpTx);
+    // Added after jsoncpp was gone
+    expected["webSocket"] = edpStatsToJsonOld(WebSocket::getStats());
+    expected["webSocketPushesDropped"] = WebSocket::getPushesDropped();
+
+    CHECK_TAG(expected, "EdpStatsGet");
+}
+
+// Left to the web server
+static void testUnknownTags() {
+    char buffer[64];
+
+    for (const char* tagName : { "", "Overview", "DmxBuffer99Get", "DmxBuffer-1Get", "ConfigWirelessStatsGet", "LogGet" }) {
+        JsonWriter json(buffer, sizeof(buffer));
+        CHECK(!WebStatus::writeTag(tagName, &json));
+        CHECK_EQUAL(0, json.length());
+    }
+}
+
+static void testValues() {
+    char buffer[1024];
+    JsonWriter json(buffer, sizeof(buffer));
+    Json::Value expected;
+
+    expected["int"] = -42;
+    expected["intMin"] = INT_MIN;
+    expected["uint32"] = 4294967295u;
+    expected["int64Min"] = (Json::Int64)LLONG_MIN;
+    expected["uint64Max"] = (Json::UInt64)ULLONG_MAX;
+    expected["zero"] = 0;
+    expected["true"] = true;
+    expected["false"] = false;
+    expected["null"] = Json::Value();
+    expected["notANumber"] = Json::Value();
+    expected["emptyObject"] = Json::Value(Json::objectValue);
+    expected["emptyArray"] = Json::Value(Json::arrayValue);
+    expected["quarter"] = 18.25;
+    expected["net"]["u0"]["ip"] = "169.254.42.1";
+    expected["net"]["u0"]["dhcp"][0] = "";
+    expected["net"]["u0"]["dhcp"][1] = "169.254.42.2";
+    expected["nested"][0][0] = 1;
+    expected["nested"][0][1] = Json::Value(Json::objectValue);
+    expected["nested"][1] = Json::Value(Json::arrayValue);
+
+    json.beginObject();
+    json.value("int", -42);
+    json.value("intMin", INT_MIN);
+    json.value("uint32", 4294967295u);
+    json.value("int64Min", LLONG_MIN);
+    json.value("uint64Max", ULLONG_MAX);
+    json.value("zero", 0);
+    json.value("true", true);
+    json.value("false", false);
+    json.key("null");
+    json.valueNull();
+    json.value("notANumber", NAN);
+    json.beginObject("emptyObject");
+    json.endObject();
+    json.beginArray("emptyArray");
+    json.endArray();
+    json.value("quarter", 18.25);
+    json.beginObject("net");
+    json.beginObject("u0");
+    json.value("ip", "169.254.42.1");
+    json.beginArray("dhcp");
+    json.value("");
+    json.value("169.254.42.2");
+    json.endArray();
+    json.endObject();
+    json.endObject();
+    json.beginArray("nested");
+    json.beginArray();
+    json.value(1);
+    json.beginObject();
+    json.endObject();
+    json.endArray();
+    json.beginArray();
+    json.endArray();
+    json.endArray();
+    json.endObject();
+
+    CHECK_SAME(expected, json, buffer);
+}
+
+// Board names and hostnames are entered by the user
+static void testStrings() {
+    static const char* strings[] = {
+        "dmxsun",
+        "",
+        "Say \"hi\"",
+        "C:\\dmx\\",
+        "line\nbreak\ttab\r",
+        "\x01\x1f\x7f",
+        "B\xc3\xbchne",
+        "</script>",
+    };
+    char buffer[512];
+    JsonWriter json(buffer, sizeof(buffer));
+    Json::Value expected(Json::arrayValue);
+
+    json.beginArray();
+    for (const char* string : strings) {
+        expected.append(string);
+        json.value(string);
+    }
+    // Not terminated, like the boardName in the config
+    expected.append("Stage");
+    json.value(std::string_view("Stage left", 5));
+    json.endArray();
+
+    CHECK_SAME(expected, json, buffer);
+}
+
+// jsoncpp writes doubles with 17 significant digits, JsonWriter with 6.
+// Nothing the web interface shows needs more. Integral ones keep their ".0"
+// (see the 0.0 in testEdpStats)
+static void testDoubles() {
+    static const double values[] = { 0.0, 1.0 / 3.0, 18.0 / 4.0, 123456789.0, -0.001 };
+    char buffer[64];
+    Json::CharReaderBuilder rbuilder;
+    std::unique_ptr<Json::CharReader> reader(rbuilder.newCharReader());
+    Json::Value value;
+
+    for (double expected : values) {
+        JsonWriter json(buffer, sizeof(buffer));
+        json.value(expected);
+        CHECK(reader->parse(buffer, buffer + json.length(), &value, nullptr));
+        CHECK(value.isNumeric());
+        CHECK(value.isDouble());
+        CHECK(fabs(value.asDouble() - expected) <= fabs(expected) * 5e-6);
+    }
+}
+
+// Same as the DmxBuffer<n>Get tag did it before: libb64 straight into the insert
+static void testBase64() {
+    uint8_t data[200];
+    char expected[300];
+    char buffer[300];
+    base64_encodestate state;
+    int length;
+
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = i * 7;
+    }
+
+    for (size_t size : { (size_t)0, (size_t)1, (size_t)2, (size_t)3, (size_t)47, (size_t)48, (size_t)49, sizeof(data) }) {
+        JsonWriter json(buffer, sizeof(buffer));
+
+        length = sprintf(expected, "\"");
+        base64_init_encodestate(&state);
+        length += base64_encode_block((const char*)data, size, expected + length, &state);
+        length += base64_encode_blockend(expected + length, &state);
+        length += sprintf(expected + length, "\"");
+
+        json.base64(data, size);
+        CHECK_EQUAL(length, json.length());
+        CHECK(!memcmp(expected, buffer, length));
+    }
+}
+
+// SSI inserts are limited, larger documents are taken in parts
+static void testParts() {
+    char whole[512];
+    char part[40];
+    std::string joined;
+    size_t taken = 0;
+    size_t wholeLength;
+
+    auto write = [](JsonWriter* json) {
+        json->beginObject();
+        json->beginArray("values");
+        for (int i = 0; i < 40; i++) {
+            json->value(i * 1000);
+        }
+        json->endArray();
+        json->value("name", "rp2040-dmxsun");
+        json->endObject();
+    };
+
+    JsonWriter json(whole, sizeof(whole));
+    write(&json);
+    CHECK(!json.overflowed());
+    wholeLength = json.length();
+
+    do {
+        JsonWriter json(part, sizeof(part), taken);
+        write(&json);
+        joined.append(part, json.length());
+        taken += json.length();
+        if (!json.overflowed()) {
+            break;
+        }
+    } while (json.length());
+
+    CHECK_EQUAL(wholeLength, joined.size());
+    CHECK(joined == std::string(whole, wholeLength));
+}
+
+static void testOverflow() {
+    char buffer[8];
+    JsonWriter json(buffer, sizeof(buffer));
+
+    json.beginObject();
+    json.value("key", "value");
+    json.endObject();
+
+    CHECK(json.overflowed());
+    CHECK_EQUAL(sizeof(buffer), json.length());
+    CHECK(!memcmp(buffer, "{\"key\":\"", sizeof(buffer)));
+}
+
+int main() {
+    testOverview();
+    testStatusLeds();
+    testIoBoards();
+    testConfig();
+    testCompressed();
+    testEdpStats();
+    testUnknownTags();
+    testValues();
+    testStrings();
+    testDoubles();
+    testBase64();
+    testParts();
+    testOverflow();
+
+    return checkResult();
+}
@@ -0,0 +1,246 @@
+// The Nodle U1 emulation, fed with HID reports the way host software sends
+// them: whole frames, slices in any order, lost reports, layout switches
+// and hosts that stop in the middle of a frame
+
+#include "check.h"
+#include "host/host.h"
+
+#include "usb_NodleU1.h"
+
+#include "dmxbuffer.h"
+
+#include <string>
+#include <vector>
+
+extern DmxBuffer dmxBuffer;
+
+// What getStats should show, kept along with the reports sent
+static uint32_t complete[NODLEU1_UNIVERSES];
+static uint32_t partial[NODLEU1_UNIVERSES];
+
+// Channel values of the frames sent, different per frame
+static uint8_t value(uint32_t frame, uint16_t channel) {
+    return channel + frame * 7;
+}
+
+static void send(const std::vector<uint8_t>& report) {
+    Usb_NodleU1::hid_set_report_cb(0, 0, HID_REPORT_TYPE_OUTPUT, report.data(), report.size());
+}
+
+// Padded to a full report, like the hosts do
+static void sendStandard(uint32_t frame, uint8_t slice) {
+    std::vector<uint8_t> report = { slice };
+
+    for (uint16_t i = 0; i < NODLEU1_STANDARD_SLICE_SIZE; i++) {
+        report.push_back(value(frame, slice * NODLEU1_STANDARD_SLICE_SIZE + i));
+    }
+    report.resize(CFG_TUD_HID_BUFSIZE, 0xee);
+    send(report);
+}
+
+static void sendExtended(uint32_t frame, uint8_t universe, uint8_t slice) {
+    std::vector<uint8_t> report = { 32, (uint8_t)((universe << 4) | slice) };
+
+    for (uint16_t i = 0; i < NODLEU1_EXTENDED_SLICE_SIZE; i++) {
+        report.push_back(value(frame, slice * NODLEU1_EXTENDED_SLICE_SIZE + i));
+    }
+    report.resize(CFG_TUD_HID_BUFSIZE, 0xee);
+    send(report);
+}
+
+// Channels of that buffer are from these frames, one per slice
+static bool bufferHas(uint8_t bufferId, uint16_t sliceSize, const std::vector<uint32_t>& frames) {
+    for (uint16_t channel = 0; channel < 512; channel++) {
+        if (dmxBuffer.buffer[bufferId][channel] != value(frames[channel / sliceSize], channel)) {
+            printf("  buffer %u channel %u is %u\n", bufferId, channel, dmxBuffer.buffer[bufferId][channel]);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void checkStats() {
+    char expected[512];
+    char buffer[512];
+    JsonWriter expectedJson(expected, sizeof(expected));
+    JsonWriter json(buffer, sizeof(buffer));
+
+    expectedJson.beginObject();
+    expectedJson.beginArray("complete");
+    for (uint8_t i = 0; i < NODLEU1_UNIVERSES; i++) {
+        expectedJson.value(complete[i]);
+    }
+    expectedJson.endArray();
+    expectedJson.beginArray("partial");
+    for (uint8_t i = 0; i < NODLEU1_UNIVERSES; i++) {
+        expectedJson.value(partial[i]);
+    }
+    expectedJson.endArray();
+    expectedJson.endObject();
+
+    Usb_NodleU1::getStats(&json);
+    CHECK(std::string(expected, expectedJson.length()) == std::string(buffer, json.length()));
+}
+
+static void start() {
+    dmxBuffer.init();
+    Usb_NodleU1::init();
+    memset(complete, 0x00, sizeof(complete));
+    memset(partial, 0x00, sizeof(partial));
+}
+
+static void testStandard() {
+    start();
+
+    for (uint32_t frame = 1; frame <= 3; frame++) {
+        for (uint8_t slice = 0; slice < NODLEU1_STANDARD_SLICES; slice++) {
+            // Nothing goes out before the frame is complete
+            CHECK_EQUAL(frame - 1, hostPatchCount(0));
+            sendStandard(frame, slice);
+        }
+        CHECK_EQUAL(frame, hostPatchCount(0));
+        CHECK(bufferHas(0, NODLEU1_STANDARD_SLICE_SIZE, std::vector<uint32_t>(NODLEU1_STANDARD_SLICES, frame)));
+        complete[0]++;
+    }
+
+    // In any order
+    for (uint8_t slice = NODLEU1_STANDARD_SLICES; slice > 0; slice--) {
+        sendStandard(4, (slice * 5) % NODLEU1_STANDARD_SLICES);
+    }
+    CHECK_EQUAL(4, hostPatchCount(0));
+    CHECK(bufferHas(0, NODLEU1_STANDARD_SLICE_SIZE, std::vector<uint32_t>(NODLEU1_STANDARD_SLICES, 4)));
+    complete[0]++;
+
+    checkStats();
+}
+
+static void testExtended() {
+    std::vector<uint32_t> frames(NODLEU1_EXTENDED_SLICES, 1);
+
+    start();
+
+    for (uint8_t universe : { 5, 15 }) {
+        for (uint8_t slice = 0; slice < NODLEU1_EXTENDED_SLICES; slice++) {
+            sendExtended(1, universe, slice);
+        }
+        CHECK_EQUAL(1, hostPatchCount(universe));
+        CHECK(bufferHas(universe, NODLEU1_EXTENDED_SLICE_SIZE, frames));
+        complete[universe]++;
+    }
+    CHECK_EQUAL(0, hostPatchCount(0));
+
+    checkStats();
+}
+
+// A lost report: The next frame starts with a slice we have. The frame is
+// committed with what it has, the missing slice keeps its old values
+static void testLostSlice() {
+    std::vector<uint32_t> frames(NODLEU1_STANDARD_SLICES, 2);
+
+    start();
+    for (uint8_t slice = 0; slice < NODLEU1_STANDARD_SLICES; slice++) {
+        sendStandard(1, slice);
+    }
+    complete[0]++;
+
+    for (uint8_t slice = 0; slice < NODLEU1_STANDARD_SLICES; slice++) {
+        if (slice != 9) {
+            sendStandard(2, slice);
+        }
+    }
+    CHECK_EQUAL(1, hostPatchCount(0));
+    sendStandard(3, 0);
+    CHECK_EQUAL(2, hostPatchCount(0));
+    frames[9] = 1;
+    CHECK(bufferHas(0, NODLEU1_STANDARD_SLICE_SIZE, frames));
+    partial[0]++;
+
+    // The new frame isn't affected
+    for (uint8_t slice = 1; slice < NODLEU1_STANDARD_SLICES; slice++) {
+        sendStandard(3, slice);
+    }
+    CHECK_EQUAL(3, hostPatchCount(0));
+    CHECK(bufferHas(0, NODLEU1_STANDARD_SLICE_SIZE, std::vector<uint32_t>(NODLEU1_STANDARD_SLICES, 3)));
+    complete[0]++;
+
+    // Same for the extended layout and when the host switches layouts
+    for (uint8_t slice = 0; slice < 4; slice++) {
+        sendStandard(4, slice);
+    }
+    sendExtended(5, 0, 0);
+    CHECK_EQUAL(4, hostPatchCount(0));
+    frames.assign(NODLEU1_STANDARD_SLICES, 3);
+    frames[0] = frames[1] = frames[2] = frames[3] = 4;
+    CHECK(bufferHas(0, NODLEU1_STANDARD_SLICE_SIZE, frames));
+    partial[0]++;
+
+    for (uint8_t slice = 0; slice < 3; slice++) {
+        sendExtended(6, 7, slice);
+    }
+    sendExtended(7, 7, 1);
+    CHECK_EQUAL(1, hostPatchCount(7));
+    for (uint16_t channel = 0; channel < 512; channel++) {
+        if (channel >= 3 * NODLEU1_EXTENDED_SLICE_SIZE) {
+            CHECK_EQUAL(0, dmxBuffer.buffer[7][channel]);
+        } else {
+            CHECK_EQUAL(value(6, channel), dmxBuffer.buffer[7][channel]);
+        }
+    }
+    partial[7]++;
+
+    checkStats();
+}
+
+// The host stops in the middle of a frame
+static void testTimeout() {
+    start();
+
+    for (uint8_t slice = 0; slice < 5; slice++) {
+        sendStandard(1, slice);
+    }
+    hostAdvance(NODLEU1_FRAME_TIMEOUT_MS * 1000);
+    Usb_NodleU1::cyclicTask();
+    CHECK_EQUAL(0, hostPatchCount(0));
+    hostAdvance(1000);
+    Usb_NodleU1::cyclicTask();
+    CHECK_EQUAL(1, hostPatchCount(0));
+    for (uint16_t channel = 0; channel < 512; channel++) {
+        CHECK_EQUAL((channel < 5 * NODLEU1_STANDARD_SLICE_SIZE) ? value(1, channel) : 0, dmxBuffer.buffer[0][channel]);
+    }
+    partial[0]++;
+
+    // Only once
+    hostAdvance(NODLEU1_FRAME_TIMEOUT_MS * 2000);
+    Usb_NodleU1::cyclicTask();
+    CHECK_EQUAL(1, hostPatchCount(0));
+
+    checkStats();
+}
+
+// Reports that don't carry DMX data, or not where it fits
+static void testIgnored() {
+    start();
+
+    send({ 0 });
+    send({ 16, 1 });
+    send({ 32, 0x19 });
+    send({ 32, 0x59, 1, 2 });
+    send({ 33, 0x00, 1, 2, 3 });
+    for (uint8_t i = 0; i < DMXBUFFER_COUNT; i++) {
+        CHECK_EQUAL(0, hostPatchCount(i));
+    }
+
+    checkStats();
+}
+
+int main() {
+    hostSetTime(1000000);
+
+    testStandard();
+    testExtended();
+    testLostSlice();
+    testTimeout();
+    testIgnored();
+
+    return checkResult();
+}
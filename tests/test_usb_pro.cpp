@@ -0,0 +1,241 @@
+// The ENTTEC DMX USB Pro emulation, fed with byte streams the way host
+// software sends them: queries at start-up, DMX frames in 64 byte USB
+// packets, Mk2 port 2 behind the API key, and some line noise
+
+#include "check.h"
+#include "host/host.h"
+
+#include "usb_UsbPro.h"
+
+#include "boardconfig.h"
+#include "dmxbuffer.h"
+
+#include <algorithm>
+
+extern DmxBuffer dmxBuffer;
+
+struct Message {
+    uint8_t label;
+    std::vector<uint8_t> data;
+};
+
+static std::vector<uint8_t> message(uint8_t label, const std::vector<uint8_t>& data) {
+    std::vector<uint8_t> result = { USBPRO_START_OF_MSG, label, (uint8_t)(data.size() & 0xff), (uint8_t)(data.size() >> 8) };
+
+    result.insert(result.end(), data.begin(), data.end());
+    result.push_back(USBPRO_END_OF_MSG);
+    return result;
+}
+
+static std::vector<uint8_t> dmxFrame(uint8_t startCode, uint16_t channels, uint8_t first) {
+    std::vector<uint8_t> result = { startCode };
+
+    for (uint16_t i = 0; i < channels; i++) {
+        result.push_back(first + i);
+    }
+    return result;
+}
+
+static void append(std::vector<uint8_t>* stream, const std::vector<uint8_t>& more) {
+    stream->insert(stream->end(), more.begin(), more.end());
+}
+
+// In USB packets of 64 byte, the parser runs once per packet
+static void feed(const std::vector<uint8_t>& stream, size_t packetSize = 64) {
+    for (size_t i = 0; i < stream.size(); i += packetSize) {
+        hostUsbFeed(hostUsbCdc, stream.data() + i, std::min(packetSize, stream.size() - i));
+        Usb_UsbPro::cyclicTask();
+    }
+    for (int i = 0; i < 50; i++) {
+        Usb_UsbPro::cyclicTask();
+    }
+}
+
+// What the widget sent, split into messages
+static std::vector<Message> sentMessages() {
+    std::vector<uint8_t>& sent = hostUsbSent(hostUsbCdc);
+    std::vector<Message> result;
+    size_t i = 0;
+
+    while (i + 5 <= sent.size()) {
+        Message msg;
+        uint16_t length = sent[i + 2] | (sent[i + 3] << 8);
+        CHECK_EQUAL(USBPRO_START_OF_MSG, sent[i]);
+        if ((sent[i] != USBPRO_START_OF_MSG) || (i + 5 + length > sent.size())) {
+            break;
+        }
+        CHECK_EQUAL(USBPRO_END_OF_MSG, sent[i + 4 + length]);
+        msg.label = sent[i + 1];
+        msg.data.assign(sent.begin() + i + 4, sent.begin() + i + 4 + length);
+        result.push_back(msg);
+        i += 5 + length;
+    }
+    CHECK_EQUAL(sent.size(), i);
+    sent.clear();
+    return result;
+}
+
+static void reset() {
+    BoardConfig::activeConfig->usbProtocol = UsbProtocol::UsbPro;
+    dmxBuffer.init();
+    Usb_UsbPro::init();
+    hostUsbSent(hostUsbCdc).clear();
+}
+
+// Start-up of a host: parameters, serial, manufacturer and name, all sent
+// back-to-back before the first answer comes back
+static void testQueries() {
+    std::vector<uint8_t> stream;
+    std::vector<Message> replies;
+    static const uint8_t boardId[8] = { 0xe6, 0x60, 0x58, 0x38, 0x00, 0xbc, 0x61, 0x4e };
+
+    reset();
+    hostSetBoardId(boardId);
+    append(&stream, message(UsbPro_Label::GetParams, { 0x00, 0x00 }));
+    append(&stream, message(UsbPro_Label::GetSerial, {}));
+    append(&stream, message(UsbPro_Label::GetManufacturer, {}));
+    append(&stream, message(UsbPro_Label::GetName, {}));
+    feed(stream);
+
+    replies = sentMessages();
+    CHECK_EQUAL(4, replies.size());
+    if (replies.size() != 4) {
+        return;
+    }
+
+    CHECK_EQUAL(UsbPro_Label::GetParams, replies[0].label);
+    CHECK_EQUAL(sizeof(struct UsbPro_Params), replies[0].data.size());
+
+    // 0x00bc614e = 12345678, as BCD, least significant digits first
+    CHECK_EQUAL(UsbPro_Label::GetSerial, replies[1].label);
+    CHECK((replies[1].data == std::vector<uint8_t>{ 0x78, 0x56, 0x34, 0x12 }));
+
+    CHECK_EQUAL(UsbPro_Label::GetManufacturer, replies[2].label);
+    CHECK((replies[2].data.size() > 2) && (replies[2].data[0] == 0xf0) && (replies[2].data[1] == 0x7f));
+    CHECK_EQUAL(UsbPro_Label::GetName, replies[3].label);
+}
+
+static void testSendDmx() {
+    std::vector<uint8_t> stream;
+    std::vector<uint8_t> frame;
+
+    reset();
+    // A full universe, then a short one that clears the rest
+    append(&stream, message(UsbPro_Label::SendDmx, dmxFrame(0x00, 512, 10)));
+    feed(stream);
+    CHECK_EQUAL(10, dmxBuffer.buffer[0][0]);
+    CHECK_EQUAL((uint8_t)(10 + 511), dmxBuffer.buffer[0][511]);
+
+    feed(message(UsbPro_Label::SendDmx, dmxFrame(0x00, 24, 100)));
+    CHECK_EQUAL(100, dmxBuffer.buffer[0][0]);
+    CHECK_EQUAL(123, dmxBuffer.buffer[0][23]);
+    CHECK_EQUAL(0, dmxBuffer.buffer[0][24]);
+
+    // RDM (start code 0xcc) is not DMX
+    feed(message(UsbPro_Label::SendDmx, dmxFrame(0xcc, 24, 1)));
+    CHECK_EQUAL(100, dmxBuffer.buffer[0][0]);
+    CHECK_EQUAL(2, Usb_UsbPro::stats.framesReceived);
+    CHECK_EQUAL(0, Usb_UsbPro::stats.errors);
+
+    // Mk2: port 2 after the API key
+    stream.clear();
+    append(&stream, message(UsbPro_Label::SetApiKey, { 0xc8, 0xd0, 0x88, 0xad }));
+    append(&stream, message(UsbPro_Label::SendDmxPort2, dmxFrame(0x00, 512, 0x40)));
+    feed(stream, 64);
+    CHECK_EQUAL(0x40, dmxBuffer.buffer[1][0]);
+    CHECK_EQUAL(100, dmxBuffer.buffer[0][0]);
+}
+
+// Broken messages cost nothing but themselves
+static void testResync() {
+    std::vector<uint8_t> stream = { 0x00, 0xff, 0x12 };
+    std::vector<uint8_t> broken;
+
+    reset();
+    // End marker missing: the next message starts right where it should be
+    broken = message(UsbPro_Label::SendDmx, dmxFrame(0x00, 4, 1));
+    broken.pop_back();
+    append(&stream, broken);
+    append(&stream, message(UsbPro_Label::SendDmx, dmxFrame(0x00, 4, 50)));
+    // Longer than any message can be
+    append(&stream, message(UsbPro_Label::SendDmx, dmxFrame(0x00, 520, 1)));
+    append(&stream, message(UsbPro_Label::GetName, std::vector<uint8_t>(700, 0x7e)));
+    append(&stream, message(UsbPro_Label::SendDmxPort2, dmxFrame(0x00, 4, 60)));
+    feed(stream, 7);
+
+    CHECK_EQUAL(50, dmxBuffer.buffer[0][0]);
+    CHECK_EQUAL(60, dmxBuffer.buffer[1][0]);
+    CHECK_EQUAL(2, Usb_UsbPro::stats.framesReceived);
+    CHECK(Usb_UsbPro::stats.errors >= 5);
+    CHECK(sentMessages().empty());
+}
+
+static void testReceiveAlways() {
+    std::vector<Message> sent;
+
+    reset();
+    dmxBuffer.setChannel(7, 0, 0x11);
+    dmxBuffer.setChannel(7, 511, 0x22);
+    Usb_UsbPro::queueBuffer(0, 7);
+    feed({});
+
+    sent = sentMessages();
+    CHECK_EQUAL(1, sent.size());
+    if (sent.size() == 1) {
+        CHECK_EQUAL(UsbPro_Label::ReceivedDmx, sent[0].label);
+        CHECK_EQUAL(514, sent[0].data.size());
+        CHECK_EQUAL(0x00, sent[0].data[0]);         // Status
+        CHECK_EQUAL(0x00, sent[0].data[1]);         // Start code
+        CHECK_EQUAL(0x11, sent[0].data[2]);
+        CHECK_EQUAL(0x22, sent[0].data[513]);
+    }
+}
+
+// Rebuild the frame from ChangeOfState messages the way a host does
+static void testReceiveOnChange() {
+    std::vector<Message> sent;
+    uint8_t host[513] = {};
+    uint8_t expected[513] = {};
+
+    reset();
+    feed(message(UsbPro_Label::ReceiveDmxOnChange, { 0x01 }));
+    sentMessages();
+
+    for (uint16_t channel : { 0, 1, 7, 8, 39, 40, 300, 511 }) {
+        dmxBuffer.setChannel(3, channel, channel / 2 + 1);
+        expected[1 + channel] = channel / 2 + 1;
+    }
+    Usb_UsbPro::queueBuffer(0, 3);
+    feed({});
+
+    sent = sentMessages();
+    CHECK(!sent.empty());
+    for (Message& msg : sent) {
+        CHECK_EQUAL(UsbPro_Label::ChangeOfState, msg.label);
+        uint16_t start = msg.data[0] * 8;
+        uint8_t value = 6;
+        for (uint16_t i = 0; i < 40; i++) {
+            if (msg.data[1 + i / 8] & (1 << (i % 8))) {
+                CHECK(value < msg.data.size());
+                host[start + i] = msg.data[value++];
+            }
+        }
+        CHECK_EQUAL(msg.data.size(), value);
+    }
+    CHECK(!memcmp(host, expected, sizeof(host)));
+
+    // Nothing changed, nothing sent
+    Usb_UsbPro::queueBuffer(0, 3);
+    feed({});
+    CHECK(sentMessages().empty());
+}
+
+int main() {
+    testQueries();
+    testSendDmx();
+    testResync();
+    testReceiveAlways();
+    testReceiveOnChange();
+
+    return checkResult();
+}
@@ -0,0 +1,197 @@
+// The framed stream on the vendor interface: messages split at any point,
+// garbage in between, deltas that must not touch other channels and what the
+// device sends back
+
+#include "check.h"
+#include "host/host.h"
+
+#include "usb_vendor.h"
+
+#include <algorithm>
+
+extern DmxBuffer dmxBuffer;
+
+static std::vector<uint8_t> message(UsbVendor_MsgType type, uint8_t buffer, uint16_t offset, const std::vector<uint8_t>& payload) {
+    struct UsbVendor_Header header;
+    std::vector<uint8_t> result;
+
+    header.magic = USB_VENDOR_MAGIC;
+    header.type = type;
+    header.buffer = buffer;
+    header.flags = 0;
+    header.offset = offset;
+    header.length = payload.size();
+
+    result.assign((uint8_t*)&header, (uint8_t*)&header + sizeof(header));
+    result.insert(result.end(), payload.begin(), payload.end());
+    return result;
+}
+
+static std::vector<uint8_t> ramp(uint16_t size, uint8_t start) {
+    std::vector<uint8_t> result(size);
+
+    for (uint16_t i = 0; i < size; i++) {
+        result[i] = start + i;
+    }
+    return result;
+}
+
+// Hand the stream in pieces of pieceSize byte, one cyclicTask per piece
+static void feed(const std::vector<uint8_t>& stream, size_t pieceSize) {
+    for (size_t i = 0; i < stream.size(); i += pieceSize) {
+        hostUsbFeed(hostUsbVendor, stream.data() + i, std::min(pieceSize, stream.size() - i));
+        Usb_Vendor::cyclicTask();
+    }
+}
+
+static void reset() {
+    dmxBuffer.init();
+    Usb_Vendor::init();
+    hostUsbSent(hostUsbVendor).clear();
+}
+
+static void testFullFrame() {
+    std::vector<uint8_t> payload = ramp(100, 1);
+
+    reset();
+    dmxBuffer.setChannel(2, 300, 0x55);
+    feed(message(UsbVendor_MsgType::FullFrame, 2, 0, payload), 1000);
+
+    CHECK(!memcmp(dmxBuffer.buffer[2], payload.data(), payload.size()));
+    // The rest of the buffer is cleared
+    CHECK_EQUAL(0, dmxBuffer.buffer[2][300]);
+    CHECK_EQUAL(1, Usb_Vendor::stats.framesReceived);
+    CHECK_EQUAL(0, Usb_Vendor::stats.errors);
+}
+
+static void testDeltaOnlyTouchesItsRange() {
+    std::vector<uint8_t> stream;
+
+    reset();
+    feed(message(UsbVendor_MsgType::FullFrame, 4, 0, ramp(512, 0)), 1000);
+
+    // Somebody else writes to the same buffer, then deltas come in for
+    // two other ranges, also of other buffers in between
+    dmxBuffer.setChannel(4, 200, 0xaa);
+    stream = message(UsbVendor_MsgType::Delta, 4, 10, { 0xf0, 0xf1, 0xf2 });
+    std::vector<uint8_t> other = message(UsbVendor_MsgType::Delta, 5, 200, { 0x11 });
+    stream.insert(stream.end(), other.begin(), other.end());
+    other = message(UsbVendor_MsgType::Delta, 4, 509, { 0xe0, 0xe1, 0xe2 });
+    stream.insert(stream.end(), other.begin(), other.end());
+    feed(stream, 1000);
+
+    CHECK_EQUAL(9, dmxBuffer.buffer[4][9]);
+    CHECK_EQUAL(0xf0, dmxBuffer.buffer[4][10]);
+    CHECK_EQUAL(0xf2, dmxBuffer.buffer[4][12]);
+    CHECK_EQUAL(13, dmxBuffer.buffer[4][13]);
+    CHECK_EQUAL(0xaa, dmxBuffer.buffer[4][200]);
+    CHECK_EQUAL(0xe2, dmxBuffer.buffer[4][511]);
+    CHECK_EQUAL(0x11, dmxBuffer.buffer[5][200]);
+    CHECK_EQUAL(0, dmxBuffer.buffer[5][10]);
+    CHECK_EQUAL(3, Usb_Vendor::stats.deltasReceived);
+}
+
+// The same stream, split at every possible point, gives the same result
+static void testSplitAnywhere() {
+    std::vector<uint8_t> stream = message(UsbVendor_MsgType::FullFrame, 1, 0, ramp(70, 3));
+    std::vector<uint8_t> delta = message(UsbVendor_MsgType::Delta, 1, 60, ramp(20, 0x80));
+    uint8_t expected[512] = {};
+
+    stream.insert(stream.end(), delta.begin(), delta.end());
+    for (int i = 0; i < 70; i++) {
+        expected[i] = 3 + i;
+    }
+    for (int i = 0; i < 20; i++) {
+        expected[60 + i] = 0x80 + i;
+    }
+
+    for (size_t pieceSize = 1; pieceSize <= stream.size(); pieceSize++) {
+        reset();
+        feed(stream, pieceSize);
+        CHECK(!memcmp(dmxBuffer.buffer[1], expected, 512));
+        CHECK_EQUAL(1, Usb_Vendor::stats.framesReceived);
+        CHECK_EQUAL(1, Usb_Vendor::stats.deltasReceived);
+    }
+}
+
+static void testResync() {
+    std::vector<uint8_t> stream = { 0x00, 0x12, 0x34 };
+    std::vector<uint8_t> frame;
+
+    reset();
+    // Garbage, a delta past the end of the universe, a header for a buffer
+    // that doesn't exist, then a valid frame
+    frame = message(UsbVendor_MsgType::Delta, 0, 510, { 1, 2, 3 });
+    stream.insert(stream.end(), frame.begin(), frame.begin() + sizeof(struct UsbVendor_Header));
+    frame = message(UsbVendor_MsgType::FullFrame, DMXBUFFER_COUNT, 0, {});
+    stream.insert(stream.end(), frame.begin(), frame.end());
+    frame = message(UsbVendor_MsgType::FullFrame, 0, 0, { 7, 8, 9 });
+    stream.insert(stream.end(), frame.begin(), frame.end());
+    feed(stream, 5);
+
+    CHECK_EQUAL(7, dmxBuffer.buffer[0][0]);
+    CHECK_EQUAL(9, dmxBuffer.buffer[0][2]);
+    CHECK_EQUAL(1, Usb_Vendor::stats.framesReceived);
+    CHECK_EQUAL(0, Usb_Vendor::stats.deltasReceived);
+    CHECK(Usb_Vendor::stats.errors >= 5);
+}
+
+// Find the first message of that type in what the device sent
+static bool findSent(UsbVendor_MsgType type, struct UsbVendor_Header* header, std::vector<uint8_t>* payload) {
+    std::vector<uint8_t>& sent = hostUsbSent(hostUsbVendor);
+    size_t i = 0;
+
+    while (i + sizeof(struct UsbVendor_Header) <= sent.size()) {
+        memcpy(header, sent.data() + i, sizeof(struct UsbVendor_Header));
+        if (header->magic != USB_VENDOR_MAGIC) {
+            return false;
+        }
+        i += sizeof(struct UsbVendor_Header);
+        if (header->type == type) {
+            payload->assign(sent.begin() + i, sent.begin() + std::min(i + header->length, sent.size()));
+            return payload->size() == header->length;
+        }
+        i += header->length;
+    }
+    return false;
+}
+
+static void testTransmit() {
+    struct UsbVendor_Header header;
+    struct UsbVendor_Status status;
+    std::vector<uint8_t> payload;
+
+    reset();
+    hostSetTime(5000000);
+    feed(message(UsbVendor_MsgType::GetStatus, 0, 0, {}), 100);
+    CHECK(findSent(UsbVendor_MsgType::Status, &header, &payload));
+    CHECK_EQUAL(sizeof(status), payload.size());
+    memcpy(&status, payload.data(), sizeof(status));
+    CHECK_EQUAL(DMXBUFFER_COUNT, status.bufferCount);
+    CHECK_EQUAL(5000, status.uptime);
+
+    // Buffer 6 as universe 3, written in small pieces
+    dmxBuffer.setChannel(6, 511, 0x42);
+    hostUsbSent(hostUsbVendor).clear();
+    hostUsbSetWriteRoom(60);
+    Usb_Vendor::queueBuffer(3, 6);
+    for (int i = 0; i < 20; i++) {
+        Usb_Vendor::cyclicTask();
+    }
+    hostUsbSetWriteRoom(0xffffffff);
+    CHECK(findSent(UsbVendor_MsgType::FullFrame, &header, &payload));
+    CHECK_EQUAL(3, header.buffer);
+    CHECK_EQUAL(512, payload.size());
+    CHECK_EQUAL(0x42, payload[511]);
+    CHECK_EQUAL(1, Usb_Vendor::stats.framesSent);
+}
+
+int main() {
+    testFullFrame();
+    testDeltaOnlyTouchesItsRange();
+    testSplitAnywhere();
+    testResync();
+    testTransmit();
+
+    return checkResult();
+}
@@ -0,0 +1,339 @@
+// Bulk writes (POST /dmxBuffer/write.bin) with the body split at any point,
+// broken bodies and fades, down to the DmxBuffers and DmxFade
+
+#include "check.h"
+#include "host/host.h"
+
+#include "webpost.h"
+#include "dmxfade.h"
+
+#include <string>
+#include <vector>
+
+extern DmxBuffer dmxBuffer;
+
+// lwIP's connections and file states are just told apart by their address
+static int connections[WEBSERVER_POSTS + 1];
+static int resultFiles[WEBSERVER_POSTS + 1];
+
+static void addHeader(std::vector<uint8_t>* body, uint8_t version, uint16_t fadeTime) {
+    struct DmxWriteHeader header = { version, 0, fadeTime };
+
+    body->insert(body->end(), (uint8_t*)&header, (uint8_t*)&header + sizeof(header));
+}
+
+// Values are first, first + 1, ...
+static void addRecord(std::vector<uint8_t>* body, uint8_t bufferId, uint16_t offset, uint16_t count, uint8_t first) {
+    struct DmxWriteRecord record = { bufferId, 0, offset, count };
+
+    body->insert(body->end(), (uint8_t*)&record, (uint8_t*)&record + sizeof(record));
+    for (uint16_t i = 0; i < count; i++) {
+        body->push_back(first + i);
+    }
+}
+
+// One call of httpd_post_receive_data with a chain of pbufs of pieceSize
+// byte each
+static void receive(void* connection, const std::vector<uint8_t>& body, size_t from, size_t to, size_t pieceSize = 1460) {
+    struct pbuf* p = NULL;
+    struct pbuf* piece;
+    size_t size;
+
+    if (from >= to) {
+        return;
+    }
+    for (size_t i = from; i < to; i += size) {
+        size = std::min(pieceSize, to - i);
+        piece = pbuf_alloc(PBUF_RAW, size, PBUF_RAM);
+        memcpy(piece->payload, body.data() + i, size);
+        if (p) {
+            pbuf_cat(p, piece);
+        } else {
+            p = piece;
+        }
+    }
+    WebPost::receive(connection, p);
+}
+
+// result.json as lwIP opens, reads and closes it after the request
+static std::string result(void* resultFile) {
+    char buffer[256];
+    JsonWriter json(buffer, sizeof(buffer));
+
+    WebPost::openResult(resultFile);
+    WebPost::writeResult(&json, resultFile);
+    WebPost::closeResult(resultFile);
+
+    return std::string(buffer, json.length());
+}
+
+// The whole request, in two calls split at split
+static std::string post(const std::vector<uint8_t>& body, size_t split, size_t pieceSize = 1460) {
+    CHECK(WebPost::begin(&connections[0]));
+    receive(&connections[0], body, 0, split, pieceSize);
+    receive(&connections[0], body, split, body.size(), pieceSize);
+    WebPost::finish(&connections[0]);
+
+    return result(&resultFiles[0]);
+}
+
+static bool channelsAre(uint8_t bufferId, uint16_t offset, std::vector<uint8_t> values) {
+    return !memcmp(dmxBuffer.buffer[bufferId] + offset, values.data(), values.size());
+}
+
+static void testUri() {
+    CHECK(WebPost::isUri("/dmxBuffer/write.bin"));
+    CHECK(WebPost::isUri("/dmxBuffer/write.bin?fade=1"));
+    CHECK(!WebPost::isUri("/dmxBuffer/write.binary"));
+    CHECK(!WebPost::isUri("/dmxBuffer/write"));
+    CHECK(!WebPost::isUri("/config/set"));
+    CHECK(!WebPost::isUri(""));
+}
+
+static void testSplit() {
+    std::vector<uint8_t> body;
+    static const char expected[] = "{\"ok\":true,\"error\":null,\"records\":4,\"channels\":13,\"buffers\":2,\"fading\":0}";
+
+    addHeader(&body, DMXWRITE_VERSION, 0);
+    addRecord(&body, 1, 0, 5, 10);
+    addRecord(&body, 4, 510, 2, 200);
+    addRecord(&body, 1, 100, 0, 0);
+    addRecord(&body, 1, 300, 6, 50);
+
+    for (size_t split = 0; split <= body.size(); split++) {
+        for (size_t pieceSize : { (size_t)1, (size_t)3, (size_t)1460 }) {
+            dmxBuffer.init();
+            CHECK(post(body, split, pieceSize) == expected);
+
+            CHECK(channelsAre(1, 0, { 10, 11, 12, 13, 14, 0 }));
+            CHECK(channelsAre(1, 299, { 0, 50, 51, 52, 53, 54, 55, 0 }));
+            CHECK(channelsAre(4, 508, { 0, 0, 200, 201 }));
+            // Once per buffer, when the request is done
+            for (uint8_t i = 0; i < DMXBUFFER_COUNT; i++) {
+                CHECK_EQUAL(((i == 1) || (i == 4)) ? 1 : 0, hostPatchCount(i));
+            }
+        }
+    }
+}
+
+static void testErrors() {
+    std::vector<uint8_t> body;
+    std::vector<uint8_t> broken;
+    std::string answer;
+
+    addHeader(&body, DMXWRITE_VERSION, 0);
+    addRecord(&body, 1, 0, 5, 10);
+    addRecord(&body, 2, 20, 3, 30);
+
+    // Whatever made it in is patched. Cut after the header or a record's
+    // values, it's a shorter body
+    for (size_t size = 0; size < body.size(); size++) {
+        dmxBuffer.init();
+        answer = post(std::vector<uint8_t>(body.begin(), body.begin() + size), size / 2);
+        if ((size == 4) || (size == 15)) {
+            CHECK(answer.find("{\"ok\":true") == 0);
+        } else {
+            CHECK(answer.find("{\"ok\":false,\"error\":\"truncated\"") == 0);
+        }
+        CHECK_EQUAL((size >= 10) ? 1 : 0, hostPatchCount(1));
+        CHECK_EQUAL((size >= 21) ? 1 : 0, hostPatchCount(2));
+    }
+
+    dmxBuffer.init();
+    broken.clear();
+    addHeader(&broken, DMXWRITE_VERSION + 1, 0);
+    addRecord(&broken, 1, 0, 5, 10);
+    CHECK(post(broken, 3) == "{\"ok\":false,\"error\":\"version\",\"records\":0,\"channels\":0,\"buffers\":0,\"fading\":0}");
+    CHECK(channelsAre(1, 0, { 0, 0, 0, 0, 0 }));
+    CHECK_EQUAL(0, hostPatchCount(1));
+
+    // Nothing after a broken record is taken, what came before is
+    for (auto record : { std::vector<uint16_t>{ DMXBUFFER_COUNT, 0, 1 }, { 2, 512, 0 }, { 2, 500, 13 }, { 2, 0, 513 } }) {
+        dmxBuffer.init();
+        broken = body;
+        addRecord(&broken, record[0], record[1], record[2], 1);
+        addRecord(&broken, 3, 0, 1, 1);
+        CHECK(post(broken, broken.size() / 2) == "{\"ok\":false,\"error\":\"record\",\"records\":2,\"channels\":8,\"buffers\":2,\"fading\":0}");
+        CHECK(channelsAre(2, 20, { 30, 31, 32 }));
+        CHECK_EQUAL(1, hostPatchCount(2));
+        CHECK_EQUAL(0, hostPatchCount(3));
+        CHECK(channelsAre(3, 0, { 0 }));
+    }
+
+    // result.json without a POST before
+    char buffer[64];
+    JsonWriter json(buffer, sizeof(buffer));
+    WebPost::writeResult(&json, &resultFiles[1]);
+    CHECK(std::string(buffer, json.length()) == "{\"ok\":false,\"error\":\"noWrite\"}");
+}
+
+static void testSlots() {
+    std::vector<uint8_t> body;
+
+    addHeader(&body, DMXWRITE_VERSION, 0);
+    addRecord(&body, 0, 0, 1, 1);
+
+    for (uint8_t i = 0; i < WEBSERVER_POSTS; i++) {
+        CHECK(WebPost::begin(&connections[i]));
+    }
+    CHECK(!WebPost::begin(&connections[WEBSERVER_POSTS]));
+
+    // Taken until the result has been sent
+    receive(&connections[1], body, 0, body.size());
+    WebPost::finish(&connections[1]);
+    CHECK(!WebPost::begin(&connections[WEBSERVER_POSTS]));
+    CHECK(result(&resultFiles[1]).find("{\"ok\":true") == 0);
+    CHECK(WebPost::begin(&connections[WEBSERVER_POSTS]));
+
+    // Connections that are gone are taken over
+    CHECK(!WebPost::begin(&connections[1]));
+    hostAdvance((WEBSERVER_POST_TIMEOUT_MS + 1) * 1000ULL);
+    for (uint8_t i = 0; i < WEBSERVER_POSTS; i++) {
+        CHECK(WebPost::begin(&connections[i]));
+    }
+
+    // Leave them all free
+    for (uint8_t i = 0; i < WEBSERVER_POSTS; i++) {
+        WebPost::finish(&connections[i]);
+        CHECK(result(&resultFiles[i]).find("{\"ok\":false,\"error\":\"truncated\"") == 0);
+    }
+}
+
+static void step(uint32_t ms) {
+    hostAdvance(ms * 1000ULL);
+    DmxFade::cyclicTask();
+}
+
+static void testFade() {
+    std::vector<uint8_t> body;
+    uint32_t patches;
+
+    dmxBuffer.init();
+    DmxFade::init();
+    dmxBuffer.setChannel(2, 3, 200);
+
+    addHeader(&body, DMXWRITE_VERSION, 1000);
+    addRecord(&body, 2, 0, 4, 0);
+    body[sizeof(struct DmxWriteHeader) + sizeof(struct DmxWriteRecord) + 0] = 100;
+    body[sizeof(struct DmxWriteHeader) + sizeof(struct DmxWriteRecord) + 1] = 200;
+    body[sizeof(struct DmxWriteHeader) + sizeof(struct DmxWriteRecord) + 2] = 50;
+    body[sizeof(struct DmxWriteHeader) + sizeof(struct DmxWriteRecord) + 3] = 0;
+
+    CHECK(post(body, 5) == "{\"ok\":true,\"error\":null,\"records\":1,\"channels\":4,\"buffers\":1,\"fading\":1}");
+    CHECK(channelsAre(2, 0, { 0, 0, 0, 200 }));
+    patches = hostPatchCount(2);
+
+    step(500);
+    CHECK(channelsAre(2, 0, { 50, 100, 25, 100 }));
+    CHECK_EQUAL(patches + 1, hostPatchCount(2));
+
+    // Written some other way: That channel stops fading, the others go on
+    dmxBuffer.setChannel(2, 1, 7);
+    step(250);
+    CHECK(channelsAre(2, 0, { 75, 7, 37, 50 }));
+
+    step(300);
+    CHECK(channelsAre(2, 0, { 100, 7, 50, 0 }));
+    patches = hostPatchCount(2);
+    step(100);
+    CHECK_EQUAL(patches, hostPatchCount(2));
+}
+
+// A second request fading the same buffer while the first one is still
+// collecting its targets
+static void testOverlappingFades() {
+    std::vector<uint8_t> first;
+    std::vector<uint8_t> second;
+
+    dmxBuffer.init();
+    DmxFade::init();
+
+    addHeader(&first, DMXWRITE_VERSION, 1000);
+    addRecord(&first, 0, 0, 2, 10);
+    addHeader(&second, DMXWRITE_VERSION, 1000);
+    addRecord(&second, 0, 2, 2, 30);
+
+    CHECK(WebPost::begin(&connections[0]));
+    receive(&connections[0], first, 0, first.size() - 1);
+
+    // Written right away
+    CHECK(WebPost::begin(&connections[1]));
+    receive(&connections[1], second, 0, second.size());
+    WebPost::finish(&connections[1]);
+    CHECK(result(&resultFiles[1]) == "{\"ok\":true,\"error\":null,\"records\":1,\"channels\":2,\"buffers\":1,\"fading\":0}");
+    CHECK(channelsAre(0, 0, { 0, 0, 30, 31 }));
+
+    receive(&connections[0], first, first.size() - 1, first.size());
+    WebPost::finish(&connections[0]);
+    CHECK(result(&resultFiles[0]) == "{\"ok\":true,\"error\":null,\"records\":1,\"channels\":2,\"buffers\":1,\"fading\":1}");
+
+    step(1000);
+    CHECK(channelsAre(0, 0, { 10, 11, 30, 31 }));
+}
+
+static void testFadeSlots() {
+    static const uint8_t values[] = { 99, 98, 97, 96 };
+    static const uint8_t other[] = { 149 };
+    int a;
+    int b;
+
+    dmxBuffer.init();
+    DmxFade::init();
+
+    CHECK(!DmxFade::reserve(DMXBUFFER_COUNT, &a));
+    for (uint8_t i = 0; i < DMXFADE_SLOTS; i++) {
+        CHECK(DmxFade::reserve(i, &a));
+    }
+    CHECK(!DmxFade::reserve(DMXFADE_SLOTS, &a));
+
+    // Only one owner at a time
+    CHECK(!DmxFade::reserve(0, &b));
+    CHECK(!DmxFade::setTarget(0, &b, 0, values, 1));
+    CHECK(!DmxFade::start(0, &b, 100));
+    CHECK(DmxFade::setTarget(0, &a, 0, values, 1));
+    CHECK(!DmxFade::setTarget(5, &a, 0, values, 1));
+
+    // Reservations that never got started are taken over, without their
+    // targets. The one that had it is told
+    hostAdvance((DMXFADE_RESERVE_TIMEOUT_MS + 1) * 1000ULL);
+    CHECK(DmxFade::reserve(0, &b));
+    CHECK(DmxFade::reserve(DMXFADE_SLOTS, &b));
+    CHECK(!DmxFade::setTarget(0, &a, 0, values, 1));
+    CHECK(!DmxFade::start(0, &a, 100));
+    CHECK(DmxFade::setTarget(0, &b, 510, values, 4));
+    CHECK(DmxFade::start(0, &b, 100));
+    step(100);
+    CHECK(channelsAre(0, 0, { 0 }));
+    CHECK(channelsAre(0, 508, { 0, 0, 99, 98 }));
+
+    // Running: Reserved again, it stops where it is and goes on from there
+    DmxFade::init();
+    CHECK(DmxFade::reserve(1, &a));
+    CHECK(DmxFade::setTarget(1, &a, 0, values, 2));
+    CHECK(DmxFade::start(1, &a, 1000));
+    step(500);
+    CHECK(channelsAre(1, 0, { 49, 49 }));
+    CHECK(DmxFade::reserve(1, &b));
+    CHECK(DmxFade::setTarget(1, &b, 1, other, 1));
+    step(100);
+    CHECK(channelsAre(1, 0, { 49, 49 }));
+    CHECK(DmxFade::start(1, &b, 1000));
+    step(500);
+    CHECK(channelsAre(1, 0, { 74, 99 }));
+    step(500);
+    CHECK(channelsAre(1, 0, { 99, 149 }));
+}
+
+int main() {
+    hostSetTime(1000000);
+
+    testUri();
+    testSplit();
+    testErrors();
+    testSlots();
+    testFade();
+    testOverlappingFades();
+    testFadeSlots();
+
+    return checkResult();
+}
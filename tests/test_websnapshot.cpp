@@ -0,0 +1,273 @@
+// Snapshots (/dmxBuffer/snapshot.bin) read the way lwIP's httpd reads custom
+// files: opened after the CGI handler took the parameters, then read in
+// pieces of whatever size it has room for until FS_READ_EOF
+
+#include "check.h"
+#include "host/host.h"
+
+#include "websnapshot.h"
+
+#include <string>
+#include <vector>
+
+extern DmxBuffer dmxBuffer;
+
+static_assert(sizeof(struct DmxSnapshotHeader) == 8);
+static_assert(sizeof(struct DmxSnapshotRecord) == 8);
+
+// Different values per buffer and write
+static void write(uint8_t bufferId, uint8_t seed) {
+    uint8_t values[512];
+
+    for (uint16_t i = 0; i < 512; i++) {
+        values[i] = bufferId * 31 + seed + i;
+    }
+    dmxBuffer.setBuffer(bufferId, values, 512);
+}
+
+// What cgi_dmxBuffer_snapshot gets from lwIP
+static void setParams(const std::vector<std::pair<std::string, std::string>>& params) {
+    std::vector<std::string> text;
+    std::vector<char*> names;
+    std::vector<char*> values;
+
+    for (const auto& param : params) {
+        text.push_back(param.first);
+        text.push_back(param.second);
+    }
+    for (size_t i = 0; i < text.size(); i += 2) {
+        names.push_back(text[i].data());
+        values.push_back(text[i + 1].data());
+    }
+    WebSnapshot::setParams(names.size(), names.data(), values.data());
+}
+
+static void put16(std::string* out, uint16_t value) {
+    out->push_back(value & 0xff);
+    out->push_back(value >> 8);
+}
+
+static void put32(std::string* out, uint32_t value) {
+    put16(out, value & 0xffff);
+    put16(out, value >> 16);
+}
+
+// The body as documented in websnapshot.h, byte by byte
+static std::string expectedBody(const std::vector<uint8_t>& bufferIds, uint32_t sequence) {
+    std::string body;
+
+    body.push_back(DMXSNAPSHOT_VERSION);
+    body.push_back(bufferIds.size());
+    put16(&body, 8 + 512);
+    put32(&body, sequence);
+    for (uint8_t bufferId : bufferIds) {
+        body.push_back(bufferId);
+        body.append(3, '\0');
+        put32(&body, DmxBuffer::sequence[bufferId]);
+        body.append((const char*)DmxBuffer::buffer[bufferId], 512);
+    }
+    return body;
+}
+
+// Reads with the sizes in counts, the last one repeated, until FS_READ_EOF
+static std::string readAll(struct fs_file* file, const std::vector<int>& counts) {
+    std::string data;
+    char buffer[6000];
+    size_t call = 0;
+    int count;
+    int read;
+
+    while (true) {
+        count = counts[MIN(call, counts.size() - 1)];
+        call++;
+        read = WebSnapshot::read(file, buffer, count);
+        if (read == FS_READ_EOF) {
+            break;
+        }
+        CHECK(read > 0);
+        CHECK(read <= count);
+        if (read <= 0) {
+            break;
+        }
+        data.append(buffer, read);
+    }
+    return data;
+}
+
+// Splits off the HTTP header and checks it
+static std::string body(const std::string& data) {
+    size_t end = data.find("\r\n\r\n");
+    std::string header;
+    std::string length;
+
+    CHECK(end != std::string::npos);
+    if (end == std::string::npos) {
+        return "";
+    }
+    header = data.substr(0, end + 4);
+    CHECK_EQUAL(0, header.find("HTTP/1.1 200 OK\r\n"));
+    CHECK(header.find("Content-Type: application/octet-stream\r\n") != std::string::npos);
+    length = "Content-Length: " + std::to_string(data.size() - header.size()) + "\r\n";
+    CHECK(header.find(length) != std::string::npos);
+    return data.substr(header.size());
+}
+
+static std::string snapshot(const std::vector<int>& counts = { 2048 }) {
+    struct fs_file file = {};
+    std::string data;
+
+    CHECK_EQUAL(1, WebSnapshot::open(&file));
+    CHECK_EQUAL(FS_FILE_FLAG_HTTP_HEADER_INCLUDED | FS_FILE_FLAG_HTTP_HEADER_PERSISTENT | FS_FILE_FLAG_HTTP_HEADER_11, file.flags);
+    data = readAll(&file, counts);
+    CHECK_EQUAL((size_t)file.len, data.size());
+    WebSnapshot::close(&file);
+    CHECK(file.pextension == nullptr);
+    return body(data);
+}
+
+static void testLayout() {
+    dmxBuffer.init();
+    write(0, 1);
+    write(3, 2);
+    write(7, 3);
+
+    // Without parameters: all buffers ever written
+    setParams({});
+    CHECK(snapshot() == expectedBody({ 0, 3, 7 }, 3));
+
+    // Nothing written at all is just the header
+    dmxBuffer.init();
+    setParams({});
+    CHECK(snapshot() == expectedBody({}, 0));
+}
+
+static void testFilters() {
+    uint32_t since;
+
+    dmxBuffer.init();
+    write(0, 1);
+    write(3, 2);
+    write(5, 3);
+    since = DmxBuffer::lastSequence;
+    write(3, 4);
+    write(9, 5);
+
+    setParams({ { "since", std::to_string(since) } });
+    CHECK(snapshot() == expectedBody({ 3, 9 }, 5));
+
+    // Written exactly at since is not newer
+    setParams({ { "since", std::to_string(since - 1) } });
+    CHECK(snapshot() == expectedBody({ 3, 5, 9 }, 5));
+
+    // Commas might be encoded, ids that don't exist are ignored
+    setParams({ { "buffers", "5%2C0,99,9" } });
+    CHECK(snapshot() == expectedBody({ 0, 5, 9 }, 5));
+    setParams({ { "buffers", "0,3,5" }, { "since", std::to_string(since) } });
+    CHECK(snapshot() == expectedBody({ 3 }, 5));
+    setParams({ { "buffers", "" } });
+    CHECK(snapshot() == expectedBody({}, 5));
+
+    // The parameters are for one snapshot only
+    CHECK(snapshot() == expectedBody({ 0, 3, 5, 9 }, 5));
+}
+
+// Wherever a read ends, in the HTTP header, the snapshot header, a record
+// header or the data, the next one continues there
+static void testSplitReads() {
+    std::string whole;
+    std::vector<uint8_t> bufferIds;
+    std::vector<int> counts;
+
+    dmxBuffer.init();
+    for (uint8_t i = 0; i < DMXBUFFER_COUNT; i += 2) {
+        write(i, i + 7);
+        bufferIds.push_back(i);
+    }
+
+    setParams({});
+    whole = snapshot();
+    CHECK(whole == expectedBody(bufferIds, bufferIds.size()));
+
+    for (int count : { 1, 2, 3, 7, 8, 9, 519, 520, 521, 1460, 5999 }) {
+        setParams({});
+        CHECK(snapshot({ count }) == whole);
+    }
+
+    // Every offset in the first records is the start of a read once
+    for (int first = 1; first < 700; first++) {
+        setParams({});
+        CHECK(snapshot({ first, 13, 5, 1024 }) == whole);
+    }
+
+    for (int i = 0; i < 200; i++) {
+        counts.push_back(1 + (i * 37) % 600);
+    }
+    setParams({});
+    CHECK(snapshot(counts) == whole);
+}
+
+// The data is read while sending, so the record has the sequence of what is
+// sent, which may be newer than the header's
+static void testLiveData() {
+    struct fs_file file = {};
+    std::string data;
+    uint32_t sequence;
+    char buffer[2048];
+    int read;
+
+    dmxBuffer.init();
+    write(1, 1);
+    sequence = DmxBuffer::lastSequence;
+
+    setParams({});
+    CHECK_EQUAL(1, WebSnapshot::open(&file));
+    read = WebSnapshot::read(&file, buffer, 10);
+    data.append(buffer, read);
+    write(1, 2);
+    data += readAll(&file, { 2048 });
+    WebSnapshot::close(&file);
+
+    CHECK(body(data) == expectedBody({ 1 }, sequence));
+    CHECK_EQUAL(sequence + 1, DmxBuffer::sequence[1]);
+
+    // Reading past the end or a closed file
+    CHECK_EQUAL(FS_READ_EOF, WebSnapshot::read(&file, buffer, sizeof(buffer)));
+}
+
+static void testSlots() {
+    struct fs_file files[WEBSERVER_SNAPSHOTS + 1] = {};
+    char buffer[16];
+
+    dmxBuffer.init();
+    write(2, 1);
+
+    for (uint8_t i = 0; i < WEBSERVER_SNAPSHOTS; i++) {
+        CHECK_EQUAL(1, WebSnapshot::open(&files[i]));
+    }
+    CHECK_EQUAL(0, WebSnapshot::open(&files[WEBSERVER_SNAPSHOTS]));
+    CHECK_EQUAL(FS_READ_EOF, WebSnapshot::read(&files[WEBSERVER_SNAPSHOTS], buffer, sizeof(buffer)));
+    WebSnapshot::close(&files[WEBSERVER_SNAPSHOTS]);
+
+    // The others are independent of each other
+    CHECK_EQUAL(16, WebSnapshot::read(&files[1], buffer, sizeof(buffer)));
+    CHECK_EQUAL(0, files[0].index);
+    CHECK_EQUAL(16, files[1].index);
+
+    WebSnapshot::close(&files[1]);
+    CHECK_EQUAL(1, WebSnapshot::open(&files[WEBSERVER_SNAPSHOTS]));
+    for (uint8_t i = 0; i <= WEBSERVER_SNAPSHOTS; i++) {
+        WebSnapshot::close(&files[i]);
+    }
+    setParams({});
+    CHECK(snapshot() == expectedBody({ 2 }, 1));
+}
+
+int main() {
+    testLayout();
+    testFilters();
+    testSplitReads();
+    testLiveData();
+    testSlots();
+
+    return checkResult();
+}
@@ -0,0 +1,412 @@
+// The WebSocket server against the handshakes browsers really send, frames
+// split at any point and what the pushes look like for the client
+
+#include "check.h"
+#include "host/host.h"
+
+#include "sha1.h"
+#include "websocket.h"
+
+#include "lwip/tcp.h"
+
+#include <string>
+
+extern DmxBuffer dmxBuffer;
+
+// Example from RFC 6455, section 1.3
+static const char rfcKey[] = "dGhlIHNhbXBsZSBub25jZQ==";
+static const char rfcAccept[] = "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=";
+
+// What Firefox sends for new WebSocket("ws://dmxsun.local:81/?buffers=0,2&rate=40"),
+// about 520 byte without any cookies
+static std::string firefoxHandshake(const std::string& cookie = "") {
+    std::string request =
+        "GET /?buffers=0,2&rate=40 HTTP/1.1\r\n"
+        "Host: dmxsun.local:81\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:131.0) Gecko/20100101 Firefox/131.0\r\n"
+        "Accept: */*\r\n"
+        "Accept-Language: en-US,en;q=0.5\r\n"
+        "Accept-Encoding: gzip, deflate\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Origin: http://dmxsun.local\r\n"
+        "Sec-WebSocket-Extensions: permessage-deflate\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+        "DNT: 1\r\n"
+        "Connection: keep-alive, Upgrade\r\n";
+    if (!cookie.empty()) {
+        request += "Cookie: " + cookie + "\r\n";
+    }
+    request +=
+        "Sec-Fetch-Dest: empty\r\n"
+        "Sec-Fetch-Mode: websocket\r\n"
+        "Sec-Fetch-Site: same-site\r\n"
+        "Pragma: no-cache\r\n"
+        "Cache-Control: no-cache\r\n"
+        "Upgrade: websocket\r\n"
+        "\r\n";
+    return request;
+}
+
+static std::string digestHex(const std::string& data) {
+    uint8_t digest[SHA1_DIGEST_SIZE];
+    char hex[2 * SHA1_DIGEST_SIZE + 1];
+
+    sha1((const uint8_t*)data.data(), data.size(), digest);
+    for (uint8_t i = 0; i < SHA1_DIGEST_SIZE; i++) {
+        sprintf(hex + 2 * i, "%02x", digest[i]);
+    }
+    return hex;
+}
+
+// Frames are masked by the client, with a different mask every time
+static std::string clientFrame(uint8_t opcode, const std::string& payload, uint32_t mask) {
+    std::string frame;
+    uint8_t maskBytes[4] = { (uint8_t)(mask >> 24), (uint8_t)(mask >> 16), (uint8_t)(mask >> 8), (uint8_t)mask };
+
+    frame += (char)(0x80 | opcode);
+    if (payload.size() < 126) {
+        frame += (char)(0x80 | payload.size());
+    } else {
+        frame += (char)(0x80 | 126);
+        frame += (char)(payload.size() >> 8);
+        frame += (char)(payload.size() & 0xff);
+    }
+    frame.append((const char*)maskBytes, 4);
+    for (size_t i = 0; i < payload.size(); i++) {
+        frame += (char)(payload[i] ^ maskBytes[i % 4]);
+    }
+    return frame;
+}
+
+struct ServerFrame {
+    uint8_t opcode;
+    std::string payload;
+};
+
+// Everything the server sent after the handshake response, which is
+// removed from sent. Server frames are neither masked nor fragmented
+static std::vector<ServerFrame> serverFrames(std::vector<uint8_t>& sent) {
+    std::vector<ServerFrame> frames;
+    size_t offset = 0;
+    size_t length;
+    size_t header;
+
+    while (offset + 2 <= sent.size()) {
+        CHECK_EQUAL(0x80, sent[offset] & 0xf0);
+        CHECK_EQUAL(0, sent[offset + 1] & 0x80);
+        length = sent[offset + 1];
+        header = 2;
+        if (length == 126) {
+            length = (sent[offset + 2] << 8) | sent[offset + 3];
+            header = 4;
+        }
+        if (offset + header + length > sent.size()) {
+            break;
+        }
+        frames.push_back({ (uint8_t)(sent[offset] & 0x0f),
+            std::string((const char*)sent.data() + offset + header, length) });
+        offset += header + length;
+    }
+    CHECK_EQUAL(sent.size(), offset);
+    sent.clear();
+
+    return frames;
+}
+
+// Applies a DmxDataDelta to what the client knows about a buffer
+static void applyDelta(const std::string& payload, uint8_t views[DMXBUFFER_COUNT][512]) {
+    const uint8_t* data = (const uint8_t*)payload.data();
+    size_t offset = 2;
+    uint16_t start;
+    uint8_t length;
+
+    CHECK(payload.size() >= 2);
+    CHECK_EQUAL(Edp_Commands::DmxDataDelta, data[0]);
+    CHECK(data[1] < DMXBUFFER_COUNT);
+
+    while (offset + 3 <= payload.size()) {
+        start = data[offset] | (data[offset + 1] << 8);
+        length = data[offset + 2];
+        if (length == 0) {
+            break;
+        }
+        CHECK(start + length <= 512);
+        CHECK(offset + 3 + length <= payload.size());
+        memcpy(views[data[1]] + start, data + offset + 3, length);
+        offset += 3 + length;
+    }
+}
+
+// Lets time pass and the server push, what the client got ends up in views
+static void push(struct tcp_pcb* pcb, uint8_t views[DMXBUFFER_COUNT][512]) {
+    hostAdvance(100 * 1000);
+    WebSocket::cyclicTask();
+    for (auto& frame : serverFrames(hostTcpSent(pcb))) {
+        CHECK_EQUAL(WS_OPCODE_BINARY, frame.opcode);
+        applyDelta(frame.payload, views);
+    }
+    hostTcpAck(pcb);
+}
+
+// Checks the 101 response and removes it from what was sent
+static bool upgraded(struct tcp_pcb* pcb) {
+    std::vector<uint8_t>& sent = hostTcpSent(pcb);
+    std::string text(sent.begin(), sent.end());
+    size_t end = text.find("\r\n\r\n");
+
+    if ((end == std::string::npos) || (text.compare(0, 13, "HTTP/1.1 101 ") != 0) ||
+        (text.find(std::string("\r\nSec-WebSocket-Accept: ") + rfcAccept + "\r\n") == std::string::npos)) {
+        return false;
+    }
+    sent.erase(sent.begin(), sent.begin() + end + 4);
+    return true;
+}
+
+static void disconnect(struct tcp_pcb* pcb) {
+    if (!pcb->closed) {
+        hostTcpFeed(pcb, NULL, 0);
+    }
+    CHECK(pcb->closed);
+}
+
+static void testSha1() {
+    std::string data;
+
+    // FIPS 180 examples
+    CHECK(digestHex("") == "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+    CHECK(digestHex("abc") == "a9993e364706816aba3e25717850c26c9cd0d89d");
+    CHECK(digestHex("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq") == "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+    CHECK(digestHex(std::string(1000000, 'a')) == "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+
+    // Around the block size, where the padding needs an extra block or not
+    static const struct {
+        size_t size;
+        const char* digest;
+    } sizes[] = {
+        { 55, "aecd1643c9903b9bae8cb94f53c50f8a4e18605b" },
+        { 56, "f5d65c621c02cc8e785159feff8088e3072da1bc" },
+        { 63, "4952f0fe097e4d6410ae9eab4855aa836caf3bff" },
+        { 64, "1e17ae1fc093e5daca033553c97a5192ca164486" },
+        { 65, "ac44f5dbe3e9b5d2733fc9537fcad715c3c20bc3" },
+        { 119, "b4a4e69060d0b1e7e8ebbf7041a4211c63438b57" },
+        { 120, "b651390c2996406336a3f6647e4b590c18cdd6f8" },
+    };
+    for (const auto& size : sizes) {
+        data.clear();
+        for (size_t i = 0; i < size.size; i++) {
+            data += (char)(i * 7);
+        }
+        CHECK(digestHex(data) == size.digest);
+    }
+}
+
+static void testHandshake() {
+    static uint8_t views[DMXBUFFER_COUNT][512];
+    std::string cookie;
+    struct tcp_pcb* pcb;
+
+    for (int i = 0; i < 40; i++) {
+        cookie += "session" + std::to_string(i) + "=0123456789abcdef0123456789abcdef; ";
+    }
+
+    dmxBuffer.init();
+    for (uint16_t i = 0; i < 512; i++) {
+        dmxBuffer.setChannel(2, i, i * 3);
+    }
+    dmxBuffer.setChannel(1, 7, 0x77);
+
+    // Larger than the frame buffer, also with a cookie that is larger on its own
+    CHECK(firefoxHandshake().size() > WEBSOCKET_REQUEST_SIZE);
+    for (const std::string& request : { firefoxHandshake(), firefoxHandshake(cookie) }) {
+        // In two parts, split anywhere, each of them in a chain of pbufs
+        for (size_t split = 0; split <= request.size(); split++) {
+            pcb = hostTcpConnect(WEBSOCKET_PORT);
+            CHECK(pcb != NULL);
+            if (pcb == NULL) {
+                return;
+            }
+            if (split) {
+                CHECK_EQUAL(ERR_OK, hostTcpFeed(pcb, request.data(), split, 1 + split % 97));
+            }
+            if (split < request.size()) {
+                CHECK(hostTcpSent(pcb).empty());
+                CHECK_EQUAL(ERR_OK, hostTcpFeed(pcb, request.data() + split, request.size() - split, 1 + split % 89));
+            }
+            CHECK_EQUAL(request.size(), pcb->recved);
+            CHECK(!pcb->closed);
+            CHECK(upgraded(pcb));
+
+            // Subscribed to 0 and 2 from the URL, 0 is all zero
+            memset(views, 0x00, sizeof(views));
+            push(pcb, views);
+            CHECK(!memcmp(views[2], dmxBuffer.buffer[2], 512));
+            CHECK_EQUAL(0, views[1][7]);
+
+            disconnect(pcb);
+        }
+    }
+}
+
+static void testBadHandshakes() {
+    struct tcp_pcb* pcb;
+    std::string request;
+
+    // Not for us
+    pcb = hostTcpConnect(WEBSOCKET_PORT);
+    request = "POST / HTTP/1.1\r\nUpgrade: websocket\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+    hostTcpFeed(pcb, request.data(), request.size());
+    CHECK(pcb->closed);
+    CHECK(hostTcpSent(pcb).empty());
+
+    // A plain HTTP request
+    pcb = hostTcpConnect(WEBSOCKET_PORT);
+    request = firefoxHandshake();
+    request.replace(request.find("Upgrade: websocket"), 18, "Upgrade: h2c");
+    hostTcpFeed(pcb, request.data(), request.size());
+    CHECK(pcb->closed);
+    CHECK(std::string(hostTcpSent(pcb).begin(), hostTcpSent(pcb).end()).starts_with("HTTP/1.1 400 "));
+
+    // Key too long to be one
+    pcb = hostTcpConnect(WEBSOCKET_PORT);
+    request = firefoxHandshake();
+    request.replace(request.find(rfcKey), strlen(rfcKey), std::string(WEBSOCKET_KEY_SIZE + 1, 'k'));
+    hostTcpFeed(pcb, request.data(), request.size());
+    CHECK(pcb->closed);
+    CHECK(std::string(hostTcpSent(pcb).begin(), hostTcpSent(pcb).end()).starts_with("HTTP/1.1 400 "));
+
+    // Headers that never end
+    pcb = hostTcpConnect(WEBSOCKET_PORT);
+    request = "GET / HTTP/1.1\r\n";
+    hostTcpFeed(pcb, request.data(), request.size());
+    request = "X-Padding: " + std::string(1000, 'x') + "\r\n";
+    for (int i = 0; !pcb->closed && (i < 100); i++) {
+        hostTcpFeed(pcb, request.data(), request.size());
+    }
+    CHECK(pcb->closed);
+    CHECK(pcb->recved <= WEBSOCKET_HANDSHAKE_MAX_SIZE + request.size());
+
+    // Or take too long
+    pcb = hostTcpConnect(WEBSOCKET_PORT);
+    hostTcpFeed(pcb, "GET", 3);
+    hostAdvance(WEBSOCKET_HANDSHAKE_TIMEOUT_MS * 1000 / 2);
+    hostTcpPoll(pcb);
+    CHECK(!pcb->closed);
+    hostAdvance(WEBSOCKET_HANDSHAKE_TIMEOUT_MS * 1000);
+    hostTcpPoll(pcb);
+    CHECK(pcb->closed);
+
+    // All slots are free again
+    struct tcp_pcb* pcbs[WEBSOCKET_MAX_CLIENTS];
+    for (int i = 0; i < WEBSOCKET_MAX_CLIENTS; i++) {
+        pcbs[i] = hostTcpConnect(WEBSOCKET_PORT);
+        CHECK(pcbs[i] != NULL);
+    }
+    CHECK(hostTcpConnect(WEBSOCKET_PORT) == NULL);
+    for (int i = 0; i < WEBSOCKET_MAX_CLIENTS; i++) {
+        if (pcbs[i] != NULL) {
+            disconnect(pcbs[i]);
+        }
+    }
+}
+
+static void testFrames() {
+    static uint8_t views[DMXBUFFER_COUNT][512];
+    struct tcp_pcb* pcb;
+    std::vector<ServerFrame> frames;
+    std::string data;
+    std::string subscribe = clientFrame(WS_OPCODE_TEXT, "buffers=1,3&rate=44", 0x12345678);
+    std::string ping = clientFrame(WS_OPCODE_PING, "are you there?", 0xa5c30ff0);
+
+    dmxBuffer.init();
+    dmxBuffer.setChannel(1, 100, 0x11);
+    dmxBuffer.setChannel(3, 511, 0x33);
+
+    // The first frames come with the end of the handshake, then split anywhere
+    for (size_t split = 0; split <= (subscribe.size() + ping.size()); split++) {
+        pcb = hostTcpConnect(WEBSOCKET_PORT);
+        data = firefoxHandshake() + subscribe.substr(0, split);
+        CHECK_EQUAL(ERR_OK, hostTcpFeed(pcb, data.data(), data.size()));
+        CHECK(upgraded(pcb));
+        data = subscribe.substr(MIN(split, subscribe.size()));
+        data += ping.substr(0, (split > subscribe.size()) ? (split - subscribe.size()) : 0);
+        if (!data.empty()) {
+            CHECK_EQUAL(ERR_OK, hostTcpFeed(pcb, data.data(), data.size(), 3));
+        }
+        data = ping.substr((split > subscribe.size()) ? (split - subscribe.size()) : 0);
+        if (!data.empty()) {
+            CHECK_EQUAL(ERR_OK, hostTcpFeed(pcb, data.data(), data.size(), 5));
+        }
+
+        frames = serverFrames(hostTcpSent(pcb));
+        CHECK_EQUAL(1, frames.size());
+        if (frames.size() == 1) {
+            CHECK_EQUAL(WS_OPCODE_PONG, frames[0].opcode);
+            CHECK(frames[0].payload == "are you there?");
+        }
+
+        // Only the buffers of the text message now
+        memset(views, 0x00, sizeof(views));
+        push(pcb, views);
+        CHECK_EQUAL(0x11, views[1][100]);
+        CHECK_EQUAL(0x33, views[3][511]);
+
+        // And only what changed after that
+        dmxBuffer.setChannel(1, 101, 0x12);
+        dmxBuffer.setChannel(2, 0, 0x22);
+        memset(views, 0x00, sizeof(views));
+        push(pcb, views);
+        CHECK_EQUAL(0, views[1][100]);
+        CHECK_EQUAL(0x12, views[1][101]);
+        CHECK_EQUAL(0, views[2][0]);
+        dmxBuffer.setChannel(1, 101, 0x00);
+        dmxBuffer.setChannel(2, 0, 0x00);
+        push(pcb, views);
+
+        // Closing is echoed
+        data = clientFrame(WS_OPCODE_CLOSE, "\x03\xe8", 0x01020304);
+        hostTcpFeed(pcb, data.data(), data.size());
+        CHECK(pcb->closed);
+        frames = serverFrames(hostTcpSent(pcb));
+        CHECK_EQUAL(1, frames.size());
+        if (frames.size() == 1) {
+            CHECK_EQUAL(WS_OPCODE_CLOSE, frames[0].opcode);
+            CHECK(frames[0].payload == "\x03\xe8");
+        }
+    }
+
+    // Unmasked frames aren't allowed from clients
+    pcb = hostTcpConnect(WEBSOCKET_PORT);
+    data = firefoxHandshake();
+    hostTcpFeed(pcb, data.data(), data.size());
+    CHECK(upgraded(pcb));
+    data = clientFrame(WS_OPCODE_TEXT, "rate=1", 0);
+    data[1] &= 0x7f;
+    data.erase(2, 4);
+    hostTcpFeed(pcb, data.data(), data.size());
+    CHECK(pcb->closed);
+
+    // Longer ones with the 16 bit length
+    pcb = hostTcpConnect(WEBSOCKET_PORT);
+    data = firefoxHandshake();
+    hostTcpFeed(pcb, data.data(), data.size());
+    CHECK(upgraded(pcb));
+    data = clientFrame(WS_OPCODE_PING, std::string(300, 'p'), 0xdeadbeef);
+    hostTcpFeed(pcb, data.data(), data.size(), 7);
+    frames = serverFrames(hostTcpSent(pcb));
+    CHECK_EQUAL(1, frames.size());
+    if (frames.size() == 1) {
+        CHECK(frames[0].payload == std::string(300, 'p'));
+    }
+    disconnect(pcb);
+}
+
+int main() {
+    WebSocket::init();
+
+    testSha1();
+    testHandshake();
+    testBadHandshakes();
+    testFrames();
+
+    return checkResult();
+}
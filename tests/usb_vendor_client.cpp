@@ -0,0 +1,279 @@
+// Reference client for the vendor interface protocol (see src/usb_vendor.h),
+// using libusb. Not a test, but built with them since it shares the code:
+//
+//   usb_vendor_client [-d vid:pid] status
+//   usb_vendor_client [-d vid:pid] frame <buffer> <value> [<value> ...]
+//   usb_vendor_client [-d vid:pid] delta <buffer> <offset> <value> [<value> ...]
+//   usb_vendor_client [-d vid:pid] monitor
+//   usb_vendor_client [-d vid:pid] bench <buffer> <seconds>
+//
+// Values are channel values starting at channel 0 (frame) or offset (delta).
+// bench sends full frames as fast as the device takes them
+
+#include "usb_vendor.h"
+
+#include <libusb.h>
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#define DEFAULT_VID 0x1209
+#define DEFAULT_PID 0xaceb
+#define TIMEOUT_MS 1000
+
+struct Device {
+    libusb_device_handle* handle;
+    int interface;
+    uint8_t endpointOut;
+    uint8_t endpointIn;
+};
+
+// The vendor interface is the one with class 0xff and two bulk endpoints
+static bool findInterface(Device* device) {
+    libusb_config_descriptor* config;
+    bool found = false;
+
+    if (libusb_get_active_config_descriptor(libusb_get_device(device->handle), &config) != 0) {
+        return false;
+    }
+
+    for (int i = 0; (i < config->bNumInterfaces) && !found; i++) {
+        const libusb_interface_descriptor* itf = &config->interface[i].altsetting[0];
+        if (itf->bInterfaceClass != LIBUSB_CLASS_VENDOR_SPEC) {
+            continue;
+        }
+        device->endpointOut = 0;
+        device->endpointIn = 0;
+        for (int j = 0; j < itf->bNumEndpoints; j++) {
+            const libusb_endpoint_descriptor* ep = &itf->endpoint[j];
+            if ((ep->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK) != LIBUSB_TRANSFER_TYPE_BULK) {
+                continue;
+            }
+            if (ep->bEndpointAddress & LIBUSB_ENDPOINT_IN) {
+                device->endpointIn = ep->bEndpointAddress;
+            } else {
+                device->endpointOut = ep->bEndpointAddress;
+            }
+        }
+        if (device->endpointOut && device->endpointIn) {
+            device->interface = itf->bInterfaceNumber;
+            found = true;
+        }
+    }
+
+    libusb_free_config_descriptor(config);
+    return found;
+}
+
+static bool sendMessage(Device* device, UsbVendor_MsgType type, uint8_t buffer, uint16_t offset, const std::vector<uint8_t>& payload) {
+    std::vector<uint8_t> message(sizeof(struct UsbVendor_Header) + payload.size());
+    struct UsbVendor_Header header;
+    int transferred;
+
+    header.magic = USB_VENDOR_MAGIC;
+    header.type = type;
+    header.buffer = buffer;
+    header.flags = 0;
+    header.offset = offset;
+    header.length = payload.size();
+    memcpy(message.data(), &header, sizeof(header));
+    if (!payload.empty()) {
+        memcpy(message.data() + sizeof(header), payload.data(), payload.size());
+    }
+
+    if (libusb_bulk_transfer(device->handle, device->endpointOut, message.data(), message.size(), &transferred, TIMEOUT_MS) != 0) {
+        return false;
+    }
+    return transferred == (int)message.size();
+}
+
+// Collects what comes in until one complete message is there. Skips
+// everything until the magic, like the device does
+class Reader {
+  public:
+    bool next(Device* device, struct UsbVendor_Header* header, std::vector<uint8_t>* payload, int timeoutMs) {
+        uint8_t packet[512];
+        int transferred;
+
+        while (true) {
+            while (!pending.empty() && (pending[0] != USB_VENDOR_MAGIC)) {
+                pending.erase(pending.begin());
+            }
+            if (pending.size() >= sizeof(struct UsbVendor_Header)) {
+                memcpy(header, pending.data(), sizeof(struct UsbVendor_Header));
+                if (pending.size() >= sizeof(struct UsbVendor_Header) + header->length) {
+                    payload->assign(pending.begin() + sizeof(struct UsbVendor_Header),
+                                    pending.begin() + sizeof(struct UsbVendor_Header) + header->length);
+                    pending.erase(pending.begin(), pending.begin() + sizeof(struct UsbVendor_Header) + header->length);
+                    return true;
+                }
+            }
+
+            if (libusb_bulk_transfer(device->handle, device->endpointIn, packet, sizeof(packet), &transferred, timeoutMs) != 0) {
+                return false;
+            }
+            pending.insert(pending.end(), packet, packet + transferred);
+        }
+    }
+
+  private:
+    std::vector<uint8_t> pending;
+};
+
+static void printStatus(const std::vector<uint8_t>& payload) {
+    struct UsbVendor_Status status;
+
+    if (payload.size() < sizeof(status)) {
+        printf("Status: %zu byte, too short\n", payload.size());
+        return;
+    }
+    memcpy(&status, payload.data(), sizeof(status));
+    printf("Status: uptime %u ms, frames received %u, deltas received %u, frames sent %u, errors %u, %u buffers\n",
+        status.uptime, status.framesReceived, status.deltasReceived, status.framesSent, status.errors, status.bufferCount);
+}
+
+static std::vector<uint8_t> parseValues(int argc, char** argv, int first) {
+    std::vector<uint8_t> values;
+
+    for (int i = first; i < argc; i++) {
+        values.push_back(strtoul(argv[i], NULL, 0));
+    }
+    return values;
+}
+
+static int usage() {
+    fprintf(stderr,
+        "usage: usb_vendor_client [-d vid:pid] status\n"
+        "       usb_vendor_client [-d vid:pid] frame <buffer> <value> [<value> ...]\n"
+        "       usb_vendor_client [-d vid:pid] delta <buffer> <offset> <value> [<value> ...]\n"
+        "       usb_vendor_client [-d vid:pid] monitor\n"
+        "       usb_vendor_client [-d vid:pid] bench <buffer> <seconds>\n");
+    return 2;
+}
+
+static int run(Device* device, int argc, char** argv) {
+    struct UsbVendor_Header header;
+    std::vector<uint8_t> payload;
+    Reader reader;
+
+    if (!strcmp(argv[0], "status")) {
+        if (!sendMessage(device, UsbVendor_MsgType::GetStatus, 0, 0, {})) {
+            return 1;
+        }
+        while (reader.next(device, &header, &payload, TIMEOUT_MS)) {
+            if (header.type == UsbVendor_MsgType::Status) {
+                printStatus(payload);
+                return 0;
+            }
+        }
+        fprintf(stderr, "No status received\n");
+        return 1;
+    }
+
+    if (!strcmp(argv[0], "frame") && (argc >= 3)) {
+        return sendMessage(device, UsbVendor_MsgType::FullFrame, strtoul(argv[1], NULL, 0), 0, parseValues(argc, argv, 2)) ? 0 : 1;
+    }
+
+    if (!strcmp(argv[0], "delta") && (argc >= 4)) {
+        return sendMessage(device, UsbVendor_MsgType::Delta, strtoul(argv[1], NULL, 0), strtoul(argv[2], NULL, 0), parseValues(argc, argv, 3)) ? 0 : 1;
+    }
+
+    if (!strcmp(argv[0], "monitor")) {
+        while (true) {
+            if (!reader.next(device, &header, &payload, 0)) {
+                return 1;
+            }
+            if (header.type == UsbVendor_MsgType::Status) {
+                printStatus(payload);
+            } else if (header.type == UsbVendor_MsgType::FullFrame) {
+                printf("Universe %u:", header.buffer);
+                for (size_t i = 0; i < std::min(payload.size(), (size_t)16); i++) {
+                    printf(" %3u", payload[i]);
+                }
+                printf("%s\n", (payload.size() > 16) ? " ..." : "");
+            }
+        }
+    }
+
+    if (!strcmp(argv[0], "bench") && (argc >= 3)) {
+        std::vector<uint8_t> frame(512);
+        uint8_t buffer = strtoul(argv[1], NULL, 0);
+        double seconds = atof(argv[2]);
+        uint32_t frames = 0;
+        auto start = std::chrono::steady_clock::now();
+        double elapsed = 0;
+
+        while (elapsed < seconds) {
+            memset(frame.data(), frames & 0xff, frame.size());
+            if (!sendMessage(device, UsbVendor_MsgType::FullFrame, buffer, 0, frame)) {
+                return 1;
+            }
+            frames++;
+            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        printf("%u frames in %.1f s: %.0f frames/s, %.0f kByte/s\n", frames, elapsed, frames / elapsed,
+            frames * (512.0 + sizeof(struct UsbVendor_Header)) / elapsed / 1024);
+        return 0;
+    }
+
+    return usage();
+}
+
+int main(int argc, char** argv) {
+    unsigned int vid = DEFAULT_VID;
+    unsigned int pid = DEFAULT_PID;
+    Device device;
+    int result;
+
+    argc--;
+    argv++;
+    if ((argc >= 2) && !strcmp(argv[0], "-d")) {
+        if (sscanf(argv[1], "%x:%x", &vid, &pid) != 2) {
+            return usage();
+        }
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc < 1) {
+        return usage();
+    }
+
+    if (libusb_init(NULL) != 0) {
+        fprintf(stderr, "libusb_init failed\n");
+        return 1;
+    }
+
+    device.handle = libusb_open_device_with_vid_pid(NULL, vid, pid);
+    if (device.handle == NULL) {
+        fprintf(stderr, "No device %04x:%04x found\n", vid, pid);
+        libusb_exit(NULL);
+        return 1;
+    }
+
+    if (!findInterface(&device)) {
+        fprintf(stderr, "Device has no vendor interface with bulk endpoints\n");
+        libusb_close(device.handle);
+        libusb_exit(NULL);
+        return 1;
+    }
+
+    libusb_set_auto_detach_kernel_driver(device.handle, 1);
+    if (libusb_claim_interface(device.handle, device.interface) != 0) {
+        fprintf(stderr, "Can't claim interface %d\n", device.interface);
+        libusb_close(device.handle);
+        libusb_exit(NULL);
+        return 1;
+    }
+
+    result = run(&device, argc, argv);
+
+    libusb_release_interface(device.handle, device.interface);
+    libusb_close(device.handle);
+    libusb_exit(NULL);
+
+    return result;
+}
@@ -63,6 +63,9 @@ class BoardStatus extends React.Component{
                     document.getElementById(modalName + 'InputAddress').value = this.props.wireless.address;
                     document.getElementById(modalName + 'InputCompress').checked = this.props.wireless.compress;
                     document.getElementById(modalName + 'InputSparse').checked = this.props.wireless.sparse;
+                    document.getElementById(modalName + 'InputFec').checked = this.props.wireless.fec;
+                    document.getElementById(modalName + 'InputHopping').checked = this.props.wireless.hopping;
+                    document.getElementById(modalName + 'InputMerge').value = this.props.wireless.merge;
                     document.getElementById(modalName + 'InputRate').value = this.props.wireless.dataRate;
                     document.getElementById(modalName + 'InputPower').value = this.props.wireless.txPower;
                     document.getElementById(modalName).configured = true;
@@ -191,6 +194,9 @@ class BoardStatus extends React.Component{
             url += 'address=' + encodeURIComponent(document.getElementById(modalName + 'InputAddress').value) + '&';
             url += 'compress=' + encodeURIComponent(document.getElementById(modalName + 'InputCompress').checked) + '&';
             url += 'sparse=' + encodeURIComponent(document.getElementById(modalName + 'InputSparse').checked) + '&';
+            url += 'fec=' + encodeURIComponent(document.getElementById(modalName + 'InputFec').checked) + '&';
+            url += 'hopping=' + encodeURIComponent(document.getElementById(modalName + 'InputHopping').checked) + '&';
+            url += 'merge=' + encodeURIComponent(document.getElementById(modalName + 'InputMerge').value) + '&';
             url += 'rate=' + encodeURIComponent(document.getElementById(modalName + 'InputRate').value) + '&';
             url += 'power=' + encodeURIComponent(document.getElementById(modalName + 'InputPower').value) + '&';
 
@@ -335,6 +341,29 @@ class BoardStatus extends React.Component{
                             </div>
                             <br />
 
+                            <div className="form-check form-switch">
+                                <input className="form-check-input" type="checkbox" id="modalWirelessInputFec" />
+                                <label className="form-check-label" htmlFor="modalWirelessInputFec">Error correction instead of ACKs (broadcast)</label>
+                            </div>
+                            <br />
+
+                            <div className="form-check form-switch">
+                                <input className="form-check-input" type="checkbox" id="modalWirelessInputHopping" />
+                                <label className="form-check-label" htmlFor="modalWirelessInputHopping">Frequency hopping (broadcast, address 0 leads)</label>
+                            </div>
+                            <br />
+
+                            <div className="form-floating">
+                                <select className="form-select" aria-label="Merge mode" id="modalWirelessInputMerge" defaultValue="0">
+                                   {/* TODO: Remove fixed values here, get them from the ENUM in the firmware */}
+                                   <option value="0">Latest frame wins</option>
+                                   <option value="1">HTP (highest value wins)</option>
+                                   <option value="2">Lowest address wins</option>
+                                </select>
+                                <label htmlFor="modalWirelessInputMerge" className="form-label">Several transmitters to one buffer (broadcast):</label>
+                            </div>
+                            <br />
+
                             <div className="form-floating">
                                 <select className="form-select" aria-label="Radio role" id="modalWirelessInputRate" defaultValue="0">
                                    {/* TODO: Remove fixed values here, get them from the ENUM in the firmware */}
@@ -22,6 +22,7 @@ class Console extends React.Component {
             partyModeChannel: 0,
         };
         this.setValueTimeout = undefined;
+        this.socket = undefined;
 
         // This binding is necessary to make `this` work in the callback
         this.selectedBufferDecrease = this.selectedBufferDecrease.bind(this);
@@ -43,12 +44,76 @@ class Console extends React.Component {
         this.setState({
             updateValuesInterval: interval
         });
+        this.openSocket();
+    }
+
+    componentDidUpdate(prevProps, prevState) {
+        if (prevState.selectedBuffer !== this.state.selectedBuffer) {
+            this.subscribe();
+        }
     }
 
     componentWillUnmount() {
         if (this.state.updateValuesInterval) {
             window.clearInterval(this.state.updateValuesInterval);
         }
+        if (this.socket) {
+            this.socket.onclose = undefined;
+            this.socket.close();
+            this.socket = undefined;
+        }
+    }
+
+    // The board pushes changes of the selected buffer over a WebSocket.
+    // Polling is only used as long as there is no socket
+    openSocket() {
+        let host = window.location.hostname;
+        if (window.urlPrefix) {
+            host = new URL(window.urlPrefix).hostname;
+        }
+
+        let socket = new WebSocket('ws://' + host + ':81/');
+        socket.binaryType = 'arraybuffer';
+        socket.onopen = () => { this.subscribe(); };
+        socket.onmessage = (event) => { this.applyDelta(new Uint8Array(event.data)); };
+        socket.onclose = () => {
+            this.socket = undefined;
+            window.setTimeout(this.openSocket.bind(this), 5000);
+        };
+        this.socket = socket;
+    }
+
+    // Every subscription starts from all zeroes, the board only sends
+    // what differs from that
+    subscribe() {
+        if (!this.socket || (this.socket.readyState !== WebSocket.OPEN)) {
+            return;
+        }
+        this.socket.send('buffers=' + this.state.selectedBuffer + '&rate=25');
+        this.setState({ values: new Array(512).fill(0) });
+    }
+
+    // EDP DmxDataDelta: command, universe, then ranges of
+    // start (2 byte, little endian), length (1 byte) and the values
+    applyDelta(data) {
+        if ((data.length < 2) || (data[0] !== 0x14) || (data[1] !== this.state.selectedBuffer)) {
+            return;
+        }
+
+        let values = this.state.values.slice();
+        let pos = 2;
+        while (pos + 3 <= data.length) {
+            const start = data[pos] | (data[pos + 1] << 8);
+            const length = data[pos + 2];
+            if (length === 0) {
+                break;
+            }
+            for (let i = 0; (i < length) && (pos + 3 + i < data.length); i++) {
+                values[start + i] = data[pos + 3 + i];
+            }
+            pos += 3 + length;
+        }
+        this.setState({ values: values });
     }
 
     updateValues() {
@@ -57,6 +122,10 @@ class Console extends React.Component {
             return;
         }
 
+        if (this.socket && (this.socket.readyState === WebSocket.OPEN)) {
+            return;
+        }
+
         this.setState({ loading: true });
         let buffer = this.state.selectedBuffer;
         if (buffer <= 9) {